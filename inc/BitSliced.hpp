@@ -0,0 +1,396 @@
+#ifndef BITSLICED_HPP_
+#define BITSLICED_HPP_
+
+#include <cstdlib>
+#include <stdint.h>					/* for uint64_t */
+
+#include "../inc/PackedBoard.hpp"	/* for 1 bit per cell boards */
+
+/*
+ * Bit-sliced templates for calculating generations of packed boards.
+ * This header is included by translation units compiled for different
+ * instruction sets, so everything has internal linkage. Otherwise the
+ * linker may pick an instance compiled with AVX for the reference path.
+ */
+namespace {
+
+/**
+* Operations on single 64 bit words, used for the words at the edges of a row
+*/
+struct ScalarOps {
+	typedef uint64_t V;
+	static const int WORDS = 1;
+
+	static inline V load(const uint64_t *p) { return *p; }
+	static inline void store(uint64_t *p, V a) { *p = a; }
+	static inline V set1(uint64_t a) { return a; }
+	static inline V orV(V a, V b) { return a | b; }
+	static inline V andV(V a, V b) { return a & b; }
+	static inline V xorV(V a, V b) { return a ^ b; }
+	/** ~a & b */
+	static inline V andNot(V a, V b) { return ~a & b; }
+	static inline V shiftLeft1(V a) { return a << 1; }
+	static inline V shiftRight1(V a) { return a >> 1; }
+	static inline V shiftLeft63(V a) { return a << 63; }
+	static inline V shiftRight63(V a) { return a >> 63; }
+	static inline V xor3(V a, V b, V c) { return a ^ b ^ c; }
+	static inline V majority(V a, V b, V c) { return (a & b) | (c & (a ^ b)); }
+	/** sel ? b : a */
+	static inline V select(V sel, V a, V b) { return a ^ ((a ^ b) & sel); }
+};
+
+/**
+* Rules as broadcast masks (all bits set or cleared) for each number of neighbours
+*/
+template <class Ops>
+struct RuleMasks {
+	typename Ops::V birth[9];     /**< dead cell with n neighbours becomes alive */
+	typename Ops::V survival[9];  /**< live cell with n neighbours stays alive */
+
+	explicit RuleMasks(const unsigned char *rules) {
+		for (int n = 0; n <= 8; n++) {
+			birth[n] = Ops::set1(rules[n] ? ~(uint64_t)0 : 0);
+			survival[n] = Ops::set1(rules[9+n] ? ~(uint64_t)0 : 0);
+		}
+	}
+
+	/** Next state of the cells c with I neighbours */
+	template <int I>
+	inline typename Ops::V leaf(typename Ops::V c) const {
+		return Ops::select(c, birth[I], survival[I]);
+	}
+};
+
+/**
+* Rules fixed at compile time, bit n of BIRTH (SURVIVAL) is set if a cell is
+* born (survives) with n neighbours. The leaves fold to constants, the cells
+* or their complement, and the compiler drops the unused multiplexers.
+*/
+template <class Ops, unsigned int BIRTH, unsigned int SURVIVAL>
+struct BakedRule {
+	/** Next state of the cells c with I neighbours */
+	template <int I>
+	inline typename Ops::V leaf(typename Ops::V c) const {
+		const bool born = (BIRTH >> I) & 1, survives = (SURVIVAL >> I) & 1;
+		if (born && survives) return Ops::set1(~(uint64_t)0);
+		if (born) return Ops::andNot(c, Ops::set1(~(uint64_t)0));
+		if (survives) return c;
+		return Ops::set1(0);
+	}
+};
+
+/**
+* Calculate the next generation of the cells c from their 8 neighbours.
+* The neighbour count is summed with full adders into 4 bit slices and the
+* rules (RuleMasks or BakedRule) are evaluated as a multiplexer tree over
+* these slices.
+*/
+template <class Ops, class Rules>
+inline typename Ops::V nextGenerationBitSliced(
+		typename Ops::V nw, typename Ops::V n, typename Ops::V ne,
+		typename Ops::V w, typename Ops::V c, typename Ops::V e,
+		typename Ops::V sw, typename Ops::V s, typename Ops::V se,
+		const Rules &rules) {
+	typedef typename Ops::V V;
+
+	/* Full adders for the rows above and below, half adder for the own row */
+	V northSum = Ops::xor3(nw, n, ne);
+	V northCarry = Ops::majority(nw, n, ne);
+	V southSum = Ops::xor3(sw, s, se);
+	V southCarry = Ops::majority(sw, s, se);
+	V rowSum = Ops::xorV(w, e);
+	V rowCarry = Ops::andV(w, e);
+
+	/* Combine the partial sums to a 4 bit neighbour count */
+	V b0 = Ops::xor3(northSum, rowSum, southSum);
+	V onesCarry = Ops::majority(northSum, rowSum, southSum);
+	V twos = Ops::xor3(northCarry, rowCarry, southCarry);
+	V twosCarry = Ops::majority(northCarry, rowCarry, southCarry);
+	V b1 = Ops::xorV(twos, onesCarry);
+	V foursCarry = Ops::andV(twos, onesCarry);
+	V b2 = Ops::xorV(twosCarry, foursCarry);
+	V b3 = Ops::andV(twosCarry, foursCarry);
+
+	/* Leaves: next state for n neighbours depending on the own state */
+	V leaf[9] = {
+		rules.template leaf<0>(c), rules.template leaf<1>(c), rules.template leaf<2>(c),
+		rules.template leaf<3>(c), rules.template leaf<4>(c), rules.template leaf<5>(c),
+		rules.template leaf<6>(c), rules.template leaf<7>(c), rules.template leaf<8>(c)
+	};
+
+	/* Multiplexer tree over the count slices, counts 9..15 cannot occur */
+	V l01 = Ops::select(b0, leaf[0], leaf[1]);
+	V l23 = Ops::select(b0, leaf[2], leaf[3]);
+	V l45 = Ops::select(b0, leaf[4], leaf[5]);
+	V l67 = Ops::select(b0, leaf[6], leaf[7]);
+	V l8 = Ops::andNot(b0, leaf[8]);
+	V l03 = Ops::select(b1, l01, l23);
+	V l47 = Ops::select(b1, l45, l67);
+	l8 = Ops::andNot(b1, l8);
+	V l07 = Ops::select(b2, l03, l47);
+	l8 = Ops::andNot(b2, l8);
+	return Ops::select(b3, l07, l8);
+}
+
+/**
+* Get a word of a row together with its west and east neighbours,
+* handling the edges of the board.
+*/
+inline void shiftRowWord(const uint64_t *row, const int w, const int wordsPerRow,
+		const int lastBits, const bool clamp, uint64_t &west, uint64_t &center, uint64_t &east) {
+	uint64_t westCarry, eastCarry;
+	const int last = wordsPerRow - 1;
+
+	center = row[w];
+	if (w > 0) westCarry = row[w-1] >> 63;
+	else westCarry = clamp ? 0 : (row[last] >> (lastBits-1)) & 1;
+	if (w < last) eastCarry = row[w+1] & 1;
+	else eastCarry = clamp ? 0 : row[0] & 1;
+
+	west = (center << 1) | westCarry;
+	/* The east carry belongs next to the last valid cell of the word */
+	east = (center >> 1) | (eastCarry << (w < last ? 63 : lastBits-1));
+}
+
+/**
+* Calculate the next generation of a row of a packed board from the row and
+* the rows above and below with Ops::WORDS words per step. Words at the
+* edges of the row use single words.
+*/
+template <class Ops, class VectorRules, class ScalarRules>
+inline void nextGenerationPackedRow(const uint64_t *north, const uint64_t *row, const uint64_t *south,
+		uint64_t *out, const int wordsPerRow, const int lastBits, const uint64_t lastWordMask,
+		const bool clamp, const VectorRules &vectorRules, const ScalarRules &scalarRules) {
+	typedef typename Ops::V V;
+
+	/* Inner words: neighbour words are complete words of the same row */
+	int w = 1;
+	for (; w + Ops::WORDS <= wordsPerRow - 1; w += Ops::WORDS) {
+		V n = Ops::load(north + w), c = Ops::load(row + w), s = Ops::load(south + w);
+		V nw = Ops::orV(Ops::shiftLeft1(n), Ops::shiftRight63(Ops::load(north + w - 1)));
+		V ne = Ops::orV(Ops::shiftRight1(n), Ops::shiftLeft63(Ops::load(north + w + 1)));
+		V cw = Ops::orV(Ops::shiftLeft1(c), Ops::shiftRight63(Ops::load(row + w - 1)));
+		V ce = Ops::orV(Ops::shiftRight1(c), Ops::shiftLeft63(Ops::load(row + w + 1)));
+		V sw = Ops::orV(Ops::shiftLeft1(s), Ops::shiftRight63(Ops::load(south + w - 1)));
+		V se = Ops::orV(Ops::shiftRight1(s), Ops::shiftLeft63(Ops::load(south + w + 1)));
+		Ops::store(out + w, nextGenerationBitSliced<Ops>(nw, n, ne, cw, c, ce, sw, s, se, vectorRules));
+	}
+
+	/* First word and remaining words */
+	for (int i = 0; i < wordsPerRow; i = (i == 0) ? w : i + 1) {
+		uint64_t nw, n, ne, cw, c, ce, sw, s, se;
+		shiftRowWord(north, i, wordsPerRow, lastBits, clamp, nw, n, ne);
+		shiftRowWord(row, i, wordsPerRow, lastBits, clamp, cw, c, ce);
+		shiftRowWord(south, i, wordsPerRow, lastBits, clamp, sw, s, se);
+		uint64_t result = nextGenerationBitSliced<ScalarOps>(nw, n, ne, cw, c, ce, sw, s, se, scalarRules);
+		out[i] = (i == wordsPerRow-1) ? (result & lastWordMask) : result;
+	}
+}
+
+/**
+* Calculate the next generation for the rows [rowBegin,rowEnd) of a packed board.
+*/
+template <class Ops, class VectorRules, class ScalarRules>
+void nextGenerationPackedRows(const PackedBoard &src, PackedBoard &dst,
+		const VectorRules &vectorRules, const ScalarRules &scalarRules,
+		bool clamp, int rowBegin, int rowEnd) {
+	const int width = src.getWidth();
+	const int height = src.getHeight();
+	const int wordsPerRow = src.getWordsPerRow();
+	const int lastBits = width - (wordsPerRow-1)*CELLS_PER_WORD;
+	const uint64_t lastWordMask = src.getLastWordMask();
+	const uint64_t *cells = src.getWords();
+	uint64_t *next = dst.getWords();
+	/* no std::vector here, see above */
+	uint64_t *deadRow = (uint64_t *)calloc(wordsPerRow, sizeof(uint64_t));
+	if (deadRow == NULL) abort();
+
+	for (int y = rowBegin; y < rowEnd; y++) {
+		/* Rows above and below, dead or wrapped around outside of the board */
+		const uint64_t *north, *south;
+		if (y > 0) north = &cells[(y-1)*wordsPerRow];
+		else north = clamp ? deadRow : &cells[(height-1)*wordsPerRow];
+		if (y < height-1) south = &cells[(y+1)*wordsPerRow];
+		else south = clamp ? deadRow : &cells[0];
+		nextGenerationPackedRow<Ops>(north, &cells[y*wordsPerRow], south, &next[y*wordsPerRow],
+				wordsPerRow, lastBits, lastWordMask, clamp, vectorRules, scalarRules);
+	}
+
+	free(deadRow);
+}
+
+/**
+* Get the live cells (state 1) of a row with PLANES bit planes.
+*/
+template <class Ops, int PLANES>
+inline void getAliveRow(const uint64_t *planes, uint64_t *alive, const int wordsPerRow) {
+	typedef typename Ops::V V;
+	int w = 0;
+	for (; w + Ops::WORDS <= wordsPerRow; w += Ops::WORDS) {
+		V rest = Ops::load(planes + wordsPerRow + w);
+		for (int p = 2; p < PLANES; p++)
+			rest = Ops::orV(rest, Ops::load(planes + p*wordsPerRow + w));
+		Ops::store(alive + w, Ops::andNot(rest, Ops::load(planes + w)));
+	}
+	for (; w < wordsPerRow; w++) {
+		uint64_t rest = planes[wordsPerRow + w];
+		for (int p = 2; p < PLANES; p++)
+			rest |= planes[p*wordsPerRow + w];
+		alive[w] = planes[w] & ~rest;
+	}
+}
+
+/**
+* Get the next states of words of a row with PLANES bit planes.
+* next holds the cells which are alive in the next generation if they are
+* dead or alive now, other cells which are not dead count up their state.
+*/
+template <class Ops, int PLANES>
+inline void nextStatesWords(const uint64_t *planes, uint64_t *out, const uint64_t *next,
+		const int w, const int wordsPerRow, const unsigned int states) {
+	typedef typename Ops::V V;
+	V s[PLANES];
+	V rest = Ops::set1(0);
+	for (int p = 0; p < PLANES; p++) {
+		s[p] = Ops::load(planes + p*wordsPerRow + w);
+		if (p > 0) rest = Ops::orV(rest, s[p]);
+	}
+	const V n = Ops::load(next + w);
+	const V any = Ops::orV(s[0], rest);
+	const V born = Ops::andNot(any, n);
+	const V stay = Ops::andV(n, Ops::andNot(rest, s[0]));
+	const V count = Ops::andNot(stay, any);
+
+	/* Ripple carry increment of the counting cells, the last state wraps around to dead */
+	V carry = count, wrap = count;
+	for (int p = 0; p < PLANES; p++) {
+		V sum = Ops::xorV(s[p], carry);
+		carry = Ops::andV(s[p], carry);
+		s[p] = sum;
+		wrap = ((states >> p) & 1) ? Ops::andV(wrap, sum) : Ops::andNot(sum, wrap);
+	}
+	for (int p = 0; p < PLANES; p++) {
+		V state = Ops::andNot(wrap, s[p]);
+		Ops::store(out + p*wordsPerRow + w, (p == 0) ? Ops::orV(state, born) : state);
+	}
+}
+
+/**
+* Calculate the next generation for the rows [rowBegin,rowEnd) of a packed
+* board with PLANES bit planes (Generations rules). The live cells of the
+* rows are counted like a board with 2 states, the states of the row are
+* updated with Ops::WORDS words per step.
+*/
+template <class Ops, int PLANES, class VectorRules, class ScalarRules>
+void nextGenerationStatesRows(const PackedBoard &src, PackedBoard &dst,
+		const VectorRules &vectorRules, const ScalarRules &scalarRules,
+		bool clamp, int rowBegin, int rowEnd) {
+	const int width = src.getWidth();
+	const int height = src.getHeight();
+	const int wordsPerRow = src.getWordsPerRow();
+	const int lastBits = width - (wordsPerRow-1)*CELLS_PER_WORD;
+	const uint64_t lastWordMask = src.getLastWordMask();
+	const unsigned int states = src.getStates();
+	/* Dead row, live cells of three rows and live cells of the next generation */
+	uint64_t *buffer = (uint64_t *)calloc(5*(size_t)wordsPerRow, sizeof(uint64_t));
+	if (buffer == NULL) abort();
+	uint64_t *deadRow = buffer, *aliveRows = buffer + wordsPerRow, *next = buffer + 4*wordsPerRow;
+
+	/* Live cells of a row, dead or wrapped around outside of the board */
+	struct {
+		const PackedBoard *board;
+		const uint64_t *deadRow;
+		int height, wordsPerRow;
+		bool clamp;
+		const uint64_t * operator()(int y, uint64_t *alive) const {
+			if (y < 0 || y >= height) {
+				if (clamp) return deadRow;
+				y = (y + height) % height;
+			}
+			getAliveRow<Ops, PLANES>(board->getRow(y), alive, wordsPerRow);
+			return alive;
+		}
+	} getAlive = { &src, deadRow, height, wordsPerRow, clamp };
+
+	/* The live cells of each row are extracted once, three rows rotate through the buffer */
+	const uint64_t *north = getAlive(rowBegin-1, aliveRows);
+	const uint64_t *row = getAlive(rowBegin, aliveRows + wordsPerRow);
+	for (int y = rowBegin; y < rowEnd; y++) {
+		const uint64_t *south = getAlive(y+1, aliveRows + ((y - rowBegin + 2) % 3)*wordsPerRow);
+		nextGenerationPackedRow<Ops>(north, row, south, next,
+				wordsPerRow, lastBits, lastWordMask, clamp, vectorRules, scalarRules);
+
+		const uint64_t *planes = src.getRow(y);
+		uint64_t *out = dst.getRow(y);
+		int w = 0;
+		for (; w + Ops::WORDS <= wordsPerRow; w += Ops::WORDS)
+			nextStatesWords<Ops, PLANES>(planes, out, next, w, wordsPerRow, states);
+		for (; w < wordsPerRow; w++)
+			nextStatesWords<ScalarOps, PLANES>(planes, out, next, w, wordsPerRow, states);
+
+		north = row;
+		row = south;
+	}
+
+	free(buffer);
+}
+
+/**
+* Calculate the next generation for the rows [rowBegin,rowEnd) of a packed
+* board with 2 states or with more states in 2 to 4 bit planes.
+*/
+template <class Ops, class VectorRules, class ScalarRules>
+void nextGenerationBoardRows(const PackedBoard &src, PackedBoard &dst,
+		const VectorRules &vectorRules, const ScalarRules &scalarRules,
+		bool clamp, int rowBegin, int rowEnd) {
+	switch (src.getPlanes()) {
+	case 2:
+		nextGenerationStatesRows<Ops, 2>(src, dst, vectorRules, scalarRules, clamp, rowBegin, rowEnd);
+		break;
+	case 3:
+		nextGenerationStatesRows<Ops, 3>(src, dst, vectorRules, scalarRules, clamp, rowBegin, rowEnd);
+		break;
+	case 4:
+		nextGenerationStatesRows<Ops, 4>(src, dst, vectorRules, scalarRules, clamp, rowBegin, rowEnd);
+		break;
+	default:
+		nextGenerationPackedRows<Ops>(src, dst, vectorRules, scalarRules, clamp, rowBegin, rowEnd);
+		break;
+	}
+}
+
+/**
+* Calculate the next generation for the rows [rowBegin,rowEnd) of a packed board.
+* Common rules run a version with the rule baked in, others use rule masks.
+*/
+template <class Ops>
+void nextGenerationPackedVector(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd) {
+	unsigned int birth, survival;
+	getRuleMasks(rules, birth, survival);
+
+	#define BAKED_RULE(BIRTH, SURVIVAL) \
+		case (BIRTH) | (SURVIVAL) << 9: \
+			nextGenerationBoardRows<Ops>(src, dst, BakedRule<Ops, BIRTH, SURVIVAL>(), \
+					BakedRule<ScalarOps, BIRTH, SURVIVAL>(), clamp, rowBegin, rowEnd); \
+			return;
+	switch (birth | survival << 9) {
+	BAKED_RULE(0x008, 0x00C)	/* B3/S23, Conway's Life */
+	BAKED_RULE(0x048, 0x00C)	/* B36/S23, HighLife */
+	BAKED_RULE(0x1C8, 0x1D8)	/* B3678/S34678, Day & Night */
+	BAKED_RULE(0x004, 0x000)	/* B2/S, Seeds and Brian's Brain */
+	BAKED_RULE(0x004, 0x038)	/* B2/S345, Star Wars */
+	BAKED_RULE(0x008, 0x1FF)	/* B3/S012345678, Life without death */
+	BAKED_RULE(0x008, 0x03E)	/* B3/S12345, Maze */
+	default:
+		break;
+	}
+	#undef BAKED_RULE
+
+	nextGenerationBoardRows<Ops>(src, dst, RuleMasks<Ops>(rules), RuleMasks<ScalarOps>(rules),
+			clamp, rowBegin, rowEnd);
+}
+
+}
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef CPUENGINE_HPP_
+#define CPUENGINE_HPP_
+
+#include <vector>
+
+#include "../inc/ThreadPool.hpp"	/* for splitting rows across all cores */
+#include "../inc/PackedBoard.hpp"	/* for 1 bit per cell boards */
+#include "../inc/SIMD.hpp"			/* for vectorized packed boards */
+#include "../inc/TileUniverse.hpp"	/* for unbounded boards */
+#include "../inc/Philox.hpp"		/* for random populations */
+
+/**
+* Width of the column tiles in cells.
+* The three RGBA rows of a tile stay in the L1/L2 cache.
+*/
+#define CPU_TILE_WIDTH 1024
+
+/**
+* Number of row bands per thread for balancing the load
+*/
+#define CPU_BANDS_PER_THREAD 4
+
+/**
+* Size of the tiles of a packed board in sparse mode,
+* in words (64 cells) per row and in rows
+*/
+#define SPARSE_TILE_WORDS 2
+#define SPARSE_TILE_ROWS 32
+
+class CPUEngine {
+private:
+	ThreadPool                    pool;  /**< threads calculating row bands */
+	unsigned int       numberOfThreads;  /**< requested number of threads, 0 for all cores */
+	SIMDLevel           supportedLevel;  /**< best instruction set of this CPU */
+	SIMDLevel                simdLevel;  /**< instruction set for packed boards */
+	bool                        sparse;  /**< only calculate tiles of packed boards near changes */
+	int                   tileCount[2];  /**< number of tiles in x and y in sparse mode */
+	std::vector<unsigned char> tileChanged;  /**< tiles changed by the last generation */
+	std::vector<unsigned char> nextTileChanged;  /**< tiles changed by the current generation */
+	std::vector<int>       activeTiles;  /**< tiles calculated in the current generation */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables, detect instruction set
+	*/
+	CPUEngine():
+			numberOfThreads(0),
+			supportedLevel(detectSIMDLevel()),
+			simdLevel(supportedLevel),
+			sparse(false)
+		{
+			tileCount[0] = 0;
+			tileCount[1] = 0;
+	}
+
+	/**
+	* Set the instruction set for packed boards.
+	* Falls back to the scalar path if the CPU does not support it.
+	* @param level instruction set
+	*/
+	void setSIMDLevel(SIMDLevel level) {
+		bool supported = level <= supportedLevel
+				&& (level != SIMD_NEON || supportedLevel == SIMD_NEON);
+		simdLevel = supported ? level : SIMD_SCALAR;
+	}
+
+	/**
+	* Get the instruction set for packed boards.
+	* @return simdLevel
+	*/
+	SIMDLevel getSIMDLevel() {
+		return simdLevel;
+	}
+
+	/**
+	* Only calculate tiles of packed boards which changed or have a changed
+	* neighbour tile in the last generation. The destination board of a
+	* generation must hold the generation before the source board.
+	* @param _sparse switch for sparse mode
+	*/
+	void setSparse(bool _sparse) {
+		sparse = _sparse;
+		invalidateTiles();
+	}
+
+	/**
+	* Get sparse mode.
+	* @return sparse
+	*/
+	bool isSparse() {
+		return sparse;
+	}
+
+	/**
+	* Calculate all tiles in the next generation,
+	* e.g. after the boards were changed from outside of the engine.
+	*/
+	void invalidateTiles() {
+		tileChanged.clear();
+	}
+
+	/**
+	* Get the number of tiles calculated in the last generation of sparse mode.
+	* @return number of active tiles
+	*/
+	size_t getNumberOfActiveTiles() {
+		return activeTiles.size();
+	}
+
+	/**
+	* Set the number of threads. Only effective before the first generation.
+	* @param _numberOfThreads number of threads, 0 for all cores
+	*/
+	void setNumberOfThreads(unsigned int _numberOfThreads) {
+		numberOfThreads = _numberOfThreads;
+	}
+
+	/**
+	* Get the number of threads calculating a generation.
+	* @return number of threads
+	*/
+	unsigned int getNumberOfThreads() {
+		pool.start(numberOfThreads);
+		return pool.getNumberOfThreads();
+	}
+
+	/**
+	* Calculate the next generation of a RGBA image.
+	* @param src image of current generation
+	* @param dst image of next generation
+	* @param width width of the images
+	* @param height height of the images
+	* @param rules rules for calculating next generation (see GameOfLife::setRule)
+	* @param clamp true: dead cells outside the board, false: wrap around
+	*/
+	void nextGeneration(const unsigned char *src, unsigned char *dst,
+			int width, int height, const unsigned char *rules, bool clamp);
+
+	/**
+	* Calculate the next generation of a packed board.
+	* @param src board of current generation
+	* @param dst board of next generation
+	* @param rules rules for calculating next generation (see GameOfLife::setRule)
+	* @param clamp true: dead cells outside the board, false: wrap around
+	*/
+	void nextGeneration(const PackedBoard &src, PackedBoard &dst,
+			const unsigned char *rules, bool clamp);
+
+	/**
+	* Calculate the next generation of the rows [rowBegin,rowEnd) of a packed board,
+	* e.g. the part of the board which is not calculated on the device.
+	* Sparse mode is ignored.
+	* @param src board of current generation
+	* @param dst board of next generation
+	* @param rules rules for calculating next generation (see GameOfLife::setRule)
+	* @param clamp true: dead cells outside the board, false: wrap around
+	* @param rowBegin first row
+	* @param rowEnd row after the last row
+	*/
+	void nextGenerationRows(const PackedBoard &src, PackedBoard &dst,
+			const unsigned char *rules, bool clamp, int rowBegin, int rowEnd);
+
+	/**
+	* Calculate the next generation of an unbounded universe of tiles.
+	* @param universe tiles of the current generation, replaced by the next generation
+	* @param rules rules for calculating next generation (see GameOfLife::setRule)
+	*/
+	void nextGeneration(TileUniverse &universe, const unsigned char *rules);
+
+	/**
+	* Get the hash of a packed board on all cores, the hashes of the row
+	* bands are combined (see PackedBoard::getHash).
+	* @param board packed board
+	* @return hash, 0 if all cells are dead
+	*/
+	uint64_t getHash(const PackedBoard &board);
+
+	/**
+	* Spawn a random population on all cores. The cells only depend on the
+	* seed and the density, not on the threads (see getRandomCells).
+	* @param board packed board, dying states are cleared
+	* @param density density of live cells
+	* @param seed seed of the population
+	*/
+	void spawnRandom(PackedBoard &board, float density, uint64_t seed);
+
+	/**
+	* Spawn a random population of a RGBA image on all cores, the same cells
+	* as on a packed board.
+	* @param image RGBA image
+	* @param width width of the image
+	* @param height height of the image
+	* @param density density of live cells
+	* @param seed seed of the population
+	*/
+	void spawnRandom(unsigned char *image, int width, int height, float density, uint64_t seed);
+
+private:
+	/**
+	* Split the rows [rowBegin,rowEnd) of the board into bands and run a task for each band.
+	* @param rowBegin first row
+	* @param rowEnd row after the last row
+	* @param band called with the first row and the row after the last row of a band
+	*/
+	void runBands(int rowBegin, int rowEnd, const std::function<void(int, int)> &band);
+
+	/**
+	* Calculate the next generation of the active tiles of a packed board.
+	*/
+	void nextGenerationSparse(const PackedBoard &src, PackedBoard &dst,
+			const unsigned char *rules, bool clamp);
+
+	/**
+	* Calculate the next generation for a band of rows of a RGBA image
+	* with a rolling sum of three rows for each column of a tile.
+	*/
+	static void nextGenerationBand(const unsigned char *src, unsigned char *dst,
+			int width, int height, const unsigned char *rules, bool clamp,
+			int rowBegin, int rowEnd, std::vector<unsigned char> &columnSums);
+
+	// Disable copy constructor
+	CPUEngine(const CPUEngine&);
+
+	// Disable operator=
+	CPUEngine& operator=(const CPUEngine&);
+};
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef CHECKPOINT_HPP_
+#define CHECKPOINT_HPP_
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <stdint.h>					/* for uint64_t */
+
+#include "../inc/PackedBoard.hpp"	/* for 1 bit per cell boards */
+
+/**
+* Version of the checkpoint format
+*/
+#define CHECKPOINT_VERSION 1
+
+/**
+* Checkpoint flags: board in clamp mode, payload of tiles
+*/
+#define CHECKPOINT_CLAMP 1
+#define CHECKPOINT_TILES 2
+
+/**
+* Rows of a tile of the compressed payload, tiles are one word wide
+*/
+#define CHECKPOINT_TILE_ROWS 64
+
+/**
+* Engine which calculated the generation of a checkpoint
+*/
+enum CheckpointEngine {
+	CHECKPOINT_OPENCL = 0,	/**< OpenCL device(s) */
+	CHECKPOINT_CPU,			/**< CPU engine */
+	CHECKPOINT_HASHLIFE		/**< HashLife, not written any more, its universe is bigger than the board */
+};
+
+/**
+* Header at the beginning of a checkpoint file, in host byte order.
+* The payload follows the header. Without CHECKPOINT_TILES it holds the
+* words of the board row by row like PackedBoard. With CHECKPOINT_TILES it
+* holds one bit per tile of CHECKPOINT_TILE_ROWS rows and one word, row of
+* tiles by row of tiles, followed by the words of the tiles with live cells.
+*/
+struct CheckpointHeader {
+	char                   magic[8];  /**< "GOLCKPT" */
+	uint32_t                version;  /**< CHECKPOINT_VERSION */
+	uint32_t                  flags;  /**< CHECKPOINT_CLAMP and CHECKPOINT_TILES */
+	int32_t                   width;  /**< width of the board in cells */
+	int32_t                  height;  /**< height of the board in cells */
+	int32_t             wordsPerRow;  /**< words per row of the board */
+	uint32_t                 engine;  /**< CheckpointEngine */
+	uint64_t             generation;  /**< generation of the board */
+	unsigned char         rules[18];  /**< rules for calculating next generation (see GameOfLife::setRule) */
+	unsigned char       reserved[6];  /**< 0, pads the header to whole words */
+	uint64_t           payloadBytes;  /**< size of the payload in bytes */
+	uint64_t               checksum;  /**< checksum of the payload words */
+};
+
+/**
+* Get the name of an engine.
+* @param engine CheckpointEngine
+* @return name of the engine
+*/
+const char * getCheckpointEngineName(uint32_t engine);
+
+/**
+* Checkpoint file mapped into memory for restoring a board.
+*/
+class Checkpoint {
+private:
+	const char                 *data;  /**< contents of the file, mapped or read */
+	size_t                  dataSize;  /**< size of the file in bytes */
+	void                    *mapping;  /**< mapping of the file, NULL if it was read into buffer */
+	std::vector<uint64_t>     buffer;  /**< contents of the file if it could not be mapped */
+	CheckpointHeader          header;  /**< header of the file */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables, no file
+	*/
+	Checkpoint():
+			data(NULL),
+			dataSize(0),
+			mapping(NULL)
+		{
+			memset(&header, 0, sizeof(header));
+	}
+
+	/**
+	* Deconstructor.
+	* Unmap the file
+	*/
+	~Checkpoint() { close(); }
+
+	/**
+	* Map a checkpoint file and check its header and payload.
+	* @param fileName path to the checkpoint
+	* @return 0 on success, -1 if the file is no valid checkpoint and -2 if it cannot be opened
+	*/
+	int open(const char *fileName);
+
+	/**
+	* Unmap the file.
+	*/
+	void close();
+
+	/**
+	* Get the header of the file.
+	* @return header
+	*/
+	const CheckpointHeader & getHeader() const {
+		return header;
+	}
+
+	/**
+	* Copy the board of the checkpoint into a packed board. Uncompressed
+	* payloads are copied straight from the mapping.
+	* @param board packed board with the size of the checkpoint
+	* @return 0 on success and -1 if the size differs
+	*/
+	int read(PackedBoard &board) const;
+
+	/**
+	* Write a board to a checkpoint file. The file is written next to
+	* fileName and renamed when complete, an interrupted write keeps the
+	* last checkpoint. The payload is tiled if that makes it smaller.
+	* @param fileName path to the checkpoint
+	* @param board packed board
+	* @param rules rules for calculating next generation
+	* @param clamp board in clamp mode
+	* @param generation generation of the board
+	* @param engine CheckpointEngine
+	* @return 0 on success and -1 on failure
+	*/
+	static int write(const char *fileName, const PackedBoard &board, const unsigned char *rules,
+			bool clamp, uint64_t generation, uint32_t engine);
+
+private:
+	// Disable copy constructor
+	Checkpoint(const Checkpoint&);
+
+	// Disable operator=
+	Checkpoint& operator=(const Checkpoint&);
+};
+
+/**
+* Writes checkpoints in a background thread. The board is copied
+* when the checkpoint is started, calculation continues meanwhile.
+*/
+class CheckpointWriter {
+private:
+	PackedBoard             snapshot;  /**< copy of the board being written */
+	std::thread               thread;  /**< thread writing the snapshot */
+	std::string             fileName;  /**< path to the checkpoint */
+	unsigned char          rules[18];  /**< rules of the snapshot */
+	bool                       clamp;  /**< snapshot in clamp mode */
+	uint64_t              generation;  /**< generation of the snapshot */
+	uint32_t                  engine;  /**< engine of the snapshot */
+	int                       status;  /**< result of the last write */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables, nothing is written
+	*/
+	CheckpointWriter():
+			clamp(false),
+			generation(0),
+			engine(CHECKPOINT_OPENCL),
+			status(0)
+		{
+			memset(rules, 0, sizeof(rules));
+	}
+
+	/**
+	* Deconstructor.
+	* Wait for the last write
+	*/
+	~CheckpointWriter() { finish(); }
+
+	/**
+	* Start writing a packed board, waits for the previous write first.
+	* @param _fileName path to the checkpoint
+	* @param board packed board
+	* @param _rules rules for calculating next generation
+	* @param _clamp board in clamp mode
+	* @param _generation generation of the board
+	* @param _engine CheckpointEngine
+	* @return result of the previous write, 0 on success and -1 on failure
+	*/
+	int start(const std::string &_fileName, const PackedBoard &board, const unsigned char *_rules,
+			bool _clamp, uint64_t _generation, uint32_t _engine);
+
+	/**
+	* Start writing a RGBA image, it is packed into the snapshot.
+	* See start for packed boards.
+	*/
+	int start(const std::string &_fileName, const unsigned char *image, int width, int height,
+			const unsigned char *_rules, bool _clamp, uint64_t _generation, uint32_t _engine);
+
+	/**
+	* Wait for the running write.
+	* @return result of the last write, 0 on success and -1 on failure
+	*/
+	int finish();
+
+private:
+	/**
+	* Copy the settings of the snapshot and start the thread.
+	*/
+	void launch(const std::string &_fileName, const unsigned char *_rules,
+			bool _clamp, uint64_t _generation, uint32_t _engine);
+
+	/**
+	* Allocate the snapshot if the size of the board changed.
+	* @return 0 on success and -1 on failure
+	*/
+	int allocateSnapshot(int width, int height);
+
+	// Disable copy constructor
+	CheckpointWriter(const CheckpointWriter&);
+
+	// Disable operator=
+	CheckpointWriter& operator=(const CheckpointWriter&);
+};
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef COMPUTETHREAD_HPP_
+#define COMPUTETHREAD_HPP_
+
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "../inc/GameOfLife.hpp"
+
+/**
+* Bit of the middle slot of the triple buffer set by a frame the display has not taken yet
+*/
+#define FRAME_FRESH 4
+
+/**
+* Commands of the display for the engine, applied between two generations
+*/
+enum EngineCommandType {
+	COMMAND_PAUSE = 0,			/**< start/stop calculation of next generations */
+	COMMAND_READ_SYNC,			/**< switch synchronous reading of images */
+	COMMAND_CPU_MODE,			/**< switch between CPU and OpenCL */
+	COMMAND_HASHLIFE,			/**< switch HashLife mode */
+	COMMAND_HASHLIFE_STEP,		/**< add arguments[0] to the HashLife step */
+	COMMAND_SINGLE_GENERATION,	/**< switch single generation mode */
+	COMMAND_RESET,				/**< switch reset to the starting population when paused */
+	COMMAND_DELAY,				/**< wait values[0] ms between calculations */
+	COMMAND_VIEW,				/**< window size in arguments, zoom and move in values */
+	COMMAND_STOP				/**< stop the engine */
+};
+
+/**
+* Command of the display, arguments and values depend on the type
+*/
+struct EngineCommand {
+	EngineCommandType                 type;  /**< what to do */
+	int                       arguments[2];  /**< integer arguments */
+	float                        values[3];  /**< float arguments */
+};
+
+/**
+* State of the game shown by the display, taken with the frame it belongs to
+*/
+struct FrameInfo {
+	uint64_t               generations;  /**< number of calculated generations */
+	float                executionTime;  /**< execution time for calculation of 1 generation */
+	int        generationsPerCopyEvent;  /**< number of executed kernels during 1 read image call */
+	int                         period;  /**< detected period, 0 for none */
+	uint64_t          periodGeneration;  /**< generation the period was detected at */
+	bool                        paused;  /**< calculation of next generations is stopped */
+	bool                      readSync;  /**< images are read synchronously */
+	bool                       CPUMode;  /**< generations are calculated on the CPU */
+	bool                  hashLifeMode;  /**< generations are calculated with HashLife */
+	int                   hashLifeStep;  /**< 2^hashLifeStep generations per HashLife frame */
+	bool              singleGeneration;  /**< single generation mode */
+	bool                  resetPending;  /**< reset to the starting population on the next stop */
+	std::string                cpuInfo;  /**< information about the CPU engine */
+};
+
+/**
+* Frame of the triple buffer
+*/
+struct EngineFrame {
+	unsigned char               *image;  /**< RGBA image of the region, NULL before the first frame */
+	size_t               capacityBytes;  /**< allocated size of image */
+	size_t                   sizeBytes;  /**< size of the image, 0 before the first image */
+	DisplayRegion               region;  /**< part of the board in the image */
+	FrameInfo                     info;  /**< state of the game at this frame */
+};
+
+/**
+* Calculates the generations of a game on its own thread, independent of
+* the frame rate of the display. Finished frames are published through a
+* lock-free triple buffer: the engine writes the back frame and swaps it
+* with the middle one, the display swaps the middle frame with its front
+* frame when it is fresh, so both always have a frame of their own and
+* the display gets the latest generation without blocking the engine.
+* Commands of the display are queued and applied between generations.
+*/
+class ComputeThread {
+private:
+	GameOfLife                       *game;  /**< game calculated by the engine, NULL if not running */
+	std::thread                     engine;  /**< thread calculating the generations */
+	EngineFrame                  frames[3];  /**< images of the triple buffer */
+	int                               back;  /**< frame written by the engine */
+	std::atomic<int>                middle;  /**< last published frame, FRAME_FRESH if not taken */
+	int                              front;  /**< frame shown by the display */
+	int                          published;  /**< frame published last by the engine, -1 for none */
+	std::mutex                 commandLock;  /**< lock for commands */
+	std::condition_variable         wakeUp;  /**< signals commands to a paused or waiting engine */
+	std::deque<EngineCommand>     commands;  /**< commands waiting for the engine, oldest first */
+	std::atomic<bool>               failed;  /**< a generation failed, the engine stopped */
+	float                          delayMs;  /**< wait time between calculations */
+	bool                      pendingReset;  /**< reset the game when it is paused */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables, no engine
+	*/
+	ComputeThread():
+			game(NULL),
+			back(0),
+			middle(1),
+			front(2),
+			published(-1),
+			failed(false),
+			delayMs(0.0f),
+			pendingReset(false)
+		{
+			for (int i = 0; i < 3; i++) {
+				frames[i].image = NULL;
+				frames[i].capacityBytes = 0;
+				frames[i].sizeBytes = 0;
+			}
+	}
+
+	/**
+	* Deconstructor.
+	* Stop the engine and free the frames
+	*/
+	~ComputeThread() { stop(); }
+
+	/**
+	* Start calculating the game on the engine thread. The game must be set
+	* up and is only used by the engine until stop.
+	* @param _game game
+	* @return 0 on success and -1 on failure
+	*/
+	int start(GameOfLife &_game);
+
+	/**
+	* Stop the engine after the current generation and free the frames.
+	*/
+	void stop();
+
+	/**
+	* Get whether the engine is running.
+	* @return true between start and stop
+	*/
+	bool isRunning() const {
+		return game != NULL;
+	}
+
+	/**
+	* Get whether a generation failed, which stops the engine.
+	* @return true after a failure
+	*/
+	bool hasFailed() const {
+		return failed;
+	}
+
+	/**
+	* Queue a command for the engine.
+	* @param command command
+	*/
+	void submit(const EngineCommand &command);
+
+	/**
+	* Take the latest published frame, only called by the display.
+	* @return frame, valid until the next call, NULL if there is no new frame
+	*/
+	const EngineFrame * acquire();
+
+	/**
+	* Apply a command directly to a game, e.g. without engine thread.
+	* COMMAND_RESET, COMMAND_DELAY and COMMAND_STOP belong to the engine
+	* and are ignored.
+	* @param game game
+	* @param command command
+	*/
+	static void apply(GameOfLife &game, const EngineCommand &command);
+
+	/**
+	* Get the state of a game shown by the display.
+	* @param game game
+	* @return state
+	*/
+	static FrameInfo getInfo(GameOfLife &game);
+
+private:
+	/**
+	* Loop of the engine thread.
+	*/
+	void run();
+
+	/**
+	* Make the back frame big enough for an image.
+	* @return 0 on success and -1 on failure
+	*/
+	int reserve(size_t sizeBytes);
+
+	/**
+	* Publish the back frame and take the middle frame as the next back frame.
+	* @param sizeBytes size of the image, 0 without image
+	* @param region part of the board in the image
+	*/
+	void publish(size_t sizeBytes, const DisplayRegion &region);
+
+	/**
+	* Publish the last image again with the current state, e.g. after a
+	* command while paused. The display may not have taken the last frame.
+	* @return 0 on success and -1 on failure
+	*/
+	int republish();
+
+	// Disable copy constructor
+	ComputeThread(const ComputeThread&);
+
+	// Disable operator=
+	ComputeThread& operator=(const ComputeThread&);
+};
+
+#endif
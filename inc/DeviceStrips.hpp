@@ -0,0 +1,162 @@
+#ifndef DEVICESTRIPS_HPP_
+#define DEVICESTRIPS_HPP_
+
+#include <vector>
+#include <CL/cl.h>					/* OpenCL definitions */
+
+#include "../inc/PackedBoard.hpp"	/* for 1 bit per cell boards */
+
+/**
+* Horizontal strip of a packed board on one device
+*/
+struct DeviceStrip {
+	cl_device_id                device;  /**< CL device calculating the strip */
+	cl_command_queue             queue;  /**< CL command queue of the device */
+	cl_kernel                   kernel;  /**< CL kernel calculating rows of the strip */
+	cl_mem                    board[2];  /**< CL buffers with rows+2 rows, halos at row 0 and rows+1 */
+	int                       rowBegin;  /**< first row of the board in the strip */
+	int                           rows;  /**< number of rows of the board in the strip */
+	std::vector<cl_uint>  edges[2][2];  /**< first and last row per buffer, staged for the neighbours */
+	cl_event            edgeEvents[2];  /**< reads of the staged rows of the last generation */
+};
+
+class DeviceStrips {
+private:
+	std::vector<DeviceStrip>    strips;  /**< strips from top to bottom */
+	int                   boardSize[2];  /**< width and height of board in cells */
+	cl_int                    rowWords;  /**< width of a row in uints, 2 uints per host word */
+	bool                         clamp;  /**< dead rows (true) or wrap around (false) outside the board */
+	size_t             localThreads[2];  /**< CL number of work items per group */
+	int                        current;  /**< buffer of the current generation */
+	cl_event          profileEvents[2];  /**< first and last kernel of the first strip, NULL if not profiled */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables, no strips
+	*/
+	DeviceStrips():
+			rowWords(0),
+			clamp(false),
+			current(0)
+		{
+			profileEvents[0] = NULL;
+			profileEvents[1] = NULL;
+			boardSize[0] = 0;
+			boardSize[1] = 0;
+			localThreads[0] = 0;
+			localThreads[1] = 0;
+	}
+
+	/**
+	* Deconstructor.
+	* Release all CL objects
+	*/
+	~DeviceStrips() { release(); }
+
+	/**
+	* Split a packed board into strips of equal height, one for each device,
+	* and copy the board to the devices.
+	* @param context CL context of all devices
+	* @param devices CL devices
+	* @param numberOfDevices number of devices and strips
+	* @param program CL program built for all devices
+	* @param rules CL buffer with the rules
+	* @param board starting board
+	* @param _clamp true: dead cells outside the board, false: wrap around
+	* @return 0 on success and -1 on failure
+	*/
+	int setup(cl_context context, const cl_device_id *devices, int numberOfDevices,
+			cl_program program, cl_mem rules, const PackedBoard &board, bool _clamp);
+
+	/**
+	* Release all CL objects.
+	*/
+	void release();
+
+	/**
+	* Get number of strips.
+	* @return number of strips, 0 if not set up
+	*/
+	size_t getNumberOfStrips() {
+		return strips.size();
+	}
+
+	/**
+	* Get the work items per work group of the strip kernel.
+	* @param i 0 for x, 1 for y
+	* @return localThreads[i]
+	*/
+	size_t getLocalThreads(int i) {
+		return localThreads[i];
+	}
+
+	/**
+	* Enqueue the next generation on all devices. The interior of each strip
+	* is calculated while the halos from the last generation are copied,
+	* the first and last row of the strip after that.
+	* @param profile switch for profiling the kernels of the first strip
+	* @return CL status
+	*/
+	cl_int enqueueGeneration(bool profile);
+
+	/**
+	* Get the execution time of the last profiled generation of the first strip.
+	* The kernels must have finished, e.g. by reading the board.
+	* @return execution time in ms
+	*/
+	float getProfiledTime();
+
+	/**
+	* Enqueue reading the current generation to the host.
+	* @param host words of a packed board with the size of the board
+	* @param events events of the reads, one per strip
+	* @return CL status
+	*/
+	cl_int enqueueRead(void *host, std::vector<cl_event> &events);
+
+	/**
+	* Read the current generation to the host, blocking.
+	* @param host words of a packed board with the size of the board
+	* @return CL status
+	*/
+	cl_int read(void *host);
+
+	/**
+	* Write a board to the devices as the current generation, blocking.
+	* @param host words of a packed board with the size of the board
+	* @return CL status
+	*/
+	cl_int write(const void *host);
+
+	/**
+	* Flush the command queues of all devices.
+	*/
+	void flush();
+
+	/**
+	* Wait until all enqueued commands of all devices have finished.
+	* @return CL status
+	*/
+	cl_int finish();
+
+private:
+	/**
+	* Enqueue the strip kernel for the rows [rowBegin,rowEnd) of a strip.
+	*/
+	cl_int enqueueRows(DeviceStrip &strip, int rowBegin, int rowEnd,
+			cl_uint numberOfEvents, const cl_event *waitEvents, cl_event *event);
+
+	/**
+	* Release the events of the staged rows.
+	*/
+	void releaseEdgeEvents();
+
+	// Disable copy constructor
+	DeviceStrips(const DeviceStrips&);
+
+	// Disable operator=
+	DeviceStrips& operator=(const DeviceStrips&);
+};
+
+#endif
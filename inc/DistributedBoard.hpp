@@ -0,0 +1,187 @@
+#ifndef DISTRIBUTEDBOARD_HPP_
+#define DISTRIBUTEDBOARD_HPP_
+
+#include <vector>
+#include <stdint.h>					/* for uint64_t and int64_t */
+#include <mpi.h>					/* MPI definitions */
+
+#include "../inc/PackedBoard.hpp"	/* for 1 bit per cell boards */
+#include "../inc/CPUEngine.hpp"		/* for calculating generations on all cores */
+
+/**
+* Neighbour directions of a subdomain: NW, N, NE, W, E, SW, S, SE
+*/
+#define DISTRIBUTED_DIRECTIONS 8
+
+/**
+* Packed board decomposed in 2D across the ranks of a MPI communicator.
+* Each rank holds a subdomain of whole words with a halo of one word
+* column on the left and right and one row above and below.
+*/
+class DistributedBoard {
+private:
+	MPI_Comm                          grid;  /**< cartesian communicator of the ranks */
+	int                               rank;  /**< rank in grid */
+	int                           ranks[2];  /**< number of ranks in x and y */
+	int                          coords[2];  /**< coordinates of this rank in grid */
+	int      neighbours[DISTRIBUTED_DIRECTIONS];  /**< ranks of the neighbour subdomains, MPI_PROC_NULL at clamped edges */
+	int64_t                  boardWords[2];  /**< width of the board in words and height in rows */
+	int64_t                      offset[2];  /**< first word and row of the subdomain in the board */
+	int                       localSize[2];  /**< words and rows of the subdomain without halos */
+	bool                             clamp;  /**< dead cells (true) or wrap around (false) outside the board */
+	PackedBoard                   board[2];  /**< subdomain with halos, current and next generation */
+	int                            current;  /**< board of the current generation */
+	std::vector<uint64_t> sendBuffers[DISTRIBUTED_DIRECTIONS];  /**< edge words sent to the neighbours */
+	std::vector<uint64_t> recvBuffers[DISTRIBUTED_DIRECTIONS];  /**< halo words received from the neighbours */
+	CPUEngine                       engine;  /**< multithreaded engine for the subdomain */
+	unsigned long              generations;  /**< number of calculated generations of this rank */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables, no subdomain
+	*/
+	DistributedBoard():
+			grid(MPI_COMM_NULL),
+			rank(0),
+			clamp(false),
+			current(0),
+			generations(0)
+		{
+			for (int i = 0; i < 2; i++) {
+				ranks[i] = 1;
+				coords[i] = 0;
+				boardWords[i] = 0;
+				offset[i] = 0;
+				localSize[i] = 0;
+			}
+			for (int i = 0; i < DISTRIBUTED_DIRECTIONS; i++)
+				neighbours[i] = MPI_PROC_NULL;
+	}
+
+	/**
+	* Deconstructor.
+	* Free the communicator of the grid
+	*/
+	~DistributedBoard() {
+		if (grid != MPI_COMM_NULL) MPI_Comm_free(&grid);
+	}
+
+	/**
+	* Decompose a board across all ranks of a communicator and allocate
+	* the subdomain of this rank with all cells dead. Collective.
+	* @param comm communicator of all ranks
+	* @param width width of the board in cells, rounded up to whole words
+	* @param height height of the board in cells
+	* @param _clamp true: dead cells outside the board, false: wrap around
+	* @return 0 on success and -1 on failure on any rank
+	*/
+	int setup(MPI_Comm comm, int64_t width, int64_t height, bool _clamp);
+
+	/**
+	* Set the number of threads calculating the subdomain.
+	* @param numberOfThreads number of threads, 0 for all cores
+	*/
+	void setNumberOfThreads(unsigned int numberOfThreads) {
+		engine.setNumberOfThreads(numberOfThreads);
+	}
+
+	/**
+	* Get the engine calculating the subdomain.
+	* @return engine
+	*/
+	CPUEngine & getEngine() {
+		return engine;
+	}
+
+	/**
+	* Fill the board randomly. Each cell is drawn from its coordinates,
+	* so the board does not depend on the number of ranks.
+	* @param density chance to create a live cell
+	* @param seed seed of the random numbers
+	*/
+	void randomise(float density, uint64_t seed);
+
+	/**
+	* Calculate the next generation. The halos are exchanged with non-blocking
+	* messages while the interior of the subdomain is calculated. Collective.
+	* @param rules rules for calculating next generation (see GameOfLife::setRule)
+	* @return 0 on success and -1 on failure
+	*/
+	int nextGeneration(const unsigned char *rules);
+
+	/**
+	* Get the number of live cells of the board. Collective.
+	* @return population of all ranks
+	*/
+	uint64_t getPopulation();
+
+	/**
+	* Get the number of generations calculated by all ranks. Collective.
+	* @return smallest generation counter of all ranks
+	*/
+	unsigned long getGenerations();
+
+	/**
+	* Get the subdomain of the current generation with the halos of the last exchange.
+	* The cells of the subdomain are the words [1,words] of the rows [1,rows].
+	* @return current board
+	*/
+	const PackedBoard & getLocalBoard() const {
+		return board[current];
+	}
+
+	/**
+	* Get first word and row of the subdomain in the board.
+	* @param i 0 for x, 1 for y
+	* @return offset[i]
+	*/
+	int64_t getOffset(int i) const {
+		return offset[i];
+	}
+
+	/**
+	* Get words and rows of the subdomain without halos.
+	* @param i 0 for x, 1 for y
+	* @return localSize[i]
+	*/
+	int getLocalSize(int i) const {
+		return localSize[i];
+	}
+
+	/**
+	* Get the number of ranks in x and y.
+	* @param i 0 for x, 1 for y
+	* @return ranks[i]
+	*/
+	int getRanks(int i) const {
+		return ranks[i];
+	}
+
+	/**
+	* Get the rank in the grid.
+	* @return rank
+	*/
+	int getRank() const {
+		return rank;
+	}
+
+private:
+	/**
+	* Copy the edges of the subdomain to the send buffers.
+	*/
+	void packEdges(const PackedBoard &src);
+
+	/**
+	* Copy the received halos into the board, dead halos at clamped edges.
+	*/
+	void unpackHalos(PackedBoard &src);
+
+	// Disable copy constructor
+	DistributedBoard(const DistributedBoard&);
+
+	// Disable operator=
+	DistributedBoard& operator=(const DistributedBoard&);
+};
+
+#endif
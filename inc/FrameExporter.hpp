@@ -0,0 +1,170 @@
+#ifndef FRAMEEXPORTER_HPP_
+#define FRAMEEXPORTER_HPP_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>					/* for uint64_t */
+#include <CL/cl.h>					/* OpenCL definitions */
+
+#include "../inc/PackedBoard.hpp"	/* for 1 bit per cell boards */
+
+/**
+* Number of host buffers frames are read into, the device only waits
+* for a free buffer if the writer is this many frames behind
+*/
+#define EXPORT_RING_SIZE 4
+
+/**
+* File formats of exported frames
+*/
+enum ExportFormat {
+	EXPORT_PNG = 0,		/**< 1 bit greyscale PNG, live cells are white */
+	EXPORT_RLE,			/**< run length encoded pattern, can be loaded with -f */
+	EXPORT_PBM			/**< raw 1 bit portable bitmap (P4), live cells are black */
+};
+
+/**
+* Buffer of the ring, holds one frame from the read to the written file
+*/
+struct ExportSlot {
+	void                         *host;  /**< host memory of the frame, pinned if possible */
+	cl_mem                      pinned;  /**< CL buffer allocated in host memory, NULL if host is malloced */
+	cl_event                     event;  /**< read of the frame from the device, NULL for host copies */
+	uint64_t                generation;  /**< generation of the frame */
+	bool                          busy;  /**< frame read or waiting for the writer */
+};
+
+/**
+* Writes frames of the board every few generations from a writer thread.
+* Frames are read into a ring of host buffers without blocking, the writer
+* waits for the read event of each frame and encodes it.
+*/
+class FrameExporter {
+private:
+	std::vector<ExportSlot>     slots;  /**< ring of host buffers */
+	std::deque<int>             queue;  /**< slots waiting for the writer, oldest first */
+	size_t                 frameBytes;  /**< size of one frame in bytes */
+	bool                       packed;  /**< frames are packed boards (true) or RGBA images (false) */
+	int                  boardSize[2];  /**< width and height of the board in cells */
+	std::string                prefix;  /**< path of the files without generation and extension */
+	ExportFormat               format;  /**< file format of the frames */
+	std::string                  rule;  /**< rule in the RLE header, e.g. B3/S23 */
+	cl_command_queue     commandQueue;  /**< CL command queue mapping the pinned buffers */
+	std::thread                writer;  /**< thread encoding and writing the frames */
+	std::mutex                  mutex;  /**< lock for queue, busy flags and stop */
+	std::condition_variable    wakeUp;  /**< signals queued frames and stop to the writer */
+	std::condition_variable      done;  /**< signals written frames */
+	bool                         stop;  /**< switch for stopping the writer */
+	int                        status;  /**< -1 after a failed write, else 0 */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables, no ring
+	*/
+	FrameExporter():
+			frameBytes(0),
+			packed(true),
+			format(EXPORT_PNG),
+			commandQueue(NULL),
+			stop(false),
+			status(0)
+		{
+			boardSize[0] = 0;
+			boardSize[1] = 0;
+	}
+
+	/**
+	* Deconstructor.
+	* Write the queued frames and release the ring
+	*/
+	~FrameExporter() { release(); }
+
+	/**
+	* Allocate the ring and start the writer. The buffers are pinned by
+	* allocating them as CL buffers in host memory if there is a context.
+	* @param context CL context, NULL for malloced buffers
+	* @param _commandQueue CL command queue for mapping the buffers
+	* @param _packed frames are packed boards (true) or RGBA images (false)
+	* @param width width of the board
+	* @param height height of the board
+	* @param _prefix path of the files, the generation and extension are appended
+	* @param _format file format of the frames
+	* @param rules rules for calculating next generation (see GameOfLife::setRule)
+	* @return 0 on success and -1 on failure
+	*/
+	int setup(cl_context context, cl_command_queue _commandQueue, bool _packed,
+			int width, int height, const std::string &_prefix, ExportFormat _format,
+			const unsigned char *rules);
+
+	/**
+	* Write the queued frames, stop the writer and release the ring.
+	*/
+	void release();
+
+	/**
+	* Get a free buffer for the next frame, waits if the writer is
+	* EXPORT_RING_SIZE frames behind.
+	* @return slot of the buffer, -1 if there is no ring
+	*/
+	int acquire();
+
+	/**
+	* Get the host memory of a slot.
+	* @param slot slot from acquire
+	* @return packed words or RGBA image with the size of the board
+	*/
+	void * getHost(int slot) {
+		return slots[slot].host;
+	}
+
+	/**
+	* Queue a frame for the writer.
+	* @param slot slot from acquire
+	* @param generation generation of the frame
+	* @param event read of the frame from the device, NULL if the frame is complete;
+	*        the writer waits for and releases it
+	*/
+	void submit(int slot, uint64_t generation, cl_event event);
+
+	/**
+	* Wait until all queued frames are written.
+	* @return 0 on success and -1 if a frame could not be written
+	*/
+	int finish();
+
+	/**
+	* Get the file format for a name.
+	* @param name png, rle or pbm
+	* @param _format file format
+	* @return 0 on success and -1 for unknown names
+	*/
+	static int getFormat(const char *name, ExportFormat &_format);
+
+private:
+	/**
+	* Write frames until stopped.
+	*/
+	void run();
+
+	/**
+	* Write a frame in the file format.
+	* @param board frame as packed board
+	* @param generation generation of the frame
+	* @return 0 on success and -1 on failure
+	*/
+	int write(const PackedBoard &board, uint64_t generation);
+
+	// Disable copy constructor
+	FrameExporter(const FrameExporter&);
+
+	// Disable operator=
+	FrameExporter& operator=(const FrameExporter&);
+};
+
+#endif
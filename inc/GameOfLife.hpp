@@ -7,16 +7,26 @@
 #include <vector>
 #include <cassert>					/* for assert() */
 #include <ctime>					/* for time() */
-#include <cstdlib>					/* for srand() and rand() */
+#include <cstdlib>					/* for malloc() and free() */
 #ifdef WIN32					// Windows system specific
 	#include <windows.h>			/* for QueryPerformanceCounter */
 #else							// Unix based system specific
 	#include <sys/time.h>			/* for gettimeofday() */
 #endif
 #include <CL/cl.h>					/* OpenCL definitions */
+#include <CL/cl_gl.h>				/* OpenCL/OpenGL sharing */
 
 #include "../inc/KernelFile.hpp"	/* for reading OpenCL kernel files */
 #include "../inc/PatternFile.hpp"	/* for reading population files */
+#include "../inc/PackedBoard.hpp"	/* for 1 bit per cell boards */
+#include "../inc/CPUEngine.hpp"		/* for calculating generations on all cores */
+#include "../inc/HashLife.hpp"		/* for extreme generation counts */
+#include "../inc/TileUniverse.hpp"	/* for unbounded boards */
+#include "../inc/DeviceStrips.hpp"	/* for several devices */
+#include "../inc/Checkpoint.hpp"	/* for saving and restoring boards */
+#include "../inc/FrameExporter.hpp"	/* for writing frames in the background */
+#include "../inc/PeriodDetector.hpp"	/* for stopping at periodic boards */
+#include "../inc/Metrics.hpp"		/* for histograms and traces of the run */
 
 /**
 * Definition of live and dead state
@@ -24,6 +34,58 @@
 #define ALIVE 255
 #define DEAD 0
 
+/**
+* Maximum number of generations enqueued behind a copy to the host
+*/
+#define MAX_QUEUED_GENERATIONS 256
+
+/**
+* Slots of the ring of board hashes on the device for period detection,
+* the host reads the ring before the kernels run around it
+*/
+#define HASH_RING (4*MAX_QUEUED_GENERATIONS)
+
+/**
+* Generations between two adjustments of the CPU/device split in co-execution mode
+*/
+#define COEXECUTION_BALANCE_GENERATIONS 8
+
+/**
+* Timed kernel runs per work-group size candidate when autotuning
+*/
+#define AUTOTUNE_RUNS 10
+
+/**
+* Cache of autotuned work-group sizes in the home directory
+*/
+#define AUTOTUNE_CACHE_FILE ".GameOfLife.autotune"
+
+/**
+* Cache of compiled OpenCL programs in the home directory
+*/
+#define PROGRAM_CACHE_DIR ".GameOfLife.programs"
+
+/**
+* Display of zoomed out views with more cells than pixels
+*/
+enum DisplayDetail {
+	DISPLAY_FULL = 0,		/**< all cells are copied, GL shrinks the image */
+	DISPLAY_ANY_ALIVE,		/**< a pixel is white if any of its cells is alive */
+	DISPLAY_DENSITY			/**< a pixel shows the density of its cells */
+};
+
+/**
+* Part of the board in a display image, pixel (u,v) covers the factor x factor
+* cells from (x+u*factor, y+v*factor)
+*/
+struct DisplayRegion {
+	int                          x;  /**< first column of cells */
+	int                          y;  /**< first row of cells */
+	int                      width;  /**< width of the image in pixels */
+	int                     height;  /**< height of the image in pixels */
+	int                     factor;  /**< cells per pixel in x and y, a power of 2 */
+};
+
 inline unsigned int countDigits(unsigned int x) {
 	unsigned count=1;
 	unsigned int value= 10;
@@ -37,18 +99,34 @@ private:
 	unsigned char           *rules;  /**< rules for calculating next generation */
 	size_t          rulesSizeBytes;  /**< size of rules in bytes */
 	std::string         humanRules;  /**< rules as an int, 9 separates survival/birth */
+	int                     states;  /**< number of states of a cell, more than 2 for Generations rules */
 	float               population;  /**< density of live cells when using random starting population */
+	uint64_t                  seed;  /**< seed of the random starting population */
 	PatternFile        patternFile;  /**< file when using static starting population */
-	unsigned char   *startingImage;  /**< image of starting population */
 	unsigned char          *imageA;  /**< first image on the host */
 	unsigned char          *imageB;  /**< second image on the host */
 	int               imageSize[2];  /**< width and height of image */
 	size_t          imageSizeBytes;  /**< size of image in bytes */
 	bool              switchImages;  /**< switch for image exchange */
+	bool                packedMode;  /**< switch for 1 bit per cell boards on host and device */
+	bool                sparseMode;  /**< switch for only calculating tiles of packed boards near changes */
+	bool                 clampMode;  /**< dead cells (true) or wrap around (false) outside the board */
+	bool               localMemory;  /**< switch for the OpenCL kernel with tiles in local memory */
+	int       generationsPerLaunch;  /**< generations calculated by one kernel run (temporal blocking) */
+	uint64_t        maxGenerations;  /**< no runs are queued beyond this generation, 0 for no limit */
+	bool                  autotune;  /**< switch for timing work-group sizes instead of the default */
+	PackedBoard      startingBoard;  /**< packed starting population of a restored checkpoint */
+	PackedBoard             boardA;  /**< first packed board on the host */
+	PackedBoard             boardB;  /**< second packed board on the host */
 
-	unsigned long      generations;  /**< number of calculated generations */
+	uint64_t           generations;  /**< number of calculated generations, 2^56 per HashLife step */
 	int    generationsPerCopyEvent;  /**< number of executed kernels during 1 read image call */
 	bool                   CPUMode;  /**< CPU/OpenCL switch for calculating next generation */
+	CPUEngine            cpuEngine;  /**< multithreaded engine for CPU mode */
+	bool              hashLifeMode;  /**< HashLife instead of CPU/OpenCL for calculating next generations */
+	HashLife              hashLife;  /**< quadtree engine for HashLife mode */
+	bool             unboundedMode;  /**< board shows a part of an unbounded universe of tiles */
+	TileUniverse          universe;  /**< tiles allocated around live cells for unbounded mode */
 	bool                    paused;  /**< start/stop calculation of next generation */
 	bool                 singleGen;  /**< switch for single generation mode */
 	float            executionTime;  /**< execution time for calculation of 1 generation */
@@ -58,7 +136,7 @@ private:
 	cl_device_id          *devices;  /**< CL device list */
 	cl_command_queue  commandQueue;  /**< CL command queue */
 	cl_program             program;  /**< CL program  */
-	cl_kernel               kernel;  /**< CL kernel */
+	cl_kernel            kernel[2];  /**< CL kernels calculating A->B and B->A */
 	std::string kernelBuildOptions;  /**< CL kernel build options */
 	std::string         kernelInfo;  /**< CL kernel information */
 	size_t        globalThreads[2];  /**< CL total number of work items for a kernel */
@@ -70,6 +148,47 @@ private:
 	size_t               origin[3];  /**< CL offset for image operations */
 	size_t               region[3];  /**< CL region for image operations */
 	cl_mem             deviceRules;  /**< cL memory object for rules */
+	cl_mem     deviceStartingBoard;  /**< CL buffer of the packed starting population for resets, NULL in random mode */
+	cl_kernel       startingKernel;  /**< CL kernel spawning the starting population in deviceImageA, NULL for copies */
+	cl_mem         pinnedBoards[2];  /**< CL buffers mapped as the host boards A and B, NULL if pageable */
+	void          *pinnedMemory[2];  /**< mapped memory of pinnedBoards */
+	cl_mem          deviceChangedA;  /**< CL buffer of tiles changed by the generation in A */
+	cl_mem          deviceChangedB;  /**< CL buffer of tiles changed by the generation in B */
+	size_t           numberOfTiles;  /**< number of tiles (work groups) in sparse mode */
+	bool                 glSharing;  /**< CL context shares objects with the GL context */
+	cl_mem      deviceDisplayImage;  /**< CL image object of the shared GL texture */
+	cl_kernel      renderKernel[2];  /**< CL kernels rendering A and B to the GL texture */
+	DisplayDetail    displayDetail;  /**< downsampling of zoomed out views on the device */
+	int           displayWindow[2];  /**< width and height of the window, 0 without window */
+	DisplayRegion       viewRegion;  /**< visible part of the board at about the resolution of the window */
+	DisplayRegion    displayRegion;  /**< part of the board in the last display image */
+	cl_kernel        displayKernel;  /**< CL kernel downsampling a board to viewRegion, NULL if not supported */
+	cl_mem       deviceDetailImage;  /**< CL image of the downsampled board read by the host */
+	int         detailImageSize[2];  /**< width and height of deviceDetailImage */
+	int            numberOfDevices;  /**< requested number of devices, 0 for all */
+	cl_uint         programDevices;  /**< number of devices the program is built for */
+	DeviceStrips            strips;  /**< strips of the board on several devices */
+	bool               coExecution;  /**< CPU calculates a band of rows while the device calculates the rest */
+	int                   splitRow;  /**< first row calculated on the CPU in co-execution mode */
+	float           balanceTime[2];  /**< device and CPU time in ms since the last adjustment of splitRow */
+	int         balanceGenerations;  /**< generations since the last adjustment of splitRow */
+	std::string     checkpointFile;  /**< path to checkpoints, empty for none */
+	uint64_t      checkpointInterval;  /**< generations between two checkpoints, 0 for none */
+	uint64_t        lastCheckpoint;  /**< generation of the last checkpoint */
+	CheckpointWriter checkpointWriter;  /**< writes checkpoints in the background */
+	std::string        restoreFile;  /**< checkpoint restored instead of spawning a population */
+	uint64_t      startingGeneration;  /**< generation of the starting population */
+	FrameExporter         exporter;  /**< ring of host buffers and writer for exported frames */
+	std::string       exportPrefix;  /**< path of exported frames, empty for none */
+	ExportFormat      exportFormat;  /**< file format of exported frames */
+	uint64_t        exportInterval;  /**< generations between two exported frames */
+	uint64_t            lastExport;  /**< generation of the last exported frame */
+	PeriodDetector  periodDetector;  /**< ring of the hashes of the last generations */
+	uint64_t      hashedGeneration;  /**< last generation added to periodDetector */
+	cl_mem        deviceTileHashes;  /**< CL buffer of the hashes of the tiles (work groups) */
+	cl_mem            deviceHashes;  /**< CL ring of the board hashes of HASH_RING generations */
+	std::vector<cl_uint> hostHashes;  /**< copy of deviceHashes on the host */
+	Metrics                metrics;  /**< histograms and trace of kernels, transfers and host work */
 
 public:
 	/** 
@@ -80,23 +199,83 @@ public:
 			spawnMode(false),
 			rules(NULL),
 			humanRules(""),
+			states(2),
 			population(0.0f),
-			startingImage(NULL),
+			seed((uint64_t)time(NULL)),
 			imageA(NULL),
 			imageB(NULL),
 			switchImages(true),
+			packedMode(false),
+			sparseMode(false),
+			clampMode(false),
+			localMemory(false),
+			generationsPerLaunch(1),
+			maxGenerations(0),
+			autotune(false),
 			generations(0),
 			generationsPerCopyEvent(0),
 			CPUMode(false),
+			hashLifeMode(false),
+			unboundedMode(false),
 			paused(true),
 			singleGen(false),
 			executionTime(0.0f),
 			readSync(CL_TRUE),
+			context(NULL),
+			devices(NULL),
+			commandQueue(NULL),
+			program(NULL),
 			kernelBuildOptions(""),
-			kernelInfo("")
+			kernelInfo(""),
+			deviceImageA(NULL),
+			deviceImageB(NULL),
+			deviceRules(NULL),
+			deviceStartingBoard(NULL),
+			startingKernel(NULL),
+			deviceChangedA(NULL),
+			deviceChangedB(NULL),
+			numberOfTiles(0),
+			glSharing(false),
+			deviceDisplayImage(NULL),
+			displayDetail(DISPLAY_ANY_ALIVE),
+			displayKernel(NULL),
+			deviceDetailImage(NULL),
+			numberOfDevices(1),
+			programDevices(1),
+			coExecution(false),
+			splitRow(0),
+			balanceGenerations(0),
+			checkpointFile(""),
+			checkpointInterval(0),
+			lastCheckpoint(0),
+			restoreFile(""),
+			startingGeneration(0),
+			exportPrefix(""),
+			exportFormat(EXPORT_PNG),
+			exportInterval(1),
+			lastExport(0),
+			hashedGeneration(0),
+			deviceTileHashes(NULL),
+			deviceHashes(NULL)
 		{
 			imageSize[0] = 0;
 			imageSize[1] = 0;
+			kernel[0] = NULL;
+			kernel[1] = NULL;
+			renderKernel[0] = NULL;
+			renderKernel[1] = NULL;
+			displayWindow[0] = 0;
+			displayWindow[1] = 0;
+			detailImageSize[0] = 0;
+			detailImageSize[1] = 0;
+			viewRegion = getFullRegion();
+			displayRegion = getFullRegion();
+			pinnedBoards[0] = NULL;
+			pinnedBoards[1] = NULL;
+			pinnedMemory[0] = NULL;
+			pinnedMemory[1] = NULL;
+			balanceTime[0] = 0.0f;
+			balanceTime[1] = 0.0f;
 	}
 	
 	/** 
@@ -113,16 +292,120 @@ public:
 
 	/**
 	* Calculate next generation.
+	* @param bufferImage destination of the frame for display,
+	*        NULL to calculate without producing frames (headless)
 	* @return 0 on success and -1 on failure
 	*/
 	int nextGeneration(unsigned char* bufferImage);
 	
+	/**
+	* Wait until all generations enqueued on the device are calculated.
+	* @return 0 on success and -1 on failure
+	*/
+	int finishGenerations() {
+		if (commandQueue != NULL && clFinish(commandQueue) != CL_SUCCESS)
+			return -1;
+		if (strips.finish() != CL_SUCCESS)
+			return -1;
+		return 0;
+	}
+	
 	/**
 	* Reset the board to the starting population.
 	* @return 0 on success and -1 on failure
 	*/
 	int resetGame(unsigned char *bufferImage);
 	
+	/**
+	* Render OpenCL generations directly to a GL texture.
+	* Only effective if the CL context shares objects with the GL context,
+	* which has to be current during setup. Otherwise images are still
+	* copied to the host.
+	* @param texture GL texture with the size of the board
+	* @return 0 on success and -1 on failure
+	*/
+	int shareGLTexture(unsigned int texture);
+	
+	/**
+	* Get whether OpenCL generations are rendered to the shared GL texture.
+	* The GL context must have finished using the texture before calling
+	* nextGeneration, and no host image is written in that case.
+	* @return true if the GL texture is shared
+	*/
+	bool isGLSharing() {
+		return deviceDisplayImage != NULL;
+	}
+	
+	/**
+	* Set the display of zoomed out views.
+	* @param _displayDetail DISPLAY_FULL copies all cells, else boards with more
+	*                       cells than pixels are downsampled on the device
+	*/
+	void setDisplayDetail(DisplayDetail _displayDetail) {
+		displayDetail = _displayDetail;
+	}
+	
+	/**
+	* Set the view of the board in the window. The next OpenCL generation only
+	* writes the visible part with about one pixel per pixel of the window,
+	* see getDisplayRegion.
+	* @param windowWidth width of the window in pixels
+	* @param windowHeight height of the window in pixels
+	* @param zoom scale of the board, which spans [-1,1] in both directions
+	* @param moveX translation of the board in x after scaling
+	* @param moveY translation of the board in y after scaling
+	*/
+	void setDisplayView(int windowWidth, int windowHeight, float zoom, float moveX, float moveY);
+	
+	/**
+	* Get whether the next generation writes a downsampled part of the board.
+	* Only single device OpenCL generations are downsampled.
+	* @return true if the display image is viewRegion
+	*/
+	bool isDisplayDownsampled() const {
+		/* There is no display kernel for strips and co-execution */
+		return displayDetail != DISPLAY_FULL && displayKernel != NULL && !CPUMode && !hashLifeMode
+			&& displayWindow[0] > 0 && (viewRegion.factor > 1
+				|| viewRegion.width < imageSize[0] || viewRegion.height < imageSize[1]);
+	}
+	
+	/**
+	* Get whether the image of the current generation depends on the view,
+	* i.e. whether redrawDisplay has to be called after setDisplayView when
+	* no generation is calculated. Other modes always show the whole board.
+	* @return true for single device OpenCL generations
+	*/
+	bool isDisplayRedrawable() const {
+		return displayKernel != NULL && !CPUMode && !hashLifeMode;
+	}
+	
+	/**
+	* Write the current generation again for the view set by setDisplayView
+	* without calculating the next one, e.g. after moving a paused board.
+	* @param bufferImage destination of getDisplaySizeBytes() bytes,
+	*        unused with a shared texture
+	* @return 0 on success and -1 on failure or if not isDisplayRedrawable
+	*/
+	int redrawDisplay(unsigned char *bufferImage);
+	
+	/**
+	* Get the size of the image the next generation writes to the host.
+	* @return size of the RGBA image in bytes
+	*/
+	size_t getDisplaySizeBytes() const {
+		if (!isDisplayDownsampled()) return 4*(size_t)imageSize[0]*imageSize[1];
+		return 4*(size_t)viewRegion.width*viewRegion.height;
+	}
+	
+	/**
+	* Get the part of the board in the image of the last generation, which is
+	* at the top left of the image or of the shared GL texture.
+	* @return region, the whole board with factor 1 unless downsampled
+	*/
+	const DisplayRegion & getDisplayRegion() const {
+		return displayRegion;
+	}
+	
 	/**
 	* Free memory.
 	* @return 0 on success and -1 on failure
@@ -145,6 +428,22 @@ public:
 		return CPUMode;
 	}
 	
+	/**
+	* Get HashLife Mode.
+	* @return hashLifeMode
+	*/
+	bool isHashLifeMode() {
+		return hashLifeMode;
+	}
+	
+	/**
+	* Get unbounded mode.
+	* @return unboundedMode
+	*/
+	bool isUnboundedMode() {
+		return unboundedMode;
+	}
+	
 	/**
 	* Get single generation mode.
 	* @return singleGen
@@ -161,6 +460,14 @@ public:
 		return readSync;
 	}
 	
+	/**
+	* Get packed mode.
+	* @return packedMode
+	*/
+	bool isPackedMode() {
+		return packedMode;
+	}
+	
 	/**
 	* Get spawn mode.
 	* @return spawnMode
@@ -181,27 +488,40 @@ public:
 	* Switch to CPU/OpenCL mode
 	*/
 	void switchCPUMode() {
+		/* The tiles of unbounded mode are only calculated on the CPU */
+		if (unboundedMode) return;
 		CPUMode = !CPUMode;
-		if (generations == 0) return;
+		/* HashLife mode updates the boards when it is switched off */
+		if (generations == 0 || hashLifeMode) return;
 		
 		/* Update first OpenCL/CPU image to last calculated generation */
 		if (CPUMode) {  /* Switch from OpenCL to CPU */
-			cl_int status = clEnqueueReadImage(commandQueue,
+			cl_int status = enqueueReadBoard(
 				switchImages ? deviceImageA : deviceImageB,
-				CL_TRUE, origin, region, rowPitch, 0,
-				switchImages ? imageA : imageB,
-				NULL, NULL, NULL);
+				CL_TRUE, getHostBoard(switchImages), NULL);
 			assert(status == CL_SUCCESS);
+			cpuEngine.invalidateTiles();
 		} else {        /* Switch from CPU to OpenCL */
-			cl_int status = clEnqueueWriteImage(commandQueue,
+			cl_int status = enqueueWriteBoard(
 				switchImages ? deviceImageA : deviceImageB,
-				CL_TRUE, origin, region, rowPitch, 0,
-				switchImages ? imageA : imageB,
-				NULL, NULL, NULL);
+				CL_TRUE, getHostBoard(switchImages), NULL);
+			assert(status == CL_SUCCESS);
+			status = resetChangedTiles();
 			assert(status == CL_SUCCESS);
 		}
 	}
 
+	/**
+	* Switch HashLife mode on/off.
+	* The universe of HashLife is unbounded, the board shows a part of it.
+	* In unbounded mode the cells move between HashLife and the tiles,
+	* else switching off crops the universe to the board.
+	* @return 0 on success, -1 if the rules are not supported by HashLife,
+	*         births on 0 neighbours or more than 2 states, and -2 if
+	*         checkpoints are written, they only hold the cells of the board
+	*/
+	int switchHashLifeMode();
+	
 	/**
 	* Start/stop calculation of next generation.
 	*/
@@ -235,7 +555,7 @@ public:
 	* Get number of calculated generations.
 	* @return generations
 	*/
-	unsigned long getGenerations() {
+	uint64_t getGenerations() {
 		return generations;
 	}
 	
@@ -246,7 +566,7 @@ public:
 	* @return generationsPerCopyEvent
 	*/
 	int getGenerationsPerCopyEvent() {
-		if (CPUMode)
+		if (CPUMode || hashLifeMode)
 			return 1;
 		else
 			return generationsPerCopyEvent;
@@ -254,10 +574,30 @@ public:
 
 	/**
 	* Get image of current generation.
+	* In packed mode the image is expanded from the current host board,
+	* free it with releaseImage() after use.
 	* @return image
 	*/
 	unsigned char * getImage() {
-		return imageA;
+		if (packedMode) {
+			if (imageA == NULL)
+				imageA = (unsigned char *)allocateHostMemory(imageSizeBytes);
+			if (imageA != NULL)
+				(switchImages ? boardA : boardB).unpack(imageA);
+			return imageA;
+		}
+		return switchImages ? imageA : imageB;
+	}
+	
+	/**
+	* Free the image expanded by getImage() in packed mode,
+	* the RGBA boards of the other modes are kept.
+	*/
+	void releaseImage() {
+		if (packedMode) {
+			freeHostMemory(imageA);
+			imageA = NULL;
+		}
 	}
 	
 	/**
@@ -284,6 +624,31 @@ public:
 		return kernelInfo;
 	}
 	
+	/**
+	* Get information about the CPU engine.
+	* @return number of threads and instruction set for packed boards
+	*/
+	std::string getCPUInfo() {
+		char threads[16];
+		snprintf(threads, sizeof(threads), "%u", cpuEngine.getNumberOfThreads());
+		std::string info("threads: ");
+		info.append(threads);
+		info.append(" | simd: ");
+		info.append(packedMode ? getSIMDName(cpuEngine.getSIMDLevel()) : "off");
+		if (coExecution) {
+			char rows[64];
+			snprintf(rows, sizeof(rows), " | co-execution: rows %i-%i", splitRow, imageSize[1]-1);
+			info.append(rows);
+		}
+		if (unboundedMode) {
+			char tiles[64];
+			snprintf(tiles, sizeof(tiles), " | unbounded: %lu tiles",
+					(unsigned long)universe.getNumberOfLiveTiles());
+			info.append(tiles);
+		}
+		return info;
+	}
+	
 	/**
 	* Set the starting population for random mode.
 	* @param _population chance to create a live cell
@@ -293,6 +658,34 @@ public:
 		population = _population;
 	}
 	
+	/**
+	* Set the seed of the random starting population, the same seed and
+	* density give the same board in all modes.
+	* @param _seed seed, default: the time of the start
+	*/
+	void setSeed(uint64_t _seed) {
+		seed = _seed;
+	}
+	
+	/**
+	* Get the seed of the random starting population.
+	* @return seed
+	*/
+	uint64_t getSeed() const {
+		return seed;
+	}
+	
+	/**
+	* Set the files of the metrics, which are written when the game ends.
+	* @param metricsFile histograms of kernel, transfer and host times and of the
+	*                    population, Prometheus text format for .prom, else JSON,
+	*                    empty for none
+	* @param traceFile timeline in the Chrome trace format, empty for none
+	*/
+	void setMetricsFiles(const std::string &metricsFile, const std::string &traceFile) {
+		metrics.setFiles(metricsFile, traceFile);
+	}
+	
 	/**
 	* Set the filename for file mode.
 	* @param _fileName path to fileName used for starting population
@@ -312,9 +705,257 @@ public:
 		imageSize[1] = _height;
 	}
 	
+	/**
+	* Use 1 bit per cell boards on host and device.
+	* RGBA images are only expanded for display.
+	* @param _packedMode switch for packed mode
+	*/
+	void setPackedMode(bool _packedMode) {
+		packedMode = _packedMode;
+	}
+	
+	/**
+	* Only calculate tiles which changed or are next to a changed tile
+	* in the last generation, on the CPU and with OpenCL.
+	* Sparse mode uses packed boards.
+	* @param _sparseMode switch for sparse mode
+	*/
+	void setSparseMode(bool _sparseMode) {
+		sparseMode = _sparseMode;
+		if (sparseMode) packedMode = true;
+		cpuEngine.setSparse(sparseMode);
+	}
+	
+	/**
+	* Use the OpenCL kernel that loads a tile with halo into local memory
+	* instead of reading all 9 cells of a neighbourhood from the image.
+	* Ignored in packed mode.
+	* @param _localMemory switch for local memory kernel
+	*/
+	void setLocalMemory(bool _localMemory) {
+		localMemory = _localMemory;
+	}
+	
+	/**
+	* Set the number of generations calculated by one kernel run.
+	* More than 1 generation uses the temporal blocking kernel with a halo
+	* of this width in local memory. Ignored in packed mode.
+	* @param _generationsPerLaunch generations per kernel run
+	*/
+	void setGenerationsPerLaunch(int _generationsPerLaunch) {
+		generationsPerLaunch = _generationsPerLaunch;
+	}
+	
+	/**
+	* Set the last generation OpenCL queues kernel runs for while it waits
+	* for a copy, so a run ends there instead of up to MAX_QUEUED_GENERATIONS
+	* later. A kernel run of the temporal blocking kernel is not split.
+	* @param _maxGenerations last generation, 0 for no limit
+	*/
+	void setMaxGenerations(uint64_t _maxGenerations) {
+		maxGenerations = _maxGenerations;
+	}
+	
+	/**
+	* Split the board into horizontal strips, one per GPU of the context,
+	* with halo rows exchanged between generations. Several devices use
+	* packed boards, sparse mode and GL sharing use a single device.
+	* @param _numberOfDevices number of devices, 0 for all
+	*/
+	void setNumberOfDevices(int _numberOfDevices) {
+		numberOfDevices = _numberOfDevices;
+		if (numberOfDevices != 1) packedMode = true;
+	}
+	
+	/**
+	* Calculate a band of rows at the bottom of the board on the CPU while
+	* the device calculates the rows above it. The rows next to the band
+	* are exchanged every generation and the split follows the measured
+	* time per row of both sides every COEXECUTION_BALANCE_GENERATIONS.
+	* Uses packed boards, ignored in sparse mode and with several devices.
+	* @param _coExecution switch for co-execution mode
+	*/
+	void setCoExecution(bool _coExecution) {
+		coExecution = _coExecution;
+		if (coExecution) packedMode = true;
+	}
+	
+	/**
+	* Use an unbounded universe of tiles which are allocated when live cells
+	* reach their border and freed when all their cells are dead.
+	* The board shows the part [0,width)x[0,height) of the universe and
+	* patterns may be bigger than the board. Generations are calculated
+	* on the CPU, clamp mode is ignored.
+	* @param _unboundedMode switch for unbounded mode
+	*/
+	void setUnboundedMode(bool _unboundedMode) {
+		unboundedMode = _unboundedMode;
+		if (unboundedMode) CPUMode = true;
+	}
+	
+	/**
+	* Time the kernel for a set of work-group sizes during setup and use the
+	* fastest one. The winner is cached per device, driver, board size and
+	* kernel in AUTOTUNE_CACHE_FILE and reused by later runs.
+	* Ignored if work-items per work-group are set with setKernelBuildOptions.
+	* @param _autotune switch for autotuning
+	*/
+	void setAutotune(bool _autotune) {
+		autotune = _autotune;
+	}
+	
+	/**
+	* Write checkpoints of the board in the background.
+	* @param _checkpointFile path to the checkpoint, replaced by every write
+	* @param _checkpointInterval generations between two checkpoints,
+	*        0 only writes on calls of writeCheckpoint
+	*/
+	void setCheckpoint(const char *_checkpointFile, uint64_t _checkpointInterval) {
+		checkpointFile = _checkpointFile;
+		checkpointInterval = _checkpointInterval;
+	}
+	
+	/**
+	* Restore a checkpoint instead of spawning a starting population.
+	* The size of the board and the clamp mode must match the checkpoint,
+	* its rule and generation replace the current ones. Reset returns to it.
+	* @param _restoreFile path to the checkpoint
+	*/
+	void setRestoreFile(const char *_restoreFile) {
+		restoreFile = _restoreFile;
+	}
+	
+	/**
+	* Get whether checkpoints are written.
+	* @return true if there is a checkpoint file
+	*/
+	bool isCheckpointMode() {
+		return !checkpointFile.empty();
+	}
+	
+	/**
+	* Get whether a checkpoint is restored instead of spawning a population.
+	* @return true if there is a checkpoint to restore
+	*/
+	bool isRestoreMode() {
+		return !restoreFile.empty();
+	}
+	
+	/**
+	* Export frames of the board every few generations. Frames are read into
+	* a ring of pinned host buffers without blocking and written by a thread,
+	* the generation and extension are appended to the path.
+	* @param _exportPrefix path of the frames, e.g. frames/gen
+	* @param _exportFormat file format of the frames
+	* @param _exportInterval generations between two frames
+	*/
+	void setExport(const char *_exportPrefix, ExportFormat _exportFormat, uint64_t _exportInterval) {
+		exportPrefix = _exportPrefix;
+		exportFormat = _exportFormat;
+		exportInterval = _exportInterval;
+	}
+	
+	/**
+	* Wait until the exported frames are written.
+	* @return 0 on success and -1 if a frame could not be written
+	*/
+	int finishExport() {
+		return exporter.finish();
+	}
+	
+	/**
+	* Detect still lifes and oscillators from the hashes of the boards of the
+	* last maxPeriod generations (see PeriodDetector). The OpenCL kernels
+	* hash the tiles of the board and combine them on the device, the CPU
+	* engine hashes its row bands. Uses packed boards, strips on several
+	* devices and co-execution are ignored, HashLife does not hash.
+	* @param maxPeriod longest period to detect, 0 for no detection
+	*/
+	void setPeriodDetection(int maxPeriod) {
+		periodDetector.setMaxPeriod(maxPeriod);
+		if (maxPeriod > 0) packedMode = true;
+	}
+	
+	/**
+	* Get the period of the board. OpenCL generations are detected when they
+	* are copied to the host, a few generations behind getGenerations.
+	* @return 1 for still lifes (also dead boards), the period of oscillators
+	*         and 0 if no period was detected
+	*/
+	int getPeriod() {
+		return periodDetector.getPeriod();
+	}
+	
+	/**
+	* Get the generation at which the board first repeated.
+	* @return first generation of the period, 0 if no period was detected
+	*/
+	uint64_t getPeriodGeneration() {
+		return periodDetector.getPeriodGeneration();
+	}
+	
+	/**
+	* Get whether all cells died.
+	* @return true if the detected period is a dead board
+	*/
+	bool isExtinct() {
+		return periodDetector.isExtinct();
+	}
+	
+	/**
+	* Start writing the current generation to the checkpoint in the background.
+	* Generations on the device are read to the host first.
+	* @return 0 on success and -1 on failure
+	*/
+	int writeCheckpoint();
+	
+	/**
+	* Wait for the checkpoint being written.
+	* @return 0 on success and -1 if the last write failed
+	*/
+	int finishCheckpoint() {
+		return checkpointWriter.finish();
+	}
+	
+	/**
+	* Set the number of generations per HashLife step.
+	* @param stepLog2 one step calculates 2^stepLog2 generations
+	*/
+	void setHashLifeStep(int stepLog2) {
+		hashLife.setStep(stepLog2);
+	}
+	
+	/**
+	* Get the number of generations per HashLife step.
+	* @return log2 of generations per step
+	*/
+	int getHashLifeStep() {
+		return hashLife.getStep();
+	}
+	
+	/**
+	* Set the memory cap of HashLife.
+	* @param megabytes memory for nodes in megabytes
+	*/
+	void setHashLifeMemory(size_t megabytes) {
+		hashLife.setMemoryLimit(megabytes);
+	}
+	
+	/**
+	* Set the number of threads for CPU mode.
+	* @param _numberOfThreads number of threads, 0 for all cores
+	*/
+	void setNumberOfThreads(unsigned int _numberOfThreads) {
+		cpuEngine.setNumberOfThreads(_numberOfThreads);
+	}
+	
 	/**
 	* Set the rule for calculating next generations.
-	* @param _rule rule as an array of characters
+	* A third part gives the number of states of Generations rules: live
+	* cells which do not survive count up through the states 2 and above
+	* and then die, e.g. Brian's Brain /2/3. These rules use packed boards.
+	* @param _rule rule as an array of characters, Survival/Birth[/States]
+	* @return 0 on success and -1 for invalid rules
 	*/
 	int setRule(char *_rule);
 	
@@ -325,6 +966,7 @@ public:
 	* @param y work-items per work-group for y
 	*/
 	void setKernelBuildOptions(int c, std::string x, std::string y) {
+		clampMode = (c == 1);
 		if (c == 1) {
 			/* Set clamp mode */
 			kernelBuildOptions.append("-D CLAMP ");
@@ -367,13 +1009,42 @@ private:
 	*/
 	int readPopulation();
 
+	/**
+	* Restore the starting population, rule and generation from the checkpoint.
+	* @return 0 on success and -1 on failure
+	*/
+	int restoreCheckpoint();
+
+	/**
+	* Update the human readable rule from the rules.
+	*/
+	void setHumanRules();
+
+	/**
+	* Queue the current generation for the exporter, the device reads it without blocking.
+	* @return 0 on success and -1 on failure
+	*/
+	int exportFrame();
+
 	/**
 	* Spawn initial population.
 	*/
 	int spawnPopulation();
 	
 	/**
-	* Spawn random population.
+	* Spawn the starting population in boardA/imageA again.
+	* @return 0 on success and -1 on failure
+	*/
+	int resetHostBoard();
+	
+	/**
+	* Reset deviceImageA to the starting population on the device.
+	* @return CL status
+	*/
+	cl_int resetDeviceBoard();
+	
+	/**
+	* Spawn random population from the seed on all cores.
 	*/
 	int spawnRandomPopulation();
 	
@@ -382,12 +1053,84 @@ private:
 	*/
 	int spawnStaticPopulation();
 
+	/**
+	* Build the program for the first programDevices devices. The binaries are loaded from
+	* PROGRAM_CACHE_DIR if the same source was built with the same options
+	* for the same device and driver before, otherwise it is built from
+	* source and saved there.
+	* @param source program source
+	* @param options build options
+	* @param printLog print the build log if the build fails
+	* @return program, NULL if the build failed
+	*/
+	cl_program buildProgram(const char *source, const std::string &options, bool printLog);
+	
+	/**
+	* Find the fastest work-group size for a kernel and append it to the
+	* build options, from the cache or by timing candidates.
+	* @param kernelName kernel to tune
+	* @param source program source
+	* @return 0 on success and -1 on failure
+	*/
+	int autotuneWorkGroupSize(const char *kernelName, const char *source);
+	
+	/**
+	* Time one work-group size candidate.
+	* @param kernelName kernel to time
+	* @param source program source
+	* @param x work-items per work-group for x
+	* @param y work-items per work-group for y
+	* @return median execution time of one run in ms, negative if the candidate is not usable
+	*/
+	float timeWorkGroupSize(const char *kernelName, const char *source, int x, int y);
+	
+	/**
+	* Calculate next generation with the strips on several devices.
+	* @return 0 on success and -1 on failure
+	*/
+	int nextGenerationStrips(unsigned char* bufferImage);
+	
+	/**
+	* Calculate next generation with OpenCL and the CPU together.
+	* @return 0 on success and -1 on failure
+	*/
+	int nextGenerationCoExecution(unsigned char* bufferImage);
+	
+	/**
+	* Move splitRow towards equal time of the device and the CPU
+	* and copy the rows moving to the device.
+	* @param board current generation on the host
+	* @param deviceBoard current generation on the device
+	*/
+	void balanceCoExecution(const PackedBoard &board, cl_mem deviceBoard);
+	
 	/**
 	* Calculate next generation with OpenCL.
 	* @return 0 on success and -1 on failure
 	*/
 	int nextGenerationOpenCL(unsigned char* bufferImage);
 	
+	/**
+	* Calculate next generations with HashLife.
+	* @return 0 on success and -1 on failure
+	*/
+	int nextGenerationHashLife(unsigned char* bufferImage);
+	
+	/**
+	* Load the current generation into HashLife, all tiles of the universe
+	* in unbounded mode, else the board or the pattern of the file in file
+	* mode before the first generation.
+	* @return 0 on success and -1 on parse errors
+	*/
+	int loadHashLife();
+	
+	/**
+	* Load the starting population into the unbounded universe,
+	* the whole pattern of the file in file mode.
+	* @return 0 on success and -1 on parse errors
+	*/
+	int loadUniverse();
+	
 	/**
 	* Calculate next generation with CPU.
 	* @return 0 on success and -1 on failure
@@ -395,13 +1138,102 @@ private:
 	int nextGenerationCPU(unsigned char* bufferImage);
 	
 	/**
-	* Calculate the number of neighbours for a cell.
-	* @param x x coordinate of cell
-	* @param y y coordinate of cell
-	* @param image search in this image
-	* @return number of neighbours
+	* Check if the host board has to hold the current generation of the
+	* unbounded universe or HashLife, for a frame, an export or the metrics.
+	* @param bufferImage destination of the frame, NULL for none
+	* @return true if the board is rasterised
+	*/
+	bool isHostBoardNeeded(const unsigned char *bufferImage) {
+		return bufferImage != NULL || !exportPrefix.empty() || metrics.isEnabled();
+	}
+	
+	/**
+	* Get the host memory of the first or second board.
+	* @param first true for imageA/boardA, false for imageB/boardB
+	* @return RGBA image or words of packed board
+	*/
+	void * getHostBoard(bool first) {
+		if (packedMode)
+			return first ? (void *)boardA.getWords() : (void *)boardB.getWords();
+		else
+			return first ? (void *)imageA : (void *)imageB;
+	}
+	
+	/**
+	* Move the host boards A and B into mapped pinned buffers, so the
+	* transfers to and from the device run by DMA. The boards stay in
+	* pageable memory if the buffers cannot be allocated.
+	*/
+	void pinHostBoards();
+	
+	/**
+	* Unmap and release the pinned buffers of the host boards,
+	* the boards are released before.
+	*/
+	void unpinHostBoards();
+	
+	/**
+	* Enqueue reading a board from the device (image or packed buffer).
+	* @param deviceBoard device image/buffer
+	* @param blocking switch for blocking read
+	* @param host destination in host memory
+	* @param event event for the read command, may be NULL
+	* @return CL status
+	*/
+	cl_int enqueueReadBoard(cl_mem deviceBoard, cl_bool blocking, void *host, cl_event *event);
+	
+	/**
+	* Enqueue writing a board to the device (image or packed buffer).
+	* @param deviceBoard device image/buffer
+	* @param blocking switch for blocking write
+	* @param host source in host memory
+	* @param event event for the write command, may be NULL
+	* @return CL status
+	*/
+	cl_int enqueueWriteBoard(cl_mem deviceBoard, cl_bool blocking, const void *host, cl_event *event);
+
+	/**
+	* Mark all tiles as changed for sparse mode and clear the hashes of
+	* period detection, so the next OpenCL generation calculates and
+	* hashes the whole board.
+	* @return CL status
+	*/
+	cl_int resetChangedTiles();
+	
+	/**
+	* Add the board hashes of the generations up to lastGeneration from
+	* hostHashes to the period detector.
+	* @param lastGeneration last generation read from the device ring
+	*/
+	void addDeviceHashes(uint64_t lastGeneration);
+	
+	/**
+	* Enqueue rendering a board to the shared GL texture.
+	* @param render kernel rendering the device image/buffer
+	* @param event event for releasing the texture, may be NULL
+	* @return CL status
+	*/
+	cl_int enqueueRenderBoard(cl_kernel render, cl_event *event);
+	
+	/**
+	* Enqueue downsampling a board to viewRegion, written to the shared GL
+	* texture or read to the host.
+	* @param deviceBoard device image/buffer
+	* @param blocking switch for blocking read
+	* @param host destination of getDisplaySizeBytes() bytes, unused with a shared texture
+	* @param event event for the read or for releasing the texture, may be NULL
+	* @return CL status
 	*/
-	int getNumberOfNeighbours(const int x, const int y, const unsigned char *image);
+	cl_int enqueueDisplayBoard(cl_mem deviceBoard, cl_bool blocking, void *host, cl_event *event);
+	
+	/**
+	* Get the whole board as a display region.
+	* @return region of all cells with factor 1
+	*/
+	DisplayRegion getFullRegion() const {
+		DisplayRegion region = {0, 0, imageSize[0], imageSize[1], 1};
+		return region;
+	}
 
 	/**
 	* Get the state of a cell.
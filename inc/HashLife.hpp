@@ -0,0 +1,328 @@
+#ifndef HASHLIFE_HPP_
+#define HASHLIFE_HPP_
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <stdint.h>					/* for uint64_t and int64_t */
+
+#include "../inc/PackedBoard.hpp"	/* for rasterising into packed boards */
+#include "../inc/TileUniverse.hpp"	/* for moving cells from and to the unbounded universe */
+
+/**
+* Number of nodes allocated at once
+*/
+#define HASHLIFE_BLOCK_NODES 65536
+
+/**
+* Default memory cap in megabytes
+*/
+#define HASHLIFE_DEFAULT_MEMORY 1024
+
+/**
+* Runs are loaded in bands of 2^HASHLIFE_BAND_LEVEL rows, one word per 64 cells of a row
+*/
+#define HASHLIFE_BAND_LEVEL 6
+
+/**
+* Tiles of the unbounded universe are nodes of this level, 2^6 = UNIVERSE_TILE_SIZE
+*/
+#define HASHLIFE_TILE_LEVEL 6
+
+/**
+* Node of the quadtree. A node of level k is a square of 2^k cells,
+* level 0 nodes are single cells. Equal nodes exist only once (hash-consing).
+*/
+struct HashLifeNode {
+	HashLifeNode         *nw, *ne, *sw, *se;  /**< quadrants, NULL for cells */
+	HashLifeNode                   *result;  /**< memoised center after the current step */
+	HashLifeNode                     *next;  /**< next node in the same hash bucket */
+	uint64_t                    population;  /**< number of live cells */
+	int                              level;  /**< size of the node is 2^level */
+	bool                            marked;  /**< reachable in garbage collection */
+};
+
+/**
+* Tile of the unbounded universe while it is loaded into nodes
+*/
+struct HashLifeTile {
+	int64_t                        tile[2];  /**< tile coordinates */
+	const uint64_t                  *rows;  /**< UNIVERSE_TILE_SIZE rows, bit x of row y is cell x,y */
+};
+
+class HashLife {
+private:
+	HashLifeNode                 *cells[2];  /**< dead and live cell */
+	HashLifeNode                     *root;  /**< current universe */
+	int64_t                      origin[2];  /**< universe coordinates of the top left cell of root */
+	unsigned char                rules[18];  /**< rules for calculating next generation */
+	int                           stepLog2;  /**< one step calculates 2^stepLog2 generations */
+	HashLifeNode                 **buckets;  /**< hash table of all nodes except cells */
+	size_t                 numberOfBuckets;  /**< size of the hash table, power of 2 */
+	size_t                   numberOfNodes;  /**< nodes in the hash table */
+	size_t                       nodeLimit;  /**< nodes before collecting garbage */
+	HashLifeNode                 *freeList;  /**< free nodes, linked with next */
+	std::vector<HashLifeNode *>     blocks;  /**< allocated blocks of nodes */
+	std::vector<HashLifeNode *> emptyNodes;  /**< empty node for each level */
+	int                          loadLevel;  /**< level of the root while loading runs */
+	int                           loadBand;  /**< band of the rows in loadWords */
+	int                    loadWordsPerRow;  /**< words of a row in loadWords */
+	std::vector<uint64_t>        loadWords;  /**< packed rows of the current band */
+	std::vector<std::vector<HashLifeNode *> > loadRows;  /**< rows of nodes waiting for the rows below, by level */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables, B3/S23 and a cap of HASHLIFE_DEFAULT_MEMORY MB
+	*/
+	HashLife();
+
+	/**
+	* Deconstructor.
+	* Free all nodes
+	*/
+	~HashLife();
+
+	/**
+	* Set the rules. Rules with birth on 0 neighbours are not supported,
+	* they turn the unbounded universe alive.
+	* @param _rules rules for calculating next generation (see GameOfLife::setRule)
+	* @return 0 on success and -1 on failure
+	*/
+	int setRules(const unsigned char *_rules);
+
+	/**
+	* Set the memory cap. Garbage is collected between steps when the nodes
+	* exceed the cap, memoised results are dropped if that is not enough.
+	* @param megabytes memory for nodes in megabytes
+	*/
+	void setMemoryLimit(size_t megabytes);
+
+	/**
+	* Set the number of generations per step, memoised results are dropped.
+	* @param _stepLog2 one step calculates 2^_stepLog2 generations
+	*/
+	void setStep(int _stepLog2);
+
+	/**
+	* Get the number of generations per step.
+	* @return stepLog2
+	*/
+	int getStep() {
+		return stepLog2;
+	}
+
+	/**
+	* Replace the universe by a RGBA image, all cells outside are dead.
+	* @param image RGBA image
+	* @param width width of the image
+	* @param height height of the image
+	* @param x universe x coordinate of the left column of the image
+	* @param y universe y coordinate of the top row of the image
+	*/
+	void load(const unsigned char *image, int width, int height, int64_t x, int64_t y);
+
+	/**
+	* Replace the universe by the cells of an unbounded universe of tiles,
+	* the coordinates of both are the same.
+	* @param universe tiles of the unbounded universe
+	*/
+	void load(const TileUniverse &universe);
+
+	/**
+	* Replace the universe by the live cells of a packed board, all cells outside are dead.
+	* @param board packed board
+	* @param x universe x coordinate of the left column of the board
+	* @param y universe y coordinate of the top row of the board
+	*/
+	void load(const PackedBoard &board, int64_t x, int64_t y);
+
+	/**
+	* Start replacing the universe by runs of live cells, e.g. decoded from
+	* a pattern file without an image of the whole pattern. Every finished
+	* band of rows is built into nodes right away.
+	* @param width width of the runs
+	* @param height height of the runs
+	* @param x universe x coordinate of the left column of the runs
+	* @param y universe y coordinate of the top row of the runs
+	*/
+	void beginRuns(int width, int height, int64_t x, int64_t y);
+
+	/**
+	* Add a run of live cells, runs come in the order of their rows.
+	* @param x first column of the run in [0,width)
+	* @param y row of the run in [0,height)
+	* @param length number of cells, the run ends before width
+	*/
+	void addRun(int x, int y, int length);
+
+	/**
+	* Finish the runs, the rows below are dead and the universe is replaced.
+	*/
+	void endRuns();
+
+	/**
+	* Calculate 2^stepLog2 generations.
+	*/
+	void step();
+
+	/**
+	* Rasterise the universe cells [0,width)x[0,height) into a RGBA image.
+	* @param image RGBA image
+	* @param width width of the image
+	* @param height height of the image
+	*/
+	void rasterise(unsigned char *image, int width, int height);
+
+	/**
+	* Rasterise the universe cells of a packed board.
+	* @param board packed board
+	*/
+	void rasterise(PackedBoard &board);
+
+	/**
+	* Replace the cells of an unbounded universe of tiles by all cells
+	* of the universe, the coordinates of both are the same.
+	* @param universe tiles of the unbounded universe
+	*/
+	void rasterise(TileUniverse &universe);
+
+	/**
+	* Get number of live cells in the universe.
+	* @return population
+	*/
+	uint64_t getPopulation() {
+		return root->population;
+	}
+
+	/**
+	* Get number of nodes in memory.
+	* @return numberOfNodes
+	*/
+	size_t getNumberOfNodes() {
+		return numberOfNodes;
+	}
+
+private:
+	/**
+	* Get the unique node with the given quadrants.
+	*/
+	HashLifeNode * join(HashLifeNode *nw, HashLifeNode *ne, HashLifeNode *sw, HashLifeNode *se);
+
+	/**
+	* Get the empty node of a level.
+	*/
+	HashLifeNode * empty(int level);
+
+	/**
+	* Get the center of a node, one level below.
+	*/
+	HashLifeNode * center(HashLifeNode *node) {
+		return join(node->nw->se, node->ne->sw, node->sw->ne, node->se->nw);
+	}
+
+	/**
+	* Surround the root with empty space, one level above.
+	*/
+	void expand();
+
+	/**
+	* Check if all live cells of the root are in its inner quarter.
+	*/
+	bool isConfined();
+
+	/**
+	* Get the center of a node of level k after 2^min(stepLog2,k-2) generations.
+	*/
+	HashLifeNode * successor(HashLifeNode *node);
+
+	/**
+	* Get the center 2x2 cells of a 4x4 node after 1 generation.
+	*/
+	HashLifeNode * baseCase(HashLifeNode *node);
+
+	/**
+	* Build the node of a level for a region of an image.
+	*/
+	HashLifeNode * build(const unsigned char *image, int width, int height,
+			int level, int x, int y);
+
+	/**
+	* Build the node of a level for a square of packed rows,
+	* the band of runs or the rows of a tile.
+	* @param words word column of the first row
+	* @param stride words from one row to the next
+	*/
+	HashLifeNode * buildWords(const uint64_t *words, size_t stride, int level, int x, int y);
+
+	/**
+	* Build the node of a level for the tiles [begin,end) inside of it.
+	* @param x tile x coordinate of the left column of the node
+	* @param y tile y coordinate of the top row of the node
+	*/
+	HashLifeNode * buildTiles(HashLifeTile *begin, HashLifeTile *end, int level, int64_t x, int64_t y);
+
+	/**
+	* Build the nodes of the band of runs and start the next band.
+	*/
+	void flushBand();
+
+	/**
+	* Add a row of nodes of level HASHLIFE_BAND_LEVEL+k below the rows
+	* before, two rows of a level are joined to one of the next level.
+	*/
+	void addNodeRow(std::vector<HashLifeNode *> &nodes, size_t k);
+
+	/**
+	* Rasterise the live cells of a node into [0,width)x[0,height).
+	*/
+	template <class SetCell>
+	void rasteriseNode(HashLifeNode *node, int64_t x, int64_t y,
+			int width, int height, SetCell &setCell);
+
+	/**
+	* Call setCell(x, y) for all live cells of a node, unlike rasteriseNode without clipping.
+	*/
+	template <class SetCell>
+	void forEachCell(HashLifeNode *node, int64_t x, int64_t y, SetCell &setCell);
+
+	/**
+	* Get a new node, collecting garbage is only done between steps.
+	*/
+	HashLifeNode * allocateNode();
+
+	/**
+	* Double the hash table.
+	*/
+	void resize();
+
+	/**
+	* Free all nodes not reachable from the root.
+	* @param keepResults false: memoised results are dropped
+	*/
+	void collectGarbage(bool keepResults);
+
+	/**
+	* Mark a node and all nodes reachable from it.
+	*/
+	void mark(HashLifeNode *node, bool keepResults);
+
+	/**
+	* Hash of the quadrants of a node.
+	*/
+	inline size_t hash(HashLifeNode *nw, HashLifeNode *ne, HashLifeNode *sw, HashLifeNode *se) {
+		uint64_t h = (uint64_t)(uintptr_t)nw * 0x9E3779B97F4A7C15ULL;
+		h ^= (uint64_t)(uintptr_t)ne * 0xC2B2AE3D27D4EB4FULL;
+		h ^= (uint64_t)(uintptr_t)sw * 0x165667B19E3779F9ULL;
+		h ^= (uint64_t)(uintptr_t)se * 0x27D4EB2F165667C5ULL;
+		return (size_t)(h ^ (h >> 29)) & (numberOfBuckets - 1);
+	}
+
+	// Disable copy constructor
+	HashLife(const HashLife&);
+
+	// Disable operator=
+	HashLife& operator=(const HashLife&);
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef HOSTMEMORY_HPP_
+#define HOSTMEMORY_HPP_
+
+#include <cstdlib>
+
+/**
+* Alignment of host boards: a page, so rows start on cache lines and SIMD
+* vectors and the drivers can lock the pages for DMA
+*/
+#define HOST_MEMORY_ALIGNMENT 4096
+
+/**
+* Boards of at least this size are aligned to and rounded up to huge
+* pages, which are requested from the kernel where it supports them
+*/
+#define HOST_HUGE_PAGE_BYTES (2*1024*1024)
+
+/**
+* Freed blocks kept for the next allocations
+*/
+#define HOST_MEMORY_POOL_BLOCKS 8
+
+/**
+* Allocate a block for a board. Freed blocks of about the same size are
+* reused, e.g. when a board is allocated again with the same size.
+* Thread safe.
+* @param sizeBytes size of the block
+* @return aligned block, NULL on failure
+*/
+void *allocateHostMemory(size_t sizeBytes);
+
+/**
+* Return a block of allocateHostMemory to the pool.
+* @param memory block, NULL is ignored
+*/
+void freeHostMemory(void *memory);
+
+/**
+* Free all blocks in the pool.
+*/
+void trimHostMemory();
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef METRICS_HPP_
+#define METRICS_HPP_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>					/* for uint64_t */
+#include <CL/cl.h>					/* OpenCL definitions */
+
+/**
+* Buckets of a histogram, bucket i holds values up to 2^(i-METRICS_BUCKET_OFFSET)
+*/
+#define METRICS_BUCKETS 64
+#define METRICS_BUCKET_OFFSET 20
+
+/**
+* Events kept for the trace, later events are only counted
+*/
+#define METRICS_MAX_TRACE_EVENTS 1000000
+
+/**
+* Recorded quantities, times are in ms
+*/
+enum MetricType {
+	METRIC_KERNEL = 0,		/**< kernel time of one generation */
+	METRIC_QUEUE_LATENCY,	/**< time from enqueueing a kernel to its start */
+	METRIC_READ,			/**< transfer of a board from the device */
+	METRIC_WRITE,			/**< transfer of a board to the device */
+	METRIC_CPU,				/**< one generation on the CPU */
+	METRIC_PARSE,			/**< parsing the pattern file */
+	METRIC_SETUP,			/**< setup of host and device */
+	METRIC_BUILD,			/**< building the CL program */
+	METRIC_POPULATION,		/**< live cells of the boards copied to the host */
+	METRIC_TYPES
+};
+
+/**
+* Histogram with power of 2 buckets
+*/
+struct MetricHistogram {
+	uint64_t      buckets[METRICS_BUCKETS];  /**< number of values per bucket */
+	uint64_t                         count;  /**< number of values */
+	double                             sum;  /**< sum of the values */
+	double                             min;  /**< smallest value */
+	double                             max;  /**< largest value */
+};
+
+/**
+* Span of the trace, host spans on thread 0 and device spans on thread 1
+*/
+struct TraceEvent {
+	MetricType                        type;  /**< what the span measures */
+	double                         startMs;  /**< start on the host clock */
+	double                      durationMs;  /**< length of the span */
+	int                             device;  /**< 1 for device spans, 0 for host spans */
+};
+
+/**
+* Metrics of a run: histograms of kernel, transfer and host times and of
+* the population, written as JSON or in the Prometheus text format, and an
+* optional timeline in the Chrome trace format (chrome://tracing, Perfetto).
+* Device times come from the profiling info of the CL events, the device
+* clock is mapped to the host clock at the first event.
+*/
+class Metrics {
+private:
+	bool                            enabled;  /**< values are recorded */
+	std::string                 metricsFile;  /**< path of the histograms, empty for none */
+	std::string                   traceFile;  /**< path of the timeline, empty for none */
+	MetricHistogram histograms[METRIC_TYPES];  /**< one histogram per metric */
+	std::vector<TraceEvent>           trace;  /**< spans of the timeline */
+	uint64_t                  droppedEvents;  /**< spans beyond METRICS_MAX_TRACE_EVENTS */
+	double                      startTimeMs;  /**< host clock at reset, the trace starts there */
+	double                   deviceOffsetMs;  /**< host clock minus device clock */
+	bool                    deviceOffsetSet;  /**< deviceOffsetMs was measured */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables, nothing is recorded
+	*/
+	Metrics():
+			enabled(false),
+			metricsFile(""),
+			traceFile(""),
+			droppedEvents(0),
+			startTimeMs(0.0),
+			deviceOffsetMs(0.0),
+			deviceOffsetSet(false)
+		{
+			reset();
+	}
+
+	/**
+	* Set the files written by write(), recording starts.
+	* @param _metricsFile path of the histograms, .prom for the Prometheus text format,
+	*                     else JSON, empty for none
+	* @param _traceFile path of the Chrome trace, empty for none
+	*/
+	void setFiles(const std::string &_metricsFile, const std::string &_traceFile) {
+		metricsFile = _metricsFile;
+		traceFile = _traceFile;
+		enabled = !metricsFile.empty() || !traceFile.empty();
+	}
+
+	/**
+	* Get whether values are recorded.
+	* @return true if a file is set
+	*/
+	bool isEnabled() const {
+		return enabled;
+	}
+
+	/**
+	* Forget all values.
+	*/
+	void reset();
+
+	/**
+	* Record a value.
+	* @param type metric
+	* @param value time in ms or population
+	*/
+	void record(MetricType type, double value);
+
+	/**
+	* Record a span on the host, its length is added to the histogram.
+	* @param type metric
+	* @param startMs start of the span (see getTimeMs)
+	* @param endMs end of the span
+	*/
+	void recordHost(MetricType type, double startMs, double endMs);
+
+	/**
+	* Record a finished command of a profiling queue: its execution and,
+	* for kernels, the time from enqueueing to the start.
+	* @param type metric of the execution
+	* @param event finished CL event
+	* @param generations generations of a kernel run, the time is divided by them
+	* @return CL status of the profiling info
+	*/
+	cl_int recordEvent(MetricType type, cl_event event, int generations = 1);
+
+	/**
+	* Get a histogram.
+	* @param type metric
+	* @return histogram
+	*/
+	const MetricHistogram & getHistogram(MetricType type) const {
+		return histograms[type];
+	}
+
+	/**
+	* Get the value below which a fraction of the values lie, up to the
+	* resolution of the buckets.
+	* @param type metric
+	* @param fraction e.g. 0.99
+	* @return upper bound of the bucket, 0 without values
+	*/
+	double getPercentile(MetricType type, double fraction) const;
+
+	/**
+	* Write the histograms and the trace to the files set by setFiles.
+	* @return 0 on success and -1 on failure
+	*/
+	int write() const;
+
+	/**
+	* Get the host clock.
+	* @return time in ms
+	*/
+	static double getTimeMs();
+
+	/**
+	* Get the name of a metric.
+	* @param type metric
+	* @return name, e.g. "kernel_ms"
+	*/
+	static const char * getName(MetricType type);
+
+private:
+	/**
+	* Write the histograms as JSON.
+	*/
+	int writeJSON(FILE *file) const;
+
+	/**
+	* Write the histograms in the Prometheus text format.
+	*/
+	int writePrometheus(FILE *file) const;
+
+	/**
+	* Write the spans in the Chrome trace format.
+	*/
+	int writeTrace(FILE *file) const;
+
+	/**
+	* Add a span to the trace.
+	*/
+	void addTraceEvent(MetricType type, double startMs, double durationMs, int device);
+};
+
+#endif
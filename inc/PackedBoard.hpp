@@ -0,0 +1,372 @@
+#ifndef PACKEDBOARD_HPP_
+#define PACKEDBOARD_HPP_
+
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>					/* for uint64_t */
+
+#include "../inc/HostMemory.hpp"	/* for aligned and pooled boards */
+
+/**
+* Number of cells stored in one word of a packed board
+*/
+#define CELLS_PER_WORD 64
+
+/**
+* Maximum number of states of a cell, stored in up to 4 bit planes
+*/
+#define PACKED_MAX_STATES 16
+
+class PackedBoard {
+private:
+	uint64_t                  *words;  /**< 1 bit per cell and plane, 64 cells per word, row-major */
+	int                 boardSize[2];  /**< width and height of board in cells */
+	int                  wordsPerRow;  /**< number of words for one row of a plane */
+	int                       states;  /**< number of states of a cell, 2 for dead and alive */
+	int                       planes;  /**< bit planes holding the state of a cell */
+	size_t             boardSizeBytes;  /**< size of board in bytes */
+	uint64_t            lastWordMask;  /**< mask of valid cells in the last word of a row */
+	bool                   ownsWords;  /**< words are from allocateHostMemory, else from useWords */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables
+	*/
+	PackedBoard():
+			words(NULL),
+			wordsPerRow(0),
+			states(2),
+			planes(1),
+			boardSizeBytes(0),
+			lastWordMask(0),
+			ownsWords(false)
+		{
+			boardSize[0] = 0;
+			boardSize[1] = 0;
+	}
+
+	/**
+	* Deconstructor.
+	*/
+	~PackedBoard() { release(); }
+
+	/**
+	* Allocate a board of the given size with all cells dead.
+	* Cells with more than 2 states (Generations rules) store the state
+	* number in bit planes, plane p of row y is the row y*planes+p.
+	* @param _width width in cells
+	* @param _height height in cells
+	* @param _states number of states of a cell, 2 to PACKED_MAX_STATES
+	* @return 0 on success and -1 on failure
+	*/
+	int allocate(int _width, int _height, int _states = 2);
+
+	/**
+	* Release the words, the board is empty afterwards.
+	*/
+	void release() {
+		if (ownsWords) freeHostMemory(words);
+		words = NULL;
+		ownsWords = false;
+	}
+
+	/**
+	* Move the cells to memory of the caller, e.g. pinned memory for
+	* transfers to the device. The memory must stay valid until the board
+	* is released or allocated again and is not freed by the board.
+	* @param memory at least getSizeBytes() bytes
+	*/
+	void useWords(uint64_t *memory) {
+		memcpy(memory, words, boardSizeBytes);
+		release();
+		words = memory;
+	}
+
+	/**
+	* Kill all cells of the board.
+	*/
+	void clear() {
+		memset(words, 0, boardSizeBytes);
+	}
+
+	/**
+	* Copy the cells of another board with the same size.
+	* @param board source board
+	*/
+	void copy(const PackedBoard &board) {
+		memcpy(words, board.words, boardSizeBytes);
+	}
+
+	/**
+	* Pack a RGBA image (red channel, bit 7) into the board.
+	* Live cells get state 1, all other cells are dead.
+	* @param image RGBA image with the size of the board
+	*/
+	void pack(const unsigned char *image);
+
+	/**
+	* Expand the board to a RGBA image for display.
+	* Cells of states 2 and above fade from grey to black,
+	* bit 7 of their red channel is cleared.
+	* @param image RGBA image with the size of the board
+	*/
+	void unpack(unsigned char *image) const;
+
+	/**
+	* Get the hash of the rows [rowBegin,rowEnd) of all planes, see hashBoardWord.
+	* Hashes of disjoint rows are combined with XOR to the hash of the board,
+	* which equals the hash calculated by the OpenCL kernels.
+	* @param rowBegin first row
+	* @param rowEnd row after the last row
+	* @return hash, 0 if all cells of the rows are dead
+	*/
+	uint64_t getHash(int rowBegin, int rowEnd) const;
+
+	/**
+	* Get the number of live cells, cells of state 1.
+	* @return population
+	*/
+	uint64_t getPopulation() const;
+
+	/**
+	* Get the state of a cell.
+	* @param x x coordinate of cell
+	* @param y y coordinate of cell
+	* @return 1 if alive, else 0
+	*/
+	inline int getCell(const int x, const int y) const {
+		return getState(x, y) == 1;
+	}
+
+	/**
+	* Set the state of a cell.
+	* @param x x coordinate of cell
+	* @param y y coordinate of cell
+	* @param alive new state of cell
+	*/
+	inline void setCell(const int x, const int y, const bool alive) {
+		setState(x, y, alive ? 1 : 0);
+	}
+
+	/**
+	* Get the state number of a cell.
+	* @param x x coordinate of cell
+	* @param y y coordinate of cell
+	* @return 0 if dead, 1 if alive, else the state of a dying cell
+	*/
+	inline int getState(const int x, const int y) const {
+		const uint64_t *word = &words[(size_t)y*planes*wordsPerRow + x/CELLS_PER_WORD];
+		int state = 0;
+		for (int p = 0; p < planes; p++)
+			state |= (int)((word[p*wordsPerRow] >> (x%CELLS_PER_WORD)) & 1) << p;
+		return state;
+	}
+
+	/**
+	* Set the state number of a cell.
+	* @param x x coordinate of cell
+	* @param y y coordinate of cell
+	* @param state new state of cell, less than the number of states
+	*/
+	inline void setState(const int x, const int y, const int state) {
+		uint64_t *word = &words[(size_t)y*planes*wordsPerRow + x/CELLS_PER_WORD];
+		uint64_t bit = (uint64_t)1 << (x%CELLS_PER_WORD);
+		for (int p = 0; p < planes; p++) {
+			if ((state >> p) & 1) word[p*wordsPerRow] |= bit;
+			else word[p*wordsPerRow] &= ~bit;
+		}
+	}
+
+	/**
+	* Get the words of a row of a plane.
+	* @param y row
+	* @param plane bit plane of the states
+	* @return words of the row
+	*/
+	uint64_t * getRow(const int y, const int plane = 0) {
+		return &words[((size_t)y*planes + plane)*wordsPerRow];
+	}
+
+	/**
+	* Get the words of a row of a plane.
+	* @param y row
+	* @param plane bit plane of the states
+	* @return words of the row
+	*/
+	const uint64_t * getRow(const int y, const int plane = 0) const {
+		return &words[((size_t)y*planes + plane)*wordsPerRow];
+	}
+
+	/**
+	* Get the words of the board.
+	* @return words
+	*/
+	uint64_t * getWords() {
+		return words;
+	}
+
+	/**
+	* Get the words of the board.
+	* @return words
+	*/
+	const uint64_t * getWords() const {
+		return words;
+	}
+
+	/**
+	* Get width of board.
+	* @return boardSize[0]
+	*/
+	int getWidth() const {
+		return boardSize[0];
+	}
+
+	/**
+	* Get height of board.
+	* @return boardSize[1]
+	*/
+	int getHeight() const {
+		return boardSize[1];
+	}
+
+	/**
+	* Get number of words per row of a plane.
+	* @return wordsPerRow
+	*/
+	int getWordsPerRow() const {
+		return wordsPerRow;
+	}
+
+	/**
+	* Get number of states of a cell.
+	* @return states
+	*/
+	int getStates() const {
+		return states;
+	}
+
+	/**
+	* Get number of bit planes of the states.
+	* @return planes
+	*/
+	int getPlanes() const {
+		return planes;
+	}
+
+	/**
+	* Get mask of valid cells in the last word of a row.
+	* @return lastWordMask
+	*/
+	uint64_t getLastWordMask() const {
+		return lastWordMask;
+	}
+
+	/**
+	* Get size of board in bytes.
+	* @return boardSizeBytes
+	*/
+	size_t getSizeBytes() const {
+		return boardSizeBytes;
+	}
+
+	/**
+	* Call setRun(x, y, length) for all runs of live cells (state 1) in the
+	* order of their rows, e.g. to load the board without expanding it.
+	* Runs end at the words of a row, the next run may go on in the next word.
+	* @param setRun function object
+	*/
+	template <class SetRun>
+	void forEachRun(SetRun &setRun) const {
+		for (int y = 0; y < boardSize[1]; y++) {
+			for (int c = 0; c < wordsPerRow; c++) {
+				uint64_t bits = getRow(y)[c];
+				for (int p = 1; p < planes; p++)
+					bits &= ~getRow(y, p)[c];
+				if (c == wordsPerRow - 1) bits &= lastWordMask;
+				while (bits != 0) {
+					const int begin = __builtin_ctzll(bits);
+					const uint64_t filled = bits | (((uint64_t)1 << begin) - 1);
+					const int end = (~filled == 0) ? CELLS_PER_WORD : __builtin_ctzll(~filled);
+					setRun(c*CELLS_PER_WORD + begin, y, end - begin);
+					bits &= (end == CELLS_PER_WORD) ? 0 : ~(uint64_t)0 << end;
+				}
+			}
+		}
+	}
+
+private:
+	// Disable copy constructor
+	PackedBoard(const PackedBoard&);
+
+	// Disable operator=
+	PackedBoard& operator=(const PackedBoard&);
+};
+
+/**
+* Hash of a 32 bit half of a word of a packed board (splitmix64 finalizer).
+* Half i of the board is the 32 bit word i of the OpenCL buffer, the hash
+* of a board is the XOR of the hashes of all its halves. Dead halves hash
+* to 0, so only live cells cost time and the order of the halves is free.
+* @param half 32 bit half of a word, the low half comes first
+* @param index number of the half in the board
+* @return hash, 0 if half is 0
+*/
+inline uint64_t hashBoardWord(uint32_t half, uint32_t index) {
+	if (half == 0) return 0;
+	uint64_t z = ((uint64_t)index << 32) | half;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+* Get the rules as bitmasks, bit n is set if a cell is born (survives) with n neighbours.
+* @param rules rules for calculating next generation (see GameOfLife::setRule)
+* @param birth bitmask of the birth rules
+* @param survival bitmask of the survival rules
+*/
+inline void getRuleMasks(const unsigned char *rules, unsigned int &birth, unsigned int &survival) {
+	birth = 0;
+	survival = 0;
+	for (int n = 0; n <= 8; n++) {
+		if (rules[n]) birth |= 1u << n;
+		if (rules[9+n]) survival |= 1u << n;
+	}
+}
+
+/**
+* Calculate the next generation for the rows [rowBegin,rowEnd) of a packed board.
+* The rule is evaluated on whole words with bit-sliced neighbour counting.
+* Boards with more than 2 states follow Generations rules: only cells of
+* state 1 are alive and counted, the rules give births of dead cells and
+* survivals of live cells. Other live cells age to state 2, the states
+* 2 and above count up and wrap around to dead.
+* @param src board of current generation
+* @param dst board of next generation, same size as src
+* @param rules rules for calculating next generation (see GameOfLife::setRule)
+* @param clamp true: dead cells outside the board, false: wrap around
+* @param rowBegin first row to calculate
+* @param rowEnd row after the last row to calculate
+*/
+void nextGenerationPacked(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd);
+
+/**
+* Calculate the next generation for a tile of a packed board with 2 states,
+* the rows [rowBegin,rowEnd) and the words [wordBegin,wordEnd) of these rows.
+* @param src board of current generation
+* @param dst board of next generation, same size as src
+* @param rules rules for calculating next generation (see GameOfLife::setRule)
+* @param clamp true: dead cells outside the board, false: wrap around
+* @param rowBegin first row to calculate
+* @param rowEnd row after the last row to calculate
+* @param wordBegin first word of a row to calculate
+* @param wordEnd word after the last word of a row to calculate
+* @return true if a cell of the tile changed
+*/
+bool nextGenerationPackedTile(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd,
+		int wordBegin, int wordEnd);
+
+#endif
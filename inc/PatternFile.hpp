@@ -7,53 +7,121 @@
 #include <vector>
 #include <iostream>
 
+#include "../inc/PackedBoard.hpp"	/* for rendering into packed boards */
+#include "../inc/HashLife.hpp"		/* for rendering into the HashLife universe */
+#include "../inc/TileUniverse.hpp"	/* for rendering into the unbounded universe */
+
 class PatternFile {
 private:
-	FILE                       *file;  /**< FILE for population */
 	char                   *fileName;  /**< filename for file */
-	unsigned char           *pattern;  /**< parsed pattern */
+	const char                 *data;  /**< contents of the file, mapped or read */
+	size_t                  dataSize;  /**< size of the file in bytes */
+	void                    *mapping;  /**< mapping of the file, NULL if it was read into buffer */
+	std::vector<char>         buffer;  /**< contents of the file if it could not be mapped */
+	size_t              patternBegin;  /**< offset of the run length encoded cells in data */
 	int               patternSize[2];  /**< width and height of specified pattern */
-	size_t          patternSizeBytes;  /**< size of pattern in bytes */
+	int                     maxState;  /**< highest state of a cell in the pattern, 1 for two states */
 	std::vector<int>      birthRules;  /**< list of number of neighbours for cell birth */
 	std::vector<int>   survivalRules;  /**< list of number of neighbours for cell survival */
-	int                            c;  /**< current character being read */
+	int                       states;  /**< number of states of the rule, 0 if there is no known rule */
 
 public:
-	/** 
+	/**
 	* Constructor.
 	* Initialize member variables
 	*/
-    PatternFile():fileName(NULL) {}
-	
-    /** 
+	PatternFile():
+			fileName(NULL),
+			data(NULL),
+			dataSize(0),
+			mapping(NULL),
+			patternBegin(0),
+			maxState(1),
+			states(0)
+		{
+			patternSize[0] = 0;
+			patternSize[1] = 0;
+	}
+
+	/**
 	* Deconstructor.
 	*/
-    ~PatternFile() {
+	~PatternFile() {
+		close();
 		free(fileName);
 	}
-	
-	/** 
-	* Parse file.
+
+	/**
+	* Map the file and parse the header, the cells are decoded when rendering.
+	* @return 0 on success, -1 on parse errors and -2 if the file cannot be opened
 	*/
 	int parse();
-	
-	/** 
+
+	/**
 	* Set filename.
 	* @param _fileName path to fileName
 	*/
-    void setFilename(char *_fileName) {
+	void setFilename(char *_fileName) {
 		fileName = (char*)malloc(sizeof(char)*strlen(_fileName)+1);
 		memcpy(fileName,_fileName,sizeof(char)*strlen(_fileName)+1);
 	}
-	
+
+	/**
+	* Decode the live cells (state 1) of the pattern straight into a RGBA image.
+	* Dead cells are not written, the image must be dead where the pattern is.
+	* Cells outside of the image are dropped.
+	* @param image RGBA image
+	* @param width width of the image
+	* @param height height of the image
+	* @param x x coordinate of the left column of the pattern in the image
+	* @param y y coordinate of the top row of the pattern in the image
+	* @return 0 on success and -1 on parse errors
+	*/
+	int render(unsigned char *image, int width, int height, int x, int y);
+
+	/**
+	* Decode the cells of the pattern straight into a packed board, the cells
+	* of states the board does not have are dropped. Dead cells are not
+	* written, the board must be dead where the pattern is.
+	* Cells outside of the board are dropped.
+	* @param board packed board
+	* @param x x coordinate of the left column of the pattern in the board
+	* @param y y coordinate of the top row of the pattern in the board
+	* @return 0 on success and -1 on parse errors
+	*/
+	int render(PackedBoard &board, int x, int y);
+
+	/**
+	* Decode the live cells (state 1) of the pattern straight into the
+	* unbounded universe. Dead cells are not written, the universe must be
+	* dead where the pattern is.
+	* @param universe universe
+	* @param x universe x coordinate of the left column of the pattern
+	* @param y universe y coordinate of the top row of the pattern
+	* @return 0 on success and -1 on parse errors
+	*/
+	int render(TileUniverse &universe, int64_t x, int64_t y);
+
+	/**
+	* Replace the HashLife universe by the live cells (state 1) of the
+	* pattern, the runs are built into nodes while they are decoded.
+	* @param hashLife HashLife universe
+	* @param x universe x coordinate of the left column of the pattern
+	* @param y universe y coordinate of the top row of the pattern
+	* @return 0 on success and -1 on parse errors
+	*/
+	int render(HashLife &hashLife, int64_t x, int64_t y);
+
 	/**
-	* Get parsed pattern.
-	* @return pattern
+	* Get the highest state of a cell, Golly's multi-state letters
+	* A-X and pA-yO are the states 1-255.
+	* Valid after rendering.
+	* @return maxState
 	*/
-	unsigned char * getPattern() {
-		return pattern;
+	int getMaxState() {
+		return maxState;
 	}
-	
+
 	/**
 	* Get rules for birth of a dead cell.
 	* @return birthRules
@@ -61,7 +129,7 @@ public:
 	std::vector<int> getBirthRules() {
 		return birthRules;
 	}
-	
+
 	/**
 	* Get rules for birth of a dead cell.
 	* @return survivalRules
@@ -69,7 +137,15 @@ public:
 	std::vector<int> getSurvivalRules() {
 		return survivalRules;
 	}
-	
+
+	/**
+	* Get number of states of the rule, more than 2 for Generations rules.
+	* @return states, 0 if the header has no rule or it is unknown
+	*/
+	int getStates() {
+		return states;
+	}
+
 	/**
 	* Get width of pattern.
 	* @return patternSize[0]
@@ -77,7 +153,7 @@ public:
 	int getWidth() {
 		return patternSize[0];
 	}
-	
+
 	/**
 	* Get height of pattern.
 	* @return patternSize[1]
@@ -85,50 +161,42 @@ public:
 	int getHeight() {
 		return patternSize[1];
 	}
-	
+
 private:
 	/**
-	* Skips comments
-	* @return -1 if EOF found, else 0
-	*/
-	int skipComments();
-	
-	/** 
-	* Skips whitespaces of file
-	* @return -1 if EOF found, else 0
+	* Unmap the file.
 	*/
-	int skipWhiteSpace();
-	
-	/** 
-	* Get a sequence of numbers and combine them to a number
-	* @return number
-	*/
-	int getNumber();
-	
-	/** 
-	* Parse the header if specified
-	* @return true if there is a header, else false
+	void close();
+
+	/**
+	* Parse the header line
+	* @param p first character of the header line, after the header on return
+	* @return true if there is a valid header, else false
 	*/
-	bool parseHeader();
-	
+	bool parseHeader(const char *&p);
+
 	/**
-	* Parse the pattern
-	* @return 0 on success and -1 on failure
+	* Parse the rule of the header, B3/S23 or 23/3, and Generations rules
+	* with the number of states as third part, B2/S/C3 or /2/3.
+	* Unknown rules keep the rule of the command line.
+	* @param p first character of the rule
+	* @param end character after the header line
 	*/
-	int parsePattern();
-	
+	void parseRule(const char *p, const char *end);
+
 	/**
-	* Set the state of a cell.
-	* @param x x coordinate of cell
-	* @param y y coordinate of cell
-	* @param state new state of cell
+	* Decode the run length encoded cells and call setRun(x, y, length, state)
+	* for every run of cells with a state other than 0 inside the pattern.
+	* @return 0 on success and -1 on failure
 	*/
-	void setState(const int x, const int y, const unsigned char state) {
-		pattern[4*x + (4*patternSize[0]*y)] = state;
-		pattern[(4*x+1) + (4*patternSize[0]*y)] = state;
-		pattern[(4*x+2) + (4*patternSize[0]*y)] = state;
-		pattern[(4*x+3) + (4*patternSize[0]*y)] = 1;
-	}
+	template <class SetRun>
+	int decode(SetRun &setRun);
+
+	// Disable copy constructor
+	PatternFile(const PatternFile&);
+
+	// Disable operator=
+	PatternFile& operator=(const PatternFile&);
 };
 
 #endif
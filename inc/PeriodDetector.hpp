@@ -0,0 +1,99 @@
+#ifndef PERIODDETECTOR_HPP_
+#define PERIODDETECTOR_HPP_
+
+#include <cstdlib>
+#include <vector>
+#include <stdint.h>					/* for uint64_t */
+
+/**
+* Detects still lifes and oscillating boards from the hashes of consecutive
+* generations. A ring holds the hashes of the last generations, a board is
+* periodic with period p if its hash equals the hash of p generations ago.
+* Equal hashes of different boards are possible but very unlikely.
+*/
+class PeriodDetector {
+private:
+	std::vector<uint64_t>       hashes;  /**< ring of the hashes of the last generations */
+	int                      maxPeriod;  /**< longest period detected, 0 for no detection */
+	uint64_t            lastGeneration;  /**< generation of the last hash, hashes before are in the ring */
+	size_t                       count;  /**< number of hashes in the ring */
+	int                         period;  /**< period of the board, 0 while not periodic */
+	uint64_t           periodGeneration;  /**< first generation of the period */
+	bool                       extinct;  /**< all cells of the periodic board are dead */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables, no detection
+	*/
+	PeriodDetector():
+			maxPeriod(0),
+			lastGeneration(0),
+			count(0),
+			period(0),
+			periodGeneration(0),
+			extinct(false)
+		{}
+
+	/**
+	* Set the longest period to detect, the ring holds as many hashes.
+	* Forgets all hashes.
+	* @param _maxPeriod longest period, 1 for still lifes only and 0 for no detection
+	*/
+	void setMaxPeriod(int _maxPeriod);
+
+	/**
+	* Get the longest period to detect.
+	* @return maxPeriod, 0 if detection is off
+	*/
+	int getMaxPeriod() const {
+		return maxPeriod;
+	}
+
+	/**
+	* Forget all hashes and the detected period,
+	* e.g. after the board was changed from outside of the generations.
+	*/
+	void reset() {
+		count = 0;
+		period = 0;
+		periodGeneration = 0;
+		extinct = false;
+	}
+
+	/**
+	* Add the hash of the next generation. Generations must be added in order
+	* without gaps, a gap forgets the hashes before it. Nothing changes
+	* after a period was detected.
+	* @param hash hash of the board (see PackedBoard::getHash)
+	* @param generation generation of the board
+	* @return period of the board, 0 if it is not periodic (yet)
+	*/
+	int add(uint64_t hash, uint64_t generation);
+
+	/**
+	* Get the period of the board.
+	* @return 1 for still lifes, the period of oscillators and 0 if no period was detected
+	*/
+	int getPeriod() const {
+		return period;
+	}
+
+	/**
+	* Get the generation at which the board first repeated.
+	* @return first generation of the period, 0 if no period was detected
+	*/
+	uint64_t getPeriodGeneration() const {
+		return periodGeneration;
+	}
+
+	/**
+	* Get whether all cells died.
+	* @return true if the period was detected on a dead board
+	*/
+	bool isExtinct() const {
+		return extinct;
+	}
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef PHILOX_HPP_
+#define PHILOX_HPP_
+
+#include <stdint.h>					/* for uint32_t and uint64_t */
+
+/**
+* Rounds of the Philox-4x32 generator, 10 pass the usual statistical tests
+*/
+#define PHILOX_ROUNDS 10
+
+/**
+* Counter-based random numbers (Philox-4x32-10, Salmon et al. 2011).
+* The four numbers of a counter only depend on the counter and the key,
+* so any part of a board can be generated on its own, in any order and
+* on any thread or device, and gives the same cells.
+* @param counter 4 words of the counter
+* @param key 64 bit key, e.g. the seed
+* @param random the 4 random numbers
+*/
+inline void philox4x32(const uint32_t counter[4], uint64_t key, uint32_t random[4]) {
+	uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key >> 32);
+	for (int i = 0; i < PHILOX_ROUNDS; i++) {
+		uint64_t product0 = (uint64_t)0xD2511F53u * c0;
+		uint64_t product1 = (uint64_t)0xCD9E8D57u * c2;
+		c0 = (uint32_t)(product1 >> 32) ^ c1 ^ k0;
+		c1 = (uint32_t)product1;
+		c2 = (uint32_t)(product0 >> 32) ^ c3 ^ k1;
+		c3 = (uint32_t)product0;
+		k0 += 0x9E3779B9u;
+		k1 += 0xBB67AE85u;
+	}
+	random[0] = c0;
+	random[1] = c1;
+	random[2] = c2;
+	random[3] = c3;
+}
+
+/**
+* Get the threshold of random numbers for live cells.
+* @param density density of live cells between 0 and 1
+* @return cells are alive if their random number is below the threshold
+*/
+inline uint64_t getRandomThreshold(float density) {
+	if (density <= 0.0f) return 0;
+	if (density >= 1.0f) return (uint64_t)1 << 32;
+	return (uint64_t)(density * 4294967296.0);
+}
+
+/**
+* Get 4 random cells of a row, cell x of row y is random number x%4 of the
+* counter (x/4, y, 0, 0).
+* @param seed key of the generator
+* @param threshold threshold of live cells (see getRandomThreshold)
+* @param group x/4 of the first cell
+* @param y row of the cells
+* @return bit i set if cell 4*group+i is alive
+*/
+inline unsigned int getRandomCells(uint64_t seed, uint64_t threshold, uint32_t group, uint32_t y) {
+	const uint32_t counter[4] = {group, y, 0, 0};
+	uint32_t random[4];
+	philox4x32(counter, seed, random);
+	return (random[0] < threshold) | (random[1] < threshold) << 1
+		| (random[2] < threshold) << 2 | (random[3] < threshold) << 3;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef SIMD_HPP_
+#define SIMD_HPP_
+
+#include "../inc/PackedBoard.hpp"	/* for 1 bit per cell boards */
+
+/**
+* Instruction sets for calculating generations of packed boards
+*/
+enum SIMDLevel {
+	SIMD_SCALAR = 0,	/**< 64 cells per step, reference path */
+	SIMD_NEON,			/**< 128 cells per step */
+	SIMD_AVX2,			/**< 256 cells per step */
+	SIMD_AVX512			/**< 512 cells per step */
+};
+
+/**
+* Detect the best instruction set supported by the CPU, the OS and this build.
+* @return instruction set
+*/
+SIMDLevel detectSIMDLevel();
+
+/**
+* Get the name of an instruction set.
+* @param level instruction set
+* @return name
+*/
+const char * getSIMDName(SIMDLevel level);
+
+/**
+* Calculate the next generation for the rows [rowBegin,rowEnd) of a packed board
+* with bit-sliced neighbour counting on vector registers.
+* @param level instruction set, must be supported (see detectSIMDLevel)
+* @param src board of current generation
+* @param dst board of next generation, same size as src
+* @param rules rules for calculating next generation (see GameOfLife::setRule)
+* @param clamp true: dead cells outside the board, false: wrap around
+* @param rowBegin first row to calculate
+* @param rowEnd row after the last row to calculate
+*/
+void nextGenerationPackedSIMD(SIMDLevel level, const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd);
+
+/*
+ * Kernels for each instruction set, each one in its own translation unit
+ * compiled with the corresponding compiler flags.
+ * has*Kernel() returns false if the kernel was not compiled in.
+ */
+bool hasNEONKernel();
+void nextGenerationPackedNEON(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd);
+bool hasAVX2Kernel();
+void nextGenerationPackedAVX2(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd);
+bool hasAVX512Kernel();
+void nextGenerationPackedAVX512(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd);
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef SOUPBATCH_HPP_
+#define SOUPBATCH_HPP_
+
+#include <vector>
+#include <stdint.h>					/* for uint64_t */
+#include <CL/cl.h>					/* OpenCL definitions */
+
+#include "../inc/PackedBoard.hpp"	/* for 1 bit per cell boards */
+#include "../inc/PeriodDetector.hpp"	/* for periods on the CPU */
+#include "../inc/ThreadPool.hpp"	/* for soups on all cores */
+
+/**
+* Generations calculated between two reads of the soup states, even so
+* the current generation of all boards is back in the first buffer
+*/
+#define SOUP_GENERATIONS_PER_STEP 32
+
+/**
+* Status of a soup: no period within the maximum generations, no soup on the board
+* (a status of 0 is a running soup, above 0 the period)
+*/
+#define SOUP_UNSTABLE -1
+#define SOUP_IDLE -2
+
+/**
+* Finished soup of a batch search
+*/
+struct SoupResult {
+	uint64_t                      seed;  /**< seed of the random starting population */
+	int                         period;  /**< 1 for still lifes, the period of oscillators or SOUP_UNSTABLE */
+	unsigned long           generation;  /**< first generation of the period, maximum generations if unstable */
+	unsigned int            population;  /**< live cells of the last generation, 0 if the soup died */
+};
+
+/**
+* Soup on the CPU, boards of one soup are calculated by one thread
+*/
+struct HostSoup {
+	PackedBoard               board[2];  /**< current and next generation */
+	int                        current;  /**< board of the current generation */
+	PeriodDetector            detector;  /**< hashes of the last generations */
+	unsigned long           generation;  /**< generation of the current board */
+	int                         status;  /**< 0 while running, else the period, SOUP_UNSTABLE or SOUP_IDLE */
+};
+
+/**
+* Batch of small boards for soup searches. Every board holds a random soup
+* of its own seed, all boards are calculated together: with OpenCL by one
+* dispatch per generation over one buffer of all boards, on the CPU by all
+* cores. Each board keeps its generation and a ring of board hashes for
+* detecting still lifes and oscillators (see PeriodDetector), finished
+* soups are replaced by the next seed every SOUP_GENERATIONS_PER_STEP.
+*/
+class SoupBatch {
+private:
+	int                   boardSize[2];  /**< width and height of a board in cells */
+	int                numberOfBoards;  /**< boards calculated together */
+	cl_int                   rowWords;  /**< width of a row in uints, 2 uints per host word */
+	cl_int                 boardWords;  /**< uints per board in the device buffers */
+	unsigned char           rules[18];  /**< rules for calculating next generation (see GameOfLife::setRule) */
+	bool                        clamp;  /**< dead cells (true) or wrap around (false) outside a board */
+	float                     density;  /**< density of live cells of the soups */
+	uint64_t                 nextSeed;  /**< seed of the next soup */
+	uint64_t                  endSeed;  /**< seed after the last soup */
+	cl_int             maxGenerations;  /**< generations before a soup is unstable */
+	cl_int                  maxPeriod;  /**< longest period detected */
+	std::vector<uint64_t>       seeds;  /**< seed of the soup on each board */
+	int                   runningSoups;  /**< boards with a running soup */
+	PackedBoard               staging;  /**< starting population of one soup */
+	std::vector<cl_uint> stagingWords;  /**< starting populations written to the device */
+
+	cl_command_queue     commandQueue;  /**< CL command queue, NULL on the CPU */
+	cl_kernel               kernel[2];  /**< CL kernels calculating A->B and B->A */
+	cl_kernel             checkKernel;  /**< CL kernel detecting the periods of the boards */
+	cl_mem                  boards[2];  /**< CL buffers of all boards */
+	cl_mem                deviceRules;  /**< CL buffer of the rules */
+	cl_mem                       sums;  /**< CL buffer of hash (2 uints) and population per board */
+	cl_mem                    history;  /**< CL buffer of the last maxPeriod hashes per board */
+	cl_mem                     states;  /**< CL buffer of generation, status, period generation and population per board */
+	std::vector<cl_int>    hostStates;  /**< copy of states on the host */
+	size_t           globalThreads[2];  /**< CL work items of the generation and the check kernel */
+
+	std::vector<HostSoup *>     soups;  /**< soups on the CPU */
+	ThreadPool                   pool;  /**< threads calculating the soups on the CPU */
+	unsigned int      numberOfThreads;  /**< requested number of threads, 0 for all cores */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables, no boards
+	*/
+	SoupBatch():
+			numberOfBoards(0),
+			rowWords(0),
+			boardWords(0),
+			clamp(false),
+			density(0.5f),
+			nextSeed(1),
+			endSeed(1),
+			maxGenerations(10000),
+			maxPeriod(16),
+			runningSoups(0),
+			commandQueue(NULL),
+			checkKernel(NULL),
+			deviceRules(NULL),
+			sums(NULL),
+			history(NULL),
+			states(NULL),
+			numberOfThreads(0)
+		{
+			boardSize[0] = 0;
+			boardSize[1] = 0;
+			memset(rules, 0, sizeof(rules));
+			kernel[0] = NULL;
+			kernel[1] = NULL;
+			boards[0] = NULL;
+			boards[1] = NULL;
+			globalThreads[0] = 0;
+			globalThreads[1] = 0;
+	}
+
+	/**
+	* Deconstructor.
+	* Release all boards and CL objects
+	*/
+	~SoupBatch() { release(); }
+
+	/**
+	* Set the soups to search, soup n of the search gets the seed firstSeed+n.
+	* @param firstSeed seed of the first soup
+	* @param numberOfSoups number of soups
+	* @param _density density of live cells of the soups
+	*/
+	void setSoups(uint64_t firstSeed, uint64_t numberOfSoups, float _density) {
+		nextSeed = firstSeed;
+		endSeed = firstSeed + numberOfSoups;
+		density = _density;
+	}
+
+	/**
+	* Set when a soup is finished.
+	* @param _maxGenerations generations before a soup is unstable
+	* @param _maxPeriod longest period detected
+	*/
+	void setLimits(int _maxGenerations, int _maxPeriod) {
+		maxGenerations = _maxGenerations;
+		maxPeriod = _maxPeriod;
+	}
+
+	/**
+	* Set the number of threads on the CPU.
+	* @param _numberOfThreads number of threads, 0 for all cores
+	*/
+	void setNumberOfThreads(unsigned int _numberOfThreads) {
+		numberOfThreads = _numberOfThreads;
+	}
+
+	/**
+	* Allocate the boards and spawn the first soups.
+	* @param width width of a board
+	* @param height height of a board
+	* @param _numberOfBoards boards calculated together
+	* @param _rules rules for calculating next generation (see GameOfLife::setRule)
+	* @param _clamp true: dead cells outside a board, false: wrap around
+	* @param context CL context, NULL for calculating the soups on the CPU
+	* @param device CL device of the context
+	* @param program CL program of kernels.cl built for the device
+	* @return 0 on success and -1 on failure
+	*/
+	int setup(int width, int height, int _numberOfBoards, const unsigned char *_rules, bool _clamp,
+			cl_context context, cl_device_id device, cl_program program);
+
+	/**
+	* Release all boards and CL objects.
+	*/
+	void release();
+
+	/**
+	* Calculate SOUP_GENERATIONS_PER_STEP generations of all running soups
+	* and replace the finished soups by the next seeds.
+	* @param results finished soups are appended
+	* @return 0 on success and -1 on failure
+	*/
+	int step(std::vector<SoupResult> &results);
+
+	/**
+	* Get whether all soups are finished.
+	* @return true if no soup is running and all seeds are used
+	*/
+	bool isFinished() const {
+		return runningSoups == 0 && nextSeed == endSeed;
+	}
+
+	/**
+	* Get the number of threads on the CPU.
+	* @return number of threads
+	*/
+	unsigned int getNumberOfThreads() {
+		pool.start(numberOfThreads);
+		return pool.getNumberOfThreads();
+	}
+
+	/**
+	* Spawn the random soup of a seed, the cells only depend on
+	* the seed and the density.
+	* @param board packed board
+	* @param seed seed of the soup
+	* @param density density of live cells
+	*/
+	static void spawnSoup(PackedBoard &board, uint64_t seed, float density);
+
+private:
+	/**
+	* Step of the soups on the device.
+	*/
+	int stepDevice(std::vector<SoupResult> &results);
+
+	/**
+	* Step of the soups on the CPU.
+	*/
+	int stepHost(std::vector<SoupResult> &results);
+
+	// Disable copy constructor
+	SoupBatch(const SoupBatch&);
+
+	// Disable operator=
+	SoupBatch& operator=(const SoupBatch&);
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+class ThreadPool {
+private:
+	std::vector<std::thread>       workers;  /**< worker threads waiting for tasks */
+	std::mutex                       mutex;  /**< lock for the state of the current batch */
+	std::condition_variable         wakeUp;  /**< signals a new batch or stop to the workers */
+	std::condition_variable           done;  /**< signals finished tasks and idle workers */
+	std::function<void(int)>          task;  /**< task of the current batch, called with task index */
+	int                      numberOfTasks;  /**< number of tasks of the current batch */
+	std::atomic<int>              nextTask;  /**< index of the next task to be taken */
+	int                      finishedTasks;  /**< number of finished tasks of the current batch */
+	int                      activeWorkers;  /**< number of workers working on a batch */
+	unsigned long                    batch;  /**< counter of started batches */
+	bool                              stop;  /**< switch for stopping the workers */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables, threads are started on first use
+	*/
+	ThreadPool():
+			numberOfTasks(0),
+			nextTask(0),
+			finishedTasks(0),
+			activeWorkers(0),
+			batch(0),
+			stop(false)
+		{}
+
+	/**
+	* Deconstructor.
+	* Stop and join all worker threads
+	*/
+	~ThreadPool();
+
+	/**
+	* Start the worker threads.
+	* @param numberOfThreads total number of threads including the calling thread,
+	*        0 uses all hardware threads
+	*/
+	void start(unsigned int numberOfThreads = 0);
+
+	/**
+	* Run a batch of tasks and wait until all of them are finished.
+	* The calling thread works on the tasks as well.
+	* @param _numberOfTasks number of tasks
+	* @param _task task, called once for each index in [0,_numberOfTasks)
+	*/
+	void run(int _numberOfTasks, const std::function<void(int)> &_task);
+
+	/**
+	* Get number of threads working on a batch.
+	* @return number of worker threads plus the calling thread
+	*/
+	unsigned int getNumberOfThreads() {
+		return workers.size() + 1;
+	}
+
+private:
+	/**
+	* Take and execute tasks of the current batch until none is left.
+	*/
+	void work();
+
+	/**
+	* Main loop of a worker thread.
+	*/
+	void workerLoop();
+
+	// Disable copy constructor
+	ThreadPool(const ThreadPool&);
+
+	// Disable operator=
+	ThreadPool& operator=(const ThreadPool&);
+};
+
+#endif
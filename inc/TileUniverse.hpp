@@ -0,0 +1,189 @@
+#ifndef TILEUNIVERSE_HPP_
+#define TILEUNIVERSE_HPP_
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>					/* for uint64_t and int64_t */
+
+#include "../inc/PackedBoard.hpp"	/* for rasterising into packed boards */
+
+/**
+* Tiles are squares of 64 cells, one 64 bit word per row
+*/
+#define UNIVERSE_TILE_SIZE 64
+
+/**
+* Tile of the unbounded universe, bit x of row y is cell x,y of the tile
+*/
+struct UniverseTile {
+	uint64_t cells[2][UNIVERSE_TILE_SIZE];  /**< current and next generation */
+	UniverseTile           *neighbours[8];  /**< NW, N, NE, W, E, SW, S, SE tiles, NULL for empty space */
+	int64_t                        tile[2];  /**< tile coordinates */
+	uint64_t                    population;  /**< number of live cells of the next generation */
+};
+
+class TileUniverse {
+private:
+	std::unordered_map<uint64_t, UniverseTile *> tiles;  /**< allocated tiles by coordinates */
+	std::vector<UniverseTile *>           tileList;  /**< tiles calculated in the current generation */
+	std::vector<UniverseTile *>          freeTiles;  /**< freed tiles for reuse */
+	int                                    current;  /**< index of the current generation in the cells of a tile */
+
+public:
+	/**
+	* Constructor.
+	* Initialize member variables, the universe is empty
+	*/
+	TileUniverse():
+			current(0)
+		{}
+
+	/**
+	* Deconstructor.
+	* Free all tiles
+	*/
+	~TileUniverse();
+
+	/**
+	* Kill all cells and free all tiles.
+	*/
+	void clear();
+
+	/**
+	* Replace the universe by a RGBA image, all cells outside are dead.
+	* @param image RGBA image
+	* @param width width of the image
+	* @param height height of the image
+	* @param x universe x coordinate of the left column of the image
+	* @param y universe y coordinate of the top row of the image
+	*/
+	void load(const unsigned char *image, int width, int height, int64_t x, int64_t y);
+
+	/**
+	* Replace the universe by the live cells of a packed board, all cells outside are dead.
+	* @param board packed board
+	* @param x universe x coordinate of the left column of the board
+	* @param y universe y coordinate of the top row of the board
+	*/
+	void load(const PackedBoard &board, int64_t x, int64_t y);
+
+	/**
+	* Set a run of cells of a row alive, e.g. decoded from a pattern file.
+	* @param x universe x coordinate of the first cell
+	* @param y universe y coordinate of the row
+	* @param length number of cells
+	*/
+	void setRun(int64_t x, int64_t y, int length);
+
+	/**
+	* Call setTile(x, y, rows) for all tiles, e.g. to load them into HashLife.
+	* @param setTile function object, x,y are the tile coordinates and
+	*        rows the UNIVERSE_TILE_SIZE rows of the current generation
+	*/
+	template <class SetTile>
+	void forEachTile(SetTile &setTile) const {
+		for (std::unordered_map<uint64_t, UniverseTile *>::const_iterator it = tiles.begin(); it != tiles.end(); ++it)
+			setTile(it->second->tile[0], it->second->tile[1], (const uint64_t *)it->second->cells[current]);
+	}
+
+	/**
+	* Rasterise the universe cells [0,width)x[0,height) into a RGBA image.
+	* @param image RGBA image
+	* @param width width of the image
+	* @param height height of the image
+	*/
+	void rasterise(unsigned char *image, int width, int height) const;
+
+	/**
+	* Rasterise the universe cells of a packed board.
+	* @param board packed board
+	*/
+	void rasterise(PackedBoard &board) const;
+
+	/**
+	* Prepare the next generation: allocate the empty tiles next to live cells
+	* at tile borders and link the neighbours of all tiles.
+	*/
+	void prepare();
+
+	/**
+	* Get number of tiles of the current generation, valid after prepare().
+	* @return number of tiles
+	*/
+	size_t getNumberOfTiles() const {
+		return tileList.size();
+	}
+
+	/**
+	* Get number of allocated tiles with live cells.
+	* @return number of tiles
+	*/
+	size_t getNumberOfLiveTiles() const {
+		return tiles.size();
+	}
+
+	/**
+	* Calculate the next generation of the tiles [begin,end) of the current generation.
+	* Different ranges can be calculated in parallel.
+	* @param rules rules for calculating next generation (see GameOfLife::setRule)
+	* @param begin first tile
+	* @param end tile after the last tile
+	*/
+	void nextGenerationTiles(const unsigned char *rules, size_t begin, size_t end);
+
+	/**
+	* Make the next generation the current one and free the tiles without live cells.
+	*/
+	void finish();
+
+	/**
+	* Get number of live cells in the universe.
+	* @return population
+	*/
+	uint64_t getPopulation() const;
+
+	/**
+	* Get memory used for tiles.
+	* @return size of all allocated tiles in bytes
+	*/
+	size_t getSizeBytes() const {
+		return (tiles.size() + freeTiles.size()) * sizeof(UniverseTile);
+	}
+
+private:
+	/**
+	* Get the tile at tile coordinates, allocate an empty tile if there is none.
+	*/
+	UniverseTile * getTile(int64_t x, int64_t y);
+
+	/**
+	* Key of tile coordinates for the map of tiles.
+	*/
+	static inline uint64_t key(int64_t x, int64_t y) {
+		return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+	}
+
+	/**
+	* Find a tile, NULL if there is none.
+	*/
+	UniverseTile * findTile(int64_t x, int64_t y) const {
+		std::unordered_map<uint64_t, UniverseTile *>::const_iterator it = tiles.find(key(x, y));
+		return (it == tiles.end()) ? NULL : it->second;
+	}
+
+	/**
+	* Call setCell(x, y) for all live cells inside [0,width)x[0,height).
+	*/
+	template <class SetCell>
+	void forEachCell(int width, int height, SetCell &setCell) const;
+
+	// Disable copy constructor
+	TileUniverse(const TileUniverse&);
+
+	// Disable operator=
+	TileUniverse& operator=(const TileUniverse&);
+};
+
+#endif
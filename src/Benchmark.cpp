@@ -0,0 +1,351 @@
+/**
+ * Name:        gol_bench
+ * Description: Benchmark of the Game of Life engines over the pattern corpus
+ *              and random boards. Writes median, p99 and cells/sec per case
+ *              as JSON or CSV, so results can be compared between versions.
+ */
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>				/* for command line parsing */
+#include <dirent.h>				/* for walking the pattern corpus */
+#include <sys/stat.h>			/* for stat() */
+#include <sys/time.h>			/* for gettimeofday() */
+#include <stdint.h>				/* for uint64_t */
+
+#include "../inc/GameOfLife.hpp"
+
+using namespace std;
+
+/**
+* Density of live cells for random boards
+*/
+#define BENCH_RANDOM_DENSITY 0.3f
+
+/**
+* Seed for random boards, every run and engine gets the same board
+*/
+#define BENCH_SEED 1
+
+/**
+* Calls before the measurement, e.g. for filling caches and device queues
+*/
+#define BENCH_WARMUP_CALLS 2
+
+/**
+* One benchmark case and its result
+*/
+struct BenchCase {
+	string                 pattern;  /**< pattern file, empty for a random board */
+	int                    size[2];  /**< width and height of board */
+	string                  engine;  /**< "cpu", "opencl" or "coexec" */
+	int                      clamp;  /**< clamp mode (1) or wrap mode (0) */
+	string               tpbx, tpby;  /**< work-items per work-group, empty for CPU */
+	uint64_t                  seed;  /**< seed of a random board */
+	string                  status;  /**< "ok" or reason for skipping */
+	unsigned long      generations;  /**< number of measured generations */
+	vector<float>          samples;  /**< execution time of one generation per call in ms */
+	double             wallSeconds;  /**< wall clock time of the measured generations */
+};
+
+/* Current time in seconds */
+static double getSeconds() {
+	timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + now.tv_usec * 1.0e-6;
+}
+
+/* Split a comma separated list */
+static vector<string> splitList(const char *list) {
+	vector<string> items;
+	string item;
+	for (const char *c = list; ; c++) {
+		if (*c == ',' || *c == '\0') {
+			if (!item.empty()) items.push_back(item);
+			item.clear();
+			if (*c == '\0') break;
+		} else {
+			item.push_back(*c);
+		}
+	}
+	return items;
+}
+
+/* Collect all RLE files below a directory, sorted for reproducible output */
+static void findPatterns(const string &directory, vector<string> &patterns) {
+	DIR *dir = opendir(directory.c_str());
+	if (dir == NULL) return;
+
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.') continue;
+		string path = directory + "/" + entry->d_name;
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0) continue;
+		if (S_ISDIR(info.st_mode)) {
+			findPatterns(path, patterns);
+		} else if (path.size() > 4 && path.compare(path.size()-4, 4, ".rle") == 0) {
+			patterns.push_back(path);
+		}
+	}
+	closedir(dir);
+	sort(patterns.begin(), patterns.end());
+}
+
+/* Sample at a quantile of sorted samples (nearest rank) */
+static float quantile(const vector<float> &sorted, float q) {
+	if (sorted.empty()) return 0.0f;
+	size_t rank = (size_t)ceil(q * sorted.size());
+	return sorted[max((size_t)1, min(rank, sorted.size())) - 1];
+}
+
+/* Run one case, results are stored in the case */
+static void runCase(BenchCase &bench, unsigned long generations) {
+	GameOfLife *game = new GameOfLife();
+
+	if (bench.pattern.empty()) {
+		game->setPopulation(BENCH_RANDOM_DENSITY);
+		game->setSeed(bench.seed);
+	} else {
+		vector<char> fileName(bench.pattern.begin(), bench.pattern.end());
+		fileName.push_back('\0');
+		game->setFilename(&fileName[0]);
+	}
+	char defaultRule[] = "23/3";
+	game->setRule(defaultRule);
+	game->setKernelBuildOptions(bench.clamp, bench.tpbx, bench.tpby);
+	game->setSize(bench.size[0], bench.size[1]);
+	if (bench.engine == "cpu") game->switchCPUMode();
+	if (bench.engine == "coexec") game->setCoExecution(true);
+
+	if (game->setup() != 0) {
+		/* e.g. the pattern is bigger than the board */
+		bench.status = "setup failed";
+		delete game;
+		return;
+	}
+
+	/* Only the engine is measured, no frames are produced */
+	for (int i = 0; i < BENCH_WARMUP_CALLS; i++)
+		game->nextGeneration(NULL);
+	game->finishGenerations();
+
+	uint64_t first = game->getGenerations();
+	double start = getSeconds();
+	while (game->getGenerations() - first < generations) {
+		if (game->nextGeneration(NULL) != 0) break;
+		bench.samples.push_back(game->getExecutionTime());
+	}
+	game->finishGenerations();
+	bench.wallSeconds = getSeconds() - start;
+	bench.generations = game->getGenerations() - first;
+	bench.status = (bench.generations >= generations) ? "ok" : "generation failed";
+
+	delete game;
+}
+
+/* Escape a string for JSON output */
+static string quote(const string &text) {
+	string quoted("\"");
+	for (size_t i = 0; i < text.size(); i++) {
+		if (text[i] == '"' || text[i] == '\\') quoted.push_back('\\');
+		quoted.push_back(text[i]);
+	}
+	quoted.push_back('"');
+	return quoted;
+}
+
+/* Quote a field for CSV output (RFC 4180), quotes are doubled */
+static string quoteCSV(const string &text) {
+	string quoted("\"");
+	for (size_t i = 0; i < text.size(); i++) {
+		if (text[i] == '"') quoted.push_back('"');
+		quoted.push_back(text[i]);
+	}
+	quoted.push_back('"');
+	return quoted;
+}
+
+/* Write the results of all cases */
+static void writeResults(FILE *out, const vector<BenchCase> &cases, bool json) {
+	if (json) fprintf(out, "[\n");
+	else fprintf(out, "pattern,seed,width,height,engine,clamp,tpbx,tpby,status,"
+					  "generations,samples,median_ms,p99_ms,mean_ms,cells_per_sec,wall_cells_per_sec\n");
+
+	for (size_t i = 0; i < cases.size(); i++) {
+		const BenchCase &bench = cases[i];
+		vector<float> sorted(bench.samples);
+		sort(sorted.begin(), sorted.end());
+		float median = quantile(sorted, 0.5f);
+		float p99 = quantile(sorted, 0.99f);
+		double sum = 0.0;
+		for (size_t k = 0; k < sorted.size(); k++) sum += sorted[k];
+		double mean = sorted.empty() ? 0.0 : sum / sorted.size();
+		double cells = (double)bench.size[0] * bench.size[1];
+		double cellsPerSec = (median > 0.0f) ? cells * 1000.0 / median : 0.0;
+		double wallCellsPerSec = (bench.wallSeconds > 0.0) ? cells * bench.generations / bench.wallSeconds : 0.0;
+		string pattern = bench.pattern.empty() ? string("random") : bench.pattern;
+		/* Only random boards have a seed */
+		char seed[24] = "";
+		if (bench.pattern.empty())
+			snprintf(seed, sizeof(seed), "%llu", (unsigned long long)bench.seed);
+
+		if (json) {
+			fprintf(out, "  {\"pattern\": %s, \"seed\": %s, \"width\": %i, \"height\": %i, \"engine\": \"%s\", "
+						 "\"clamp\": %s, \"tpbx\": %s, \"tpby\": %s, \"status\": %s, "
+						 "\"generations\": %lu, \"samples\": %lu, \"median_ms\": %g, \"p99_ms\": %g, "
+						 "\"mean_ms\": %g, \"cells_per_sec\": %g, \"wall_cells_per_sec\": %g}%s\n",
+					quote(pattern).c_str(), seed[0] ? seed : "null", bench.size[0], bench.size[1],
+					bench.engine.c_str(), bench.clamp ? "true" : "false",
+					bench.tpbx.empty() ? "null" : bench.tpbx.c_str(),
+					bench.tpby.empty() ? "null" : bench.tpby.c_str(),
+					quote(bench.status).c_str(), bench.generations, (unsigned long)sorted.size(),
+					median, p99, mean, cellsPerSec, wallCellsPerSec,
+					(i+1 < cases.size()) ? "," : "");
+		} else {
+			fprintf(out, "%s,%s,%i,%i,%s,%i,%s,%s,%s,%lu,%lu,%g,%g,%g,%g,%g\n",
+					quoteCSV(pattern).c_str(), seed, bench.size[0], bench.size[1],
+					bench.engine.c_str(), bench.clamp,
+					bench.tpbx.c_str(), bench.tpby.c_str(), quoteCSV(bench.status).c_str(),
+					bench.generations, (unsigned long)sorted.size(),
+					median, p99, mean, cellsPerSec, wallCellsPerSec);
+		}
+	}
+	if (json) fprintf(out, "]\n");
+}
+
+/* Print command line help */
+static void showHelp() {
+	printf( "\n" );
+	printf( "Usage: gol_bench [OPTIONS]\n");
+	printf( "\n" );
+	printf( "---- Options ----\n" );
+	printf( " -h            Prints this help\n");
+	printf( " -d DIR        pattern corpus, all RLE files below DIR\n");
+	printf( "               default: patterns\n");
+	printf( " -s SIZES      comma separated board sizes (square boards)\n");
+	printf( "               default: 512,2048\n");
+	printf( " -n NUMBER     generations per case\n");
+	printf( "               default: 1000\n");
+	printf( " -x LIST       comma separated work-items per work-group for x\n");
+	printf( "               default: 8,16,32\n");
+	printf( " -y LIST       comma separated work-items per work-group for y\n");
+	printf( "               default: 4,8,12\n");
+	printf( " -e ENGINES    comma separated list of cpu, opencl and coexec\n");
+	printf( "               default: cpu,opencl\n");
+	printf( " -S NUMBER     seed of the random boards\n");
+	printf( "               default: %i\n", BENCH_SEED);
+	printf( " -f FORMAT     json or csv\n");
+	printf( "               default: json\n");
+	printf( " -o FILE       output file\n");
+	printf( "               default: standard output\n");
+	printf( "\n" );
+}
+
+int main(int argc, char **argv) {
+	string directory("patterns");
+	vector<string> sizes = splitList("512,2048");
+	vector<string> tpbx = splitList("8,16,32");
+	vector<string> tpby = splitList("4,8,12");
+	vector<string> engines = splitList("cpu,opencl");
+	unsigned long generations = 1000;
+	uint64_t seed = BENCH_SEED;
+	bool json = true;
+	const char *outputFile = NULL;
+
+	int optionChar;
+	while ((optionChar = getopt(argc, argv, ":hd:s:n:x:y:e:S:f:o:")) != -1) {
+		switch (optionChar) {
+		case 'd': directory = optarg; break;
+		case 's': sizes = splitList(optarg); break;
+		case 'n':
+			if (atol(optarg) <= 0) {
+				fprintf(stderr,"\nError in number of generations\n");
+				return -1;
+			}
+			generations = atol(optarg);
+			break;
+		case 'x': tpbx = splitList(optarg); break;
+		case 'y': tpby = splitList(optarg); break;
+		case 'e': engines = splitList(optarg); break;
+		case 'S': seed = strtoull(optarg, NULL, 10); break;
+		case 'f':
+			if (strcmp(optarg, "json") != 0 && strcmp(optarg, "csv") != 0) {
+				fprintf(stderr,"\nError in output format\n");
+				return -1;
+			}
+			json = strcmp(optarg, "json") == 0;
+			break;
+		case 'o': outputFile = optarg; break;
+		case 'h': showHelp(); return 0;
+		case ':':
+			fprintf(stderr,"\nOption -%c requires an operand\n", optopt);
+			showHelp();
+			return -1;
+		case '?':
+			fprintf(stderr,"\nUnrecognized option: -%c\n", optopt);
+			showHelp();
+			return -1;
+		}
+	}
+
+	/* Random boards first, then the corpus */
+	vector<string> patterns(1, string(""));
+	findPatterns(directory, patterns);
+
+	/* Cross product of patterns, sizes, engines, clamp/wrap and work-group sizes */
+	vector<BenchCase> cases;
+	for (size_t p = 0; p < patterns.size(); p++) {
+		for (size_t s = 0; s < sizes.size(); s++) {
+			for (size_t e = 0; e < engines.size(); e++) {
+				for (int clamp = 0; clamp <= 1; clamp++) {
+					bool cpu = engines[e] == "cpu";
+					if (!cpu && engines[e] != "opencl" && engines[e] != "coexec") continue;
+					for (size_t x = 0; x < (cpu ? 1 : tpbx.size()); x++) {
+						for (size_t y = 0; y < (cpu ? 1 : tpby.size()); y++) {
+							BenchCase bench;
+							bench.pattern = patterns[p];
+							bench.size[0] = atoi(sizes[s].c_str());
+							bench.size[1] = bench.size[0];
+							bench.engine = engines[e];
+							bench.seed = seed;
+							bench.clamp = clamp;
+							if (!cpu) {
+								bench.tpbx = tpbx[x];
+								bench.tpby = tpby[y];
+							}
+							bench.generations = 0;
+							bench.wallSeconds = 0.0;
+							cases.push_back(bench);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < cases.size(); i++) {
+		fprintf(stderr, "[%lu/%lu] %s %ix%i %s %s %s %s\n",
+				(unsigned long)(i+1), (unsigned long)cases.size(),
+				cases[i].pattern.empty() ? "random" : cases[i].pattern.c_str(),
+				cases[i].size[0], cases[i].size[1],
+				cases[i].engine.c_str(), cases[i].clamp ? "clamp" : "wrap",
+				cases[i].tpbx.c_str(), cases[i].tpby.c_str());
+		runCase(cases[i], generations);
+	}
+
+	FILE *out = (outputFile == NULL) ? stdout : fopen(outputFile, "w");
+	if (out == NULL) {
+		fprintf(stderr, "\nCannot open output file %s\n", outputFile);
+		return -1;
+	}
+	writeResults(out, cases, json);
+	if (out != stdout) fclose(out);
+
+	return 0;
+}
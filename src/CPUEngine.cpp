@@ -0,0 +1,202 @@
+#include "../inc/CPUEngine.hpp"
+#include <algorithm>
+#include <atomic>
+
+void CPUEngine::runBands(int rowBegin, int rowEnd, const std::function<void(int, int)> &band) {
+	const int height = rowEnd - rowBegin;
+	if (height <= 0) return;
+	pool.start(numberOfThreads);
+	int bands = std::min(height, (int)(pool.getNumberOfThreads()*CPU_BANDS_PER_THREAD));
+	pool.run(bands, [&](int i) {
+		band(rowBegin + (int)((long)height*i/bands), rowBegin + (int)((long)height*(i+1)/bands));
+	});
+}
+
+void CPUEngine::nextGeneration(const unsigned char *src, unsigned char *dst,
+		int width, int height, const unsigned char *rules, bool clamp) {
+	runBands(0, height, [&](int rowBegin, int rowEnd) {
+		std::vector<unsigned char> columnSums;
+		nextGenerationBand(src, dst, width, height, rules, clamp,
+				rowBegin, rowEnd, columnSums);
+	});
+}
+
+void CPUEngine::nextGeneration(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp) {
+	if (sparse) {
+		nextGenerationSparse(src, dst, rules, clamp);
+		return;
+	}
+	nextGenerationRows(src, dst, rules, clamp, 0, src.getHeight());
+}
+
+void CPUEngine::nextGenerationRows(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd) {
+	runBands(rowBegin, rowEnd, [&](int bandBegin, int bandEnd) {
+		nextGenerationPackedSIMD(simdLevel, src, dst, rules, clamp, bandBegin, bandEnd);
+	});
+}
+
+void CPUEngine::nextGeneration(TileUniverse &universe, const unsigned char *rules) {
+	universe.prepare();
+	const size_t numberOfTiles = universe.getNumberOfTiles();
+	if (numberOfTiles != 0) {
+		pool.start(numberOfThreads);
+		const int tasks = (int)std::min(numberOfTiles, (size_t)pool.getNumberOfThreads()*CPU_BANDS_PER_THREAD);
+		pool.run(tasks, [&](int task) {
+			universe.nextGenerationTiles(rules, numberOfTiles*task/tasks, numberOfTiles*(task+1)/tasks);
+		});
+	}
+	universe.finish();
+}
+
+uint64_t CPUEngine::getHash(const PackedBoard &board) {
+	std::atomic<uint64_t> hash(0);
+	runBands(0, board.getHeight(), [&](int bandBegin, int bandEnd) {
+		hash ^= board.getHash(bandBegin, bandEnd);
+	});
+	return hash;
+}
+
+void CPUEngine::spawnRandom(PackedBoard &board, float density, uint64_t seed) {
+	const uint64_t threshold = getRandomThreshold(density);
+	const int wordsPerRow = board.getWordsPerRow();
+	runBands(0, board.getHeight(), [&](int bandBegin, int bandEnd) {
+		for (int y = bandBegin; y < bandEnd; y++) {
+			/* Live cells are state 1 in the first plane */
+			for (int p = 1; p < board.getPlanes(); p++)
+				memset(board.getRow(y, p), 0, wordsPerRow*sizeof(uint64_t));
+			uint64_t *row = board.getRow(y);
+			for (int w = 0; w < wordsPerRow; w++) {
+				uint64_t bits = 0;
+				for (int i = 0; i < CELLS_PER_WORD/4; i++)
+					bits |= (uint64_t)getRandomCells(seed, threshold, w*CELLS_PER_WORD/4 + i, y) << 4*i;
+				row[w] = (w == wordsPerRow-1) ? bits & board.getLastWordMask() : bits;
+			}
+		}
+	});
+}
+
+void CPUEngine::spawnRandom(unsigned char *image, int width, int height, float density, uint64_t seed) {
+	const uint64_t threshold = getRandomThreshold(density);
+	runBands(0, height, [&](int bandBegin, int bandEnd) {
+		for (int y = bandBegin; y < bandEnd; y++) {
+			unsigned char *row = &image[(size_t)4*width*y];
+			for (int x = 0; x < width; x += 4) {
+				unsigned int cells = getRandomCells(seed, threshold, x/4, y);
+				for (int i = 0; i < 4 && x+i < width; i++) {
+					unsigned char state = ((cells >> i) & 1) ? 255 : 0;
+					row[4*(x+i)] = state;
+					row[4*(x+i)+1] = state;
+					row[4*(x+i)+2] = state;
+					row[4*(x+i)+3] = 1;
+				}
+			}
+		}
+	});
+}
+
+void CPUEngine::nextGenerationSparse(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp) {
+	const int tilesX = (src.getWordsPerRow() + SPARSE_TILE_WORDS - 1) / SPARSE_TILE_WORDS;
+	const int tilesY = (src.getHeight() + SPARSE_TILE_ROWS - 1) / SPARSE_TILE_ROWS;
+	const int numberOfTiles = tilesX * tilesY;
+
+	/* Without changes from the last generation all tiles are calculated */
+	if (tilesX != tileCount[0] || tilesY != tileCount[1] || (int)tileChanged.size() != numberOfTiles) {
+		tileCount[0] = tilesX;
+		tileCount[1] = tilesY;
+		tileChanged.assign(numberOfTiles, 1);
+	}
+
+	/* Work queue of tiles which changed themselves or next to a changed tile */
+	activeTiles.clear();
+	for (int ty = 0; ty < tilesY; ty++) {
+		for (int tx = 0; tx < tilesX; tx++) {
+			bool active = false;
+			for (int i = -1; i <= 1 && !active; i++) {
+				for (int k = -1; k <= 1 && !active; k++) {
+					int nx = tx + k, ny = ty + i;
+					if (clamp && (nx < 0 || ny < 0 || nx >= tilesX || ny >= tilesY)) continue;
+					nx = (nx + tilesX) % tilesX;
+					ny = (ny + tilesY) % tilesY;
+					active = tileChanged[ny*tilesX + nx] != 0;
+				}
+			}
+			if (active) activeTiles.push_back(ty*tilesX + tx);
+		}
+	}
+
+	/* Stable tiles keep the cells of dst, they equal the cells of src */
+	nextTileChanged.assign(numberOfTiles, 0);
+	if (!activeTiles.empty()) {
+		pool.start(numberOfThreads);
+		const int numberOfActive = activeTiles.size();
+		const int tasks = std::min(numberOfActive, (int)(pool.getNumberOfThreads()*CPU_BANDS_PER_THREAD));
+		pool.run(tasks, [&](int task) {
+			for (int i = (long)numberOfActive*task/tasks; i < (long)numberOfActive*(task+1)/tasks; i++) {
+				const int tile = activeTiles[i];
+				const int tx = tile % tilesX, ty = tile / tilesX;
+				nextTileChanged[tile] = nextGenerationPackedTile(src, dst, rules, clamp,
+						ty*SPARSE_TILE_ROWS, std::min((ty+1)*SPARSE_TILE_ROWS, src.getHeight()),
+						tx*SPARSE_TILE_WORDS, std::min((tx+1)*SPARSE_TILE_WORDS, src.getWordsPerRow()));
+			}
+		});
+	}
+	tileChanged.swap(nextTileChanged);
+}
+
+void CPUEngine::nextGenerationBand(const unsigned char *src, unsigned char *dst,
+		int width, int height, const unsigned char *rules, bool clamp,
+		int rowBegin, int rowEnd, std::vector<unsigned char> &columnSums) {
+
+	/* Row of the board for a row index, NULL for dead rows outside the board */
+	auto row = [&](int y) -> const unsigned char * {
+		if (y < 0) y = clamp ? -1 : y + height;
+		else if (y >= height) y = clamp ? -1 : y - height;
+		return (y < 0) ? NULL : &src[4*width*y];
+	};
+	/* State (0 or 1) of a cell of a row, dead outside the board */
+	auto cell = [&](const unsigned char *r, int x) -> int {
+		if (x < 0) x = clamp ? -1 : x + width;
+		else if (x >= width) x = clamp ? -1 : x - width;
+		return (r == NULL || x < 0) ? 0 : (r[4*x] >> 7);
+	};
+
+	/* Walk the band tile by tile, each tile row-major */
+	for (int x0 = 0; x0 < width; x0 += CPU_TILE_WIDTH) {
+		const int tileWidth = std::min(CPU_TILE_WIDTH, width - x0);
+		/* columnSums[c] is the sum of three rows for column x0-1+c */
+		columnSums.resize(tileWidth + 2);
+
+		const unsigned char *north = row(rowBegin-1);
+		const unsigned char *center = row(rowBegin);
+		const unsigned char *south = row(rowBegin+1);
+		for (int c = 0; c < tileWidth + 2; c++) {
+			columnSums[c] = cell(north, x0-1+c) + cell(center, x0-1+c) + cell(south, x0-1+c);
+		}
+
+		for (int y = rowBegin; y < rowEnd; y++) {
+			if (y > rowBegin) {
+				/* Roll the sums down by one row */
+				const unsigned char *leaving = row(y-2);
+				const unsigned char *entering = row(y+1);
+				for (int c = 0; c < tileWidth + 2; c++) {
+					columnSums[c] += cell(entering, x0-1+c) - cell(leaving, x0-1+c);
+				}
+				center = row(y);
+			}
+
+			unsigned char *out = &dst[4*width*y];
+			for (int x = 0; x < tileWidth; x++) {
+				int alive = center[4*(x0+x)] >> 7;
+				int numberOfNeighbours = columnSums[x] + columnSums[x+1] + columnSums[x+2] - alive;
+				unsigned char state = rules[numberOfNeighbours + 9*alive];
+				out[4*(x0+x)] = state;
+				out[4*(x0+x)+1] = state;
+				out[4*(x0+x)+2] = state;
+				out[4*(x0+x)+3] = 1;
+			}
+		}
+	}
+}
@@ -0,0 +1,261 @@
+#include "../inc/Checkpoint.hpp"
+#include <algorithm>				/* for min() */
+#ifndef WIN32
+	#include <fcntl.h>				/* for open() */
+	#include <unistd.h>				/* for close() and fsync() */
+	#include <sys/mman.h>			/* for mmap() */
+	#include <sys/stat.h>			/* for fstat() */
+#endif
+using namespace std;
+
+static const char checkpointMagic[8] = {'G', 'O', 'L', 'C', 'K', 'P', 'T', '\0'};
+
+/**
+* 64 bit FNV-1a like hash of words, one multiplication per word
+*/
+static uint64_t hashWords(const uint64_t *words, size_t count) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < count; i++) {
+		hash ^= words[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+const char * getCheckpointEngineName(uint32_t engine) {
+	switch (engine) {
+	case CHECKPOINT_OPENCL: return "OpenCL";
+	case CHECKPOINT_CPU: return "CPU";
+	case CHECKPOINT_HASHLIFE: return "HashLife";
+	default: return "unknown";
+	}
+}
+
+int Checkpoint::open(const char *fileName) {
+	close();
+
+	/* Map the whole file, read it into the buffer if that fails */
+	#ifndef WIN32
+		int fd = ::open(fileName, O_RDONLY);
+		if (fd < 0) return -2;
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map != MAP_FAILED) {
+				mapping = map;
+				data = (const char *)map;
+				dataSize = info.st_size;
+			}
+		}
+		::close(fd);
+	#endif
+	if (mapping == NULL) {
+		FILE *file = fopen(fileName, "rb");
+		if (file == NULL) return -2;
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		if (size > 0) {
+			/* Words keep the payload aligned */
+			buffer.resize((size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+			dataSize = fread(&buffer[0], 1, size, file);
+			data = (const char *)&buffer[0];
+		}
+		fclose(file);
+	}
+
+	/* Check the header */
+	if (dataSize < sizeof(CheckpointHeader)) return -1;
+	memcpy(&header, data, sizeof(CheckpointHeader));
+	if (memcmp(header.magic, checkpointMagic, sizeof(checkpointMagic)) != 0
+		|| header.version != CHECKPOINT_VERSION
+		|| header.width <= 0 || header.height <= 0
+		|| header.wordsPerRow != (header.width + CELLS_PER_WORD - 1) / CELLS_PER_WORD
+		|| header.payloadBytes % sizeof(uint64_t) != 0
+		|| header.payloadBytes != dataSize - sizeof(CheckpointHeader))
+		return -1;
+
+	/* Check the payload */
+	const uint64_t *payload = (const uint64_t *)(data + sizeof(CheckpointHeader));
+	const size_t payloadWords = header.payloadBytes / sizeof(uint64_t);
+	const size_t boardWords = (size_t)header.wordsPerRow * header.height;
+	if (header.flags & CHECKPOINT_TILES) {
+		const size_t tileRows = (header.height + CHECKPOINT_TILE_ROWS - 1) / CHECKPOINT_TILE_ROWS;
+		const size_t maskWords = (tileRows * header.wordsPerRow + 63) / 64;
+		if (payloadWords < maskWords) return -1;
+		/* The tiles must match the number of words of the payload */
+		size_t tileWords = 0;
+		for (size_t t = 0; t < tileRows * header.wordsPerRow; t++) {
+			if ((payload[t / 64] >> (t % 64)) & 1) {
+				size_t row = (t / header.wordsPerRow) * CHECKPOINT_TILE_ROWS;
+				tileWords += min((size_t)CHECKPOINT_TILE_ROWS, header.height - row);
+			}
+		}
+		if (payloadWords != maskWords + tileWords) return -1;
+	} else if (payloadWords != boardWords) {
+		return -1;
+	}
+	if (hashWords(payload, payloadWords) != header.checksum) return -1;
+
+	return 0;
+}
+
+void Checkpoint::close() {
+	#ifndef WIN32
+		if (mapping != NULL) munmap(mapping, dataSize);
+	#endif
+	mapping = NULL;
+	buffer.clear();
+	data = NULL;
+	dataSize = 0;
+}
+
+int Checkpoint::read(PackedBoard &board) const {
+	if (data == NULL || board.getWidth() != header.width || board.getHeight() != header.height)
+		return -1;
+
+	const uint64_t *payload = (const uint64_t *)(data + sizeof(CheckpointHeader));
+	if (!(header.flags & CHECKPOINT_TILES)) {
+		memcpy(board.getWords(), payload, board.getSizeBytes());
+		return 0;
+	}
+
+	/* Scatter the words of the tiles with live cells, the rest is dead */
+	const int wordsPerRow = header.wordsPerRow;
+	const int tileRows = (header.height + CHECKPOINT_TILE_ROWS - 1) / CHECKPOINT_TILE_ROWS;
+	const uint64_t *mask = payload;
+	const uint64_t *tileWords = payload + ((size_t)tileRows * wordsPerRow + 63) / 64;
+	uint64_t *words = board.getWords();
+	board.clear();
+	for (size_t t = 0; t < (size_t)tileRows * wordsPerRow; t++) {
+		if (!((mask[t / 64] >> (t % 64)) & 1)) continue;
+		const int rowBegin = (int)(t / wordsPerRow) * CHECKPOINT_TILE_ROWS;
+		const int rowEnd = min(rowBegin + CHECKPOINT_TILE_ROWS, (int)header.height);
+		const int word = (int)(t % wordsPerRow);
+		for (int r = rowBegin; r < rowEnd; r++)
+			words[(size_t)r*wordsPerRow + word] = *tileWords++;
+	}
+	return 0;
+}
+
+int Checkpoint::write(const char *fileName, const PackedBoard &board, const unsigned char *rules,
+		bool clamp, uint64_t generation, uint32_t engine) {
+	const int wordsPerRow = board.getWordsPerRow();
+	const int height = board.getHeight();
+	const uint64_t *words = board.getWords();
+
+	/* Tiles with live cells */
+	const int tileRows = (height + CHECKPOINT_TILE_ROWS - 1) / CHECKPOINT_TILE_ROWS;
+	vector<uint64_t> tiles(((size_t)tileRows * wordsPerRow + 63) / 64, 0);
+	size_t tileWords = 0;
+	for (int tileRow = 0; tileRow < tileRows; tileRow++) {
+		const int rowBegin = tileRow * CHECKPOINT_TILE_ROWS;
+		const int rowEnd = min(rowBegin + CHECKPOINT_TILE_ROWS, height);
+		for (int w = 0; w < wordsPerRow; w++) {
+			uint64_t live = 0;
+			for (int r = rowBegin; r < rowEnd; r++)
+				live |= words[(size_t)r*wordsPerRow + w];
+			if (live == 0) continue;
+			size_t t = (size_t)tileRow * wordsPerRow + w;
+			tiles[t / 64] |= (uint64_t)1 << (t % 64);
+			tileWords += rowEnd - rowBegin;
+		}
+	}
+
+	/* Tiles only pay off if they are smaller than the whole board */
+	const size_t boardWords = (size_t)wordsPerRow * height;
+	const bool tiled = tiles.size() + tileWords < boardWords;
+	if (tiled) {
+		tiles.reserve(tiles.size() + tileWords);
+		for (size_t t = 0; t < (size_t)tileRows * wordsPerRow; t++) {
+			if (!((tiles[t / 64] >> (t % 64)) & 1)) continue;
+			const int rowBegin = (int)(t / wordsPerRow) * CHECKPOINT_TILE_ROWS;
+			const int rowEnd = min(rowBegin + CHECKPOINT_TILE_ROWS, height);
+			const int word = (int)(t % wordsPerRow);
+			for (int r = rowBegin; r < rowEnd; r++)
+				tiles.push_back(words[(size_t)r*wordsPerRow + word]);
+		}
+	}
+	const uint64_t *payload = tiled ? &tiles[0] : words;
+	const size_t payloadWords = tiled ? tiles.size() : boardWords;
+
+	CheckpointHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, checkpointMagic, sizeof(checkpointMagic));
+	header.version = CHECKPOINT_VERSION;
+	header.flags = (clamp ? CHECKPOINT_CLAMP : 0) | (tiled ? CHECKPOINT_TILES : 0);
+	header.width = board.getWidth();
+	header.height = height;
+	header.wordsPerRow = wordsPerRow;
+	header.engine = engine;
+	header.generation = generation;
+	memcpy(header.rules, rules, sizeof(header.rules));
+	header.payloadBytes = payloadWords * sizeof(uint64_t);
+	header.checksum = hashWords(payload, payloadWords);
+
+	/* Write next to the checkpoint and replace it when complete */
+	string tempName(fileName);
+	tempName.append(".tmp");
+	FILE *file = fopen(tempName.c_str(), "wb");
+	if (file == NULL) return -1;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+			&& fwrite(payload, sizeof(uint64_t), payloadWords, file) == payloadWords
+			&& fflush(file) == 0;
+	#ifndef WIN32
+		/* The data must be on disk before the rename replaces the last checkpoint */
+		ok = ok && fsync(fileno(file)) == 0;
+	#endif
+	ok = (fclose(file) == 0) && ok;
+	#ifdef WIN32
+		/* rename does not replace files on Windows */
+		if (ok) remove(fileName);
+	#endif
+	if (!ok || rename(tempName.c_str(), fileName) != 0) {
+		remove(tempName.c_str());
+		return -1;
+	}
+	return 0;
+}
+
+int CheckpointWriter::start(const string &_fileName, const PackedBoard &board, const unsigned char *_rules,
+		bool _clamp, uint64_t _generation, uint32_t _engine) {
+	int lastStatus = finish();
+	if (allocateSnapshot(board.getWidth(), board.getHeight()) != 0) return -1;
+	snapshot.copy(board);
+	launch(_fileName, _rules, _clamp, _generation, _engine);
+	return lastStatus;
+}
+
+int CheckpointWriter::start(const string &_fileName, const unsigned char *image, int width, int height,
+		const unsigned char *_rules, bool _clamp, uint64_t _generation, uint32_t _engine) {
+	int lastStatus = finish();
+	if (allocateSnapshot(width, height) != 0) return -1;
+	snapshot.pack(image);
+	launch(_fileName, _rules, _clamp, _generation, _engine);
+	return lastStatus;
+}
+
+int CheckpointWriter::finish() {
+	if (thread.joinable()) thread.join();
+	int lastStatus = status;
+	status = 0;
+	return lastStatus;
+}
+
+void CheckpointWriter::launch(const string &_fileName, const unsigned char *_rules,
+		bool _clamp, uint64_t _generation, uint32_t _engine) {
+	fileName = _fileName;
+	memcpy(rules, _rules, sizeof(rules));
+	clamp = _clamp;
+	generation = _generation;
+	engine = _engine;
+	thread = std::thread([this]() {
+		status = Checkpoint::write(fileName.c_str(), snapshot, rules, clamp, generation, engine);
+	});
+}
+
+int CheckpointWriter::allocateSnapshot(int width, int height) {
+	if (snapshot.getWidth() == width && snapshot.getHeight() == height && snapshot.getWords() != NULL)
+		return 0;
+	return snapshot.allocate(width, height);
+}
@@ -0,0 +1,188 @@
+#include "../inc/ComputeThread.hpp"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include "../inc/HostMemory.hpp"
+using namespace std;
+
+int ComputeThread::start(GameOfLife &_game) {
+	if (isRunning()) return -1;
+	game = &_game;
+	back = 0;
+	middle = 1;
+	front = 2;
+	published = -1;
+	failed = false;
+	delayMs = 0.0f;
+	pendingReset = false;
+	commands.clear();
+	engine = thread(&ComputeThread::run, this);
+	return 0;
+}
+
+void ComputeThread::stop() {
+	if (!isRunning()) return;
+	EngineCommand command = {COMMAND_STOP, {0, 0}, {0.0f, 0.0f, 0.0f}};
+	submit(command);
+	engine.join();
+	game = NULL;
+	for (int i = 0; i < 3; i++) {
+		freeHostMemory(frames[i].image);
+		frames[i].image = NULL;
+		frames[i].capacityBytes = 0;
+		frames[i].sizeBytes = 0;
+	}
+}
+
+void ComputeThread::submit(const EngineCommand &command) {
+	{
+		lock_guard<mutex> lock(commandLock);
+		commands.push_back(command);
+	}
+	wakeUp.notify_one();
+}
+
+const EngineFrame * ComputeThread::acquire() {
+	/* The engine sets FRAME_FRESH with each frame, the front frame never has it */
+	if ((middle.load() & FRAME_FRESH) == 0) return NULL;
+	front = middle.exchange(front) & ~FRAME_FRESH;
+	return &frames[front];
+}
+
+void ComputeThread::apply(GameOfLife &game, const EngineCommand &command) {
+	switch (command.type) {
+	case COMMAND_PAUSE: game.switchPause(); break;
+	case COMMAND_READ_SYNC: game.switchreadSync(); break;
+	case COMMAND_CPU_MODE: game.switchCPUMode(); break;
+	case COMMAND_HASHLIFE:
+		switch (game.switchHashLifeMode()) {
+		case -1: cerr << "HashLife does not support births on 0 neighbours or more than 2 states" << endl; break;
+		case -2: cerr << "HashLife does not support checkpoints" << endl; break;
+		default: break;
+		}
+		break;
+	case COMMAND_HASHLIFE_STEP:
+		game.setHashLifeStep(game.getHashLifeStep() + command.arguments[0]);
+		break;
+	case COMMAND_SINGLE_GENERATION: game.switchSingleGeneration(); break;
+	case COMMAND_VIEW:
+		game.setDisplayView(command.arguments[0], command.arguments[1],
+				command.values[0], command.values[1], command.values[2]);
+		break;
+	default: break;
+	}
+}
+
+FrameInfo ComputeThread::getInfo(GameOfLife &game) {
+	FrameInfo info;
+	info.generations = game.getGenerations();
+	info.executionTime = game.getExecutionTime();
+	info.generationsPerCopyEvent = game.getGenerationsPerCopyEvent();
+	info.period = game.getPeriod();
+	info.periodGeneration = game.getPeriodGeneration();
+	info.paused = game.isPaused();
+	info.readSync = game.isReadSync();
+	info.CPUMode = game.isCPUMode();
+	info.hashLifeMode = game.isHashLifeMode();
+	info.hashLifeStep = game.getHashLifeStep();
+	info.singleGeneration = game.isSingleGeneration();
+	info.resetPending = false;
+	info.cpuInfo = game.getCPUInfo();
+	return info;
+}
+
+void ComputeThread::run() {
+	chrono::steady_clock::time_point nextCalculation = chrono::steady_clock::now();
+	while (true) {
+		deque<EngineCommand> next;
+		{
+			unique_lock<mutex> lock(commandLock);
+			/* Paused engines wait for commands, running ones until the delay is over */
+			if (commands.empty() && game->isPaused() && !pendingReset)
+				wakeUp.wait(lock, [this] { return !commands.empty(); });
+			else if (commands.empty() && delayMs > 0.0f)
+				wakeUp.wait_until(lock, nextCalculation, [this] { return !commands.empty(); });
+			next.swap(commands);
+		}
+		
+		/* Commands of the display between two generations */
+		bool viewChanged = false;
+		for (size_t i = 0; i < next.size(); i++) {
+			switch (next[i].type) {
+			case COMMAND_STOP: return;
+			case COMMAND_VIEW:
+				apply(*game, next[i]);
+				viewChanged = true;
+				break;
+			case COMMAND_RESET: pendingReset = !pendingReset; break;
+			case COMMAND_DELAY: delayMs = next[i].values[0]; break;
+			default: apply(*game, next[i]); break;
+			}
+		}
+		
+		/* Reset only while paused like the display did */
+		if (pendingReset && game->isPaused()) {
+			size_t sizeBytes = 4*(size_t)game->getWidth()*game->getHeight();
+			if (reserve(sizeBytes) != 0 || game->resetGame(frames[back].image) != 0) break;
+			pendingReset = false;
+			publish(sizeBytes, game->getDisplayRegion());
+			continue;
+		}
+		
+		/* Commands change the state shown by the display without a new generation */
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (game->isPaused() || (delayMs > 0.0f && now < nextCalculation)) {
+			/* A downsampled image only holds the old view, the current generation is drawn again */
+			if (viewChanged && game->isDisplayRedrawable()) {
+				if (reserve(game->getDisplaySizeBytes()) != 0) break;
+				if (game->redrawDisplay(frames[back].image) != 0) break;
+				const DisplayRegion &region = game->getDisplayRegion();
+				publish(4*(size_t)region.width*region.height, region);
+			} else if (!next.empty() && republish() != 0) break;
+			continue;
+		}
+		nextCalculation = now + chrono::microseconds((long)(delayMs * 1000.0f));
+		
+		/* The image of the generation is written directly into the back frame */
+		if (reserve(game->getDisplaySizeBytes()) != 0) break;
+		if (game->nextGeneration(frames[back].image) != 0) break;
+		const DisplayRegion &region = game->getDisplayRegion();
+		publish(4*(size_t)region.width*region.height, region);
+	}
+	
+	/* The display stops the program */
+	failed = true;
+}
+
+int ComputeThread::reserve(size_t sizeBytes) {
+	EngineFrame &frame = frames[back];
+	if (frame.capacityBytes >= sizeBytes) return 0;
+	freeHostMemory(frame.image);
+	frame.image = (unsigned char *)allocateHostMemory(sizeBytes);
+	frame.capacityBytes = (frame.image == NULL) ? 0 : sizeBytes;
+	return (frame.image == NULL) ? -1 : 0;
+}
+
+void ComputeThread::publish(size_t sizeBytes, const DisplayRegion &region) {
+	EngineFrame &frame = frames[back];
+	frame.sizeBytes = sizeBytes;
+	frame.region = region;
+	frame.info = getInfo(*game);
+	frame.info.resetPending = pendingReset;
+	published = back;
+	/* The frame replaced in the middle was not taken by the display and is written next */
+	back = middle.exchange(back | FRAME_FRESH) & ~FRAME_FRESH;
+}
+
+int ComputeThread::republish() {
+	if (published < 0) {
+		publish(0, game->getDisplayRegion());
+		return 0;
+	}
+	/* The display only reads the published frames, the engine may read them as well */
+	const EngineFrame &last = frames[published];
+	if (reserve(last.sizeBytes) != 0) return -1;
+	memcpy(frames[back].image, last.image, last.sizeBytes);
+	publish(last.sizeBytes, last.region);
+	return 0;
+}
@@ -0,0 +1,245 @@
+#include "../inc/DeviceStrips.hpp"
+#include <cstring>
+#include <cassert>					/* for assert() */
+
+int DeviceStrips::setup(cl_context context, const cl_device_id *devices, int numberOfDevices,
+		cl_program program, cl_mem rules, const PackedBoard &board, bool _clamp) {
+	cl_int status = CL_SUCCESS;
+	release();
+	boardSize[0] = board.getWidth();
+	boardSize[1] = board.getHeight();
+	rowWords = 2*board.getWordsPerRow();
+	clamp = _clamp;
+	current = 0;
+
+	/* Every strip needs at least one row */
+	if (numberOfDevices > boardSize[1]) numberOfDevices = boardSize[1];
+	strips.resize(numberOfDevices);
+	for (int i = 0; i < numberOfDevices; i++) {
+		DeviceStrip &strip = strips[i];
+		strip.device = devices[i];
+		strip.queue = NULL;
+		strip.kernel = NULL;
+		strip.board[0] = NULL;
+		strip.board[1] = NULL;
+		strip.edgeEvents[0] = NULL;
+		strip.edgeEvents[1] = NULL;
+		strip.rowBegin = (int)((long)boardSize[1]*i/numberOfDevices);
+		strip.rows = (int)((long)boardSize[1]*(i+1)/numberOfDevices) - strip.rowBegin;
+		for (int b = 0; b < 2; b++) {
+			strip.edges[b][0].assign(rowWords, 0);
+			strip.edges[b][1].assign(rowWords, 0);
+		}
+	}
+
+	for (int i = 0; i < numberOfDevices; i++) {
+		DeviceStrip &strip = strips[i];
+		strip.queue = clCreateCommandQueue(context, strip.device, CL_QUEUE_PROFILING_ENABLE, &status);
+		if (status != CL_SUCCESS) return -1;
+		strip.kernel = clCreateKernel(program, "nextGenerationPackedStrip", &status);
+		if (status != CL_SUCCESS) return -1;
+		/* Each device only holds its strip and two halo rows */
+		for (int b = 0; b < 2; b++) {
+			strip.board[b] = clCreateBuffer(context, CL_MEM_READ_WRITE,
+					(strip.rows+2)*rowWords*sizeof(cl_uint), NULL, &status);
+			if (status != CL_SUCCESS) return -1;
+		}
+		status |= clSetKernelArg(strip.kernel, 2, sizeof(cl_mem), (void *)&rules);
+		status |= clSetKernelArg(strip.kernel, 3, sizeof(cl_int), (void *)&boardSize[0]);
+		status |= clSetKernelArg(strip.kernel, 4, sizeof(cl_int), (void *)&rowWords);
+		if (status != CL_SUCCESS) return -1;
+
+		/* Work items per work group of the kernel */
+		size_t compileWorkGroupSize[3];
+		status = clGetKernelWorkGroupInfo(strip.kernel, strip.device,
+				CL_KERNEL_COMPILE_WORK_GROUP_SIZE, 3*sizeof(size_t), &compileWorkGroupSize, NULL);
+		if (status != CL_SUCCESS) return -1;
+		localThreads[0] = compileWorkGroupSize[0];
+		localThreads[1] = compileWorkGroupSize[1];
+	}
+
+	return (write(board.getWords()) == CL_SUCCESS) ? 0 : -1;
+}
+
+void DeviceStrips::release() {
+	releaseEdgeEvents();
+	for (int i = 0; i < 2; i++) {
+		if (profileEvents[i] != NULL) clReleaseEvent(profileEvents[i]);
+		profileEvents[i] = NULL;
+	}
+	for (size_t i = 0; i < strips.size(); i++) {
+		DeviceStrip &strip = strips[i];
+		if (strip.queue != NULL) clFinish(strip.queue);
+		for (int b = 0; b < 2; b++)
+			if (strip.board[b] != NULL) clReleaseMemObject(strip.board[b]);
+		if (strip.kernel != NULL) clReleaseKernel(strip.kernel);
+		if (strip.queue != NULL) clReleaseCommandQueue(strip.queue);
+	}
+	strips.clear();
+}
+
+void DeviceStrips::releaseEdgeEvents() {
+	for (size_t i = 0; i < strips.size(); i++) {
+		for (int k = 0; k < 2; k++) {
+			if (strips[i].edgeEvents[k] != NULL) clReleaseEvent(strips[i].edgeEvents[k]);
+			strips[i].edgeEvents[k] = NULL;
+		}
+	}
+}
+
+cl_int DeviceStrips::enqueueRows(DeviceStrip &strip, int rowBegin, int rowEnd,
+		cl_uint numberOfEvents, const cl_event *waitEvents, cl_event *event) {
+	size_t globalThreads[2];
+	globalThreads[0] = (rowWords + localThreads[0] - 1) / localThreads[0] * localThreads[0];
+	globalThreads[1] = (rowEnd - rowBegin + localThreads[1] - 1) / localThreads[1] * localThreads[1];
+	cl_int status = clSetKernelArg(strip.kernel, 5, sizeof(cl_int), (void *)&rowBegin);
+	status |= clSetKernelArg(strip.kernel, 6, sizeof(cl_int), (void *)&rowEnd);
+	status |= clEnqueueNDRangeKernel(strip.queue, strip.kernel, 2, NULL,
+			globalThreads, localThreads, numberOfEvents, waitEvents, event);
+	return status;
+}
+
+cl_int DeviceStrips::enqueueGeneration(bool profile) {
+	cl_int status = CL_SUCCESS;
+	const int src = current, dst = current^1;
+	const int numberOfStrips = strips.size();
+	const size_t rowBytes = rowWords*sizeof(cl_uint);
+
+	/* Keep the events of the last profiled generation until the next one */
+	for (int i = 0; profile && i < 2; i++) {
+		if (profileEvents[i] != NULL) clReleaseEvent(profileEvents[i]);
+		profileEvents[i] = NULL;
+	}
+
+	for (int i = 0; i < numberOfStrips; i++) {
+		DeviceStrip &strip = strips[i];
+		cl_event *first = (profile && i == 0) ? &profileEvents[0] : NULL;
+		status |= clSetKernelArg(strip.kernel, 0, sizeof(cl_mem), (void *)&strip.board[src]);
+		status |= clSetKernelArg(strip.kernel, 1, sizeof(cl_mem), (void *)&strip.board[dst]);
+
+		/* The interior does not depend on the halos */
+		if (strip.rows > 2) {
+			status |= enqueueRows(strip, 2, strip.rows, 0, NULL, first);
+			first = NULL;
+		}
+
+		/* Halos from the rows staged by the neighbours in the last generation,
+		   they are already on the device after write() */
+		int north = (i > 0) ? i-1 : (clamp ? -1 : numberOfStrips-1);
+		int south = (i < numberOfStrips-1) ? i+1 : (clamp ? -1 : 0);
+		if (north >= 0 && strips[north].edgeEvents[1] != NULL) {
+			status |= clEnqueueWriteBuffer(strip.queue, strip.board[src], CL_FALSE,
+					0, rowBytes, &strips[north].edges[src][1][0],
+					1, &strips[north].edgeEvents[1], NULL);
+		}
+		if (south >= 0 && strips[south].edgeEvents[0] != NULL) {
+			status |= clEnqueueWriteBuffer(strip.queue, strip.board[src], CL_FALSE,
+					(strip.rows+1)*rowBytes, rowBytes, &strips[south].edges[src][0][0],
+					1, &strips[south].edgeEvents[0], NULL);
+		}
+
+		/* First and last row of the strip after the halos */
+		cl_event *last = (profile && i == 0) ? &profileEvents[1] : NULL;
+		if (strip.rows > 1) {
+			status |= enqueueRows(strip, 1, 2, 0, NULL, first);
+			status |= enqueueRows(strip, strip.rows, strip.rows+1, 0, NULL, last);
+		} else {
+			status |= enqueueRows(strip, 1, 2, 0, NULL, (first != NULL) ? first : last);
+		}
+		if (profile && i == 0 && profileEvents[1] == NULL) {
+			/* Only one kernel in the strip */
+			profileEvents[1] = profileEvents[0];
+			clRetainEvent(profileEvents[1]);
+		}
+	}
+
+	/* Stage the first and last row of each strip for the next generation.
+	   The writes above still wait for the old events, releasing them is safe. */
+	releaseEdgeEvents();
+	for (int i = 0; i < numberOfStrips; i++) {
+		DeviceStrip &strip = strips[i];
+		status |= clEnqueueReadBuffer(strip.queue, strip.board[dst], CL_FALSE,
+				rowBytes, rowBytes, &strip.edges[dst][0][0], 0, NULL, &strip.edgeEvents[0]);
+		status |= clEnqueueReadBuffer(strip.queue, strip.board[dst], CL_FALSE,
+				strip.rows*rowBytes, rowBytes, &strip.edges[dst][1][0], 0, NULL, &strip.edgeEvents[1]);
+	}
+	flush();
+
+	current = dst;
+	return status;
+}
+
+float DeviceStrips::getProfiledTime() {
+	if (profileEvents[0] == NULL || profileEvents[1] == NULL) return 0.0f;
+	cl_ulong start, end;
+	cl_int status = clGetEventProfilingInfo(profileEvents[0],
+		CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+	status |= clGetEventProfilingInfo(profileEvents[1],
+		CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+	assert(status == CL_SUCCESS);
+	return (end - start) * 1.0e-6f;
+}
+
+cl_int DeviceStrips::enqueueRead(void *host, std::vector<cl_event> &events) {
+	cl_int status = CL_SUCCESS;
+	cl_uint *words = (cl_uint *)host;
+	const size_t rowBytes = rowWords*sizeof(cl_uint);
+	events.resize(strips.size());
+	for (size_t i = 0; i < strips.size(); i++) {
+		DeviceStrip &strip = strips[i];
+		/* The rows of the strip without the halo rows */
+		status |= clEnqueueReadBuffer(strip.queue, strip.board[current], CL_FALSE,
+				rowBytes, strip.rows*rowBytes, &words[strip.rowBegin*rowWords],
+				0, NULL, &events[i]);
+	}
+	flush();
+	return status;
+}
+
+cl_int DeviceStrips::read(void *host) {
+	std::vector<cl_event> events;
+	cl_int status = enqueueRead(host, events);
+	if (status == CL_SUCCESS)
+		status = clWaitForEvents(events.size(), &events[0]);
+	for (size_t i = 0; i < events.size(); i++)
+		clReleaseEvent(events[i]);
+	return status;
+}
+
+cl_int DeviceStrips::write(const void *host) {
+	cl_int status = finish();
+	const cl_uint *words = (const cl_uint *)host;
+	releaseEdgeEvents();
+
+	for (size_t i = 0; i < strips.size(); i++) {
+		DeviceStrip &strip = strips[i];
+		/* Rows of the strip with the halo rows, dead or wrapped around outside of the board */
+		std::vector<cl_uint> rows((strip.rows+2)*rowWords, 0);
+		for (int y = -1; y <= strip.rows; y++) {
+			int boardRow = strip.rowBegin + y;
+			if (boardRow < 0 || boardRow >= boardSize[1]) {
+				if (clamp) continue;
+				boardRow = (boardRow + boardSize[1]) % boardSize[1];
+			}
+			memcpy(&rows[(y+1)*rowWords], &words[boardRow*rowWords], rowWords*sizeof(cl_uint));
+		}
+		/* Both buffers, the dead halos of a clamped board are never written again */
+		for (int b = 0; b < 2; b++) {
+			status |= clEnqueueWriteBuffer(strip.queue, strip.board[b], CL_TRUE,
+					0, rows.size()*sizeof(cl_uint), &rows[0], 0, NULL, NULL);
+		}
+	}
+	return status;
+}
+
+void DeviceStrips::flush() {
+	for (size_t i = 0; i < strips.size(); i++)
+		clFlush(strips[i].queue);
+}
+
+cl_int DeviceStrips::finish() {
+	cl_int status = CL_SUCCESS;
+	for (size_t i = 0; i < strips.size(); i++)
+		status |= clFinish(strips[i].queue);
+	return status;
+}
@@ -0,0 +1,199 @@
+/**
+ * Name:        gol_mpi
+ * Description: Game of Life on boards bigger than one node. The packed board
+ *              is decomposed in 2D across the MPI ranks, every rank calculates
+ *              its subdomain on all cores and exchanges halos each generation.
+ */
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <stdint.h>				/* for uint64_t and int64_t */
+#include <unistd.h>				/* for command line parsing */
+#include <mpi.h>				/* MPI definitions */
+
+#include "../inc/DistributedBoard.hpp"
+
+using namespace std;
+
+/**
+* Parse a rule of the form SURVIVAL/BIRTH like GameOfLife::setRule.
+* @param rule list of Survival/Birth, e.g. 23/3
+* @param rules 18 rules for calculating next generation
+* @return 0 on success and -1 on failure
+*/
+static int parseRule(const char *rule, unsigned char *rules) {
+	const char *delimiter = strchr(rule, '/');
+	if (delimiter == NULL || strchr(delimiter+1, '/') != NULL) return -1;
+	memset(rules, 0, 18);
+	for (const char *c = rule; *c != '\0'; c++) {
+		if (c == delimiter) continue;
+		if (*c < '0' || *c > '9') return -1;
+		int number = *c - '0';
+		/* 9 is the same as 0 like in GameOfLife::setRule */
+		rules[(c < delimiter ? 9 : 0) + (number==9 ? 0 : number)] = 255;
+	}
+	return 0;
+}
+
+/* Print command line help on rank 0 */
+static void showHelp(int rank) {
+	if (rank != 0) return;
+	printf( "\n" );
+	printf( "Usage: mpirun -np RANKS gol_mpi [OPTIONS] WIDTH [HEIGHT]\n");
+	printf( "\n" );
+	printf( "---- Options ----\n" );
+	printf( " -h            Prints this help\n");
+	printf( " -r DENSITY    density of the random starting population\n");
+	printf( "               default: 0.3\n");
+	printf( " -s SEED       seed of the random starting population,\n");
+	printf( "               the board does not depend on the number of ranks\n");
+	printf( "               default: 1\n");
+	printf( " -l RULE       rule for next generations as a list of Survival/Birth\n");
+	printf( "               default: 23/3\n");
+	printf( " -n NUMBER     generations to calculate\n");
+	printf( "               default: 100\n");
+	printf( " -i NUMBER     print population every NUMBER generations\n");
+	printf( "               default: 0 (only at the end)\n");
+	printf( " -j NUMBER     threads per rank\n");
+	printf( "               default: all cores\n");
+	printf( " -c            Use clamp mode (dead cells outside the board)\n");
+	printf( "               default: wrap mode\n");
+	printf( "\n" );
+	printf( "WIDTH is rounded up to a multiple of %i cells.\n", CELLS_PER_WORD);
+	printf( "\n" );
+}
+
+/* Calculate the generations, the board is freed before MPI_Finalize */
+static int run(int64_t width, int64_t height, bool clamp, int threads, float density,
+		uint64_t seed, const unsigned char *rules, unsigned long generations, unsigned long interval) {
+	int rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	DistributedBoard board;
+	board.setNumberOfThreads(threads);
+	if (board.setup(MPI_COMM_WORLD, width, height, clamp) != 0) {
+		if (rank == 0)
+			fprintf(stderr, "\nCannot decompose a %lldx%lld board (too small or too big for the ranks)\n",
+					(long long)width, (long long)height);
+		return -1;
+	}
+	board.randomise(density, seed);
+
+	width = ((width + CELLS_PER_WORD - 1) / CELLS_PER_WORD) * CELLS_PER_WORD;
+	if (board.getRank() == 0) {
+		printf("board: %lldx%lld | ranks: %ix%i | threads per rank: %u | simd: %s\n",
+				(long long)width, (long long)height, board.getRanks(0), board.getRanks(1),
+				board.getEngine().getNumberOfThreads(), getSIMDName(board.getEngine().getSIMDLevel()));
+	}
+	uint64_t population = board.getPopulation();
+	if (board.getRank() == 0)
+		printf("generation: 0 | population: %llu\n", (unsigned long long)population);
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	double start = MPI_Wtime();
+	for (unsigned long i = 1; i <= generations; i++) {
+		if (board.nextGeneration(rules) != 0) {
+			fprintf(stderr, "\nHalo exchange failed on rank %i\n", board.getRank());
+			MPI_Abort(MPI_COMM_WORLD, -1);
+		}
+		if (interval > 0 && i % interval == 0 && i != generations) {
+			population = board.getPopulation();
+			unsigned long calculated = board.getGenerations();
+			if (board.getRank() == 0)
+				printf("generation: %lu | population: %llu | %.3f ms/gen\n", calculated,
+						(unsigned long long)population, (MPI_Wtime() - start) * 1000.0 / i);
+		}
+	}
+	MPI_Barrier(MPI_COMM_WORLD);
+	double seconds = MPI_Wtime() - start;
+
+	population = board.getPopulation();
+	unsigned long calculated = board.getGenerations();
+	if (board.getRank() == 0) {
+		double cells = (double)width * height;
+		printf("generation: %lu | population: %llu\n", calculated, (unsigned long long)population);
+		printf("seconds: %.3f | generations/sec: %.2f | cell updates/sec: %.4g\n",
+				seconds, calculated / seconds, cells * calculated / seconds);
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	MPI_Init(&argc, &argv);
+	int rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+	float density = 0.3f;
+	uint64_t seed = 1;
+	string rule("23/3");
+	unsigned long generations = 100, interval = 0;
+	int threads = 0;
+	bool clamp = false;
+
+	int optionChar;
+	while ((optionChar = getopt(argc, argv, ":hr:s:l:n:i:j:c")) != -1) {
+		bool error = false;
+		switch (optionChar) {
+		case 'r':
+			density = atof(optarg);
+			error = density < 0.0f || density > 1.0f;
+			break;
+		case 's': seed = strtoull(optarg, NULL, 10); break;
+		case 'l': rule = optarg; break;
+		case 'n':
+			error = atol(optarg) <= 0;
+			generations = atol(optarg);
+			break;
+		case 'i':
+			error = atol(optarg) < 0;
+			interval = atol(optarg);
+			break;
+		case 'j':
+			error = atoi(optarg) < 0;
+			threads = atoi(optarg);
+			break;
+		case 'c': clamp = true; break;
+		case 'h':
+			showHelp(rank);
+			MPI_Finalize();
+			return 0;
+		case ':':
+			if (rank == 0) fprintf(stderr,"\nOption -%c requires an operand\n", optopt);
+			error = true;
+			break;
+		case '?':
+			if (rank == 0) fprintf(stderr,"\nUnrecognized option: -%c\n", optopt);
+			error = true;
+			break;
+		}
+		if (error) {
+			if (rank == 0 && optionChar != ':' && optionChar != '?')
+				fprintf(stderr,"\nError in option -%c\n", optionChar);
+			showHelp(rank);
+			MPI_Finalize();
+			return -1;
+		}
+	}
+
+	/* Board size from the remaining arguments */
+	if (optind >= argc || optind+2 < argc) {
+		showHelp(rank);
+		MPI_Finalize();
+		return -1;
+	}
+	int64_t width = atoll(argv[optind]);
+	int64_t height = (optind+1 < argc) ? atoll(argv[optind+1]) : width;
+
+	unsigned char rules[18];
+	if (parseRule(rule.c_str(), rules) != 0) {
+		if (rank == 0) fprintf(stderr,"\nError in rule %s\n", rule.c_str());
+		MPI_Finalize();
+		return -1;
+	}
+
+	int status = run(width, height, clamp, threads, density, seed, rules, generations, interval);
+	MPI_Finalize();
+	return status;
+}
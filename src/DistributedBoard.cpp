@@ -0,0 +1,202 @@
+#include "../inc/DistributedBoard.hpp"
+#include "../inc/Philox.hpp"
+
+/**
+* Rows of the interior calculated between two tests of the halo messages,
+* so MPI can progress the exchange during the interior
+*/
+#define DISTRIBUTED_PROGRESS_CHUNKS 4
+
+/*
+ * Neighbour directions in x and y in the order of DistributedBoard::neighbours,
+ * the opposite of direction d is DISTRIBUTED_DIRECTIONS-1-d
+ */
+static const int directions[DISTRIBUTED_DIRECTIONS][2] = {
+	{-1, -1}, {0, -1}, {1, -1},
+	{-1, 0},           {1, 0},
+	{-1, 1},  {0, 1},  {1, 1}
+};
+
+int DistributedBoard::setup(MPI_Comm comm, int64_t width, int64_t height, bool _clamp) {
+	clamp = _clamp;
+	current = 0;
+	generations = 0;
+
+	/* Cartesian grid, dimension 0 are the rows of ranks */
+	int size, dims[2] = {0, 0}, cartCoords[2];
+	int periods[2] = {clamp ? 0 : 1, clamp ? 0 : 1};
+	MPI_Comm_size(comm, &size);
+	MPI_Dims_create(size, 2, dims);
+	if (grid != MPI_COMM_NULL) MPI_Comm_free(&grid);
+	MPI_Cart_create(comm, 2, dims, periods, 1, &grid);
+	MPI_Comm_rank(grid, &rank);
+	MPI_Cart_coords(grid, rank, 2, cartCoords);
+	ranks[0] = dims[1];
+	ranks[1] = dims[0];
+	coords[0] = cartCoords[1];
+	coords[1] = cartCoords[0];
+
+	/* Subdomains of whole words, every rank gets at least one word and row */
+	boardWords[0] = (width + CELLS_PER_WORD - 1) / CELLS_PER_WORD;
+	boardWords[1] = height;
+	int ok = (width > 0 && boardWords[0] >= ranks[0] && boardWords[1] >= ranks[1]) ? 1 : 0;
+	for (int i = 0; i < 2 && ok; i++) {
+		offset[i] = boardWords[i]*coords[i]/ranks[i];
+		int64_t local = boardWords[i]*(coords[i]+1)/ranks[i] - offset[i];
+		/* The cells of a row with the halos must fit into an int */
+		ok = (local + 2 <= (int64_t)(0x7FFFFFFF / CELLS_PER_WORD)) ? 1 : 0;
+		localSize[i] = (int)local;
+	}
+	/* The packed engine indexes the words of the subdomain with an int */
+	if (ok && (int64_t)(localSize[0]+2)*(localSize[1]+2) > (int64_t)0x7FFFFFFF)
+		ok = 0;
+
+	if (ok) {
+		/* Neighbours wrap around or are missing at clamped edges */
+		for (int d = 0; d < DISTRIBUTED_DIRECTIONS; d++) {
+			int x = coords[0] + directions[d][0], y = coords[1] + directions[d][1];
+			if (clamp && (x < 0 || y < 0 || x >= ranks[0] || y >= ranks[1])) {
+				neighbours[d] = MPI_PROC_NULL;
+				continue;
+			}
+			int neighbourCoords[2] = {(y + ranks[1]) % ranks[1], (x + ranks[0]) % ranks[0]};
+			MPI_Cart_rank(grid, neighbourCoords, &neighbours[d]);
+		}
+
+		/* Edges are one word in x and one row in y */
+		for (int d = 0; d < DISTRIBUTED_DIRECTIONS; d++) {
+			size_t words = (directions[d][0] == 0) ? localSize[0] : 1;
+			size_t rows = (directions[d][1] == 0) ? localSize[1] : 1;
+			sendBuffers[d].assign(words*rows, 0);
+			recvBuffers[d].assign(words*rows, 0);
+		}
+
+		for (int i = 0; i < 2 && ok; i++) {
+			if (board[i].allocate((localSize[0]+2)*CELLS_PER_WORD, localSize[1]+2) != 0)
+				ok = 0;
+		}
+	}
+
+	/* Fail on all ranks together */
+	int allOk;
+	MPI_Allreduce(&ok, &allOk, 1, MPI_INT, MPI_MIN, grid);
+	return allOk ? 0 : -1;
+}
+
+void DistributedBoard::randomise(float density, uint64_t seed) {
+	PackedBoard &src = board[current];
+	const int stride = src.getWordsPerRow();
+	const uint64_t threshold = getRandomThreshold(density);
+	src.clear();
+
+	for (int r = 1; r <= localSize[1]; r++) {
+		uint64_t *row = &src.getWords()[r*stride];
+		/* Counters of the global row and word, the same cells as GameOfLife --seed */
+		const uint32_t y = (uint32_t)(offset[1] + r-1);
+		for (int w = 1; w <= localSize[0]; w++) {
+			const uint32_t group = (uint32_t)((offset[0] + w-1) * (CELLS_PER_WORD/4));
+			uint64_t bits = 0;
+			for (int i = 0; i < CELLS_PER_WORD/4; i++)
+				bits |= (uint64_t)getRandomCells(seed, threshold, group + i, y) << 4*i;
+			row[w] = bits;
+		}
+	}
+}
+
+void DistributedBoard::packEdges(const PackedBoard &src) {
+	const int stride = src.getWordsPerRow();
+	const uint64_t *words = src.getWords();
+	for (int d = 0; d < DISTRIBUTED_DIRECTIONS; d++) {
+		if (neighbours[d] == MPI_PROC_NULL) continue;
+		/* First or last word and row of the subdomain towards the neighbour */
+		int wordBegin = (directions[d][0] > 0) ? localSize[0] : 1;
+		int wordEnd = (directions[d][0] < 0) ? 2 : localSize[0]+1;
+		int rowBegin = (directions[d][1] > 0) ? localSize[1] : 1;
+		int rowEnd = (directions[d][1] < 0) ? 2 : localSize[1]+1;
+		uint64_t *buffer = &sendBuffers[d][0];
+		for (int r = rowBegin; r < rowEnd; r++)
+			for (int w = wordBegin; w < wordEnd; w++)
+				*buffer++ = words[r*stride + w];
+	}
+}
+
+void DistributedBoard::unpackHalos(PackedBoard &src) {
+	const int stride = src.getWordsPerRow();
+	uint64_t *words = src.getWords();
+	for (int d = 0; d < DISTRIBUTED_DIRECTIONS; d++) {
+		/* Halo word and row next to the subdomain towards the neighbour */
+		int wordBegin = (directions[d][0] < 0) ? 0 : (directions[d][0] > 0) ? localSize[0]+1 : 1;
+		int wordEnd = (directions[d][0] == 0) ? localSize[0]+1 : wordBegin+1;
+		int rowBegin = (directions[d][1] < 0) ? 0 : (directions[d][1] > 0) ? localSize[1]+1 : 1;
+		int rowEnd = (directions[d][1] == 0) ? localSize[1]+1 : rowBegin+1;
+		const bool dead = (neighbours[d] == MPI_PROC_NULL);
+		const uint64_t *buffer = &recvBuffers[d][0];
+		for (int r = rowBegin; r < rowEnd; r++)
+			for (int w = wordBegin; w < wordEnd; w++)
+				words[r*stride + w] = dead ? 0 : *buffer++;
+	}
+}
+
+int DistributedBoard::nextGeneration(const unsigned char *rules) {
+	PackedBoard &src = board[current];
+	PackedBoard &dst = board[current^1];
+	const int words = localSize[0], rows = localSize[1];
+	MPI_Request requests[2*DISTRIBUTED_DIRECTIONS];
+	int status = MPI_SUCCESS;
+
+	/* A message towards direction d is tagged with d, it arrives from the opposite direction */
+	packEdges(src);
+	for (int d = 0; d < DISTRIBUTED_DIRECTIONS; d++) {
+		status |= MPI_Irecv(&recvBuffers[d][0], recvBuffers[d].size(), MPI_UINT64_T,
+				neighbours[d], DISTRIBUTED_DIRECTIONS-1-d, grid, &requests[d]);
+	}
+	for (int d = 0; d < DISTRIBUTED_DIRECTIONS; d++) {
+		status |= MPI_Isend(&sendBuffers[d][0], sendBuffers[d].size(), MPI_UINT64_T,
+				neighbours[d], d, grid, &requests[DISTRIBUTED_DIRECTIONS+d]);
+	}
+
+	/* Interior rows [2,rows) while the halos are exchanged,
+	   their first and last word still need the halos */
+	for (int chunk = 0; chunk < DISTRIBUTED_PROGRESS_CHUNKS && rows > 2; chunk++) {
+		int rowBegin = 2 + (int)((long)(rows-2)*chunk/DISTRIBUTED_PROGRESS_CHUNKS);
+		int rowEnd = 2 + (int)((long)(rows-2)*(chunk+1)/DISTRIBUTED_PROGRESS_CHUNKS);
+		engine.nextGenerationRows(src, dst, rules, true, rowBegin, rowEnd);
+		int finished;
+		MPI_Testall(2*DISTRIBUTED_DIRECTIONS, requests, &finished, MPI_STATUSES_IGNORE);
+	}
+
+	status |= MPI_Waitall(2*DISTRIBUTED_DIRECTIONS, requests, MPI_STATUSES_IGNORE);
+	if (status != MPI_SUCCESS) return -1;
+	unpackHalos(src);
+
+	/* First and last row, first and last word of the interior rows */
+	engine.nextGenerationRows(src, dst, rules, true, 1, 2);
+	if (rows > 1) engine.nextGenerationRows(src, dst, rules, true, rows, rows+1);
+	if (rows > 2) {
+		nextGenerationPackedTile(src, dst, rules, true, 2, rows, 1, 2);
+		if (words > 1) nextGenerationPackedTile(src, dst, rules, true, 2, rows, words, words+1);
+	}
+
+	current ^= 1;
+	generations++;
+	return 0;
+}
+
+uint64_t DistributedBoard::getPopulation() {
+	const PackedBoard &src = board[current];
+	const int stride = src.getWordsPerRow();
+	uint64_t population = 0, globalPopulation = 0;
+	for (int r = 1; r <= localSize[1]; r++) {
+		const uint64_t *row = &src.getWords()[r*stride];
+		for (int w = 1; w <= localSize[0]; w++)
+			population += __builtin_popcountll(row[w]);
+	}
+	MPI_Allreduce(&population, &globalPopulation, 1, MPI_UINT64_T, MPI_SUM, grid);
+	return globalPopulation;
+}
+
+unsigned long DistributedBoard::getGenerations() {
+	unsigned long globalGenerations = 0;
+	MPI_Allreduce(&generations, &globalGenerations, 1, MPI_UNSIGNED_LONG, MPI_MIN, grid);
+	return globalGenerations;
+}
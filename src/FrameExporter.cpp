@@ -0,0 +1,385 @@
+#include "../inc/FrameExporter.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>				/* for min() */
+using namespace std;
+
+/**
+* Bytes of a stored deflate block, PNG images are written without compression
+*/
+#define EXPORT_DEFLATE_BLOCK 65535
+
+/**
+* Reverse the bits of a byte, cells are LSB first in words and MSB first in images
+*/
+static unsigned char reverseBits(unsigned char b) {
+	b = (unsigned char)((b & 0xF0) >> 4 | (b & 0x0F) << 4);
+	b = (unsigned char)((b & 0xCC) >> 2 | (b & 0x33) << 2);
+	return (unsigned char)((b & 0xAA) >> 1 | (b & 0x55) << 1);
+}
+
+/**
+* Pack a row of the board MSB first into bytes like PNG and PBM rows.
+*/
+static void packRow(const uint64_t *words, int width, unsigned char *row) {
+	const int bytes = (width + 7) / 8;
+	for (int i = 0; i < bytes; i++)
+		row[i] = reverseBits((unsigned char)(words[i / 8] >> (8 * (i % 8))));
+	/* Cells behind the last cell are padding */
+	if (width % 8) row[bytes-1] &= (unsigned char)(0xFF << (8 - width % 8));
+}
+
+/**
+* CRC-32 of PNG chunks, continuing from a previous value.
+*/
+static uint32_t crc32(const unsigned char *data, size_t size, uint32_t crc = 0) {
+	static uint32_t table[256];
+	static bool initialised = false;
+	if (!initialised) {
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+		initialised = true;
+	}
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void putBigEndian(unsigned char *p, uint32_t value) {
+	p[0] = (unsigned char)(value >> 24);
+	p[1] = (unsigned char)(value >> 16);
+	p[2] = (unsigned char)(value >> 8);
+	p[3] = (unsigned char)value;
+}
+
+/**
+* Write a PNG chunk with its length and CRC.
+*/
+static bool writeChunk(FILE *file, const char *type, const unsigned char *data, size_t size) {
+	unsigned char length[4], crc[4];
+	putBigEndian(length, (uint32_t)size);
+	uint32_t c = crc32((const unsigned char *)type, 4);
+	if (size > 0) c = crc32(data, size, c);
+	putBigEndian(crc, c);
+	return fwrite(length, 1, 4, file) == 4 && fwrite(type, 1, 4, file) == 4
+		&& (size == 0 || fwrite(data, 1, size, file) == size) && fwrite(crc, 1, 4, file) == 4;
+}
+
+/**
+* Write a 1 bit greyscale PNG, the zlib stream has stored blocks only.
+*/
+static bool writePNG(FILE *file, const PackedBoard &board) {
+	static const unsigned char signature[8] = {137, 'P', 'N', 'G', 13, 10, 26, 10};
+	const int width = board.getWidth(), height = board.getHeight();
+	const size_t rowBytes = 1 + (width + 7) / 8;
+
+	unsigned char header[13];
+	putBigEndian(header, width);
+	putBigEndian(header+4, height);
+	header[8] = 1;		/* bit depth */
+	header[9] = 0;		/* greyscale */
+	header[10] = 0;		/* deflate */
+	header[11] = 0;		/* adaptive filters */
+	header[12] = 0;		/* no interlace */
+
+	/* Rows with filter type 0 */
+	vector<unsigned char> raw(rowBytes * height);
+	for (int y = 0; y < height; y++) {
+		raw[y*rowBytes] = 0;
+		packRow(&board.getWords()[(size_t)y*board.getWordsPerRow()], width, &raw[y*rowBytes+1]);
+	}
+
+	/* zlib stream of stored blocks and the Adler-32 of the rows */
+	vector<unsigned char> data;
+	data.reserve(raw.size() + 5*(raw.size()/EXPORT_DEFLATE_BLOCK + 1) + 6);
+	data.push_back(0x78);
+	data.push_back(0x01);
+	uint32_t a = 1, b = 0;
+	for (size_t i = 0; i < raw.size(); i++) {
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	for (size_t offset = 0; offset < raw.size(); offset += EXPORT_DEFLATE_BLOCK) {
+		size_t size = min((size_t)EXPORT_DEFLATE_BLOCK, raw.size() - offset);
+		data.push_back(offset + size == raw.size() ? 1 : 0);
+		data.push_back((unsigned char)size);
+		data.push_back((unsigned char)(size >> 8));
+		data.push_back((unsigned char)~size);
+		data.push_back((unsigned char)(~size >> 8));
+		data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + size);
+	}
+	unsigned char adler[4];
+	putBigEndian(adler, (b << 16) | a);
+	data.insert(data.end(), adler, adler + 4);
+
+	return fwrite(signature, 1, 8, file) == 8
+		&& writeChunk(file, "IHDR", header, sizeof(header))
+		&& writeChunk(file, "IDAT", &data[0], data.size())
+		&& writeChunk(file, "IEND", NULL, 0);
+}
+
+/**
+* Write a raw portable bitmap, 1 is black.
+*/
+static bool writePBM(FILE *file, const PackedBoard &board) {
+	const int width = board.getWidth(), height = board.getHeight();
+	vector<unsigned char> row((width + 7) / 8);
+	if (fprintf(file, "P4\n%i %i\n", width, height) < 0) return false;
+	for (int y = 0; y < height; y++) {
+		packRow(&board.getWords()[(size_t)y*board.getWordsPerRow()], width, &row[0]);
+		if (fwrite(&row[0], 1, row.size(), file) != row.size()) return false;
+	}
+	return true;
+}
+
+/**
+* Append a run to a RLE line, lines are at most 70 characters.
+*/
+static void putRun(string &out, size_t &lineStart, unsigned long run, char tag) {
+	if (run == 0) return;
+	char token[24];
+	int length = (run == 1) ? snprintf(token, sizeof(token), "%c", tag)
+							: snprintf(token, sizeof(token), "%lu%c", run, tag);
+	if (out.size() - lineStart + length > 70) {
+		out.push_back('\n');
+		lineStart = out.size();
+	}
+	out.append(token, length);
+}
+
+/**
+* Write a run length encoded pattern, dead cells at the end of rows are left out.
+*/
+static bool writeRLE(FILE *file, const PackedBoard &board, const string &rule) {
+	const int width = board.getWidth(), height = board.getHeight();
+	const int wordsPerRow = board.getWordsPerRow();
+	string out;
+	size_t lineStart = 0;
+	unsigned long emptyRows = 0;
+	for (int y = 0; y < height; y++) {
+		const uint64_t *words = &board.getWords()[(size_t)y*wordsPerRow];
+		int x = 0;
+		bool first = true;
+		while (x < width) {
+			/* Next live cell and the end of its run, a word at a time */
+			int w = x / CELLS_PER_WORD;
+			uint64_t bits = words[w] & (~(uint64_t)0 << (x % CELLS_PER_WORD));
+			while (bits == 0 && ++w < wordsPerRow) bits = words[w];
+			if (bits == 0) break;
+			int begin = w*CELLS_PER_WORD + __builtin_ctzll(bits);
+			if (begin >= width) break;
+			w = begin / CELLS_PER_WORD;
+			bits = ~words[w] & (~(uint64_t)0 << (begin % CELLS_PER_WORD));
+			while (bits == 0 && ++w < wordsPerRow) bits = ~words[w];
+			int end = (bits == 0) ? width : min(width, w*CELLS_PER_WORD + __builtin_ctzll(bits));
+
+			/* Rows without cells are merged into one $ run */
+			if (first) {
+				putRun(out, lineStart, emptyRows, '$');
+				emptyRows = 0;
+				first = false;
+			}
+			putRun(out, lineStart, begin - x, 'b');
+			putRun(out, lineStart, end - begin, 'o');
+			x = end;
+		}
+		emptyRows++;
+	}
+	out.push_back('!');
+	out.push_back('\n');
+	return fprintf(file, "x = %i, y = %i, rule = %s\n", width, height, rule.c_str()) >= 0
+		&& fwrite(out.data(), 1, out.size(), file) == out.size();
+}
+
+int FrameExporter::setup(cl_context context, cl_command_queue _commandQueue, bool _packed,
+		int width, int height, const string &_prefix, ExportFormat _format,
+		const unsigned char *rules) {
+	release();
+	packed = _packed;
+	boardSize[0] = width;
+	boardSize[1] = height;
+	prefix = _prefix;
+	format = _format;
+	commandQueue = _commandQueue;
+	status = 0;
+	frameBytes = packed ? (size_t)((width + CELLS_PER_WORD - 1) / CELLS_PER_WORD) * height * sizeof(uint64_t)
+						: 4 * (size_t)width * height;
+
+	/* Rule of the frames for the RLE header */
+	rule = "B";
+	for (int i = 0; i < 9; i++) if (rules[i]) rule.push_back('0' + i);
+	rule.append("/S");
+	for (int i = 0; i < 9; i++) if (rules[9+i]) rule.push_back('0' + i);
+
+	/* Pinned buffers are copied by DMA without staging */
+	slots.resize(EXPORT_RING_SIZE);
+	for (int i = 0; i < EXPORT_RING_SIZE; i++) {
+		ExportSlot &slot = slots[i];
+		slot.host = NULL;
+		slot.pinned = NULL;
+		slot.event = NULL;
+		slot.generation = 0;
+		slot.busy = false;
+		if (context != NULL && commandQueue != NULL) {
+			cl_int clStatus;
+			slot.pinned = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+						frameBytes, NULL, &clStatus);
+			if (clStatus == CL_SUCCESS) {
+				slot.host = clEnqueueMapBuffer(commandQueue, slot.pinned, CL_TRUE,
+						CL_MAP_READ | CL_MAP_WRITE, 0, frameBytes, 0, NULL, NULL, &clStatus);
+			}
+			if (clStatus != CL_SUCCESS) {
+				if (slot.pinned != NULL) clReleaseMemObject(slot.pinned);
+				slot.pinned = NULL;
+				slot.host = NULL;
+			}
+		}
+		if (slot.host == NULL) slot.host = malloc(frameBytes);
+		if (slot.host == NULL) {
+			release();
+			return -1;
+		}
+	}
+
+	stop = false;
+	writer = std::thread(&FrameExporter::run, this);
+	return 0;
+}
+
+void FrameExporter::release() {
+	if (writer.joinable()) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wakeUp.notify_all();
+		writer.join();
+	}
+	for (size_t i = 0; i < slots.size(); i++) {
+		ExportSlot &slot = slots[i];
+		if (slot.event != NULL) clReleaseEvent(slot.event);
+		if (slot.pinned != NULL) {
+			clEnqueueUnmapMemObject(commandQueue, slot.pinned, slot.host, 0, NULL, NULL);
+			clFinish(commandQueue);
+			clReleaseMemObject(slot.pinned);
+		} else {
+			free(slot.host);
+		}
+	}
+	slots.clear();
+	queue.clear();
+	commandQueue = NULL;
+}
+
+int FrameExporter::acquire() {
+	if (slots.empty()) return -1;
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		for (size_t i = 0; i < slots.size(); i++) {
+			if (!slots[i].busy) {
+				slots[i].busy = true;
+				return (int)i;
+			}
+		}
+		done.wait(lock);
+	}
+}
+
+void FrameExporter::submit(int slot, uint64_t generation, cl_event event) {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		slots[slot].generation = generation;
+		slots[slot].event = event;
+		queue.push_back(slot);
+	}
+	wakeUp.notify_one();
+}
+
+int FrameExporter::finish() {
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		bool busy = false;
+		for (size_t i = 0; i < slots.size(); i++)
+			busy = busy || slots[i].busy;
+		if (!busy) break;
+		done.wait(lock);
+	}
+	int lastStatus = status;
+	status = 0;
+	return lastStatus;
+}
+
+int FrameExporter::getFormat(const char *name, ExportFormat &_format) {
+	if (strcmp(name, "png") == 0) _format = EXPORT_PNG;
+	else if (strcmp(name, "rle") == 0) _format = EXPORT_RLE;
+	else if (strcmp(name, "pbm") == 0) _format = EXPORT_PBM;
+	else return -1;
+	return 0;
+}
+
+void FrameExporter::run() {
+	/* RGBA frames are packed by the writer, not by the calculating thread */
+	PackedBoard board;
+	if (board.allocate(boardSize[0], boardSize[1]) != 0) {
+		std::unique_lock<std::mutex> lock(mutex);
+		status = -1;
+	}
+
+	for (;;) {
+		int index;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (queue.empty() && !stop) wakeUp.wait(lock);
+			/* The queued frames are written before stopping */
+			if (queue.empty()) return;
+			index = queue.front();
+			queue.pop_front();
+		}
+		ExportSlot &slot = slots[index];
+
+		/* The calculation goes on while the frame is read */
+		int result = 0;
+		if (slot.event != NULL) {
+			result = (clWaitForEvents(1, &slot.event) == CL_SUCCESS) ? 0 : -1;
+			clReleaseEvent(slot.event);
+			slot.event = NULL;
+		}
+		if (result == 0 && board.getWords() != NULL) {
+			if (packed) memcpy(board.getWords(), slot.host, frameBytes);
+			else board.pack((const unsigned char *)slot.host);
+			result = write(board, slot.generation);
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (result != 0 || board.getWords() == NULL) status = -1;
+			slot.busy = false;
+		}
+		done.notify_all();
+	}
+}
+
+int FrameExporter::write(const PackedBoard &board, uint64_t generation) {
+	static const char *extensions[] = {".png", ".rle", ".pbm"};
+	char number[24];
+	snprintf(number, sizeof(number), "%08llu", (unsigned long long)generation);
+	string fileName(prefix);
+	fileName.append(number);
+	fileName.append(extensions[format]);
+
+	FILE *file = fopen(fileName.c_str(), "wb");
+	if (file == NULL) return -1;
+	bool ok;
+	switch (format) {
+	case EXPORT_RLE: ok = writeRLE(file, board, rule); break;
+	case EXPORT_PBM: ok = writePBM(file, board); break;
+	default: ok = writePNG(file, board); break;
+	}
+	ok = (fclose(file) == 0) && ok;
+	return ok ? 0 : -1;
+}
@@ -1,16 +1,90 @@
 #include "../inc/GameOfLife.hpp"
+#include <algorithm>				/* for sort() */
+#include <cmath>					/* for floor() and ceil() */
+#include <sys/stat.h>				/* for mkdir() */
+#ifdef WIN32
+	#include <direct.h>				/* for _mkdir() */
+	#include <process.h>			/* for getpid() */
+#else
+	#include <unistd.h>				/* for getpid() */
+#endif
+#if defined(__APPLE__) || defined(MACOSX)
+	#include <OpenGL/gl.h>
+#else
+	#include <GL/gl.h>
+	#ifndef WIN32
+		#include <GL/glx.h>				/* for sharing the current GL context */
+	#endif
+#endif
 using namespace std;
 
+/**
+* Get the context properties for sharing objects with the current GL context.
+* @param platform CL platform
+* @param properties 7 context properties
+* @return true if the platform and a current GL context allow sharing
+*/
+static bool getGLContextProperties(cl_platform_id platform, cl_context_properties *properties) {
+#if defined(__APPLE__) || defined(MACOSX)
+	return false;
+#else
+	char extensions[4096];
+	if (clGetPlatformInfo(platform, CL_PLATFORM_EXTENSIONS,
+			sizeof(extensions), extensions, NULL) != CL_SUCCESS
+		|| strstr(extensions, "cl_khr_gl_sharing") == NULL)
+		return false;
+	
+	properties[0] = CL_GL_CONTEXT_KHR;
+	#ifdef WIN32
+		properties[1] = (cl_context_properties)wglGetCurrentContext();
+		properties[2] = CL_WGL_HDC_KHR;
+		properties[3] = (cl_context_properties)wglGetCurrentDC();
+	#else
+		properties[1] = (cl_context_properties)glXGetCurrentContext();
+		properties[2] = CL_GLX_DISPLAY_KHR;
+		properties[3] = (cl_context_properties)glXGetCurrentDisplay();
+	#endif
+	properties[4] = CL_CONTEXT_PLATFORM;
+	properties[5] = (cl_context_properties)platform;
+	properties[6] = 0;
+	return properties[1] != 0;
+#endif
+}
+
+/**
+* Get the number of live cells of a RGBA image.
+* @param image RGBA image
+* @param sizeBytes size of the image in bytes
+* @return cells with bit 7 of red set like in CPUEngine
+*/
+static uint64_t getImagePopulation(const unsigned char *image, size_t sizeBytes) {
+	uint64_t population = 0;
+	for (size_t i = 0; i < sizeBytes; i += 4)
+		population += image[i] >> 7;
+	return population;
+}
+
 int GameOfLife::setRule(char *_rule) {
 	int counter = 0;
 	unsigned int delimiterPos = 0;
+	unsigned int statesPos = 0;
 	for (unsigned int i = 0; i < strlen(_rule); i++) {
 		if (_rule[i] == '/') {
 			counter++;
-			delimiterPos = i;
+			if (counter == 1) delimiterPos = i;
+			else statesPos = i;
 		}
 	}
-	if (counter != 1) return -1;	/* Only 1 delimiter allowed */
+	if (counter != 1 && counter != 2) return -1;	/* Survival/Birth[/States] */
+	
+	/* Generations rules: number of states after the second delimiter */
+	states = 2;
+	if (counter == 2) {
+		char *end;
+		states = (int)strtol(&_rule[statesPos+1], &end, 10);
+		if (end == &_rule[statesPos+1] || *end != '\0'
+			|| states < 2 || states > PACKED_MAX_STATES) return -1;
+	}
 	
 	/* Allocate space for rules and set to default value 0 */
 	rulesSizeBytes = 18*sizeof(char);
@@ -18,7 +92,7 @@ int GameOfLife::setRule(char *_rule) {
 	memset(rules,0,18);
 	
 	/* Split up rule in survival and birth */
-	std::string splitter(_rule);
+	std::string splitter(_rule, counter == 2 ? statesPos : strlen(_rule));
 	humanRules.push_back('S');
 	char numChar[(int)sizeof(int)];
 	if (delimiterPos > 0) {
@@ -41,17 +115,38 @@ int GameOfLife::setRule(char *_rule) {
 			humanRules.push_back(numChar[0]);
 		}
 	}
+	if (states > 2) {
+		char statesChar[16];
+		snprintf(statesChar, sizeof(statesChar), "/C%i", states);
+		humanRules.append(statesChar);
+	}
 	
 	return 0;
 }
 
 int GameOfLife::setup() {
 	
+	double start = Metrics::getTimeMs();
 	if (setupHost() != 0)
 		return -1;
+	metrics.recordHost(METRIC_SETUP, start, Metrics::getTimeMs());
+	viewRegion = getFullRegion();
+	displayRegion = getFullRegion();
 	
+	start = Metrics::getTimeMs();
 	if (setupDevice() != 0)
 		return -1;
+	metrics.recordHost(METRIC_SETUP, start, Metrics::getTimeMs());
+	
+	/* Ring of host buffers for exported frames, starting with the first generation */
+	if (!exportPrefix.empty()) {
+		if (exporter.setup(context, commandQueue, packedMode, imageSize[0], imageSize[1],
+				exportPrefix, exportFormat, rules) != 0) {
+			cerr << "Could not set up frame export" << endl;
+			return -1;
+		}
+		if (exportFrame() != 0) return -1;
+	}
 	
 	return 0;
 }
@@ -66,20 +161,60 @@ int GameOfLife::setupHost() {
 	region[1]=imageSize[1];
 	region[2]=1;
 	
-	startingImage = (unsigned char *)malloc(imageSizeBytes);
-	if (startingImage == NULL)
+	/* Read the header of the pattern file, its rule decides the number of states */
+	if (restoreFile.empty() && spawnMode && readPopulation() != 0) return -1;
+	
+	/* Generations rules keep the state of a cell in bit planes of packed boards */
+	if (states > 2) {
+		packedMode = true;
+		if (unboundedMode || sparseMode) {
+			cerr << "Unbounded and sparse mode do not support rules with more than 2 states" << endl;
+			return -1;
+		}
+		if (!restoreFile.empty() || !checkpointFile.empty() || !exportPrefix.empty()) {
+			cerr << "Checkpoints and frame export do not support rules with more than 2 states" << endl;
+			return -1;
+		}
+	}
+	
+	if (packedMode) {
+		/* 1 bit per cell and plane, RGBA images are only expanded for display */
+		if (boardA.allocate(imageSize[0], imageSize[1], states) != 0
+			|| boardB.allocate(imageSize[0], imageSize[1], states) != 0)
+			return -1;
+	} else {
+		/* Images of an earlier size go back to the pool and are reused */
+		freeHostMemory(imageA);
+		imageA = (unsigned char *)allocateHostMemory(imageSizeBytes);
+		if (imageA == NULL)
+			return -1;
+		
+		freeHostMemory(imageB);
+		imageB = (unsigned char *)allocateHostMemory(imageSizeBytes);
+		if (imageB == NULL)
+			return -1;
+	}
+		
+	/* Births on 0 neighbours would turn the whole unbounded universe alive */
+	if (unboundedMode && rules[0] != 0) {
+		cerr << "Unbounded mode does not support births on 0 neighbours" << endl;
 		return -1;
+	}
 	
-	imageA = (unsigned char *)malloc(imageSizeBytes);
-	if (imageA == NULL)
+	/* The board only shows a part of the universe */
+	if (unboundedMode && periodDetector.getMaxPeriod() > 0) {
+		cerr << "Unbounded mode does not support period detection" << endl;
 		return -1;
+	}
 	
-	imageB = (unsigned char *)malloc(imageSizeBytes);
-	if (imageB == NULL)
+	/* The checkpoint only holds the cells of the board */
+	if (unboundedMode && (!restoreFile.empty() || !checkpointFile.empty())) {
+		cerr << "Unbounded mode does not support checkpoints" << endl;
 		return -1;
-		
-	/* Read population from file */
-	if (spawnMode && readPopulation() != 0) return -1;
+	}
+	
+	/* Continue from a checkpoint */
+	if (!restoreFile.empty()) return restoreCheckpoint();
 	
 	/* Spawn initial population */
 	if (spawnPopulation() != 0) return -1;
@@ -89,7 +224,9 @@ int GameOfLife::setupHost() {
 
 int GameOfLife::readPopulation() {
 	/* Parse file */
+	double start = Metrics::getTimeMs();
 	int status = patternFile.parse();
+	metrics.recordHost(METRIC_PARSE, start, Metrics::getTimeMs());
 	if (status != 0) {
 		switch (status) {
 			default: cerr << "Pattern file parse error\n" << endl; break;
@@ -102,31 +239,87 @@ int GameOfLife::readPopulation() {
 	/* Overwrite rule if specified in file, else skip */
 	vector<int> birthRules = patternFile.getBirthRules();
 	vector<int> survivalRules = patternFile.getSurvivalRules();
-	if (birthRules.size() > 0 && survivalRules.size() > 0) {
+	if (patternFile.getStates() > 0) {
 		/* Reset rule definitions */
 		memset(rules,0,18);
-		humanRules.clear();
+		states = patternFile.getStates();
 		
 		/* Write new definitions */
-		char numChar[2];
-		humanRules.push_back('S');
-		for (unsigned int i = 0; i < survivalRules.size(); i++) {
+		for (unsigned int i = 0; i < survivalRules.size(); i++)
 			rules[9+survivalRules.at(i)] = 255;
-			snprintf(numChar,2,"%i",survivalRules.at(i));
-			humanRules.push_back(numChar[0]);
-		}
-		humanRules.push_back('/');
-		humanRules.push_back('B');
-		for (unsigned int i = 0; i < birthRules.size(); i++) {
+		for (unsigned int i = 0; i < birthRules.size(); i++)
 			rules[birthRules.at(i)] = 255;
-			snprintf(numChar,2,"%i",birthRules.at(i));
-			humanRules.push_back(numChar[0]);
+		setHumanRules();
+	}
+	
+	return 0;
+}
+
+int GameOfLife::restoreCheckpoint() {
+	Checkpoint checkpoint;
+	int status = checkpoint.open(restoreFile.c_str());
+	if (status != 0) {
+		switch (status) {
+			default: cerr << "Checkpoint is invalid or damaged\n" << endl; break;
+			case -2: cerr << "Cannot open checkpoint\n" << endl; break;
 		}
+		return -1;
 	}
 	
+	const CheckpointHeader &header = checkpoint.getHeader();
+	if (header.width != imageSize[0] || header.height != imageSize[1]) {
+		cerr << "Size of checkpoint (" << header.width << "x" << header.height;
+		cerr << ") differs from size of board (" << imageSize[0] << "x" << imageSize[1] << ") !" << endl;
+		return -1;
+	}
+	if (((header.flags & CHECKPOINT_CLAMP) != 0) != clampMode) {
+		cerr << "Checkpoint was written in " << (clampMode ? "wrap" : "clamp") << " mode" << endl;
+		return -1;
+	}
+	
+	/* The checkpoint replaces the pattern, also for HashLife */
+	spawnMode = false;
+	
+	/* Rule and generation of the checkpoint */
+	memcpy(rules, header.rules, 18);
+	setHumanRules();
+	generations = header.generation;
+	startingGeneration = generations;
+	lastCheckpoint = generations;
+	
+	/* The checkpoint is the starting population, kept packed for resets */
+	if (startingBoard.allocate(imageSize[0], imageSize[1]) != 0) return -1;
+	checkpoint.read(startingBoard);
+	resetHostBoard();
+	
+	cout << "Restored generation " << generations << " (" << getCheckpointEngineName(header.engine);
+	cout << ", " << humanRules << ") from " << restoreFile << endl;
 	return 0;
 }
 
+void GameOfLife::setHumanRules() {
+	char numChar[2];
+	humanRules.clear();
+	humanRules.push_back('S');
+	for (int i = 0; i < 9; i++) {
+		if (rules[9+i] == 0) continue;
+		snprintf(numChar,2,"%i",i);
+		humanRules.push_back(numChar[0]);
+	}
+	humanRules.push_back('/');
+	humanRules.push_back('B');
+	for (int i = 0; i < 9; i++) {
+		if (rules[i] == 0) continue;
+		snprintf(numChar,2,"%i",i);
+		humanRules.push_back(numChar[0]);
+	}
+	if (states > 2) {
+		char statesChar[16];
+		snprintf(statesChar, sizeof(statesChar), "/C%i", states);
+		humanRules.append(statesChar);
+	}
+}
+
 int GameOfLife::spawnPopulation() {
 	if (spawnMode) {	/* Spawn population from file pattern */
 		return spawnStaticPopulation();
@@ -135,20 +328,24 @@ int GameOfLife::spawnPopulation() {
 	}
 }
 
+int GameOfLife::resetHostBoard() {
+	/* Only a restored checkpoint is kept, seeds and patterns are spawned again */
+	if (restoreFile.empty()) return spawnPopulation();
+	if (packedMode)
+		boardA.copy(startingBoard);
+	else
+		startingBoard.unpack(imageA);
+	return 0;
+}
+
 int GameOfLife::spawnRandomPopulation() {
-	int random;
-	srand(time(NULL));
-	for (int x = 0; x < imageSize[0]; x++) {
-		for (int y = 0; y < imageSize[1]; y++) {
-			random = rand() % 100;
-			if ((float)random / 100.0f < population)
-				setState(x, y, ALIVE, startingImage);
-			else
-				setState(x, y, DEAD, startingImage);
-		}
-	}
+	/* Counter-based random numbers, the threads do not change the board */
+	if (packedMode)
+		cpuEngine.spawnRandom(boardA, population, seed);
+	else
+		cpuEngine.spawnRandom(imageA, imageSize[0], imageSize[1], population, seed);
 	
-	memcpy(imageA, startingImage, imageSizeBytes);
+	if (unboundedMode) loadUniverse();
 	
 	return 0;
 }
@@ -157,6 +354,19 @@ int GameOfLife::spawnStaticPopulation() {
 	int patternWidth = patternFile.getWidth();
 	int patternHeight = patternFile.getHeight();
 	
+	if (unboundedMode) {
+		/* Load the whole pattern, the board shows its center */
+		if (loadUniverse() != 0) {
+			cerr << "Pattern file parse error\n" << endl;
+			return -1;
+		}
+		if (packedMode)
+			universe.rasterise(boardA);
+		else
+			universe.rasterise(imageA, imageSize[0], imageSize[1]);
+		return 0;
+	}
+	
 	/* Check if pattern fits into image */
 	if (imageSize[0] < patternWidth || imageSize[1] < patternHeight) {
 		cerr << "Size of pattern (" << patternWidth << "x" << patternHeight;
@@ -167,29 +377,25 @@ int GameOfLife::spawnStaticPopulation() {
 	/* Spawn pattern in the center of the image */
 	int topLeft[2] = {imageSize[0]/2-patternWidth/2,
 					  imageSize[1]/2-patternHeight/2};
-	/* counter for copied pattern lines */
-	int copyLine = 0;
 	
-	for (int y = 0; y < imageSize[1]; y++) {
-		for (int x = 0; x < imageSize[0]; x++) {
-			
-			if (x == topLeft[0] && y >= topLeft[1]
-				&& y < (topLeft[1]+patternHeight)
-				) {
-				/* Insert pattern line by line into image */
-				memcpy(&(startingImage[4*x + (4*imageSize[0]*y)]),
-				       &((patternFile.getPattern())[4*patternWidth*copyLine]),
-					   4*patternWidth*sizeof(char));
-				x += patternWidth;
-				copyLine++;
-			} else {
-				setState(x, y, DEAD, startingImage);
-			}
-			
+	/* Decode the pattern straight into the board, the rest of the board is dead */
+	if (packedMode) {
+		boardA.clear();
+		if (patternFile.render(boardA, topLeft[0], topLeft[1]) != 0) {
+			cerr << "Pattern file parse error\n" << endl;
+			return -1;
 		}
+		return 0;
 	}
 	
-	memcpy(imageA, startingImage, imageSizeBytes);
+	for (int y = 0; y < imageSize[1]; y++) {
+		for (int x = 0; x < imageSize[0]; x++)
+			setState(x, y, DEAD, imageA);
+	}
+	if (patternFile.render(imageA, imageSize[0], imageSize[1], topLeft[0], topLeft[1]) != 0) {
+		cerr << "Pattern file parse error\n" << endl;
+		return -1;
+	}
 	
 	return 0;
 }
@@ -237,7 +443,15 @@ int GameOfLife::setupDevice(void) {
 	/**
 	* Create context for OpenCL platform with specified context properties
 	*/
-	context = clCreateContextFromType(cprops, CL_DEVICE_TYPE_GPU, NULL, NULL, &status);
+	cl_context_properties glProperties[7];
+	glSharing = false;
+	if (platform != NULL && getGLContextProperties(platform, glProperties)) {
+		/* Share objects with the current GL context */
+		context = clCreateContextFromType(glProperties, CL_DEVICE_TYPE_GPU, NULL, NULL, &status);
+		glSharing = (status == CL_SUCCESS);
+	}
+	if (!glSharing)
+		context = clCreateContextFromType(cprops, CL_DEVICE_TYPE_GPU, NULL, NULL, &status);
 	assert(status == CL_SUCCESS);
 	
 	/* Get the size of device list data */
@@ -246,20 +460,35 @@ int GameOfLife::setupDevice(void) {
 	assert(status == CL_SUCCESS);
 	
 	devices = (cl_device_id *)malloc(deviceListSize);
-	assert(devices > 0);
+	assert(devices != NULL);
 	
 	/* Get the device list data */
 	status = clGetContextInfo(context, CL_CONTEXT_DEVICES, deviceListSize, devices, NULL);
 	assert(status == CL_SUCCESS);
 	
+	/* Several devices calculate horizontal strips of a packed board */
+	int contextDevices = deviceListSize / sizeof(cl_device_id);
+	int stripDevices = (numberOfDevices == 0) ? contextDevices : min(numberOfDevices, contextDevices);
+	bool periodDetection = periodDetector.getMaxPeriod() > 0;
+	bool useStrips = packedMode && !sparseMode && !periodDetection && states == 2 && stripDevices > 1;
+	programDevices = useStrips ? stripDevices : 1;
+	
+	/* The CPU calculates a band of a packed board on a single device */
+	coExecution = coExecution && packedMode && !sparseMode && !periodDetection && states == 2
+				&& !useStrips && imageSize[1] >= 2;
+	splitRow = imageSize[1] / 2;
+	balanceTime[0] = 0.0f;
+	balanceTime[1] = 0.0f;
+	balanceGenerations = 0;
+	
 	/**
 	* Check OpenCL device skills
 	*/
-	/* Check image support */
+	/* Check image support, packed boards use plain buffers */
 	cl_bool imageSupport;
 	status = clGetDeviceInfo(devices[0], CL_DEVICE_IMAGE_SUPPORT,
 								sizeof(cl_bool), &imageSupport, NULL);
-	assert(status == CL_SUCCESS && imageSupport == CL_TRUE);
+	assert(status == CL_SUCCESS && (packedMode || imageSupport == CL_TRUE));
 	
 	/**
 	* Create OpenCL command queue with profiling support
@@ -267,21 +496,35 @@ int GameOfLife::setupDevice(void) {
 	commandQueue = clCreateCommandQueue(context, devices[0],
 							CL_QUEUE_PROFILING_ENABLE, &status);
 	assert(status == CL_SUCCESS);
+	pinHostBoards();
 	
 	/**
-	* Allocate device memory
+	* Allocate device memory, the strips allocate their own buffers
 	*/
-	cl_image_format format;
-	format.image_channel_order = CL_RGBA;
-	format.image_channel_data_type = CL_UNSIGNED_INT8;
-	// imageA (texture memory)
-	deviceImageA = clCreateImage2D(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-		&format, imageSize[0], imageSize[1], rowPitch, imageA, &status);
-	assert(status == CL_SUCCESS);
-	// imageB (texture memory)
-	deviceImageB = clCreateImage2D(context, CL_MEM_READ_WRITE,
-		&format, imageSize[0], imageSize[1], 0, NULL, &status);
-	assert(status == CL_SUCCESS);
+	if (useStrips) {
+		/* no single device board */
+	} else if (packedMode) {
+		// boardA (global memory, 32 cells per uint)
+		deviceImageA = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+			boardA.getSizeBytes(), boardA.getWords(), &status);
+		assert(status == CL_SUCCESS);
+		// boardB (global memory, 32 cells per uint)
+		deviceImageB = clCreateBuffer(context, CL_MEM_READ_WRITE,
+			boardB.getSizeBytes(), NULL, &status);
+		assert(status == CL_SUCCESS);
+	} else {
+		cl_image_format format;
+		format.image_channel_order = CL_RGBA;
+		format.image_channel_data_type = CL_UNSIGNED_INT8;
+		// imageA (texture memory)
+		deviceImageA = clCreateImage2D(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+			&format, imageSize[0], imageSize[1], rowPitch, imageA, &status);
+		assert(status == CL_SUCCESS);
+		// imageB (texture memory)
+		deviceImageB = clCreateImage2D(context, CL_MEM_READ_WRITE,
+			&format, imageSize[0], imageSize[1], 0, NULL, &status);
+		assert(status == CL_SUCCESS);
+	}
 	// rules (constant memory)
 	deviceRules = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
 			rulesSizeBytes, rules, &status);
@@ -296,42 +539,90 @@ int GameOfLife::setupDevice(void) {
 		return -1;
 	}
 	const char* source = kernels.source().c_str();
-	size_t sourceSize[] = {strlen(source)};		
 	
-	program = clCreateProgramWithSource(context, 1, &source,sourceSize, &status);
+	/* Width of the halo for temporal blocking */
+	if (packedMode) generationsPerLaunch = 1;
+	if (generationsPerLaunch > 1) {
+		char gens[16];
+		snprintf(gens, sizeof(gens), "%i", generationsPerLaunch);
+		kernelBuildOptions.append(" -D GENS=");
+		kernelBuildOptions.append(gens);
+	}
+
+	/* Bake the rules into the program, each rule gets its own cached binary */
+	unsigned int birth, survival;
+	getRuleMasks(rules, birth, survival);
+	char ruleOptions[64];
+	snprintf(ruleOptions, sizeof(ruleOptions), " -D RULE_BIRTH=0x%03X -D RULE_SURVIVAL=0x%03X", birth, survival);
+	kernelBuildOptions.append(ruleOptions);
+	if (states > 2) {
+		snprintf(ruleOptions, sizeof(ruleOptions), " -D STATES=%i", states);
+		kernelBuildOptions.append(ruleOptions);
+	}
 	
-	/* Create a OpenCL program executable for all the devices specified */
-	status = clBuildProgram(program, 1, devices, kernelBuildOptions.c_str(), NULL, NULL);
+	/* The packed kernels hash their tiles into a ring of board hashes */
+	if (periodDetection) {
+		snprintf(ruleOptions, sizeof(ruleOptions), " -D HASH_RING=%i", HASH_RING);
+		kernelBuildOptions.append(ruleOptions);
+	}
+
+	/* Get a kernel object handle for the specified kernel */
+	const char *kernelName = states > 2 ? "nextGenerationPackedStates"
+		: sparseMode ? "nextGenerationPackedSparse"
+		: coExecution ? "nextGenerationPackedRows"
+		: packedMode ? "nextGenerationPacked"
+		: generationsPerLaunch > 1 ? "nextGenerationTemporal"
+		: localMemory ? "nextGenerationLocal" : "nextGeneration";
 	
-	if (status != CL_SUCCESS) {
-		/* if clBuildProgram failed get the build log for the first device */
-		char *buildLog;
-		size_t buildLogSize;
-		/* Get size of build log */
-		clGetProgramBuildInfo(program, devices[0],
-				CL_PROGRAM_BUILD_LOG, 0, NULL, &buildLogSize);
-		/* Allocate space for build log */
-		buildLog = new char[buildLogSize+1];
-		clGetProgramBuildInfo(program, devices[0],
-				CL_PROGRAM_BUILD_LOG, buildLogSize, buildLog, NULL);
-		/* to be carefully, terminate with \0 */
-		buildLog[buildLogSize] = '\0';
-		
-		cerr << "\nBUILD LOG:\n" << buildLog << endl;
-		
-		delete[] buildLog;
+	/* Work-items per work-group from the cache or by timing candidates */
+	bool manualWorkGroupSize = useStrips || kernelBuildOptions.find("TPBX") != string::npos
+							|| kernelBuildOptions.find("TPBY") != string::npos;
+	if (autotune && !manualWorkGroupSize && autotuneWorkGroupSize(kernelName, source) != 0)
 		return -1;
-	}
 	
-	/* Get a kernel object handle for the specified kernel */
-	kernel = clCreateKernel(program, "nextGeneration", &status);
-	assert(status == CL_SUCCESS);
+	/* Create a OpenCL program executable for the device, cached across runs */
+	double buildStart = Metrics::getTimeMs();
+	program = buildProgram(source, kernelBuildOptions, true);
+	if (program == NULL) return -1;
+	metrics.recordHost(METRIC_BUILD, buildStart, Metrics::getTimeMs());
 	
-	/* Set kernel arguments */
-	status |= clSetKernelArg(kernel, 0, sizeof(cl_mem), (void *)&deviceImageA);
-	status |= clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *)&deviceImageB);
-	status |= clSetKernelArg(kernel, 2, sizeof(cl_mem), (void *)&deviceRules);
-	assert(status == CL_SUCCESS);
+	if (useStrips) {
+		/* One command queue and strip kernel per device */
+		if (strips.setup(context, devices, stripDevices, program, deviceRules,
+				boardA, clampMode) != 0) {
+			cerr << "Could not set up strips on " << stripDevices << " devices" << endl;
+			return -1;
+		}
+		char info[64];
+		snprintf(info, sizeof(info), " | devices: %i | threads: %ix%i",
+				(int)strips.getNumberOfStrips(),
+				(int)strips.getLocalThreads(0), (int)strips.getLocalThreads(1));
+		kernelInfo.append(info);
+		kernelInfo.append(" | packed: on");
+		return 0;
+	}
+	
+	/* Width of a row of the device board in uints, 2 uints per host word */
+	cl_int rowWords = 2*boardA.getWordsPerRow();
+	/* Two kernel objects with fixed arguments, A->B and B->A */
+	for (int i = 0; i < 2; i++) {
+		kernel[i] = clCreateKernel(program, kernelName, &status);
+		assert(status == CL_SUCCESS);
+		
+		/* Set kernel arguments */
+		status |= clSetKernelArg(kernel[i], 0, sizeof(cl_mem), (i == 0) ? (void *)&deviceImageA : (void *)&deviceImageB);
+		status |= clSetKernelArg(kernel[i], 1, sizeof(cl_mem), (i == 0) ? (void *)&deviceImageB : (void *)&deviceImageA);
+		status |= clSetKernelArg(kernel[i], 2, sizeof(cl_mem), (void *)&deviceRules);
+		if (packedMode) {
+			status |= clSetKernelArg(kernel[i], 3, sizeof(cl_int), (void *)&imageSize[0]);
+			status |= clSetKernelArg(kernel[i], 4, sizeof(cl_int), (void *)&imageSize[1]);
+			status |= clSetKernelArg(kernel[i], 5, sizeof(cl_int), (void *)&rowWords);
+		}
+		/* Co-execution: last row of the device band, set for every generation */
+		if (coExecution)
+			status |= clSetKernelArg(kernel[i], 6, sizeof(cl_int), (void *)&splitRow);
+		assert(status == CL_SUCCESS);
+	}
 	
 	/* Set optimal values for local and global threads */
 	size_t maxWorkGroupSize;
@@ -339,7 +630,7 @@ int GameOfLife::setupDevice(void) {
 					(void*)&maxWorkGroupSize, NULL);
 	
 	size_t optWorkGroupSize[3];
-	clGetKernelWorkGroupInfo(kernel, devices[0],
+	clGetKernelWorkGroupInfo(kernel[0], devices[0],
 		CL_KERNEL_COMPILE_WORK_GROUP_SIZE, 3*sizeof(size_t),
 		&optWorkGroupSize, NULL);
 	
@@ -347,11 +638,108 @@ int GameOfLife::setupDevice(void) {
 	localThreads[1] = optWorkGroupSize[1];
 	assert(maxWorkGroupSize >= (localThreads[0] * localThreads[1]));
 	
-	int r1 = imageSize[0] % localThreads[0];
+	/* The tiles of the temporal blocking kernel grow with the halo */
+	cl_ulong localMemSize, kernelLocalMemSize;
+	clGetDeviceInfo(devices[0], CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong),
+					(void*)&localMemSize, NULL);
+	clGetKernelWorkGroupInfo(kernel[0], devices[0], CL_KERNEL_LOCAL_MEM_SIZE,
+					sizeof(cl_ulong), (void*)&kernelLocalMemSize, NULL);
+	if (kernelLocalMemSize > localMemSize) {
+		cerr << "Kernel needs " << kernelLocalMemSize << " bytes of local memory, device has "
+			 << localMemSize << endl;
+		return -1;
+	}
+	
+	/* One work item per cell, or per 32 cells of a row in packed mode */
+	int workItems = packedMode ? rowWords : imageSize[0];
+	int r1 = workItems % localThreads[0];
 	int r2 = imageSize[1] % localThreads[1];
-	globalThreads[0] = (r1 == 0) ? imageSize[0] : imageSize[0] + localThreads[0] - r1;
+	globalThreads[0] = (r1 == 0) ? workItems : workItems + localThreads[0] - r1;
 	globalThreads[1] = (r2 == 0) ? imageSize[1] : imageSize[1] + localThreads[1] - r2;
 	
+	/* Resets regenerate the starting population on the device, random cells from
+	   the seed, patterns and checkpoints from a packed copy on the device */
+	if (restoreFile.empty() && !spawnMode) {
+		startingKernel = clCreateKernel(program, packedMode ? "spawnRandomPacked" : "spawnRandomImage", &status);
+		assert(status == CL_SUCCESS);
+		cl_ulong startingSeed = seed;
+		cl_ulong threshold = getRandomThreshold(population);
+		cl_uint argument = 0;
+		status |= clSetKernelArg(startingKernel, argument++, sizeof(cl_mem), (void *)&deviceImageA);
+		if (packedMode) {
+			status |= clSetKernelArg(startingKernel, argument++, sizeof(cl_int), (void *)&imageSize[0]);
+			status |= clSetKernelArg(startingKernel, argument++, sizeof(cl_int), (void *)&imageSize[1]);
+			status |= clSetKernelArg(startingKernel, argument++, sizeof(cl_int), (void *)&rowWords);
+		}
+		status |= clSetKernelArg(startingKernel, argument++, sizeof(cl_ulong), (void *)&startingSeed);
+		status |= clSetKernelArg(startingKernel, argument++, sizeof(cl_ulong), (void *)&threshold);
+		assert(status == CL_SUCCESS);
+	} else if (packedMode) {
+		deviceStartingBoard = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+				boardA.getSizeBytes(), boardA.getWords(), &status);
+		assert(status == CL_SUCCESS);
+	} else {
+		PackedBoard board;
+		if (board.allocate(imageSize[0], imageSize[1]) != 0) return -1;
+		board.pack(imageA);
+		cl_int packedRowWords = 2*board.getWordsPerRow();
+		deviceStartingBoard = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+				board.getSizeBytes(), board.getWords(), &status);
+		assert(status == CL_SUCCESS);
+		startingKernel = clCreateKernel(program, "unpackImage", &status);
+		assert(status == CL_SUCCESS);
+		status |= clSetKernelArg(startingKernel, 0, sizeof(cl_mem), (void *)&deviceStartingBoard);
+		status |= clSetKernelArg(startingKernel, 1, sizeof(cl_mem), (void *)&deviceImageA);
+		status |= clSetKernelArg(startingKernel, 2, sizeof(cl_int), (void *)&packedRowWords);
+		assert(status == CL_SUCCESS);
+	}
+	
+	/* Downsampling of zoomed out views, co-execution copies the whole board */
+	if (!coExecution) {
+		displayKernel = clCreateKernel(program, packedMode ? "downsamplePacked" : "downsampleImage", &status);
+		assert(status == CL_SUCCESS);
+		status |= clSetKernelArg(displayKernel, 6, sizeof(cl_int), (void *)&imageSize[0]);
+		status |= clSetKernelArg(displayKernel, 7, sizeof(cl_int), (void *)&imageSize[1]);
+		if (packedMode)
+			status |= clSetKernelArg(displayKernel, 8, sizeof(cl_int), (void *)&rowWords);
+		assert(status == CL_SUCCESS);
+	}
+	
+	/* Sparse mode: one flag per work group for changed tiles */
+	if (sparseMode) {
+		numberOfTiles = (globalThreads[0]/localThreads[0]) * (globalThreads[1]/localThreads[1]);
+		deviceChangedA = clCreateBuffer(context, CL_MEM_READ_WRITE, numberOfTiles, NULL, &status);
+		assert(status == CL_SUCCESS);
+		deviceChangedB = clCreateBuffer(context, CL_MEM_READ_WRITE, numberOfTiles, NULL, &status);
+		assert(status == CL_SUCCESS);
+		for (int i = 0; i < 2; i++) {
+			status |= clSetKernelArg(kernel[i], 6, sizeof(cl_mem), (i == 0) ? (void *)&deviceChangedA : (void *)&deviceChangedB);
+			status |= clSetKernelArg(kernel[i], 7, sizeof(cl_mem), (i == 0) ? (void *)&deviceChangedB : (void *)&deviceChangedA);
+		}
+		status |= resetChangedTiles();
+		assert(status == CL_SUCCESS);
+	}
+	
+	/* Period detection: the hash of each tile and the ring of board hashes */
+	if (periodDetection) {
+		numberOfTiles = (globalThreads[0]/localThreads[0]) * (globalThreads[1]/localThreads[1]);
+		deviceTileHashes = clCreateBuffer(context, CL_MEM_READ_WRITE,
+				2*numberOfTiles*sizeof(cl_uint), NULL, &status);
+		assert(status == CL_SUCCESS);
+		deviceHashes = clCreateBuffer(context, CL_MEM_READ_WRITE,
+				2*HASH_RING*sizeof(cl_uint), NULL, &status);
+		assert(status == CL_SUCCESS);
+		hostHashes.assign(2*HASH_RING, 0);
+		/* The slot of the ring is set for every generation */
+		cl_uint hashArgument = sparseMode ? 8 : 6;
+		for (int i = 0; i < 2; i++) {
+			status |= clSetKernelArg(kernel[i], hashArgument, sizeof(cl_mem), (void *)&deviceTileHashes);
+			status |= clSetKernelArg(kernel[i], hashArgument+1, sizeof(cl_mem), (void *)&deviceHashes);
+		}
+		status |= resetChangedTiles();
+		assert(status == CL_SUCCESS);
+	}
+	
 	char threads[32];
 	kernelInfo.append(" | blocks: ");
 	snprintf(threads,countDigits(globalThreads[0]/localThreads[0])+1,"%i",(int)globalThreads[0]/(int)localThreads[0]);
@@ -365,84 +753,699 @@ int GameOfLife::setupDevice(void) {
 	kernelInfo.append("x");
 	snprintf(threads,countDigits(localThreads[1])+1,"%i",(int)localThreads[1]);
 	kernelInfo.append(threads);
+	if (glSharing) kernelInfo.append(" | gl sharing: on");
+	if (packedMode) kernelInfo.append(" | packed: on");
+	if (states > 2) {
+		snprintf(threads,sizeof(threads),"%i",states);
+		kernelInfo.append(" | states: ");
+		kernelInfo.append(threads);
+	}
+	if (coExecution) kernelInfo.append(" | co-execution: on");
+	if (sparseMode) kernelInfo.append(" | sparse: on");
+	else if (generationsPerLaunch > 1) {
+		kernelInfo.append(" | generations per run: ");
+		snprintf(threads,countDigits(generationsPerLaunch)+1,"%i",generationsPerLaunch);
+		kernelInfo.append(threads);
+	}
+	else if (localMemory) kernelInfo.append(" | local memory: on");
+	if (periodDetection) {
+		snprintf(threads,sizeof(threads),"%i",periodDetector.getMaxPeriod());
+		kernelInfo.append(" | periods: ");
+		kernelInfo.append(threads);
+	}
+	if (autotune && !manualWorkGroupSize) kernelInfo.append(" | autotuned");
+	
+	return 0;
+}
+
+/**
+* Get the path of the autotune cache in the home directory,
+* in the working directory if there is none.
+*/
+static string getCachePath(const char *name) {
+	const char *home = getenv("HOME");
+	#ifdef WIN32
+		if (home == NULL) home = getenv("USERPROFILE");
+	#endif
+	string path(home != NULL ? home : ".");
+	path.append("/");
+	path.append(name);
+	return path;
+}
+
+/**
+* 64 bit FNV-1a hash of a string, continuing from a previous hash.
+*/
+static uint64_t hashFNV1a(const string &data, uint64_t hash = 14695981039346656037ULL) {
+	for (size_t i = 0; i < data.size(); i++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ULL;
+	}
+	/* Separate the strings of a key */
+	hash ^= 0xFF;
+	hash *= 1099511628211ULL;
+	return hash;
+}
+
+cl_program GameOfLife::buildProgram(const char *source, const string &options, bool printLog) {
+	cl_int status = CL_SUCCESS;
+	const cl_uint n = programDevices;
+	
+	/* One cache file per device, named by the hash of source, options, device and driver */
+	string cacheDir = getCachePath(PROGRAM_CACHE_DIR);
+	vector<string> cachePaths(n);
+	uint64_t sourceHash = hashFNV1a(options, hashFNV1a(source));
+	for (cl_uint i = 0; i < n; i++) {
+		char deviceName[256], driverVersion[256], hashName[32];
+		status |= clGetDeviceInfo(devices[i], CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL);
+		status |= clGetDeviceInfo(devices[i], CL_DRIVER_VERSION, sizeof(driverVersion), driverVersion, NULL);
+		assert(status == CL_SUCCESS);
+		uint64_t hash = hashFNV1a(driverVersion, hashFNV1a(deviceName, sourceHash));
+		snprintf(hashName, sizeof(hashName), "/%016llx.bin", (unsigned long long)hash);
+		cachePaths[i] = cacheDir + hashName;
+	}
+	
+	/* Load the cached binaries, they still have to be built for the devices */
+	vector< vector<unsigned char> > binaries(n);
+	bool cachedAll = true;
+	for (cl_uint i = 0; i < n && cachedAll; i++) {
+		FILE *file = fopen(cachePaths[i].c_str(), "rb");
+		cachedAll = false;
+		if (file == NULL) break;
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		if (size > 0) {
+			binaries[i].resize(size);
+			cachedAll = fread(&binaries[i][0], 1, size, file) == (size_t)size;
+		}
+		fclose(file);
+	}
+	if (cachedAll) {
+		vector<const unsigned char *> binaryPointers(n);
+		vector<size_t> binarySizes(n);
+		vector<cl_int> binaryStatus(n);
+		for (cl_uint i = 0; i < n; i++) {
+			binaryPointers[i] = &binaries[i][0];
+			binarySizes[i] = binaries[i].size();
+		}
+		cl_program cached = clCreateProgramWithBinary(context, n, devices, &binarySizes[0],
+				&binaryPointers[0], &binaryStatus[0], &status);
+		bool valid = status == CL_SUCCESS;
+		for (cl_uint i = 0; i < n; i++)
+			valid = valid && binaryStatus[i] == CL_SUCCESS;
+		if (valid && clBuildProgram(cached, n, devices, options.c_str(), NULL, NULL) == CL_SUCCESS)
+			return cached;
+		/* Stale or broken binary, build from source */
+		if (cached != NULL) clReleaseProgram(cached);
+	}
+	
+	size_t sourceSize[] = {strlen(source)};
+	cl_program built = clCreateProgramWithSource(context, 1, &source, sourceSize, &status);
+	if (status != CL_SUCCESS) return NULL;
+	status = clBuildProgram(built, n, devices, options.c_str(), NULL, NULL);
+	
+	if (status != CL_SUCCESS) {
+		if (printLog) {
+			/* if clBuildProgram failed get the build log for the first device */
+			char *buildLog;
+			size_t buildLogSize;
+			/* Get size of build log */
+			clGetProgramBuildInfo(built, devices[0],
+					CL_PROGRAM_BUILD_LOG, 0, NULL, &buildLogSize);
+			/* Allocate space for build log */
+			buildLog = new char[buildLogSize+1];
+			clGetProgramBuildInfo(built, devices[0],
+					CL_PROGRAM_BUILD_LOG, buildLogSize, buildLog, NULL);
+			/* to be carefully, terminate with \0 */
+			buildLog[buildLogSize] = '\0';
+			
+			cerr << "\nBUILD LOG:\n" << buildLog << endl;
+			
+			delete[] buildLog;
+		}
+		clReleaseProgram(built);
+		return NULL;
+	}
+	
+	/* Save the binaries of the devices, a missing cache only costs the next build */
+	vector<size_t> binarySizes(n, 0);
+	if (clGetProgramInfo(built, CL_PROGRAM_BINARY_SIZES, n*sizeof(size_t), &binarySizes[0], NULL) != CL_SUCCESS)
+		return built;
+	vector<unsigned char *> binaryPointers(n);
+	for (cl_uint i = 0; i < n; i++) {
+		binaries[i].resize(binarySizes[i] > 0 ? binarySizes[i] : 1);
+		binaryPointers[i] = &binaries[i][0];
+	}
+	if (clGetProgramInfo(built, CL_PROGRAM_BINARIES, n*sizeof(unsigned char *), &binaryPointers[0], NULL) != CL_SUCCESS)
+		return built;
+	#ifdef WIN32
+		_mkdir(cacheDir.c_str());
+	#else
+		mkdir(cacheDir.c_str(), 0755);
+	#endif
+	for (cl_uint i = 0; i < n; i++) {
+		if (binarySizes[i] == 0) continue;
+		/* Write to a temporary file first, parallel runs never read half a binary */
+		char pid[32];
+		snprintf(pid, sizeof(pid), ".tmp%ld", (long)getpid());
+		string tempPath = cachePaths[i] + pid;
+		FILE *file = fopen(tempPath.c_str(), "wb");
+		if (file == NULL) continue;
+		bool written = fwrite(&binaries[i][0], 1, binarySizes[i], file) == binarySizes[i];
+		written = (fclose(file) == 0) && written;
+		if (!written || rename(tempPath.c_str(), cachePaths[i].c_str()) != 0)
+			remove(tempPath.c_str());
+	}
+	return built;
+}
+
+int GameOfLife::autotuneWorkGroupSize(const char *kernelName, const char *source) {
+	/* Cache key: device, driver, board size, kernel and build options */
+	char deviceName[256], driverVersion[256], size[32];
+	cl_int status = clGetDeviceInfo(devices[0], CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL);
+	status |= clGetDeviceInfo(devices[0], CL_DRIVER_VERSION, sizeof(driverVersion), driverVersion, NULL);
+	assert(status == CL_SUCCESS);
+	snprintf(size, sizeof(size), "%ix%i", imageSize[0], imageSize[1]);
+	string key(deviceName);
+	key.append("|").append(driverVersion).append("|").append(size);
+	key.append("|").append(kernelName).append("|").append(kernelBuildOptions);
 	
+	/* Lines of the cache are the key, a tab and the work-items for x and y */
+	int best[2] = {0, 0};
+	string cachePath = getCachePath(AUTOTUNE_CACHE_FILE);
+	FILE *cache = fopen(cachePath.c_str(), "r");
+	if (cache != NULL) {
+		char line[1024];
+		while (fgets(line, sizeof(line), cache) != NULL) {
+			char *tab = strrchr(line, '\t');
+			if (tab == NULL) continue;
+			*tab = '\0';
+			int x, y;
+			if (key == line && sscanf(tab+1, "%i %i", &x, &y) == 2) {
+				best[0] = x;
+				best[1] = y;
+			}
+		}
+		fclose(cache);
+	}
+	
+	if (best[0] == 0) {
+		/* Time all candidates which fit the device */
+		static const int candidates[2][7] = {
+			{8, 16, 32, 64, 128, 256, 0},
+			{1, 2, 4, 8, 12, 16, 32}
+		};
+		size_t maxWorkGroupSize;
+		clGetDeviceInfo(devices[0], CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t),
+						(void*)&maxWorkGroupSize, NULL);
+		float bestTime = -1.0f;
+		for (int i = 0; candidates[0][i] != 0; i++) {
+			for (int k = 0; k < 7; k++) {
+				int x = candidates[0][i], y = candidates[1][k];
+				if (x*y < 32 || (size_t)(x*y) > maxWorkGroupSize) continue;
+				float time = timeWorkGroupSize(kernelName, source, x, y);
+				if (time >= 0.0f && (bestTime < 0.0f || time < bestTime)) {
+					bestTime = time;
+					best[0] = x;
+					best[1] = y;
+				}
+			}
+		}
+		if (best[0] == 0) {
+			cerr << "Autotuning found no usable work-group size" << endl;
+			return -1;
+		}
+		
+		/* Append the winner, the newest line of a key wins */
+		cache = fopen(cachePath.c_str(), "a");
+		if (cache != NULL) {
+			fprintf(cache, "%s\t%i %i\n", key.c_str(), best[0], best[1]);
+			fclose(cache);
+		}
+	}
+	
+	char options[64];
+	snprintf(options, sizeof(options), " -D TPBX=%i -D TPBY=%i", best[0], best[1]);
+	kernelBuildOptions.append(options);
 	return 0;
 }
 
+float GameOfLife::timeWorkGroupSize(const char *kernelName, const char *source, int x, int y) {
+	cl_int status = CL_SUCCESS;
+	char options[64];
+	snprintf(options, sizeof(options), " -D TPBX=%i -D TPBY=%i", x, y);
+	string buildOptions(kernelBuildOptions);
+	buildOptions.append(options);
+	
+	/* Build the program for this candidate, failures only drop the candidate */
+	cl_program candidate = buildProgram(source, buildOptions, false);
+	if (candidate == NULL) return -1.0f;
+	cl_kernel candidateKernel = clCreateKernel(candidate, kernelName, &status);
+	if (status != CL_SUCCESS) {
+		clReleaseProgram(candidate);
+		return -1.0f;
+	}
+	
+	/* The kernel must run with the whole work-group and fit into local memory */
+	size_t kernelWorkGroupSize;
+	cl_ulong localMemSize, kernelLocalMemSize;
+	clGetKernelWorkGroupInfo(candidateKernel, devices[0], CL_KERNEL_WORK_GROUP_SIZE,
+					sizeof(size_t), (void*)&kernelWorkGroupSize, NULL);
+	clGetDeviceInfo(devices[0], CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong),
+					(void*)&localMemSize, NULL);
+	clGetKernelWorkGroupInfo(candidateKernel, devices[0], CL_KERNEL_LOCAL_MEM_SIZE,
+					sizeof(cl_ulong), (void*)&kernelLocalMemSize, NULL);
+	float time = -1.0f;
+	if (kernelWorkGroupSize >= (size_t)(x*y) && kernelLocalMemSize <= localMemSize) {
+		/* Same arguments and global size as setupDevice, always A->B */
+		cl_int rowWords = 2*boardA.getWordsPerRow();
+		size_t local[2] = {(size_t)x, (size_t)y};
+		size_t global[2];
+		int workItems = packedMode ? rowWords : imageSize[0];
+		global[0] = (workItems + x - 1) / x * x;
+		global[1] = (imageSize[1] + y - 1) / y * y;
+		status |= clSetKernelArg(candidateKernel, 0, sizeof(cl_mem), (void *)&deviceImageA);
+		status |= clSetKernelArg(candidateKernel, 1, sizeof(cl_mem), (void *)&deviceImageB);
+		status |= clSetKernelArg(candidateKernel, 2, sizeof(cl_mem), (void *)&deviceRules);
+		if (packedMode) {
+			status |= clSetKernelArg(candidateKernel, 3, sizeof(cl_int), (void *)&imageSize[0]);
+			status |= clSetKernelArg(candidateKernel, 4, sizeof(cl_int), (void *)&imageSize[1]);
+			status |= clSetKernelArg(candidateKernel, 5, sizeof(cl_int), (void *)&rowWords);
+		}
+		/* Co-execution: time the whole board on the device */
+		if (coExecution)
+			status |= clSetKernelArg(candidateKernel, 6, sizeof(cl_int), (void *)&imageSize[1]);
+		/* Sparse mode: all tiles changed, so every work group calculates */
+		cl_mem changed[2] = {NULL, NULL};
+		if (sparseMode) {
+			size_t tiles = (global[0]/local[0]) * (global[1]/local[1]);
+			vector<unsigned char> ones(tiles, 1);
+			for (int i = 0; i < 2; i++) {
+				changed[i] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+						tiles, &ones[0], &status);
+				assert(status == CL_SUCCESS);
+			}
+			status |= clSetKernelArg(candidateKernel, 6, sizeof(cl_mem), (void *)&changed[0]);
+			status |= clSetKernelArg(candidateKernel, 7, sizeof(cl_mem), (void *)&changed[1]);
+		}
+		/* Period detection: zero hashes, the slot does not matter */
+		cl_mem hashes[2] = {NULL, NULL};
+		if (periodDetector.getMaxPeriod() > 0) {
+			size_t tiles = (global[0]/local[0]) * (global[1]/local[1]);
+			size_t sizes[2] = {2*tiles*sizeof(cl_uint), 2*HASH_RING*sizeof(cl_uint)};
+			cl_uint hashArgument = sparseMode ? 8 : 6;
+			cl_int slot = 0;
+			for (int i = 0; i < 2; i++) {
+				vector<cl_uint> zeros(sizes[i]/sizeof(cl_uint), 0);
+				hashes[i] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+						sizes[i], &zeros[0], &status);
+				assert(status == CL_SUCCESS);
+				status |= clSetKernelArg(candidateKernel, hashArgument+i, sizeof(cl_mem), (void *)&hashes[i]);
+			}
+			status |= clSetKernelArg(candidateKernel, hashArgument+2, sizeof(cl_int), (void *)&slot);
+		}
+		assert(status == CL_SUCCESS);
+		
+		/* One warm up run, then the median of the profiled runs */
+		vector<float> times;
+		cl_event events[AUTOTUNE_RUNS+1];
+		int enqueued = 0;
+		while (enqueued <= AUTOTUNE_RUNS && clEnqueueNDRangeKernel(commandQueue, candidateKernel,
+				2, NULL, global, local, 0, NULL, &events[enqueued]) == CL_SUCCESS)
+			enqueued++;
+		clFinish(commandQueue);
+		if (enqueued == AUTOTUNE_RUNS+1) {
+			for (int i = 1; i <= AUTOTUNE_RUNS; i++) {
+				cl_ulong start, end;
+				clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+				clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+				times.push_back((end - start) * 1.0e-6f);
+			}
+			sort(times.begin(), times.end());
+			time = times[times.size()/2];
+		}
+		for (int i = 0; i < enqueued; i++)
+			clReleaseEvent(events[i]);
+		for (int i = 0; i < 2; i++) {
+			if (changed[i] != NULL) clReleaseMemObject(changed[i]);
+			if (hashes[i] != NULL) clReleaseMemObject(hashes[i]);
+		}
+	}
+	
+	clReleaseKernel(candidateKernel);
+	clReleaseProgram(candidate);
+	return time;
+}
+
 int GameOfLife::nextGeneration(unsigned char *bufferImage) {
-	if (CPUMode) return nextGenerationCPU(bufferImage);
-	else return nextGenerationOpenCL(bufferImage);
+	int status;
+	displayRegion = isDisplayDownsampled() ? viewRegion : getFullRegion();
+	if (hashLifeMode) status = nextGenerationHashLife(bufferImage);
+	else if (CPUMode) status = nextGenerationCPU(bufferImage);
+	else status = nextGenerationOpenCL(bufferImage);
+	
+	/* Periodic checkpoint, one call may calculate several generations */
+	if (status == 0 && checkpointInterval > 0 && !checkpointFile.empty()
+		&& generations >= lastCheckpoint + checkpointInterval)
+		status = writeCheckpoint();
+	
+	/* Frames are read and written while the next generations are calculated */
+	if (status == 0 && !exportPrefix.empty() && generations >= lastExport + exportInterval)
+		status = exportFrame();
+	return status;
+}
+
+int GameOfLife::exportFrame() {
+	int slot = exporter.acquire();
+	if (slot < 0) return -1;
+	cl_event event = NULL;
+	
+	if (CPUMode || hashLifeMode || coExecution) {
+		/* The current host board is complete */
+		memcpy(exporter.getHost(slot), getHostBoard(switchImages),
+				packedMode ? boardA.getSizeBytes() : imageSizeBytes);
+	} else {
+		/* Read behind the enqueued generations, the writer waits for the event */
+		cl_int status = enqueueReadBoard(switchImages ? deviceImageA : deviceImageB,
+				CL_FALSE, exporter.getHost(slot), &event);
+		assert(status == CL_SUCCESS);
+		clFlush(commandQueue);
+	}
+	exporter.submit(slot, generations, event);
+	lastExport = generations;
+	return 0;
+}
+
+int GameOfLife::writeCheckpoint() {
+	if (checkpointFile.empty() || unboundedMode || hashLifeMode) return -1;
+	
+	/* Get the current generation from the device, the queue is in order */
+	if (!CPUMode && !hashLifeMode && generations > 0) {
+		cl_int status = enqueueReadBoard(
+			switchImages ? deviceImageA : deviceImageB,
+			CL_TRUE, getHostBoard(switchImages), NULL);
+		assert(status == CL_SUCCESS);
+	}
+	
+	/* Copy the board, the file is written in the background */
+	uint32_t engine = CPUMode ? CHECKPOINT_CPU : CHECKPOINT_OPENCL;
+	int status;
+	if (packedMode)
+		status = checkpointWriter.start(checkpointFile, switchImages ? boardA : boardB,
+					rules, clampMode, generations, engine);
+	else
+		status = checkpointWriter.start(checkpointFile, switchImages ? imageA : imageB,
+					imageSize[0], imageSize[1], rules, clampMode, generations, engine);
+	lastCheckpoint = generations;
+	
+	/* A failed write keeps the previous checkpoint, the calculation goes on */
+	if (status != 0)
+		cerr << "Cannot write checkpoint " << checkpointFile << endl;
+	return 0;
+}
+
+int GameOfLife::nextGenerationStrips(unsigned char *bufferImage) {
+	cl_int status = CL_SUCCESS;
+	std::vector<cl_event> copyEvents;
+	bool copyFinished;
+	PackedBoard &copyBoard = switchImages ? boardB : boardA;
+	generationsPerCopyEvent = 0;
+	
+	/* Like nextGenerationOpenCL, all devices calculate until the copy has finished */
+	do {
+		status = strips.enqueueGeneration(copyEvents.empty());
+		assert(status == CL_SUCCESS);
+		generations++;
+		generationsPerCopyEvent++;
+		
+		/* Read all strips of the first generation, this starts the copy */
+		if (copyEvents.empty()) {
+			status = strips.enqueueRead(copyBoard.getWords(), copyEvents);
+			assert(status == CL_SUCCESS);
+		}
+		switchImages = !switchImages;
+		
+		/* Limit the number of generations queued behind the copy */
+		if (readSync || generationsPerCopyEvent >= MAX_QUEUED_GENERATIONS
+			|| (maxGenerations > 0 && generations >= maxGenerations))
+			clWaitForEvents(copyEvents.size(), &copyEvents[0]);
+		
+		copyFinished = true;
+		for (size_t i = 0; i < copyEvents.size(); i++) {
+			cl_int copyStatus;
+			status = clGetEventInfo(copyEvents[i], CL_EVENT_COMMAND_EXECUTION_STATUS,
+						sizeof(cl_int), &copyStatus, NULL);
+			assert(status == CL_SUCCESS && copyStatus >= 0);
+			copyFinished = copyFinished && copyStatus == CL_COMPLETE;
+		}
+	} while (!copyFinished);
+	for (size_t i = 0; i < copyEvents.size(); i++)
+		clReleaseEvent(copyEvents[i]);
+	
+	/* The profiled generation is in front of the copy and has finished */
+	executionTime = strips.getProfiledTime();
+	if (metrics.isEnabled()) {
+		metrics.record(METRIC_KERNEL, executionTime);
+		metrics.record(METRIC_POPULATION, (double)copyBoard.getPopulation());
+	}
+	
+	/* Expand packed board for OpenGL output */
+	if (bufferImage != NULL) copyBoard.unpack(bufferImage);
+	
+	/* Single generation mode */
+	if (singleGen) switchPause();
+	
+	return 0;
+}
+
+int GameOfLife::nextGenerationCoExecution(unsigned char *bufferImage) {
+	cl_int status = CL_SUCCESS;
+	const int height = imageSize[1];
+	const int wordsPerRow = boardA.getWordsPerRow();
+	const size_t rowBytes = wordsPerRow*sizeof(uint64_t);
+	PackedBoard &src = switchImages ? boardA : boardB;
+	PackedBoard &dst = switchImages ? boardB : boardA;
+	cl_mem deviceSrc = switchImages ? deviceImageA : deviceImageB;
+	cl_mem deviceDst = switchImages ? deviceImageB : deviceImageA;
+	cl_kernel bandKernel = switchImages ? kernel[0] : kernel[1];
+	cl_event writeEvent, readEvent;
+	double start = Metrics::getTimeMs();
+	
+	/* The first and last row of the CPU band are the neighbours of the device band */
+	status |= clEnqueueWriteBuffer(commandQueue, deviceSrc, CL_FALSE,
+				splitRow*rowBytes, rowBytes, &src.getWords()[splitRow*wordsPerRow],
+				0, NULL, &writeEvent);
+	status |= clEnqueueWriteBuffer(commandQueue, deviceSrc, CL_FALSE,
+				(height-1)*rowBytes, rowBytes, &src.getWords()[(height-1)*wordsPerRow],
+				0, NULL, NULL);
+	
+	/* Device band [0,splitRow) */
+	size_t bandThreads[2];
+	bandThreads[0] = globalThreads[0];
+	bandThreads[1] = (splitRow + localThreads[1] - 1) / localThreads[1] * localThreads[1];
+	status |= clSetKernelArg(bandKernel, 6, sizeof(cl_int), (void *)&splitRow);
+	status |= clEnqueueNDRangeKernel(commandQueue, bandKernel, 2, NULL,
+				bandThreads, localThreads, 0, NULL, NULL);
+	
+	/* The whole band is read, every generation is shown and its
+	   first and last row are the neighbours of the CPU band */
+	status |= clEnqueueReadBuffer(commandQueue, deviceDst, CL_FALSE,
+				0, splitRow*rowBytes, dst.getWords(), 0, NULL, &readEvent);
+	assert(status == CL_SUCCESS);
+	clFlush(commandQueue);
+	
+	/* CPU band [splitRow,height) on all cores meanwhile, the bands of dst do not overlap */
+	double cpuStart = Metrics::getTimeMs();
+	cpuEngine.nextGenerationRows(src, dst, rules, clampMode, splitRow, height);
+	balanceTime[1] += (float)(Metrics::getTimeMs() - cpuStart);
+	
+	/* Time of the device from the first copy to the end of the read */
+	cl_ulong deviceStart, deviceEnd;
+	status = clWaitForEvents(1, &readEvent);
+	status |= clGetEventProfilingInfo(writeEvent,
+		CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &deviceStart, NULL);
+	status |= clGetEventProfilingInfo(readEvent,
+		CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &deviceEnd, NULL);
+	assert(status == CL_SUCCESS);
+	balanceTime[0] += (deviceEnd - deviceStart) * 1.0e-6f;
+	metrics.recordEvent(METRIC_WRITE, writeEvent);
+	metrics.recordEvent(METRIC_READ, readEvent);
+	clReleaseEvent(writeEvent);
+	clReleaseEvent(readEvent);
+	
+	if (++balanceGenerations >= COEXECUTION_BALANCE_GENERATIONS)
+		balanceCoExecution(dst, deviceDst);
+	
+	/* Update generation counter */
+	generations++;
+	generationsPerCopyEvent = 1;
+	executionTime = (float)(Metrics::getTimeMs() - start);
+	if (metrics.isEnabled()) metrics.record(METRIC_POPULATION, (double)dst.getPopulation());
+	
+	/* Expand packed board for OpenGL output */
+	if (bufferImage != NULL) dst.unpack(bufferImage);
+	switchImages = !switchImages;
+	
+	/* Single generation mode */
+	if (singleGen) switchPause();
+	
+	return 0;
+}
+
+void GameOfLife::balanceCoExecution(const PackedBoard &board, cl_mem deviceBoard) {
+	const int height = imageSize[1];
+	float deviceRowTime = balanceTime[0] / splitRow;
+	float cpuRowTime = balanceTime[1] / (height - splitRow);
+	balanceTime[0] = 0.0f;
+	balanceTime[1] = 0.0f;
+	balanceGenerations = 0;
+	if (deviceRowTime + cpuRowTime <= 0.0f) return;
+	
+	/* Split for equal time on both sides, moved halfway to damp noisy timings */
+	int target = (int)(height * cpuRowTime / (deviceRowTime + cpuRowTime));
+	int nextSplitRow = max(1, min(height-1, (splitRow + target) / 2));
+	
+	/* Rows moving to the device are only up to date on the host,
+	   rows moving to the CPU were read with the device band */
+	if (nextSplitRow > splitRow) {
+		const size_t rowBytes = board.getWordsPerRow()*sizeof(uint64_t);
+		cl_int status = clEnqueueWriteBuffer(commandQueue, deviceBoard, CL_TRUE,
+					splitRow*rowBytes, (nextSplitRow-splitRow)*rowBytes,
+					&board.getWords()[splitRow*board.getWordsPerRow()], 0, NULL, NULL);
+		assert(status == CL_SUCCESS);
+	}
+	splitRow = nextSplitRow;
 }
 
 int GameOfLife::nextGenerationOpenCL(unsigned char *bufferImage) {
+	if (strips.getNumberOfStrips() > 0) return nextGenerationStrips(bufferImage);
+	if (coExecution) return nextGenerationCoExecution(bufferImage);
 	cl_int status = CL_SUCCESS;
 	cl_event kernelEvent = NULL;
 	cl_event copyEvent = NULL;
+	cl_event hashEvent = NULL;
+	uint64_t hashGeneration = 0;
 	cl_int copyFinished;
+	PackedBoard *copyBoard = NULL;
+	unsigned char *copyImage = NULL;
+	bool downsample = isDisplayDownsampled();
 	generationsPerCopyEvent = 0;
 	
 	/* 
 	 * Calculate next generations until copying the first
-	 * generation from device to host has finished
+	 * generation from device to host has finished.
+	 * The queue is in-order, so kernel runs are enqueued back to back
+	 * without waiting for them on the host.
 	 */
 	do {
-		/* Enqueue a kernel run call and wait for kernel to finish */
-		status = clEnqueueNDRangeKernel(commandQueue, kernel, 2, NULL,
-			globalThreads, localThreads, NULL, NULL, &kernelEvent);
-		clWaitForEvents(1, &kernelEvent);
-		
-		assert(status == CL_SUCCESS);
-		
-		/* Update generation counter */
-		generations++;
-		generationsPerCopyEvent++;
-		
-		/* Calculate kernel execution time */
-		if (copyEvent == NULL) {
-			cl_ulong start, end;
-			
-			status |= clGetEventProfilingInfo(kernelEvent,
-				CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
-			
-			status |= clGetEventProfilingInfo(kernelEvent,
-				CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+		/* Slot of the generation in the ring of board hashes */
+		if (deviceHashes != NULL) {
+			cl_int slot = (generations + 1) % HASH_RING;
+			status = clSetKernelArg(switchImages ? kernel[0] : kernel[1],
+					sparseMode ? 10 : 8, sizeof(cl_int), (void *)&slot);
 			assert(status == CL_SUCCESS);
-			
-			executionTime = (end - start) * 1.0e-6f;
 		}
-		clReleaseEvent(kernelEvent);
 		
-		/* Exchange images for current and next generation */
-		status |= clSetKernelArg(kernel,
-					0, sizeof(cl_mem),
-					switchImages ? (void *)&deviceImageB : (void *)&deviceImageA );
-		status |= clSetKernelArg(kernel,
-					1, sizeof(cl_mem),
-					switchImages ? (void *)&deviceImageA : (void *)&deviceImageB );
+		/* Enqueue the kernel for the current direction, only the first run is profiled */
+		status = clEnqueueNDRangeKernel(commandQueue,
+			switchImages ? kernel[0] : kernel[1], 2, NULL,
+			globalThreads, localThreads, 0, NULL,
+			(copyEvent == NULL) ? &kernelEvent : NULL);
 		assert(status == CL_SUCCESS);
 		
+		/* Update generation counter, one run may calculate several generations */
+		generations += generationsPerLaunch;
+		generationsPerCopyEvent += generationsPerLaunch;
+		
 		/*
 		 * Update image on host for OpenGL output
 		 * This starts the copy event
 		 */
-		if (copyEvent == NULL) {
-			status |= clEnqueueReadImage(commandQueue,
+		if (copyEvent == NULL && bufferImage == NULL && !metrics.isEnabled()) {
+			/* No frame is drawn, a marker behind the run limits the queue like a copy */
+			status |= clEnqueueMarker(commandQueue, &copyEvent);
+			assert(status == CL_SUCCESS);
+			clFlush(commandQueue);
+		} else if (copyEvent == NULL && bufferImage != NULL && downsample) {
+			/* Only the visible part at the resolution of the window */
+			status |= enqueueDisplayBoard(switchImages ? deviceImageB : deviceImageA,
+						readSync, bufferImage, &copyEvent);
+			assert(status == CL_SUCCESS);
+			clFlush(commandQueue);
+		} else if (copyEvent == NULL && bufferImage != NULL && deviceDisplayImage != NULL) {
+			/* Render to the shared GL texture, the board stays on the device */
+			status |= enqueueRenderBoard(switchImages ? renderKernel[1] : renderKernel[0], &copyEvent);
+			assert(status == CL_SUCCESS);
+			clFlush(commandQueue);
+		} else if (copyEvent == NULL) {
+			/* Packed boards, and boards without a frame for their population,
+			   are read to the host board and packed boards expanded afterwards */
+			status |= enqueueReadBoard(
 				switchImages ? deviceImageB : deviceImageA, readSync,
-				origin, region, rowPitch, 0, bufferImage,
-				NULL, NULL, &copyEvent);
+				(packedMode || bufferImage == NULL) ? getHostBoard(!switchImages) : bufferImage,
+				&copyEvent);
 			assert(status == CL_SUCCESS);
+			if (packedMode) copyBoard = &(switchImages ? boardB : boardA);
+			else copyImage = (bufferImage != NULL) ? bufferImage : (switchImages ? imageB : imageA);
+			clFlush(commandQueue);
+		}
+		
+		/* The board hashes up to the copied generation are read with it */
+		if (hashEvent == NULL && deviceHashes != NULL) {
+			status |= clEnqueueReadBuffer(commandQueue, deviceHashes, CL_FALSE, 0,
+						hostHashes.size()*sizeof(cl_uint), &hostHashes[0], 0, NULL, &hashEvent);
+			assert(status == CL_SUCCESS);
+			hashGeneration = generations;
 		}
 		switchImages = !switchImages;
 		
+		/* Limit the number of runs queued behind the copy, none beyond the last generation */
+		if (generationsPerCopyEvent >= MAX_QUEUED_GENERATIONS
+			|| (maxGenerations > 0 && generations >= maxGenerations))
+			clWaitForEvents(1, &copyEvent);
+		
 		/* Get status of copy event */
 		status = clGetEventInfo(
 			copyEvent, CL_EVENT_COMMAND_EXECUTION_STATUS,
 			sizeof(cl_int), &copyFinished,
 			NULL);
-		assert(status == CL_SUCCESS);
+		assert(status == CL_SUCCESS && copyFinished >= 0);
 		
 	} while (copyFinished != CL_COMPLETE);
+	/* A render to the GL texture is no transfer */
+	if (deviceDisplayImage == NULL) metrics.recordEvent(METRIC_READ, copyEvent);
 	clReleaseEvent(copyEvent);
+	/* Submit the runs queued behind the copy */
+	clFlush(commandQueue);
+	
+	/* The profiled run is in front of the copy and has finished */
+	cl_ulong start, end;
+	status |= clGetEventProfilingInfo(kernelEvent,
+		CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+	status |= clGetEventProfilingInfo(kernelEvent,
+		CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+	assert(status == CL_SUCCESS);
+	executionTime = (end - start) * 1.0e-6f / generationsPerLaunch;
+	metrics.recordEvent(METRIC_KERNEL, kernelEvent, generationsPerLaunch);
+	clReleaseEvent(kernelEvent);
+	
+	/* Live cells of the copied generation */
+	if (metrics.isEnabled() && copyBoard != NULL)
+		metrics.record(METRIC_POPULATION, (double)copyBoard->getPopulation());
+	else if (metrics.isEnabled() && copyImage != NULL)
+		metrics.record(METRIC_POPULATION, (double)getImagePopulation(copyImage, imageSizeBytes));
+	
+	/* Expand packed board for OpenGL output */
+	if (copyBoard != NULL && bufferImage != NULL) copyBoard->unpack(bufferImage);
+	
+	/* Look for periods in the generations up to the copy */
+	if (hashEvent != NULL) {
+		status = clWaitForEvents(1, &hashEvent);
+		assert(status == CL_SUCCESS);
+		clReleaseEvent(hashEvent);
+		addDeviceHashes(hashGeneration);
+	}
 	
 	/* Single generation mode */
 	if (singleGen) switchPause();
@@ -466,19 +1469,20 @@ int GameOfLife::nextGenerationCPU(unsigned char *bufferImage) {
 		gettimeofday(&start, NULL);
 	#endif
 	
-	unsigned char state;
-	int numberOfNeighbours, i;
-	
-	/* Calculate next generation for each pixel */
-	for (int x = 0; x < imageSize[0]; x++) {
-		for (int y = 0; y < imageSize[1]; y++) {
-			numberOfNeighbours =
-				getNumberOfNeighbours(x, y, switchImages?imageA:imageB);
-			state = getState(x, y, switchImages?imageA:imageB);
-			
-			i = numberOfNeighbours + 9*(state >> 7);
-			setState(x, y, rules[i], switchImages?imageB:imageA);
-		}
+	/* Calculate next generation on all cores, row bands per thread */
+	if (unboundedMode) {
+		/* Tiles of the universe, the board shows a part of it */
+		cpuEngine.nextGeneration(universe, rules);
+		if (packedMode && isHostBoardNeeded(bufferImage))
+			universe.rasterise(switchImages?boardB:boardA);
+		else if (isHostBoardNeeded(bufferImage))
+			universe.rasterise(switchImages?imageB:imageA, imageSize[0], imageSize[1]);
+	} else if (packedMode) {
+		cpuEngine.nextGeneration(switchImages?boardA:boardB, switchImages?boardB:boardA,
+				rules, clampMode);
+	} else {
+		cpuEngine.nextGeneration(switchImages?imageA:imageB, switchImages?imageB:imageA,
+				imageSize[0], imageSize[1], rules, clampMode);
 	}
 	
 	/* Stop timer and calculate execution time for one generation */
@@ -494,9 +1498,24 @@ int GameOfLife::nextGenerationCPU(unsigned char *bufferImage) {
 	
 	/* Update generation counter */
 	generations++;
+	if (metrics.isEnabled()) {
+		metrics.record(METRIC_CPU, executionTime);
+		metrics.record(METRIC_POPULATION, packedMode
+			? (double)(switchImages?boardB:boardA).getPopulation()
+			: (double)getImagePopulation(switchImages?imageB:imageA, imageSizeBytes));
+	}
+	
+	/* Look for periods, the bands of the board are hashed on all cores */
+	if (packedMode && !unboundedMode && periodDetector.getMaxPeriod() > 0) {
+		periodDetector.add(cpuEngine.getHash(switchImages?boardB:boardA), generations);
+		hashedGeneration = generations;
+	}
 	
 	/* Update image for OpenGL output directly on the mapped buffer */
-	memcpy(bufferImage, switchImages?imageB:imageA, imageSizeBytes);
+	if (bufferImage != NULL && packedMode)
+		(switchImages?boardB:boardA).unpack(bufferImage);
+	else if (bufferImage != NULL)
+		memcpy(bufferImage, switchImages?imageB:imageA, imageSizeBytes);
 	
 	switchImages = !switchImages;
 	
@@ -506,92 +1525,541 @@ int GameOfLife::nextGenerationCPU(unsigned char *bufferImage) {
 	return 0;
 }
 
-int GameOfLife::getNumberOfNeighbours(const int x, const int y, const unsigned char *image) {
-	int counter = 0;
-	int neighbourCoord[2];
-	
-	for (int i = -1; i <= 1; i++) {
-		for (int k = -1; k <= 1; k++) {
-			neighbourCoord[0] = x + i;
-			neighbourCoord[1] = y + k;
-			if (!((i == 0) && (k == 0))
-				&& (neighbourCoord[0] < imageSize[0])
-				&& (neighbourCoord[1] < imageSize[1])
-				&& (x + i > 0) && (y + k > 0))
-				{
-				if (getState(neighbourCoord[0], neighbourCoord[1], image) == ALIVE)
-					counter++;
-			}
+int GameOfLife::nextGenerationHashLife(unsigned char *bufferImage) {
+	/* Start timer */
+	#ifdef WIN32
+		LARGE_INTEGER frequency;	/* ticks per second */
+		LARGE_INTEGER start;
+		LARGE_INTEGER end;
+		
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&start);
+	#else
+		timeval start;
+		timeval end;
+		
+		gettimeofday(&start, NULL);
+	#endif
+	
+	/* Calculate 2^step generations of the unbounded universe */
+	hashLife.step();
+	uint64_t stepGenerations = (uint64_t)1 << hashLife.getStep();
+	
+	/* Stop timer and calculate execution time for one generation */
+	#ifdef WIN32
+		QueryPerformanceCounter(&end);
+		executionTime = (end.QuadPart - start.QuadPart) * (1000.0f / frequency.QuadPart);
+	#else
+		gettimeofday(&end, NULL);
+		executionTime = (float)(end.tv_sec - start.tv_sec) * 1000.0f
+						+ (float)(end.tv_usec - start.tv_usec) / 1000.0f;
+	#endif
+	executionTime /= stepGenerations;
+	
+	/* Update generation counter */
+	generations += stepGenerations;
+	
+	/* Rasterise the board into the current host board and the mapped buffer */
+	if (!isHostBoardNeeded(bufferImage)) {
+		/* no frame, the board is rasterised when it is shown or exported */
+	} else if (packedMode) {
+		PackedBoard &board = switchImages ? boardA : boardB;
+		hashLife.rasterise(board);
+		if (bufferImage != NULL) board.unpack(bufferImage);
+	} else {
+		unsigned char *image = switchImages ? imageA : imageB;
+		hashLife.rasterise(image, imageSize[0], imageSize[1]);
+		if (bufferImage != NULL) memcpy(bufferImage, image, imageSizeBytes);
+	}
+	
+	/* Single generation mode */
+	if (singleGen) switchPause();
+	
+	return 0;
+}
+
+int GameOfLife::switchHashLifeMode() {
+	if (!hashLifeMode) {
+		if (states > 2 || hashLife.setRules(rules) != 0) return -1;
+		/* A checkpoint of the board would drop the cells outside of it */
+		if (!checkpointFile.empty()) return -2;
+		
+		/* Get the current generation from the device */
+		if (!CPUMode && generations > 0) {
+			cl_int status = enqueueReadBoard(
+				switchImages ? deviceImageA : deviceImageB,
+				CL_TRUE, getHostBoard(switchImages), NULL);
+			assert(status == CL_SUCCESS);
 		}
+		if (loadHashLife() != 0) return -1;
+	} else if (unboundedMode) {
+		/* Both are unbounded, all cells move back to the tiles */
+		hashLife.rasterise(universe);
+	} else if (!CPUMode) {
+		/* The current host board holds the last rasterised generation */
+		cl_int status = enqueueWriteBoard(
+			switchImages ? deviceImageA : deviceImageB,
+			CL_TRUE, getHostBoard(switchImages), NULL);
+		status |= resetChangedTiles();
+		assert(status == CL_SUCCESS);
 	}
+	cpuEngine.invalidateTiles();
 	
-	return counter;
+	hashLifeMode = !hashLifeMode;
+	return 0;
+}
+
+int GameOfLife::loadHashLife() {
+	/* The tiles hold the whole unbounded universe, not only the board */
+	if (unboundedMode) {
+		hashLife.load(universe);
+		return 0;
+	}
+	if (spawnMode && generations == 0) {
+		/* Pattern in the center of the board like spawnStaticPopulation, decoded into the nodes */
+		int patternWidth = patternFile.getWidth();
+		int patternHeight = patternFile.getHeight();
+		return patternFile.render(hashLife,
+			imageSize[0]/2-patternWidth/2, imageSize[1]/2-patternHeight/2);
+	}
+	/* Packed boards are loaded without expanding them to an image */
+	if (packedMode)
+		hashLife.load(switchImages ? boardA : boardB, 0, 0);
+	else
+		hashLife.load(switchImages ? imageA : imageB, imageSize[0], imageSize[1], 0, 0);
+	return 0;
+}
+
+int GameOfLife::loadUniverse() {
+	if (spawnMode) {
+		/* Pattern in the center of the board like spawnStaticPopulation, decoded into the tiles */
+		int patternWidth = patternFile.getWidth();
+		int patternHeight = patternFile.getHeight();
+		universe.clear();
+		return patternFile.render(universe,
+			imageSize[0]/2-patternWidth/2, imageSize[1]/2-patternHeight/2);
+	}
+	if (packedMode)
+		universe.load(switchImages ? boardA : boardB, 0, 0);
+	else
+		universe.load(switchImages ? imageA : imageB, imageSize[0], imageSize[1], 0, 0);
+	return 0;
 }
 
 int GameOfLife::resetGame(unsigned char *bufferImage) {
-	/* Reset host */
-	memcpy(imageA, startingImage, imageSizeBytes);
-	generations = 0;
+	/* Reset host, the starting population is spawned again from its seed or pattern */
+	if (resetHostBoard() != 0) return -1;
+	generations = startingGeneration;
+	lastCheckpoint = startingGeneration;
+	lastExport = startingGeneration;
 	generationsPerCopyEvent = 0;
 	executionTime = 0.0f;
-	/* Reset device */
-	cl_int status = clEnqueueWriteImage(commandQueue,
-						deviceImageA, CL_TRUE, origin, region, rowPitch, 0,
-						startingImage, NULL, NULL, NULL);
-	status |= clSetKernelArg(kernel, 0, sizeof(cl_mem),(void *)&deviceImageA);
-	status |= clSetKernelArg(kernel, 1, sizeof(cl_mem),(void *)&deviceImageB);
+	periodDetector.reset();
+	/* Reset device without uploading the board */
+	cl_int status = resetDeviceBoard();
+	status |= resetChangedTiles();
 	assert(status == CL_SUCCESS);
+	cpuEngine.invalidateTiles();
 	
 	/* Update OpenGL buffer image */
-	memcpy(bufferImage, startingImage, imageSizeBytes);
+	displayRegion = getFullRegion();
+	if (packedMode)
+		boardA.unpack(bufferImage);
+	else
+		memcpy(bufferImage, imageA, imageSizeBytes);
 	
 	switchImages = true;
+	
+	/* Restart HashLife with the starting population, spawning loaded the unbounded universe */
+	if (hashLifeMode && loadHashLife() != 0) return -1;
+	return 0;
+}
+
+cl_int GameOfLife::resetDeviceBoard() {
+	/* Random cells from the seed, or the pattern expanded from the packed copy */
+	if (startingKernel != NULL) {
+		return clEnqueueNDRangeKernel(commandQueue, startingKernel, 2, NULL,
+					globalThreads, NULL, 0, NULL, NULL);
+	}
+	if (deviceStartingBoard != NULL) {
+		return clEnqueueCopyBuffer(commandQueue, deviceStartingBoard, deviceImageA,
+					0, 0, boardA.getSizeBytes(), 0, NULL, NULL);
+	}
+	/* The strips are only written from the host */
+	return enqueueWriteBoard(deviceImageA, CL_TRUE, getHostBoard(true), NULL);
+}
+
+void GameOfLife::pinHostBoards() {
+	/* The RGBA images or the packed boards are the ends of all transfers */
+	size_t sizeBytes = packedMode ? boardA.getSizeBytes() : imageSizeBytes;
+	for (int i = 0; i < 2; i++) {
+		cl_int status;
+		pinnedBoards[i] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+					sizeBytes, NULL, &status);
+		if (status == CL_SUCCESS) {
+			pinnedMemory[i] = clEnqueueMapBuffer(commandQueue, pinnedBoards[i], CL_TRUE,
+					CL_MAP_READ | CL_MAP_WRITE, 0, sizeBytes, 0, NULL, NULL, &status);
+		}
+		if (status != CL_SUCCESS) {
+			if (pinnedBoards[i] != NULL) clReleaseMemObject(pinnedBoards[i]);
+			pinnedBoards[i] = NULL;
+			pinnedMemory[i] = NULL;
+			continue;
+		}
+		
+		if (packedMode) {
+			(i == 0 ? boardA : boardB).useWords((uint64_t *)pinnedMemory[i]);
+		} else {
+			unsigned char *&image = (i == 0) ? imageA : imageB;
+			memcpy(pinnedMemory[i], image, imageSizeBytes);
+			freeHostMemory(image);
+			image = (unsigned char *)pinnedMemory[i];
+		}
+	}
+}
+
+void GameOfLife::unpinHostBoards() {
+	for (int i = 0; i < 2; i++) {
+		if (pinnedBoards[i] == NULL) continue;
+		if (packedMode) {
+			(i == 0 ? boardA : boardB).release();
+		} else {
+			unsigned char *&image = (i == 0) ? imageA : imageB;
+			image = NULL;
+		}
+		clEnqueueUnmapMemObject(commandQueue, pinnedBoards[i], pinnedMemory[i], 0, NULL, NULL);
+		clFinish(commandQueue);
+		clReleaseMemObject(pinnedBoards[i]);
+		pinnedBoards[i] = NULL;
+		pinnedMemory[i] = NULL;
+	}
+}
+
+cl_int GameOfLife::enqueueReadBoard(cl_mem deviceBoard, cl_bool blocking, void *host, cl_event *event) {
+	/* The strips only hold the current generation, reading them always blocks */
+	if (strips.getNumberOfStrips() > 0)
+		return strips.read(host);
+	/* Co-execution: the rows of the CPU band are only up to date on the host */
+	if (coExecution)
+		return clEnqueueReadBuffer(commandQueue, deviceBoard, blocking,
+					0, splitRow*boardA.getWordsPerRow()*sizeof(uint64_t), host, 0, NULL, event);
+	if (packedMode)
+		return clEnqueueReadBuffer(commandQueue, deviceBoard, blocking,
+					0, boardA.getSizeBytes(), host, 0, NULL, event);
+	else
+		return clEnqueueReadImage(commandQueue, deviceBoard, blocking,
+					origin, region, rowPitch, 0, host, 0, NULL, event);
+}
+
+cl_int GameOfLife::enqueueWriteBoard(cl_mem deviceBoard, cl_bool blocking, const void *host, cl_event *event) {
+	if (strips.getNumberOfStrips() > 0)
+		return strips.write(host);
+	/* Blocking writes are timed with their own event */
+	cl_event writeEvent = NULL;
+	bool timed = metrics.isEnabled() && blocking && event == NULL;
+	if (timed) event = &writeEvent;
+	cl_int status;
+	if (packedMode)
+		status = clEnqueueWriteBuffer(commandQueue, deviceBoard, blocking,
+					0, boardA.getSizeBytes(), host, 0, NULL, event);
+	else
+		status = clEnqueueWriteImage(commandQueue, deviceBoard, blocking,
+					origin, region, rowPitch, 0, host, 0, NULL, event);
+	if (timed && status == CL_SUCCESS) {
+		metrics.recordEvent(METRIC_WRITE, writeEvent);
+		clReleaseEvent(writeEvent);
+	}
+	return status;
+}
+
+cl_int GameOfLife::resetChangedTiles() {
+	cl_int status = CL_SUCCESS;
+	if (sparseMode && deviceChangedA != NULL) {
+		std::vector<unsigned char> changed(numberOfTiles, 1);
+		status |= clEnqueueWriteBuffer(commandQueue, deviceChangedA, CL_TRUE,
+							0, numberOfTiles, &changed[0], 0, NULL, NULL);
+		status |= clEnqueueWriteBuffer(commandQueue, deviceChangedB, CL_TRUE,
+							0, numberOfTiles, &changed[0], 0, NULL, NULL);
+	}
+	
+	/* Zero tile hashes and ring, the first generation adds up the hashes of all tiles */
+	if (deviceHashes != NULL) {
+		std::vector<cl_uint> zeros(2*max(numberOfTiles, (size_t)HASH_RING), 0);
+		status |= clEnqueueWriteBuffer(commandQueue, deviceTileHashes, CL_TRUE,
+							0, 2*numberOfTiles*sizeof(cl_uint), &zeros[0], 0, NULL, NULL);
+		status |= clEnqueueWriteBuffer(commandQueue, deviceHashes, CL_TRUE,
+							0, 2*HASH_RING*sizeof(cl_uint), &zeros[0], 0, NULL, NULL);
+		hashedGeneration = generations;
+	}
+	return status;
+}
+
+void GameOfLife::addDeviceHashes(uint64_t lastGeneration) {
+	/* The kernel of lastGeneration cleared the slot after it */
+	uint64_t first = hashedGeneration + 1;
+	if (lastGeneration + 2 > HASH_RING && first < lastGeneration + 2 - HASH_RING)
+		first = lastGeneration + 2 - HASH_RING;
+	for (uint64_t g = first; g <= lastGeneration; g++) {
+		size_t slot = g % HASH_RING;
+		uint64_t hash = ((uint64_t)hostHashes[2*slot+1] << 32) | hostHashes[2*slot];
+		periodDetector.add(hash, g);
+	}
+	if (lastGeneration > hashedGeneration) hashedGeneration = lastGeneration;
+}
+
+int GameOfLife::shareGLTexture(unsigned int texture) {
+	/* The strips are spread over several devices, images are copied to the host */
+	if (!glSharing || strips.getNumberOfStrips() > 0) return 0;
+	/* Co-execution calculates a part of the board on the host */
+	if (coExecution) return 0;
+	cl_int status = CL_SUCCESS;
+	
+	deviceDisplayImage = clCreateFromGLTexture2D(context, CL_MEM_WRITE_ONLY,
+							GL_TEXTURE_2D, 0, texture, &status);
+	if (status != CL_SUCCESS) {
+		/* Keep copying images to the host */
+		deviceDisplayImage = NULL;
+		return 0;
+	}
+	
+	/* Two kernel objects with fixed arguments, rendering A and B */
+	cl_int rowWords = 2*boardA.getWordsPerRow();
+	for (int i = 0; i < 2; i++) {
+		renderKernel[i] = clCreateKernel(program,
+			packedMode ? "renderPacked" : "renderImage", &status);
+		if (status != CL_SUCCESS) return -1;
+		
+		status |= clSetKernelArg(renderKernel[i], 0, sizeof(cl_mem), (i == 0) ? (void *)&deviceImageA : (void *)&deviceImageB);
+		status |= clSetKernelArg(renderKernel[i], 1, sizeof(cl_mem), (void *)&deviceDisplayImage);
+		if (packedMode)
+			status |= clSetKernelArg(renderKernel[i], 2, sizeof(cl_int), (void *)&rowWords);
+		if (status != CL_SUCCESS) return -1;
+	}
+	
 	return 0;
 }
 
+cl_int GameOfLife::enqueueRenderBoard(cl_kernel render, cl_event *event) {
+	size_t renderThreads[2] = { (size_t)imageSize[0], (size_t)imageSize[1] };
+	cl_int status = clEnqueueAcquireGLObjects(commandQueue, 1, &deviceDisplayImage, 0, NULL, NULL);
+	status |= clEnqueueNDRangeKernel(commandQueue, render, 2, NULL,
+				renderThreads, NULL, 0, NULL, NULL);
+	status |= clEnqueueReleaseGLObjects(commandQueue, 1, &deviceDisplayImage, 0, NULL, event);
+	return status;
+}
+
+void GameOfLife::setDisplayView(int windowWidth, int windowHeight, float zoom, float moveX, float moveY) {
+	displayWindow[0] = windowWidth;
+	displayWindow[1] = windowHeight;
+	const int width = imageSize[0];
+	const int height = imageSize[1];
+	if (windowWidth <= 0 || windowHeight <= 0 || zoom <= 0.0f || width <= 0 || height <= 0) {
+		viewRegion = getFullRegion();
+		return;
+	}
+	
+	/* The board spans [-1,1], the window shows [-1/zoom,1/zoom] minus the move */
+	float left = max(-1.0f, -1.0f/zoom - moveX);
+	float right = min(1.0f, 1.0f/zoom - moveX);
+	float bottom = max(-1.0f, -1.0f/zoom - moveY);
+	float top = min(1.0f, 1.0f/zoom - moveY);
+	
+	/* The largest power of 2 of cells per pixel of the window, row 0 is at the top */
+	float cellsPerPixel = max(width / (zoom*windowWidth), height / (zoom*windowHeight));
+	int factor = 1;
+	while (2.0f*factor <= cellsPerPixel) factor *= 2;
+	
+	/* Aligned to the factor, a pixel keeps its cells while the view moves */
+	int x0 = min((int)floor((left + 1.0f) * 0.5f * width), width-1) / factor * factor;
+	int y0 = min((int)floor((1.0f - top) * 0.5f * height), height-1) / factor * factor;
+	int x1 = max(x0+1, min(width, (int)ceil((right + 1.0f) * 0.5f * width)));
+	int y1 = max(y0+1, min(height, (int)ceil((1.0f - bottom) * 0.5f * height)));
+	viewRegion.x = x0;
+	viewRegion.y = y0;
+	viewRegion.width = (x1 - x0 + factor - 1) / factor;
+	viewRegion.height = (y1 - y0 + factor - 1) / factor;
+	viewRegion.factor = factor;
+}
+
+int GameOfLife::redrawDisplay(unsigned char *bufferImage) {
+	if (!isDisplayRedrawable()) return -1;
+	displayRegion = isDisplayDownsampled() ? viewRegion : getFullRegion();
+	
+	/* The current generation is on the device, the queue is in order */
+	cl_mem deviceBoard = switchImages ? deviceImageA : deviceImageB;
+	cl_int status;
+	if (isDisplayDownsampled()) {
+		status = enqueueDisplayBoard(deviceBoard, CL_TRUE, bufferImage, NULL);
+	} else if (deviceDisplayImage != NULL) {
+		status = enqueueRenderBoard(switchImages ? renderKernel[0] : renderKernel[1], NULL);
+	} else {
+		status = enqueueReadBoard(deviceBoard, CL_TRUE,
+					packedMode ? getHostBoard(switchImages) : bufferImage, NULL);
+		if (status == CL_SUCCESS && packedMode)
+			(switchImages ? boardA : boardB).unpack(bufferImage);
+	}
+	/* A render finishes before GL uses the texture again */
+	if (status == CL_SUCCESS && deviceDisplayImage != NULL) status = clFinish(commandQueue);
+	return (status == CL_SUCCESS) ? 0 : -1;
+}
+
+cl_int GameOfLife::enqueueDisplayBoard(cl_mem deviceBoard, cl_bool blocking, void *host, cl_event *event) {
+	const DisplayRegion &region = viewRegion;
+	cl_int status = CL_SUCCESS;
+	
+	/* The host reads a small image, which grows with the largest view */
+	if (deviceDisplayImage == NULL
+		&& (region.width > detailImageSize[0] || region.height > detailImageSize[1])) {
+		if (deviceDetailImage != NULL) clReleaseMemObject(deviceDetailImage);
+		detailImageSize[0] = max(detailImageSize[0], region.width);
+		detailImageSize[1] = max(detailImageSize[1], region.height);
+		cl_image_format format;
+		format.image_channel_order = CL_RGBA;
+		format.image_channel_data_type = CL_UNORM_INT8;
+		deviceDetailImage = clCreateImage2D(context, CL_MEM_WRITE_ONLY, &format,
+				detailImageSize[0], detailImageSize[1], 0, NULL, &status);
+		if (status != CL_SUCCESS) {
+			deviceDetailImage = NULL;
+			detailImageSize[0] = 0;
+			detailImageSize[1] = 0;
+			return status;
+		}
+	}
+	cl_mem display = (deviceDisplayImage != NULL) ? deviceDisplayImage : deviceDetailImage;
+	cl_int density = (displayDetail == DISPLAY_DENSITY);
+	status |= clSetKernelArg(displayKernel, 0, sizeof(cl_mem), (void *)&deviceBoard);
+	status |= clSetKernelArg(displayKernel, 1, sizeof(cl_mem), (void *)&display);
+	status |= clSetKernelArg(displayKernel, 2, sizeof(cl_int), (void *)&region.x);
+	status |= clSetKernelArg(displayKernel, 3, sizeof(cl_int), (void *)&region.y);
+	status |= clSetKernelArg(displayKernel, 4, sizeof(cl_int), (void *)&region.factor);
+	status |= clSetKernelArg(displayKernel, 5, sizeof(cl_int), (void *)&density);
+	
+	size_t displayThreads[2] = { (size_t)region.width, (size_t)region.height };
+	if (deviceDisplayImage != NULL) {
+		status |= clEnqueueAcquireGLObjects(commandQueue, 1, &deviceDisplayImage, 0, NULL, NULL);
+		status |= clEnqueueNDRangeKernel(commandQueue, displayKernel, 2, NULL,
+					displayThreads, NULL, 0, NULL, NULL);
+		status |= clEnqueueReleaseGLObjects(commandQueue, 1, &deviceDisplayImage, 0, NULL, event);
+	} else {
+		size_t displayOrigin[3] = { 0, 0, 0 };
+		size_t displaySize[3] = { (size_t)region.width, (size_t)region.height, 1 };
+		status |= clEnqueueNDRangeKernel(commandQueue, displayKernel, 2, NULL,
+					displayThreads, NULL, 0, NULL, NULL);
+		status |= clEnqueueReadImage(commandQueue, deviceDetailImage, blocking,
+					displayOrigin, displaySize, 4*region.width, 0, host, 0, NULL, event);
+	}
+	return status;
+}
+
 int GameOfLife::freeMem() {
+	/* Histograms and trace of the whole run */
+	if (metrics.isEnabled() && metrics.write() != 0)
+		cerr << "Cannot write metrics" << endl;
+	
+	/* Write the queued frames, the pinned buffers belong to the context */
+	exporter.release();
+	
 	/* Releases OpenCL resources */
 	cl_int status = CL_SUCCESS;
-	if (kernel) {
-		status = clReleaseKernel(kernel);
+	strips.release();
+	for (int i = 0; i < 2; i++) {
+		if (kernel[i]) {
+			status = clReleaseKernel(kernel[i]);
+			assert(status == CL_SUCCESS);
+			kernel[i] = NULL;
+		}
+		if (renderKernel[i]) {
+			status = clReleaseKernel(renderKernel[i]);
+			assert(status == CL_SUCCESS);
+			renderKernel[i] = NULL;
+		}
+	}
+	if (displayKernel) {
+		status = clReleaseKernel(displayKernel);
 		assert(status == CL_SUCCESS);
+		displayKernel = NULL;
+	}
+	if (deviceDetailImage) {
+		status = clReleaseMemObject(deviceDetailImage);
+		assert(status == CL_SUCCESS);
+		deviceDetailImage = NULL;
+		detailImageSize[0] = 0;
+		detailImageSize[1] = 0;
 	}
 	if (program) {
 		status = clReleaseProgram(program);
 		assert(status == CL_SUCCESS);
+		program = NULL;
 	}
 	if (deviceImageA) {
 		status = clReleaseMemObject(deviceImageA);
 		assert(status == CL_SUCCESS);
+		deviceImageA = NULL;
 	}
 	if (deviceImageB) {
 		status = clReleaseMemObject(deviceImageB);
 		assert(status == CL_SUCCESS);
+		deviceImageB = NULL;
+	}
+	if (deviceDisplayImage) {
+		status = clReleaseMemObject(deviceDisplayImage);
+		assert(status == CL_SUCCESS);
+		deviceDisplayImage = NULL;
+	}
+	if (deviceChangedA) {
+		status = clReleaseMemObject(deviceChangedA);
+		assert(status == CL_SUCCESS);
+		deviceChangedA = NULL;
+	}
+	if (deviceChangedB) {
+		status = clReleaseMemObject(deviceChangedB);
+		assert(status == CL_SUCCESS);
+		deviceChangedB = NULL;
+	}
+	if (deviceTileHashes) {
+		status = clReleaseMemObject(deviceTileHashes);
+		assert(status == CL_SUCCESS);
+		deviceTileHashes = NULL;
+	}
+	if (deviceHashes) {
+		status = clReleaseMemObject(deviceHashes);
+		assert(status == CL_SUCCESS);
+		deviceHashes = NULL;
 	}
 	if (deviceRules) {
 		status = clReleaseMemObject(deviceRules);
 		assert(status == CL_SUCCESS);
+		deviceRules = NULL;
+	}
+	if (startingKernel) {
+		status = clReleaseKernel(startingKernel);
+		assert(status == CL_SUCCESS);
+		startingKernel = NULL;
 	}
+	if (deviceStartingBoard) {
+		status = clReleaseMemObject(deviceStartingBoard);
+		assert(status == CL_SUCCESS);
+		deviceStartingBoard = NULL;
+	}
+	unpinHostBoards();
 	if (commandQueue) {
 		status = clReleaseCommandQueue(commandQueue);
 		assert(status == CL_SUCCESS);
+		commandQueue = NULL;
 	}
 	if (context) {
 		status = clReleaseContext(context);
 		assert(status == CL_SUCCESS);
+		context = NULL;
 	}
 	
 	/* Release host resources */
-	if (startingImage) {
-		free(startingImage);
-		startingImage = 0;
-	}
 	if (imageA) {
-		free(imageA);
+		freeHostMemory(imageA);
 		imageA = 0;
 	}
 	if (imageB) {
-		free(imageB);
+		freeHostMemory(imageB);
 		imageB = 0;
 	}
 	if (devices) {
@@ -602,6 +2070,7 @@ int GameOfLife::freeMem() {
 		free(rules);
 		rules = 0;
 	}
+	trimHostMemory();
 	
 	return 0;
 }
@@ -0,0 +1,530 @@
+#include "../inc/HashLife.hpp"
+#include <algorithm>
+
+HashLife::HashLife():
+		root(NULL),
+		stepLog2(0),
+		buckets(NULL),
+		numberOfBuckets(1 << 16),
+		numberOfNodes(0),
+		freeList(NULL),
+		loadLevel(0),
+		loadBand(0),
+		loadWordsPerRow(0) {
+	origin[0] = 0;
+	origin[1] = 0;
+	setMemoryLimit(HASHLIFE_DEFAULT_MEMORY);
+
+	buckets = (HashLifeNode **)calloc(numberOfBuckets, sizeof(HashLifeNode *));
+	if (buckets == NULL) abort();
+
+	/* Cells are not hashed and never collected */
+	for (int i = 0; i < 2; i++) {
+		cells[i] = allocateNode();
+		memset(cells[i], 0, sizeof(HashLifeNode));
+		cells[i]->population = i;
+	}
+
+	/* B3/S23 */
+	memset(rules, 0, sizeof(rules));
+	rules[3] = 255;
+	rules[9+2] = 255;
+	rules[9+3] = 255;
+
+	root = empty(3);
+}
+
+HashLife::~HashLife() {
+	for (unsigned int i = 0; i < blocks.size(); i++)
+		free(blocks[i]);
+	free(buckets);
+}
+
+int HashLife::setRules(const unsigned char *_rules) {
+	/* Birth on 0 neighbours fills the unbounded universe */
+	if (_rules[0]) return -1;
+	memcpy(rules, _rules, sizeof(rules));
+	collectGarbage(false);
+	return 0;
+}
+
+void HashLife::setMemoryLimit(size_t megabytes) {
+	nodeLimit = megabytes * 1024 * 1024 / (sizeof(HashLifeNode) + sizeof(HashLifeNode *));
+}
+
+void HashLife::setStep(int _stepLog2) {
+	/* Coordinates of the expanded universe have to fit into 64 bits */
+	if (_stepLog2 < 0) _stepLog2 = 0;
+	if (_stepLog2 > 56) _stepLog2 = 56;
+	if (_stepLog2 == stepLog2) return;
+	stepLog2 = _stepLog2;
+	collectGarbage(false);
+}
+
+void HashLife::load(const unsigned char *image, int width, int height, int64_t x, int64_t y) {
+	int level = 3;
+	while ((1 << level) < width || (1 << level) < height) level++;
+
+	root = build(image, width, height, level, 0, 0);
+	origin[0] = x;
+	origin[1] = y;
+	collectGarbage(false);
+}
+
+void HashLife::load(const TileUniverse &universe) {
+	std::vector<HashLifeTile> tiles;
+	auto addTile = [&](int64_t x, int64_t y, const uint64_t *rows) {
+		HashLifeTile tile = { { x, y }, rows };
+		tiles.push_back(tile);
+	};
+	universe.forEachTile(addTile);
+	if (tiles.empty()) {
+		root = empty(3);
+		origin[0] = 0;
+		origin[1] = 0;
+		collectGarbage(false);
+		return;
+	}
+
+	/* Root over the bounding box of the tiles, a tile is a node of HASHLIFE_TILE_LEVEL */
+	int64_t min[2] = { tiles[0].tile[0], tiles[0].tile[1] };
+	int64_t max[2] = { min[0], min[1] };
+	for (size_t i = 1; i < tiles.size(); i++) {
+		for (int k = 0; k < 2; k++) {
+			min[k] = std::min(min[k], tiles[i].tile[k]);
+			max[k] = std::max(max[k], tiles[i].tile[k]);
+		}
+	}
+	int level = HASHLIFE_TILE_LEVEL;
+	while (((int64_t)1 << (level - HASHLIFE_TILE_LEVEL)) <= std::max(max[0] - min[0], max[1] - min[1]))
+		level++;
+
+	root = buildTiles(&tiles[0], &tiles[0] + tiles.size(), level, min[0], min[1]);
+	origin[0] = min[0] * UNIVERSE_TILE_SIZE;
+	origin[1] = min[1] * UNIVERSE_TILE_SIZE;
+	collectGarbage(false);
+}
+
+void HashLife::load(const PackedBoard &board, int64_t x, int64_t y) {
+	beginRuns(board.getWidth(), board.getHeight(), x, y);
+	auto addBoardRun = [&](int cx, int cy, int length) { addRun(cx, cy, length); };
+	board.forEachRun(addBoardRun);
+	endRuns();
+}
+
+void HashLife::beginRuns(int width, int height, int64_t x, int64_t y) {
+	loadLevel = HASHLIFE_BAND_LEVEL;
+	while (((int64_t)1 << loadLevel) < width || ((int64_t)1 << loadLevel) < height) loadLevel++;
+	loadWordsPerRow = (width + CELLS_PER_WORD - 1) / CELLS_PER_WORD;
+	loadWords.assign((size_t)loadWordsPerRow << HASHLIFE_BAND_LEVEL, 0);
+	loadBand = 0;
+	loadRows.clear();
+	origin[0] = x;
+	origin[1] = y;
+}
+
+void HashLife::addRun(int x, int y, int length) {
+	/* Bands above the run are finished, runs come in row order */
+	while ((y >> HASHLIFE_BAND_LEVEL) > loadBand)
+		flushBand();
+
+	uint64_t *row = &loadWords[(size_t)(y & ((1 << HASHLIFE_BAND_LEVEL) - 1)) * loadWordsPerRow];
+	const int end = x + length;
+	while (x < end) {
+		const int bit = x % CELLS_PER_WORD;
+		const int bits = (end - x < CELLS_PER_WORD - bit) ? end - x : CELLS_PER_WORD - bit;
+		row[x / CELLS_PER_WORD] |= (bits == CELLS_PER_WORD) ? ~(uint64_t)0 : (((uint64_t)1 << bits) - 1) << bit;
+		x += bits;
+	}
+}
+
+void HashLife::endRuns() {
+	flushBand();
+
+	/* The bands below the last one are dead, like a carry of empty rows */
+	const size_t rootRow = loadLevel - HASHLIFE_BAND_LEVEL;
+	for (size_t k = 0; k < rootRow; k++) {
+		if (k >= loadRows.size() || loadRows[k].empty()) continue;
+		std::vector<HashLifeNode *> nodes(loadRows[k].size(), empty(HASHLIFE_BAND_LEVEL + k));
+		addNodeRow(nodes, k);
+	}
+	root = (rootRow < loadRows.size() && !loadRows[rootRow].empty())
+		? loadRows[rootRow][0] : empty(loadLevel);
+
+	std::vector<uint64_t>().swap(loadWords);
+	loadRows.clear();
+	collectGarbage(false);
+}
+
+void HashLife::step() {
+	/* Collect garbage between steps, when nodes are not referenced from the stack */
+	if (numberOfNodes > nodeLimit) {
+		collectGarbage(true);
+		if (numberOfNodes > nodeLimit / 2)
+			collectGarbage(false);
+	}
+
+	/* The result of a node of level k is its center after up to 2^(k-2) generations */
+	while (root->level < stepLog2 + 3 || !isConfined())
+		expand();
+
+	int64_t shift = (int64_t)1 << (root->level - 2);
+	root = successor(root);
+	origin[0] += shift;
+	origin[1] += shift;
+}
+
+void HashLife::rasterise(unsigned char *image, int width, int height) {
+	for (int i = 0; i < width*height; i++) {
+		image[4*i] = 0;
+		image[4*i+1] = 0;
+		image[4*i+2] = 0;
+		image[4*i+3] = 1;
+	}
+
+	struct {
+		unsigned char *image;
+		int width;
+		void operator()(int x, int y) {
+			unsigned char *pixel = &image[4*x + 4*width*y];
+			pixel[0] = 255;
+			pixel[1] = 255;
+			pixel[2] = 255;
+		}
+	} setCell = { image, width };
+	rasteriseNode(root, origin[0], origin[1], width, height, setCell);
+}
+
+void HashLife::rasterise(PackedBoard &board) {
+	board.clear();
+
+	struct {
+		PackedBoard *board;
+		void operator()(int x, int y) {
+			board->setCell(x, y, true);
+		}
+	} setCell = { &board };
+	rasteriseNode(root, origin[0], origin[1], board.getWidth(), board.getHeight(), setCell);
+}
+
+void HashLife::rasterise(TileUniverse &universe) {
+	universe.clear();
+
+	struct {
+		TileUniverse *universe;
+		void operator()(int64_t x, int64_t y) {
+			universe->setRun(x, y, 1);
+		}
+	} setCell = { &universe };
+	forEachCell(root, origin[0], origin[1], setCell);
+}
+
+template <class SetCell>
+void HashLife::forEachCell(HashLifeNode *node, int64_t x, int64_t y, SetCell &setCell) {
+	if (node->population == 0)
+		return;
+
+	if (node->level == 0) {
+		setCell(x, y);
+		return;
+	}
+
+	int64_t half = (int64_t)1 << (node->level - 1);
+	forEachCell(node->nw, x, y, setCell);
+	forEachCell(node->ne, x + half, y, setCell);
+	forEachCell(node->sw, x, y + half, setCell);
+	forEachCell(node->se, x + half, y + half, setCell);
+}
+
+template <class SetCell>
+void HashLife::rasteriseNode(HashLifeNode *node, int64_t x, int64_t y,
+		int width, int height, SetCell &setCell) {
+	int64_t size = (int64_t)1 << node->level;
+	if (node->population == 0 || x >= width || y >= height || x + size <= 0 || y + size <= 0)
+		return;
+
+	if (node->level == 0) {
+		setCell((int)x, (int)y);
+		return;
+	}
+
+	int64_t half = size / 2;
+	rasteriseNode(node->nw, x, y, width, height, setCell);
+	rasteriseNode(node->ne, x + half, y, width, height, setCell);
+	rasteriseNode(node->sw, x, y + half, width, height, setCell);
+	rasteriseNode(node->se, x + half, y + half, width, height, setCell);
+}
+
+HashLifeNode * HashLife::join(HashLifeNode *nw, HashLifeNode *ne, HashLifeNode *sw, HashLifeNode *se) {
+	size_t h = hash(nw, ne, sw, se);
+	for (HashLifeNode *node = buckets[h]; node != NULL; node = node->next) {
+		if (node->nw == nw && node->ne == ne && node->sw == sw && node->se == se)
+			return node;
+	}
+
+	HashLifeNode *node = allocateNode();
+	node->nw = nw;
+	node->ne = ne;
+	node->sw = sw;
+	node->se = se;
+	node->result = NULL;
+	node->population = nw->population + ne->population + sw->population + se->population;
+	node->level = nw->level + 1;
+	node->marked = false;
+	node->next = buckets[h];
+	buckets[h] = node;
+
+	if (++numberOfNodes > numberOfBuckets)
+		resize();
+	return node;
+}
+
+HashLifeNode * HashLife::empty(int level) {
+	while ((int)emptyNodes.size() <= level) {
+		if (emptyNodes.empty()) {
+			emptyNodes.push_back(cells[0]);
+		} else {
+			HashLifeNode *e = emptyNodes.back();
+			emptyNodes.push_back(join(e, e, e, e));
+		}
+	}
+	return emptyNodes[level];
+}
+
+void HashLife::expand() {
+	HashLifeNode *e = empty(root->level - 1);
+	int64_t shift = (int64_t)1 << (root->level - 1);
+	root = join(join(e, e, e, root->nw), join(e, e, root->ne, e),
+	            join(e, root->sw, e, e), join(root->se, e, e, e));
+	origin[0] -= shift;
+	origin[1] -= shift;
+}
+
+bool HashLife::isConfined() {
+	return root->level >= 3 && root->population ==
+		root->nw->se->se->population + root->ne->sw->sw->population
+		+ root->sw->ne->ne->population + root->se->nw->nw->population;
+}
+
+HashLifeNode * HashLife::successor(HashLifeNode *node) {
+	if (node->result != NULL) return node->result;
+
+	HashLifeNode *result;
+	if (node->population == 0) {
+		result = empty(node->level - 1);
+	} else if (node->level == 2) {
+		result = baseCase(node);
+	} else {
+		/* Nine overlapping nodes one level below */
+		HashLifeNode *n00 = node->nw;
+		HashLifeNode *n01 = join(node->nw->ne, node->ne->nw, node->nw->se, node->ne->sw);
+		HashLifeNode *n02 = node->ne;
+		HashLifeNode *n10 = join(node->nw->sw, node->nw->se, node->sw->nw, node->sw->ne);
+		HashLifeNode *n11 = center(node);
+		HashLifeNode *n12 = join(node->ne->sw, node->ne->se, node->se->nw, node->se->ne);
+		HashLifeNode *n20 = node->sw;
+		HashLifeNode *n21 = join(node->sw->ne, node->se->nw, node->sw->se, node->se->sw);
+		HashLifeNode *n22 = node->se;
+
+		HashLifeNode *r00, *r01, *r02, *r10, *r11, *r12, *r20, *r21, *r22;
+		if (stepLog2 >= node->level - 2) {
+			/* Full step: two halves of 2^(k-3) generations each */
+			r00 = successor(n00); r01 = successor(n01); r02 = successor(n02);
+			r10 = successor(n10); r11 = successor(n11); r12 = successor(n12);
+			r20 = successor(n20); r21 = successor(n21); r22 = successor(n22);
+		} else {
+			/* Smaller step: only the second half calculates generations */
+			r00 = center(n00); r01 = center(n01); r02 = center(n02);
+			r10 = center(n10); r11 = center(n11); r12 = center(n12);
+			r20 = center(n20); r21 = center(n21); r22 = center(n22);
+		}
+
+		result = join(successor(join(r00, r01, r10, r11)), successor(join(r01, r02, r11, r12)),
+		              successor(join(r10, r11, r20, r21)), successor(join(r11, r12, r21, r22)));
+	}
+
+	node->result = result;
+	return result;
+}
+
+HashLifeNode * HashLife::baseCase(HashLifeNode *node) {
+	/* 4x4 cells, bit 4*y+x */
+	HashLifeNode *quadrants[4] = { node->nw, node->ne, node->sw, node->se };
+	int bits = 0;
+	for (int q = 0; q < 4; q++) {
+		int x = 2*(q & 1), y = 2*(q >> 1);
+		bits |= (int)quadrants[q]->nw->population << (4*y + x);
+		bits |= (int)quadrants[q]->ne->population << (4*y + x+1);
+		bits |= (int)quadrants[q]->sw->population << (4*(y+1) + x);
+		bits |= (int)quadrants[q]->se->population << (4*(y+1) + x+1);
+	}
+
+	HashLifeNode *next[4];
+	for (int i = 0; i < 4; i++) {
+		int x = 1 + (i & 1), y = 1 + (i >> 1);
+		int numberOfNeighbours = 0;
+		for (int dy = -1; dy <= 1; dy++)
+			for (int dx = -1; dx <= 1; dx++)
+				if (dx != 0 || dy != 0)
+					numberOfNeighbours += (bits >> (4*(y+dy) + x+dx)) & 1;
+		int alive = (bits >> (4*y + x)) & 1;
+		next[i] = cells[rules[numberOfNeighbours + 9*alive] ? 1 : 0];
+	}
+	return join(next[0], next[1], next[2], next[3]);
+}
+
+HashLifeNode * HashLife::build(const unsigned char *image, int width, int height,
+		int level, int x, int y) {
+	if (x >= width || y >= height)
+		return empty(level);
+	if (level == 0)
+		return cells[image[4*x + 4*width*y] >> 7];
+
+	int half = 1 << (level - 1);
+	return join(build(image, width, height, level-1, x, y),
+	            build(image, width, height, level-1, x + half, y),
+	            build(image, width, height, level-1, x, y + half),
+	            build(image, width, height, level-1, x + half, y + half));
+}
+
+HashLifeNode * HashLife::buildWords(const uint64_t *words, size_t stride, int level, int x, int y) {
+	const int size = 1 << level;
+	const uint64_t mask = (size == CELLS_PER_WORD) ? ~(uint64_t)0 : (((uint64_t)1 << size) - 1) << x;
+	uint64_t bits = 0;
+	for (int i = y; i < y + size; i++)
+		bits |= words[(size_t)i * stride];
+	if ((bits & mask) == 0)
+		return empty(level);
+	if (level == 0)
+		return cells[1];
+
+	int half = size / 2;
+	return join(buildWords(words, stride, level-1, x, y),
+	            buildWords(words, stride, level-1, x + half, y),
+	            buildWords(words, stride, level-1, x, y + half),
+	            buildWords(words, stride, level-1, x + half, y + half));
+}
+
+HashLifeNode * HashLife::buildTiles(HashLifeTile *begin, HashLifeTile *end, int level, int64_t x, int64_t y) {
+	if (begin == end)
+		return empty(level);
+	if (level == HASHLIFE_TILE_LEVEL)
+		return buildWords(begin->rows, 1, level, 0, 0);
+
+	/* Sort the tiles into the quadrants nw, ne, sw, se */
+	const int64_t half = (int64_t)1 << (level - 1 - HASHLIFE_TILE_LEVEL);
+	HashLifeTile *south = std::partition(begin, end,
+			[&](const HashLifeTile &tile) { return tile.tile[1] < y + half; });
+	HashLifeTile *northEast = std::partition(begin, south,
+			[&](const HashLifeTile &tile) { return tile.tile[0] < x + half; });
+	HashLifeTile *southEast = std::partition(south, end,
+			[&](const HashLifeTile &tile) { return tile.tile[0] < x + half; });
+	return join(buildTiles(begin, northEast, level-1, x, y),
+	            buildTiles(northEast, south, level-1, x + half, y),
+	            buildTiles(south, southEast, level-1, x, y + half),
+	            buildTiles(southEast, end, level-1, x + half, y + half));
+}
+
+void HashLife::flushBand() {
+	/* Columns of the root right of the runs are dead */
+	std::vector<HashLifeNode *> nodes((size_t)1 << (loadLevel - HASHLIFE_BAND_LEVEL),
+			empty(HASHLIFE_BAND_LEVEL));
+	for (int c = 0; c < loadWordsPerRow; c++)
+		nodes[c] = buildWords(&loadWords[c], loadWordsPerRow, HASHLIFE_BAND_LEVEL, 0, 0);
+	std::fill(loadWords.begin(), loadWords.end(), 0);
+	loadBand++;
+	addNodeRow(nodes, 0);
+}
+
+void HashLife::addNodeRow(std::vector<HashLifeNode *> &nodes, size_t k) {
+	/* A waiting row of the same level is the top half of the next level */
+	while (k < loadRows.size() && !loadRows[k].empty() && nodes.size() > 1) {
+		std::vector<HashLifeNode *> &top = loadRows[k];
+		std::vector<HashLifeNode *> joined(nodes.size() / 2);
+		for (size_t i = 0; i < joined.size(); i++)
+			joined[i] = join(top[2*i], top[2*i+1], nodes[2*i], nodes[2*i+1]);
+		top.clear();
+		nodes.swap(joined);
+		k++;
+	}
+	if (k >= loadRows.size()) loadRows.resize(k + 1);
+	loadRows[k].swap(nodes);
+}
+
+HashLifeNode * HashLife::allocateNode() {
+	if (freeList == NULL) {
+		HashLifeNode *block = (HashLifeNode *)malloc(HASHLIFE_BLOCK_NODES * sizeof(HashLifeNode));
+		if (block == NULL) abort();
+		blocks.push_back(block);
+		for (int i = 0; i < HASHLIFE_BLOCK_NODES; i++) {
+			block[i].next = freeList;
+			freeList = &block[i];
+		}
+	}
+
+	HashLifeNode *node = freeList;
+	freeList = node->next;
+	return node;
+}
+
+void HashLife::resize() {
+	size_t newNumberOfBuckets = 2 * numberOfBuckets;
+	HashLifeNode **newBuckets = (HashLifeNode **)calloc(newNumberOfBuckets, sizeof(HashLifeNode *));
+	if (newBuckets == NULL) return;
+
+	HashLifeNode **oldBuckets = buckets;
+	size_t oldNumberOfBuckets = numberOfBuckets;
+	buckets = newBuckets;
+	numberOfBuckets = newNumberOfBuckets;
+	for (size_t i = 0; i < oldNumberOfBuckets; i++) {
+		HashLifeNode *node = oldBuckets[i];
+		while (node != NULL) {
+			HashLifeNode *next = node->next;
+			size_t h = hash(node->nw, node->ne, node->sw, node->se);
+			node->next = buckets[h];
+			buckets[h] = node;
+			node = next;
+		}
+	}
+	free(oldBuckets);
+}
+
+void HashLife::collectGarbage(bool keepResults) {
+	for (size_t i = 0; i < numberOfBuckets; i++) {
+		for (HashLifeNode *node = buckets[i]; node != NULL; node = node->next) {
+			node->marked = false;
+			if (!keepResults) node->result = NULL;
+		}
+	}
+	mark(root, keepResults);
+
+	/* Sweep unmarked nodes into the free list */
+	for (size_t i = 0; i < numberOfBuckets; i++) {
+		HashLifeNode **link = &buckets[i];
+		while (*link != NULL) {
+			HashLifeNode *node = *link;
+			if (node->marked) {
+				link = &node->next;
+			} else {
+				*link = node->next;
+				node->next = freeList;
+				freeList = node;
+				numberOfNodes--;
+			}
+		}
+	}
+
+	/* Empty nodes are created again on demand */
+	emptyNodes.clear();
+}
+
+void HashLife::mark(HashLifeNode *node, bool keepResults) {
+	if (node->level == 0 || node->marked) return;
+	node->marked = true;
+	mark(node->nw, keepResults);
+	mark(node->ne, keepResults);
+	mark(node->sw, keepResults);
+	mark(node->se, keepResults);
+	if (keepResults && node->result != NULL)
+		mark(node->result, keepResults);
+}
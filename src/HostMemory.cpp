@@ -0,0 +1,94 @@
+#include "../inc/HostMemory.hpp"
+#include <map>
+#include <vector>
+#include <mutex>
+#ifdef WIN32					// Windows system specific
+	#include <malloc.h>				/* for _aligned_malloc() */
+#else							// Unix based system specific
+	#include <sys/mman.h>			/* for madvise() */
+#endif
+
+/**
+* Capacity of the used blocks and the pool of freed blocks
+*/
+struct HostMemoryPool {
+	std::mutex                                  mutex;  /**< lock of the blocks */
+	std::map<void *, size_t>               usedBlocks;  /**< blocks in use and their capacity */
+	std::vector<std::pair<void *, size_t> > freeBlocks;  /**< freed blocks, newest last */
+};
+
+/* The pool is never destroyed, boards of global objects are freed after main */
+static HostMemoryPool &getPool() {
+	static HostMemoryPool *pool = new HostMemoryPool();
+	return *pool;
+}
+
+/* Free a block itself */
+static void releaseBlock(void *memory) {
+#ifdef WIN32
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+void *allocateHostMemory(size_t sizeBytes) {
+	if (sizeBytes == 0) sizeBytes = 1;
+	HostMemoryPool &pool = getPool();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+
+	/* The smallest free block which wastes at most half of it */
+	int best = -1;
+	for (size_t i = 0; i < pool.freeBlocks.size(); i++) {
+		size_t capacity = pool.freeBlocks[i].second;
+		if (capacity < sizeBytes || capacity/2 > sizeBytes) continue;
+		if (best < 0 || capacity < pool.freeBlocks[best].second) best = (int)i;
+	}
+	if (best >= 0) {
+		std::pair<void *, size_t> block = pool.freeBlocks[best];
+		pool.freeBlocks.erase(pool.freeBlocks.begin() + best);
+		pool.usedBlocks[block.first] = block.second;
+		return block.first;
+	}
+
+	/* Whole pages, huge pages for big boards */
+	bool huge = sizeBytes >= HOST_HUGE_PAGE_BYTES;
+	size_t alignment = huge ? HOST_HUGE_PAGE_BYTES : HOST_MEMORY_ALIGNMENT;
+	size_t capacity = (sizeBytes + alignment - 1) / alignment * alignment;
+	void *memory = NULL;
+#ifdef WIN32
+	memory = _aligned_malloc(capacity, alignment);
+#else
+	if (posix_memalign(&memory, alignment, capacity) != 0) memory = NULL;
+	#ifdef MADV_HUGEPAGE
+	if (memory != NULL && huge) madvise(memory, capacity, MADV_HUGEPAGE);
+	#endif
+#endif
+	if (memory == NULL) return NULL;
+	pool.usedBlocks[memory] = capacity;
+	return memory;
+}
+
+void freeHostMemory(void *memory) {
+	if (memory == NULL) return;
+	HostMemoryPool &pool = getPool();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	std::map<void *, size_t>::iterator block = pool.usedBlocks.find(memory);
+	if (block == pool.usedBlocks.end()) return;
+	pool.freeBlocks.push_back(*block);
+	pool.usedBlocks.erase(block);
+
+	/* The oldest blocks leave the pool */
+	if (pool.freeBlocks.size() > HOST_MEMORY_POOL_BLOCKS) {
+		releaseBlock(pool.freeBlocks[0].first);
+		pool.freeBlocks.erase(pool.freeBlocks.begin());
+	}
+}
+
+void trimHostMemory() {
+	HostMemoryPool &pool = getPool();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	for (size_t i = 0; i < pool.freeBlocks.size(); i++)
+		releaseBlock(pool.freeBlocks[i].first);
+	pool.freeBlocks.clear();
+}
@@ -0,0 +1,211 @@
+#include "../inc/Metrics.hpp"
+#include <cmath>
+#include <cstring>
+#ifdef WIN32
+	#include <windows.h>			/* for QueryPerformanceCounter() */
+#else
+	#include <sys/time.h>			/* for gettimeofday() */
+#endif
+using namespace std;
+
+/* Names of the metrics, in the order of MetricType */
+static const char *metricNames[METRIC_TYPES] = {
+	"kernel_ms",
+	"queue_latency_ms",
+	"read_ms",
+	"write_ms",
+	"cpu_generation_ms",
+	"parse_ms",
+	"setup_ms",
+	"build_ms",
+	"population_cells"
+};
+
+/* Upper bound of a bucket */
+static double getBucketBound(int bucket) {
+	return ldexp(1.0, bucket - METRICS_BUCKET_OFFSET);
+}
+
+/* Bucket of a value, values in (2^(e-1), 2^e] go to bucket e+METRICS_BUCKET_OFFSET */
+static int getBucket(double value) {
+	if (!(value > 0.0)) return 0;
+	int exponent;
+	if (frexp(value, &exponent) == 0.5) exponent--;
+	int bucket = exponent + METRICS_BUCKET_OFFSET;
+	if (bucket < 0) return 0;
+	if (bucket >= METRICS_BUCKETS) return METRICS_BUCKETS - 1;
+	return bucket;
+}
+
+/* Open a file for writing, print an error on failure */
+static FILE *openFile(const string &path) {
+	FILE *file = fopen(path.c_str(), "w");
+	if (file == NULL) fprintf(stderr, "\nCannot write metrics to %s\n", path.c_str());
+	return file;
+}
+
+double Metrics::getTimeMs() {
+	#ifdef WIN32
+		LARGE_INTEGER frequency, now;
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&now);
+		return now.QuadPart * (1000.0 / frequency.QuadPart);
+	#else
+		timeval now;
+		gettimeofday(&now, NULL);
+		return now.tv_sec * 1000.0 + now.tv_usec / 1000.0;
+	#endif
+}
+
+const char * Metrics::getName(MetricType type) {
+	return metricNames[type];
+}
+
+void Metrics::reset() {
+	memset(histograms, 0, sizeof(histograms));
+	trace.clear();
+	droppedEvents = 0;
+	deviceOffsetSet = false;
+	startTimeMs = getTimeMs();
+}
+
+void Metrics::record(MetricType type, double value) {
+	if (!enabled) return;
+	MetricHistogram &histogram = histograms[type];
+	if (histogram.count == 0 || value < histogram.min) histogram.min = value;
+	if (histogram.count == 0 || value > histogram.max) histogram.max = value;
+	histogram.count++;
+	histogram.sum += value;
+	histogram.buckets[getBucket(value)]++;
+}
+
+void Metrics::recordHost(MetricType type, double startMs, double endMs) {
+	if (!enabled) return;
+	record(type, endMs - startMs);
+	addTraceEvent(type, startMs, endMs - startMs, 0);
+}
+
+cl_int Metrics::recordEvent(MetricType type, cl_event event, int generations) {
+	if (!enabled || event == NULL) return CL_SUCCESS;
+	cl_ulong queued = 0, start = 0, end = 0;
+	cl_int status = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED,
+			sizeof(cl_ulong), &queued, NULL);
+	status |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START,
+			sizeof(cl_ulong), &start, NULL);
+	status |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END,
+			sizeof(cl_ulong), &end, NULL);
+	if (status != CL_SUCCESS) return status;
+
+	/* The device clock has its own origin, its end of the first event is now on the host */
+	if (!deviceOffsetSet) {
+		deviceOffsetMs = getTimeMs() - end * 1.0e-6;
+		deviceOffsetSet = true;
+	}
+	double durationMs = (end - start) * 1.0e-6;
+	record(type, durationMs / (generations > 0 ? generations : 1));
+	if (type == METRIC_KERNEL) record(METRIC_QUEUE_LATENCY, (start - queued) * 1.0e-6);
+	addTraceEvent(type, start * 1.0e-6 + deviceOffsetMs, durationMs, 1);
+	return CL_SUCCESS;
+}
+
+double Metrics::getPercentile(MetricType type, double fraction) const {
+	const MetricHistogram &histogram = histograms[type];
+	if (histogram.count == 0) return 0.0;
+	uint64_t rank = (uint64_t)ceil(fraction * histogram.count), counted = 0;
+	for (int i = 0; i < METRICS_BUCKETS; i++) {
+		counted += histogram.buckets[i];
+		if (counted >= rank && counted > 0) return min(getBucketBound(i), histogram.max);
+	}
+	return histogram.max;
+}
+
+void Metrics::addTraceEvent(MetricType type, double startMs, double durationMs, int device) {
+	if (traceFile.empty()) return;
+	if (trace.size() >= METRICS_MAX_TRACE_EVENTS) {
+		droppedEvents++;
+		return;
+	}
+	TraceEvent event = {type, startMs, durationMs, device};
+	trace.push_back(event);
+}
+
+int Metrics::write() const {
+	int status = 0;
+	if (!metricsFile.empty()) {
+		FILE *file = openFile(metricsFile);
+		bool prometheus = metricsFile.size() >= 5
+			&& metricsFile.compare(metricsFile.size() - 5, 5, ".prom") == 0;
+		if (file == NULL) status = -1;
+		else {
+			status |= prometheus ? writePrometheus(file) : writeJSON(file);
+			if (fclose(file) != 0) status = -1;
+		}
+	}
+	if (!traceFile.empty()) {
+		FILE *file = openFile(traceFile);
+		if (file == NULL) status = -1;
+		else {
+			status |= writeTrace(file);
+			if (fclose(file) != 0) status = -1;
+		}
+	}
+	return status;
+}
+
+int Metrics::writeJSON(FILE *file) const {
+	fprintf(file, "{\n");
+	for (int type = 0; type < METRIC_TYPES; type++) {
+		const MetricHistogram &histogram = histograms[type];
+		fprintf(file, "\t\"%s\": {\"count\": %llu, \"sum\": %.9g, \"min\": %.9g, \"max\": %.9g, "
+				"\"mean\": %.9g, \"p50\": %.9g, \"p99\": %.9g,\n\t\t\"buckets\": [",
+				metricNames[type], (unsigned long long)histogram.count, histogram.sum,
+				histogram.min, histogram.max,
+				histogram.count > 0 ? histogram.sum / histogram.count : 0.0,
+				getPercentile((MetricType)type, 0.5), getPercentile((MetricType)type, 0.99));
+		bool first = true;
+		for (int i = 0; i < METRICS_BUCKETS; i++) {
+			if (histogram.buckets[i] == 0) continue;
+			fprintf(file, "%s{\"le\": %.9g, \"count\": %llu}", first ? "" : ", ",
+					getBucketBound(i), (unsigned long long)histogram.buckets[i]);
+			first = false;
+		}
+		fprintf(file, "]}%s\n", type+1 < METRIC_TYPES ? "," : "");
+	}
+	fprintf(file, "}\n");
+	return ferror(file) ? -1 : 0;
+}
+
+int Metrics::writePrometheus(FILE *file) const {
+	for (int type = 0; type < METRIC_TYPES; type++) {
+		const MetricHistogram &histogram = histograms[type];
+		const char *name = metricNames[type];
+		fprintf(file, "# TYPE gol_%s histogram\n", name);
+		/* Cumulative buckets up to the largest value */
+		uint64_t counted = 0;
+		for (int i = 0; i < METRICS_BUCKETS && counted < histogram.count; i++) {
+			counted += histogram.buckets[i];
+			if (histogram.buckets[i] == 0) continue;
+			fprintf(file, "gol_%s_bucket{le=\"%.9g\"} %llu\n", name, getBucketBound(i),
+					(unsigned long long)counted);
+		}
+		fprintf(file, "gol_%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)histogram.count);
+		fprintf(file, "gol_%s_sum %.9g\n", name, histogram.sum);
+		fprintf(file, "gol_%s_count %llu\n", name, (unsigned long long)histogram.count);
+	}
+	return ferror(file) ? -1 : 0;
+}
+
+int Metrics::writeTrace(FILE *file) const {
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"host\"}},\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"device\"}}");
+	/* Times in us relative to reset() */
+	for (size_t i = 0; i < trace.size(); i++) {
+		const TraceEvent &event = trace[i];
+		fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+				"\"pid\":1,\"tid\":%i}", metricNames[event.type], event.device ? "device" : "host",
+				(event.startMs - startTimeMs) * 1000.0, event.durationMs * 1000.0, event.device);
+	}
+	fprintf(file, "\n],\"otherData\":{\"droppedEvents\":%llu}}\n", (unsigned long long)droppedEvents);
+	return ferror(file) ? -1 : 0;
+}
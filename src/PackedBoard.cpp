@@ -0,0 +1,170 @@
+#include "../inc/PackedBoard.hpp"
+#include "../inc/BitSliced.hpp"
+
+int PackedBoard::allocate(int _width, int _height, int _states) {
+	release();
+	if (_states < 2 || _states > PACKED_MAX_STATES)
+		return -1;
+
+	boardSize[0] = _width;
+	boardSize[1] = _height;
+	wordsPerRow = (_width + CELLS_PER_WORD - 1) / CELLS_PER_WORD;
+	states = _states;
+	for (planes = 1; (1 << planes) < states; planes++);
+	boardSizeBytes = (size_t)wordsPerRow * _height * planes * sizeof(uint64_t);
+
+	int lastBits = _width - (wordsPerRow-1)*CELLS_PER_WORD;
+	lastWordMask = (lastBits == CELLS_PER_WORD) ? ~(uint64_t)0 : (((uint64_t)1 << lastBits) - 1);
+
+	words = (uint64_t *)allocateHostMemory(boardSizeBytes);
+	if (words == NULL)
+		return -1;
+	ownsWords = true;
+
+	clear();
+	return 0;
+}
+
+void PackedBoard::pack(const unsigned char *image) {
+	clear();
+	for (int y = 0; y < boardSize[1]; y++) {
+		const unsigned char *pixel = &image[4*boardSize[0]*y];
+		uint64_t *row = getRow(y);
+		for (int x = 0; x < boardSize[0]; x++) {
+			row[x/CELLS_PER_WORD] |= (uint64_t)(pixel[4*x] >> 7) << (x%CELLS_PER_WORD);
+		}
+	}
+}
+
+void PackedBoard::unpack(unsigned char *image) const {
+	/* Grey levels of the states, dying cells fade out */
+	unsigned char shades[PACKED_MAX_STATES];
+	shades[0] = 0;
+	shades[1] = 255;
+	for (int i = 2; i < states; i++)
+		shades[i] = (unsigned char)(127 * (states - i) / (states - 1));
+
+	for (int y = 0; y < boardSize[1]; y++) {
+		unsigned char *pixel = &image[4*boardSize[0]*y];
+		const uint64_t *row = getRow(y);
+		for (int x = 0; x < boardSize[0]; x++) {
+			unsigned char state;
+			if (planes == 1) {
+				state = ((row[x/CELLS_PER_WORD] >> (x%CELLS_PER_WORD)) & 1) ? 255 : 0;
+			} else {
+				state = shades[getState(x, y)];
+			}
+			pixel[4*x] = state;
+			pixel[4*x+1] = state;
+			pixel[4*x+2] = state;
+			pixel[4*x+3] = 1;
+		}
+	}
+}
+
+uint64_t PackedBoard::getHash(int rowBegin, int rowEnd) const {
+	uint64_t hash = 0;
+	const size_t begin = (size_t)rowBegin*planes*wordsPerRow;
+	const size_t end = (size_t)rowEnd*planes*wordsPerRow;
+	for (size_t i = begin; i < end; i++) {
+		if (words[i] == 0) continue;
+		hash ^= hashBoardWord((uint32_t)words[i], (uint32_t)(2*i))
+			  ^ hashBoardWord((uint32_t)(words[i] >> 32), (uint32_t)(2*i+1));
+	}
+	return hash;
+}
+
+uint64_t PackedBoard::getPopulation() const {
+	uint64_t population = 0;
+	for (size_t row = 0; row < (size_t)boardSize[1]*planes; row += planes) {
+		const uint64_t *planeRow = &words[row*wordsPerRow];
+		for (int w = 0; w < wordsPerRow; w++) {
+			/* State 1 has only the bit of plane 0 */
+			uint64_t alive = planeRow[w];
+			for (int p = 1; p < planes; p++)
+				alive &= ~planeRow[p*wordsPerRow + w];
+			population += __builtin_popcountll(alive);
+		}
+	}
+	return population;
+}
+
+/**
+* Apply the rules to bit-sliced neighbour counts (count = b0 + 2*b1 + 4*b2 + 8*b3).
+*/
+static inline uint64_t applyRules(const uint64_t b0, const uint64_t b1,
+		const uint64_t b2, const uint64_t b3, const uint64_t alive,
+		const unsigned char *rules) {
+	uint64_t next = 0;
+	for (int n = 0; n <= 8; n++) {
+		if (!rules[n] && !rules[9+n]) continue;
+		uint64_t equal = ((n & 1) ? b0 : ~b0) & ((n & 2) ? b1 : ~b1)
+		               & ((n & 4) ? b2 : ~b2) & ((n & 8) ? b3 : ~b3);
+		next |= equal & ((rules[n] ? ~alive : 0) | (rules[9+n] ? alive : 0));
+	}
+	return next;
+}
+
+bool nextGenerationPackedTile(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd,
+		int wordBegin, int wordEnd) {
+	const int height = src.getHeight();
+	const int wordsPerRow = src.getWordsPerRow();
+	const int lastBits = src.getWidth() - (wordsPerRow-1)*CELLS_PER_WORD;
+	const uint64_t lastWordMask = src.getLastWordMask();
+	const uint64_t *cells = src.getWords();
+	uint64_t *next = dst.getWords();
+	bool changed = false;
+
+	for (int y = rowBegin; y < rowEnd; y++) {
+		/* Rows above and below, dead (NULL) or wrapped around outside of the board */
+		const uint64_t *north, *south;
+		if (y > 0) north = &cells[(y-1)*wordsPerRow];
+		else north = clamp ? NULL : &cells[(height-1)*wordsPerRow];
+		if (y < height-1) south = &cells[(y+1)*wordsPerRow];
+		else south = clamp ? NULL : &cells[0];
+		const uint64_t *row = &cells[y*wordsPerRow];
+
+		for (int w = wordBegin; w < wordEnd; w++) {
+			uint64_t nw = 0, n = 0, ne = 0, cw, c, ce, sw = 0, s = 0, se = 0;
+			if (north != NULL) shiftRowWord(north, w, wordsPerRow, lastBits, clamp, nw, n, ne);
+			shiftRowWord(row, w, wordsPerRow, lastBits, clamp, cw, c, ce);
+			if (south != NULL) shiftRowWord(south, w, wordsPerRow, lastBits, clamp, sw, s, se);
+
+			/* Full adders for the rows above and below, half adder for the own row */
+			uint64_t northSum = nw ^ n ^ ne;
+			uint64_t northCarry = (nw & n) | (ne & (nw ^ n));
+			uint64_t southSum = sw ^ s ^ se;
+			uint64_t southCarry = (sw & s) | (se & (sw ^ s));
+			uint64_t rowSum = cw ^ ce;
+			uint64_t rowCarry = cw & ce;
+
+			/* Combine the partial sums to a 4 bit neighbour count */
+			uint64_t b0 = northSum ^ rowSum ^ southSum;
+			uint64_t onesCarry = (northSum & rowSum) | (southSum & (northSum ^ rowSum));
+			uint64_t twos = northCarry ^ rowCarry ^ southCarry;
+			uint64_t twosCarry = (northCarry & rowCarry) | (southCarry & (northCarry ^ rowCarry));
+			uint64_t b1 = twos ^ onesCarry;
+			uint64_t foursCarry = twos & onesCarry;
+			uint64_t b2 = twosCarry ^ foursCarry;
+			uint64_t b3 = twosCarry & foursCarry;
+
+			uint64_t result = applyRules(b0, b1, b2, b3, c, rules);
+			if (w == wordsPerRow-1) result &= lastWordMask;
+			changed |= (result != c);
+			next[y*wordsPerRow + w] = result;
+		}
+	}
+
+	return changed;
+}
+
+void nextGenerationPacked(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd) {
+	/* Generations rules age the cells with a bit-sliced counter over the planes */
+	if (src.getPlanes() > 1) {
+		nextGenerationPackedVector<ScalarOps>(src, dst, rules, clamp, rowBegin, rowEnd);
+		return;
+	}
+	nextGenerationPackedTile(src, dst, rules, clamp, rowBegin, rowEnd, 0, src.getWordsPerRow());
+}
@@ -1,237 +1,302 @@
 #include "../inc/PatternFile.hpp"
+#ifdef WIN32
+	#include <cstdio>
+#else
+	#include <fcntl.h>				/* for open() */
+	#include <unistd.h>				/* for close() */
+	#include <sys/mman.h>			/* for mmap() */
+	#include <sys/stat.h>			/* for fstat() */
+#endif
 using namespace std;
 
-int PatternFile::parse() {
-	/* Open pattern file */
-	if ((file = fopen(fileName, "r")) == NULL)
-		return -2;
-	
-	/* Header specified */
-	bool header = true;
-	
-	/* Skip leading comment lines */
-	if (skipComments() != 0) { fclose(file); return -1;}
-	
-	/* Skip whitespaces */
-	if (skipWhiteSpace() != 0) { fclose(file); return -1; }
-	
-	/* Check for header line and parse it, abort when there is no header */
-	header = parseHeader();
-	if (!header) { fclose(file); return -1; }
-	
-	/* Allocate space for pattern according to specified width and height of pattern */
-	patternSizeBytes = 4*patternSize[0]*patternSize[1]*sizeof(char);
-	pattern = (unsigned char *)malloc(patternSizeBytes);
-	
-	/* Parse pattern */
-	if (parsePattern() != 0) { fclose(file); return -1; }
-	
-	fclose(file);
-	return 0;
+/**
+* Whitespaces between the tokens of a RLE file
+*/
+static inline bool isWhiteSpace(const char c) {
+	return c == ' ' || c == '\t' || c == 13 || c == 10;
 }
 
-int PatternFile::skipComments() {
-	for (;;) {
-		c = getc(file);
-		switch (c) {
-		case EOF:
-			return -1;
-		case '\n':				/* blank line: ignored */
-			continue;
-		case '#':				/* #: ignore, but look for EOF in comment */
-			while ((c = getc (file)) != '\n') {
-				if (c == EOF)	/* EOF in comment */
-					return -1;
+int PatternFile::parse() {
+	close();
+
+	/* Map the whole file, read it into the buffer if that fails */
+	#ifndef WIN32
+		int fd = open(fileName, O_RDONLY);
+		if (fd < 0) return -2;
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map != MAP_FAILED) {
+				madvise(map, info.st_size, MADV_SEQUENTIAL);
+				mapping = map;
+				data = (const char *)map;
+				dataSize = info.st_size;
 			}
-			continue;
-		default:				/* other: legitimate text */
-			ungetc(c, file);
-			break;
 		}
-		break;
+		::close(fd);
+	#endif
+	if (mapping == NULL) {
+		FILE *file = fopen(fileName, "rb");
+		if (file == NULL) return -2;
+		char chunk[65536];
+		size_t read;
+		while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+			buffer.insert(buffer.end(), chunk, chunk + read);
+		fclose(file);
+		data = buffer.empty() ? NULL : &buffer[0];
+		dataSize = buffer.size();
 	}
-	return 0;
-}
 
-int PatternFile::skipWhiteSpace() {
-	while ((c = getc(file)) == ' ' || c == '\t' || c == 13 || c == 10 || c == EOF) {
-		if (c == EOF)
-			return -1;
+	/* Skip leading comment and blank lines */
+	const char *p = data, *end = data + dataSize;
+	while (p < end) {
+		if (*p == '#') {
+			const char *line = (const char *)memchr(p, '\n', end - p);
+			p = (line == NULL) ? end : line + 1;
+		} else if (isWhiteSpace(*p)) {
+			p++;
+		} else {
+			break;
+		}
 	}
+
+	/* Check for header line and parse it, abort when there is no header */
+	if (p == end || !parseHeader(p)) return -1;
+	patternBegin = p - data;
 	return 0;
 }
 
-int PatternFile::getNumber() {
-	int number = 0;
-	bool isNumber = false;
-	while (c >= '0' && c <= '9') {
-		number = (isNumber ? 10*number : 0) + (c-'0');
-		isNumber = true;
-		c = getc(file);
-	}
-	ungetc(c,file);
-	return number;
+void PatternFile::close() {
+	#ifndef WIN32
+		if (mapping != NULL) munmap(mapping, dataSize);
+	#endif
+	mapping = NULL;
+	buffer.clear();
+	data = NULL;
+	dataSize = 0;
+	maxState = 1;
+	states = 0;
 }
 
-bool PatternFile::parseHeader() {
-	int number = 0;
-	
-	/* Check for header line */
-	if (c != 'x') return false;
-	
-	/* Header line is supplied */
-	if (skipWhiteSpace() != 0) return false;
-	
-	if (c != '=') return true;
-	if (skipWhiteSpace() != 0) return false;
-	
-	/* Get width */
-	number = getNumber();
-	if (number == 0) return false;
-	else patternSize[0] = number;
-	
-	if (skipWhiteSpace() != 0) return false;
-	if (c != ',') return false;
-	if (skipWhiteSpace() != 0) return false;
-	if (c != 'y') return false;
-	if (skipWhiteSpace() != 0) return false;
-	if (c != '=') return false;
-	if (skipWhiteSpace() != 0) return false;
-	
-	/* Get height */
-	number = getNumber();
-	if (number == 0) return false;
-	else patternSize[1] = number;
-	
-	/* Get rule definition */
-	if (skipWhiteSpace() != 0) return false;
-	/*
-	 * If there is no , then assume there is no rule definition
-	 * Use default Conway rule B3/S23
-	 */
-	if (c != ',') {
-		ungetc(c,file);
-		return true;
-	}
-	
-	if (skipWhiteSpace() != 0) return false;
-	if (c != 'r') return false;
-	if ((c=getc(file)) != 'u') return false;
-	if ((c=getc(file)) != 'l') return false;
-	if ((c=getc(file)) != 'e') return false;
-	if (skipWhiteSpace() != 0) return false;
-	if (c != '=') return false;
-	if (skipWhiteSpace() != 0) return false;
-	
-	if (c != 'B') return false;
-	/* Get rules for birth of a dead cell */
-	while ((c = getc(file)) != '/') {
-		switch (c) {
-		default:
-			if (c >= '0' && c <= '8') {
-				birthRules.push_back((int)c-(int)'0');
-				break;
-			} else {		/* other characters are not allowed */
-				return -1;
-			}
-		case ' ':			/* whitespaces are not allowed */
-		case '\t':
-		case 13:
-		case 10:
-		case EOF:			/* end of file is not allowed */
-			return true;
+bool PatternFile::parseHeader(const char *&p) {
+	const char *end = data + dataSize;
+	const char *line = (const char *)memchr(p, '\n', end - p);
+	const char *lineEnd = (line == NULL) ? end : line;
+
+	/* x = WIDTH, y = HEIGHT[, rule = RULE] */
+	int *sizes[2] = {&patternSize[0], &patternSize[1]};
+	const char names[2] = {'x', 'y'};
+	for (int i = 0; i < 2; i++) {
+		while (p < lineEnd && isWhiteSpace(*p)) p++;
+		if (i == 1) {
+			if (p == lineEnd || *p != ',') return false;
+			p++;
+			while (p < lineEnd && isWhiteSpace(*p)) p++;
 		}
+		if (p == lineEnd || *p != names[i]) return false;
+		p++;
+		while (p < lineEnd && isWhiteSpace(*p)) p++;
+		if (p == lineEnd || *p != '=') return false;
+		p++;
+		while (p < lineEnd && isWhiteSpace(*p)) p++;
+		long number = 0;
+		while (p < lineEnd && *p >= '0' && *p <= '9' && number <= 0x7FFFFFF)
+			number = 10*number + (*p++ - '0');
+		if (number <= 0 || number > 0x7FFFFFF) return false;
+		*sizes[i] = (int)number;
 	}
-	
-	if (skipWhiteSpace() != 0) return -1;
-	if (c != 'S') return true;
-	/* Get rules for survival of a live cell */
-	while ((c = getc(file)) != ' ' && c != '\t' && c != 13 && c != 10) {
-		switch (c) {
-		default:
-			if (c >= '0' && c <= '8') {
-				survivalRules.push_back((int)c-(int)'0');
-				break;
-			} else {		/* other characters are not allowed */
-				return -1;
+
+	/* Optional rule, otherwise the rule of the command line is used */
+	while (p < lineEnd && isWhiteSpace(*p)) p++;
+	if (p < lineEnd && *p == ',') {
+		p++;
+		while (p < lineEnd && isWhiteSpace(*p)) p++;
+		if (lineEnd - p >= 4 && strncmp(p, "rule", 4) == 0) {
+			p += 4;
+			while (p < lineEnd && isWhiteSpace(*p)) p++;
+			if (p < lineEnd && *p == '=') {
+				p++;
+				while (p < lineEnd && isWhiteSpace(*p)) p++;
+				parseRule(p, lineEnd);
 			}
-		case EOF:			/* end of file is not allowed */
-			return true;
 		}
 	}
-	
+
+	p = (line == NULL) ? end : line + 1;
 	return true;
 }
 
-int PatternFile::parsePattern() {
-	int number = 1;
-	bool isNumber = false;
-	bool isCell = false;
-	int x = 0;
-	int y = 0;
-	unsigned char color;
-	
-	for (;;) {
-		if (skipWhiteSpace() != 0) return -1;
-		
-		switch (c) {
-		default:
-			if (c >= '0' && c <= '9') {
-				number = (isNumber ? 10*number : 0) + (c-'0');
-				isNumber = true;
-				continue;
-			} else {
-				return -1;
-			}
-		case ' ':
-		case '\t':
-		case 13:
-		case 10:
-			continue;
-		case EOF:			/* end of file: not allowed */
-			return -1;
-		case '!':			/* end of RLE file */
-			if (y == (patternSize[1]-1)) {
-				/* Fill the rest of the line with dead cells */
-				for (int i = x; i < patternSize[0]; i++) {
-					setState(x,y,0);
-				}
-				return 0;
-			} else
-				return -1;
-		case 'b':			/* dead cell */
-			isCell = true;
-			color = 0;
-			break;
-		case 'o':			/* live cell */
-		case 'x':
-		case 'y':
-		case 'z':
-			isCell = true;
-			color = 255;
+void PatternFile::parseRule(const char *p, const char *end) {
+	birthRules.clear();
+	survivalRules.clear();
+	states = 0;
+
+	/* B3/S23 names the parts, 23/3 is survival before birth */
+	std::vector<int> *rules = &survivalRules;
+	bool named = false;
+	int parts = 0;
+	int count = -1;
+	for (; p < end && !isWhiteSpace(*p) && *p != ':' && *p != ','; p++) {
+		if (parts == 2) {
+			/* Number of states of Generations rules, optionally named C or G */
+			if (*p >= '0' && *p <= '9' && count < 1000) count = 10*(count < 0 ? 0 : count) + (*p - '0');
+			else if (count >= 0 || (*p != 'C' && *p != 'c' && *p != 'G' && *p != 'g')) break;
+			else count = 0;
+		} else if (*p == 'B' || *p == 'b') {
+			rules = &birthRules;
+			named = true;
+		} else if (*p == 'S' || *p == 's') {
+			rules = &survivalRules;
+			named = true;
+		} else if (*p == '/') {
+			if (++parts > 2) break;
+			if (!named && parts == 1) rules = &birthRules;
+		} else if (*p >= '0' && *p <= '8') {
+			rules->push_back(*p - '0');
+		} else {
 			break;
-		case '$':			/* new line */
-			/* Fill the rest of the line with dead cells */
-			for (int i = x; i < patternSize[0]; i++) {
-				setState(x,y,0);
-			}
+		}
+	}
+
+	/* Unknown rules, e.g. names of multi-state rules, keep the rule of the command line */
+	states = (parts == 2) ? count : 2;
+	if ((p < end && !isWhiteSpace(*p) && *p != ':' && *p != ',')
+		|| states < 2 || states > PACKED_MAX_STATES) {
+		birthRules.clear();
+		survivalRules.clear();
+		states = 0;
+	}
+}
+
+template <class SetRun>
+int PatternFile::decode(SetRun &setRun) {
+	const char *p = data + patternBegin, *end = data + dataSize;
+	const int width = patternSize[0], height = patternSize[1];
+	int x = 0, y = 0;
+	int run = 0;
+
+	for (; p < end; p++) {
+		const char c = *p;
+
+		/* Run length, capped so it cannot overflow */
+		if (c >= '0' && c <= '9') {
+			if (run < 100000000) run = 10*run + (c - '0');
+			continue;
+		}
+		if (isWhiteSpace(c)) continue;
+
+		const int length = (run == 0) ? 1 : run;
+		run = 0;
+		int state;
+		if (c == 'b' || c == '.') {			/* dead cells */
+			x += length;
+			continue;
+		} else if (c == '$') {				/* new line(s) */
 			x = 0;
-			/* Make new line(s) */
-			y += isNumber?number:1;
-			
-			number = 1;
-			isNumber = false;
-			
+			y += length;
+			if (y >= height) y = height;
 			continue;
+		} else if (c == '!') {				/* end of RLE file */
+			return 0;
+		} else if (c == '#') {				/* comment line between the cells */
+			const char *line = (const char *)memchr(p, '\n', end - p);
+			if (line == NULL) return 0;
+			p = line;
+			continue;
+		} else if (c >= 'A' && c <= 'X') {	/* multi-state cells 1-24 */
+			state = c - 'A' + 1;
+		} else if (c >= 'p' && c <= 'y' && p+1 < end && p[1] >= 'A' && p[1] <= 'X') {
+			/* multi-state cells 25-255, a prefix letter and a state letter */
+			state = 24*(c - 'p' + 1) + (p[1] - 'A' + 1);
+			p++;
+			if (state > 255) return -1;
+		} else if (c >= 'a' && c <= 'z') {	/* live cells, o and other letters of two states */
+			state = 1;
+		} else {
+			return -1;
 		}
-		if (isCell) {
-			/* Make number of c cells */
-			for (; number > 0; x++, number--) {
-				setState(x,y,color);
+
+		/* Cells outside of the pattern are dropped */
+		if (state > maxState) maxState = state;
+		if (y < height && x < width)
+			setRun(x, y, (length < width - x) ? length : width - x, state);
+		x = (length < width - x) ? x + length : width;
+	}
+
+	/* A missing ! ends the pattern */
+	return 0;
+}
+
+int PatternFile::render(unsigned char *image, int width, int height, int x, int y) {
+	struct {
+		unsigned char *image;
+		int width, height, left, top;
+		void operator()(int cx, int cy, int length, int state) {
+			if (state != 1) return;
+			const int row = top + cy;
+			if (row < 0 || row >= height) return;
+			int begin = left + cx, end = begin + length;
+			if (begin < 0) begin = 0;
+			if (end > width) end = width;
+			for (unsigned char *pixel = &image[4*((size_t)width*row + begin)]; begin < end; begin++, pixel += 4) {
+				pixel[0] = 255;
+				pixel[1] = 255;
+				pixel[2] = 255;
+				pixel[3] = 1;
 			}
-			isNumber = false;
-			isCell = false;
-			number = 1;
 		}
-	}
-}
\ No newline at end of file
+	} setRun = { image, width, height, x, y };
+	return decode(setRun);
+}
+
+int PatternFile::render(PackedBoard &board, int x, int y) {
+	struct {
+		PackedBoard *board;
+		int left, top;
+		void operator()(int cx, int cy, int length, int state) {
+			if (state >= board->getStates()) return;
+			const int row = top + cy;
+			if (row < 0 || row >= board->getHeight()) return;
+			int begin = left + cx, end = begin + length;
+			if (begin < 0) begin = 0;
+			if (end > board->getWidth()) end = board->getWidth();
+			/* Whole words of the run at once, in the planes of the state bits */
+			uint64_t *words = board->getRow(row);
+			const int wordsPerRow = board->getWordsPerRow();
+			while (begin < end) {
+				const int bit = begin % CELLS_PER_WORD;
+				const int bits = (end - begin < CELLS_PER_WORD - bit) ? end - begin : CELLS_PER_WORD - bit;
+				const uint64_t mask = (bits == CELLS_PER_WORD) ? ~(uint64_t)0 : (((uint64_t)1 << bits) - 1) << bit;
+				for (int p = 0; p < board->getPlanes(); p++) {
+					if ((state >> p) & 1) words[p*wordsPerRow + begin / CELLS_PER_WORD] |= mask;
+				}
+				begin += bits;
+			}
+		}
+	} setRun = { &board, x, y };
+	return decode(setRun);
+}
+
+int PatternFile::render(TileUniverse &universe, int64_t x, int64_t y) {
+	struct {
+		TileUniverse *universe;
+		int64_t left, top;
+		void operator()(int cx, int cy, int length, int state) {
+			if (state == 1) universe->setRun(left + cx, top + cy, length);
+		}
+	} setRun = { &universe, x, y };
+	return decode(setRun);
+}
+
+int PatternFile::render(HashLife &hashLife, int64_t x, int64_t y) {
+	struct {
+		HashLife *hashLife;
+		void operator()(int cx, int cy, int length, int state) {
+			if (state == 1) hashLife->addRun(cx, cy, length);
+		}
+	} setRun = { &hashLife };
+	hashLife.beginRuns(patternSize[0], patternSize[1], x, y);
+	int status = decode(setRun);
+	hashLife.endRuns();
+	return status;
+}
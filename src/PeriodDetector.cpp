@@ -0,0 +1,28 @@
+#include "../inc/PeriodDetector.hpp"
+
+void PeriodDetector::setMaxPeriod(int _maxPeriod) {
+	maxPeriod = (_maxPeriod > 0) ? _maxPeriod : 0;
+	hashes.assign(maxPeriod, 0);
+	reset();
+}
+
+int PeriodDetector::add(uint64_t hash, uint64_t generation) {
+	if (maxPeriod == 0 || period != 0) return period;
+	if (count > 0 && generation != lastGeneration + 1) count = 0;
+
+	/* Search the last generations, the most recent first for the shortest period */
+	const size_t ring = hashes.size();
+	for (size_t p = 1; p <= count; p++) {
+		if (hashes[(generation - p) % ring] == hash) {
+			period = (int)p;
+			periodGeneration = generation - p;
+			extinct = (hash == 0);
+			return period;
+		}
+	}
+
+	hashes[generation % ring] = hash;
+	if (count < ring) count++;
+	lastGeneration = generation;
+	return 0;
+}
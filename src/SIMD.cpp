@@ -0,0 +1,93 @@
+#include "../inc/SIMD.hpp"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#define SIMD_X86
+	#ifdef _MSC_VER
+		#include <intrin.h>		/* for __cpuidex() and _xgetbv() */
+	#else
+		#include <cpuid.h>		/* for __cpuid_count() */
+	#endif
+#endif
+
+#ifdef SIMD_X86
+/**
+* Execute CPUID for a leaf and sub-leaf.
+*/
+static void cpuid(unsigned int leaf, unsigned int subLeaf, unsigned int registers[4]) {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, (int)leaf, (int)subLeaf);
+	for (int i = 0; i < 4; i++) registers[i] = (unsigned int)info[i];
+#else
+	if (leaf > __get_cpuid_max(leaf & 0x80000000, NULL)) {
+		registers[0] = registers[1] = registers[2] = registers[3] = 0;
+		return;
+	}
+	__cpuid_count(leaf, subLeaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+/**
+* Get the register state enabled by the OS (XCR0).
+*/
+static unsigned long long xgetbv() {
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif
+
+SIMDLevel detectSIMDLevel() {
+#ifdef SIMD_X86
+	unsigned int leaf1[4], leaf7[4];
+	cpuid(1, 0, leaf1);
+	cpuid(7, 0, leaf7);
+
+	/* The OS has to save the vector registers (OSXSAVE and XCR0) */
+	bool osxsave = (leaf1[2] >> 27) & 1;
+	unsigned long long xcr0 = osxsave ? xgetbv() : 0;
+	bool ymm = (xcr0 & 0x6) == 0x6;			/* SSE and AVX state */
+	bool zmm = (xcr0 & 0xE6) == 0xE6;		/* additionally opmask and ZMM state */
+
+	bool avx2 = ((leaf1[2] >> 28) & 1) && ((leaf7[1] >> 5) & 1);
+	bool avx512f = (leaf7[1] >> 16) & 1;
+
+	if (ymm && zmm && avx512f && hasAVX512Kernel()) return SIMD_AVX512;
+	if (ymm && avx2 && hasAVX2Kernel()) return SIMD_AVX2;
+#else
+	/* NEON is part of every AArch64 CPU */
+	if (hasNEONKernel()) return SIMD_NEON;
+#endif
+	return SIMD_SCALAR;
+}
+
+const char * getSIMDName(SIMDLevel level) {
+	switch (level) {
+		case SIMD_NEON: return "NEON";
+		case SIMD_AVX2: return "AVX2";
+		case SIMD_AVX512: return "AVX-512";
+		default: return "scalar";
+	}
+}
+
+void nextGenerationPackedSIMD(SIMDLevel level, const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd) {
+	switch (level) {
+		case SIMD_NEON:
+			nextGenerationPackedNEON(src, dst, rules, clamp, rowBegin, rowEnd);
+			break;
+		case SIMD_AVX2:
+			nextGenerationPackedAVX2(src, dst, rules, clamp, rowBegin, rowEnd);
+			break;
+		case SIMD_AVX512:
+			nextGenerationPackedAVX512(src, dst, rules, clamp, rowBegin, rowEnd);
+			break;
+		default:
+			nextGenerationPacked(src, dst, rules, clamp, rowBegin, rowEnd);
+			break;
+	}
+}
@@ -0,0 +1,53 @@
+#include "../inc/SIMD.hpp"
+
+/* Compiled with -mavx2, the kernel is only called when the CPU supports it */
+#ifdef __AVX2__
+#include <immintrin.h>
+#include "../inc/BitSliced.hpp"
+
+namespace {
+
+/**
+* Operations on 4 words per 256 bit register
+*/
+struct AVX2Ops {
+	typedef __m256i V;
+	static const int WORDS = 4;
+
+	static inline V load(const uint64_t *p) { return _mm256_loadu_si256((const __m256i *)p); }
+	static inline void store(uint64_t *p, V a) { _mm256_storeu_si256((__m256i *)p, a); }
+	static inline V set1(uint64_t a) { return _mm256_set1_epi64x((long long)a); }
+	static inline V orV(V a, V b) { return _mm256_or_si256(a, b); }
+	static inline V andV(V a, V b) { return _mm256_and_si256(a, b); }
+	static inline V xorV(V a, V b) { return _mm256_xor_si256(a, b); }
+	/** ~a & b */
+	static inline V andNot(V a, V b) { return _mm256_andnot_si256(a, b); }
+	static inline V shiftLeft1(V a) { return _mm256_slli_epi64(a, 1); }
+	static inline V shiftRight1(V a) { return _mm256_srli_epi64(a, 1); }
+	static inline V shiftLeft63(V a) { return _mm256_slli_epi64(a, 63); }
+	static inline V shiftRight63(V a) { return _mm256_srli_epi64(a, 63); }
+	static inline V xor3(V a, V b, V c) { return xorV(xorV(a, b), c); }
+	static inline V majority(V a, V b, V c) { return orV(andV(a, b), andV(c, xorV(a, b))); }
+	/** sel ? b : a */
+	static inline V select(V sel, V a, V b) { return xorV(a, andV(xorV(a, b), sel)); }
+};
+
+}
+
+bool hasAVX2Kernel() { return true; }
+
+void nextGenerationPackedAVX2(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd) {
+	nextGenerationPackedVector<AVX2Ops>(src, dst, rules, clamp, rowBegin, rowEnd);
+}
+
+#else
+
+bool hasAVX2Kernel() { return false; }
+
+void nextGenerationPackedAVX2(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd) {
+	nextGenerationPacked(src, dst, rules, clamp, rowBegin, rowEnd);
+}
+
+#endif
@@ -0,0 +1,54 @@
+#include "../inc/SIMD.hpp"
+
+/* Compiled with -mavx512f, the kernel is only called when the CPU supports it */
+#ifdef __AVX512F__
+#include <immintrin.h>
+#include "../inc/BitSliced.hpp"
+
+namespace {
+
+/**
+* Operations on 8 words per 512 bit register.
+* Adders and multiplexers are single ternary logic instructions.
+*/
+struct AVX512Ops {
+	typedef __m512i V;
+	static const int WORDS = 8;
+
+	static inline V load(const uint64_t *p) { return _mm512_loadu_si512((const void *)p); }
+	static inline void store(uint64_t *p, V a) { _mm512_storeu_si512((void *)p, a); }
+	static inline V set1(uint64_t a) { return _mm512_set1_epi64((long long)a); }
+	static inline V orV(V a, V b) { return _mm512_or_si512(a, b); }
+	static inline V andV(V a, V b) { return _mm512_and_si512(a, b); }
+	static inline V xorV(V a, V b) { return _mm512_xor_si512(a, b); }
+	/** ~a & b */
+	static inline V andNot(V a, V b) { return _mm512_andnot_si512(a, b); }
+	static inline V shiftLeft1(V a) { return _mm512_slli_epi64(a, 1); }
+	static inline V shiftRight1(V a) { return _mm512_srli_epi64(a, 1); }
+	static inline V shiftLeft63(V a) { return _mm512_slli_epi64(a, 63); }
+	static inline V shiftRight63(V a) { return _mm512_srli_epi64(a, 63); }
+	static inline V xor3(V a, V b, V c) { return _mm512_ternarylogic_epi64(a, b, c, 0x96); }
+	static inline V majority(V a, V b, V c) { return _mm512_ternarylogic_epi64(a, b, c, 0xE8); }
+	/** sel ? b : a */
+	static inline V select(V sel, V a, V b) { return _mm512_ternarylogic_epi64(sel, a, b, 0xAC); }
+};
+
+}
+
+bool hasAVX512Kernel() { return true; }
+
+void nextGenerationPackedAVX512(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd) {
+	nextGenerationPackedVector<AVX512Ops>(src, dst, rules, clamp, rowBegin, rowEnd);
+}
+
+#else
+
+bool hasAVX512Kernel() { return false; }
+
+void nextGenerationPackedAVX512(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd) {
+	nextGenerationPacked(src, dst, rules, clamp, rowBegin, rowEnd);
+}
+
+#endif
@@ -0,0 +1,53 @@
+#include "../inc/SIMD.hpp"
+
+/* NEON is available on every AArch64 CPU, no extra compiler flags needed */
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#include "../inc/BitSliced.hpp"
+
+namespace {
+
+/**
+* Operations on 2 words per 128 bit register
+*/
+struct NEONOps {
+	typedef uint64x2_t V;
+	static const int WORDS = 2;
+
+	static inline V load(const uint64_t *p) { return vld1q_u64(p); }
+	static inline void store(uint64_t *p, V a) { vst1q_u64(p, a); }
+	static inline V set1(uint64_t a) { return vdupq_n_u64(a); }
+	static inline V orV(V a, V b) { return vorrq_u64(a, b); }
+	static inline V andV(V a, V b) { return vandq_u64(a, b); }
+	static inline V xorV(V a, V b) { return veorq_u64(a, b); }
+	/** ~a & b */
+	static inline V andNot(V a, V b) { return vbicq_u64(b, a); }
+	static inline V shiftLeft1(V a) { return vshlq_n_u64(a, 1); }
+	static inline V shiftRight1(V a) { return vshrq_n_u64(a, 1); }
+	static inline V shiftLeft63(V a) { return vshlq_n_u64(a, 63); }
+	static inline V shiftRight63(V a) { return vshrq_n_u64(a, 63); }
+	static inline V xor3(V a, V b, V c) { return veorq_u64(veorq_u64(a, b), c); }
+	static inline V majority(V a, V b, V c) { return vorrq_u64(vandq_u64(a, b), vandq_u64(c, veorq_u64(a, b))); }
+	/** sel ? b : a */
+	static inline V select(V sel, V a, V b) { return vbslq_u64(sel, b, a); }
+};
+
+}
+
+bool hasNEONKernel() { return true; }
+
+void nextGenerationPackedNEON(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd) {
+	nextGenerationPackedVector<NEONOps>(src, dst, rules, clamp, rowBegin, rowEnd);
+}
+
+#else
+
+bool hasNEONKernel() { return false; }
+
+void nextGenerationPackedNEON(const PackedBoard &src, PackedBoard &dst,
+		const unsigned char *rules, bool clamp, int rowBegin, int rowEnd) {
+	nextGenerationPacked(src, dst, rules, clamp, rowBegin, rowEnd);
+}
+
+#endif
@@ -0,0 +1,249 @@
+#include "../inc/SoupBatch.hpp"
+#include <algorithm>
+#include "../inc/Philox.hpp"
+
+void SoupBatch::spawnSoup(PackedBoard &board, uint64_t seed, float density) {
+	/* The same cells as GameOfLife --seed for a board of this size */
+	const uint64_t threshold = getRandomThreshold(density);
+	const int wordsPerRow = board.getWordsPerRow();
+	for (int y = 0; y < board.getHeight(); y++) {
+		uint64_t *row = board.getRow(y);
+		for (int w = 0; w < wordsPerRow; w++) {
+			uint64_t bits = 0;
+			for (int i = 0; i < CELLS_PER_WORD/4; i++)
+				bits |= (uint64_t)getRandomCells(seed, threshold, w*CELLS_PER_WORD/4 + i, y) << 4*i;
+			row[w] = (w == wordsPerRow-1) ? bits & board.getLastWordMask() : bits;
+		}
+	}
+}
+
+int SoupBatch::setup(int width, int height, int _numberOfBoards, const unsigned char *_rules, bool _clamp,
+		cl_context context, cl_device_id device, cl_program program) {
+	release();
+	if (width <= 0 || height <= 0 || _numberOfBoards <= 0 || maxGenerations <= 0 || maxPeriod <= 0)
+		return -1;
+	boardSize[0] = width;
+	boardSize[1] = height;
+	numberOfBoards = _numberOfBoards;
+	memcpy(rules, _rules, sizeof(rules));
+	clamp = _clamp;
+	if (staging.allocate(width, height) != 0) return -1;
+	rowWords = 2*staging.getWordsPerRow();
+	boardWords = rowWords*height;
+	seeds.assign(numberOfBoards, 0);
+	runningSoups = 0;
+
+	if (context == NULL) {
+		/* Soups on the CPU, one thread calculates all generations of a soup */
+		for (int i = 0; i < numberOfBoards; i++) {
+			HostSoup *soup = new HostSoup();
+			soups.push_back(soup);
+			if (soup->board[0].allocate(width, height) != 0
+				|| soup->board[1].allocate(width, height) != 0)
+				return -1;
+			soup->detector.setMaxPeriod(maxPeriod);
+			soup->current = 0;
+			soup->generation = 0;
+			soup->status = SOUP_IDLE;
+			if (nextSeed != endSeed) {
+				seeds[i] = nextSeed++;
+				spawnSoup(soup->board[0], seeds[i], density);
+				soup->status = 0;
+				runningSoups++;
+			}
+		}
+		return 0;
+	}
+
+	cl_int status = CL_SUCCESS;
+	commandQueue = clCreateCommandQueue(context, device, 0, &status);
+	if (status != CL_SUCCESS) return -1;
+
+	/* All boards one after another, the first soups are spawned on the host */
+	const size_t wordsOfBoards = (size_t)numberOfBoards*boardWords;
+	stagingWords.assign(wordsOfBoards, 0);
+	hostStates.assign(4*numberOfBoards, 0);
+	for (int i = 0; i < numberOfBoards; i++) {
+		hostStates[4*i+1] = SOUP_IDLE;
+		if (nextSeed == endSeed) continue;
+		seeds[i] = nextSeed++;
+		spawnSoup(staging, seeds[i], density);
+		memcpy(&stagingWords[(size_t)i*boardWords], staging.getWords(), staging.getSizeBytes());
+		hostStates[4*i+1] = 0;
+		runningSoups++;
+	}
+	boards[0] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+			wordsOfBoards*sizeof(cl_uint), &stagingWords[0], &status);
+	if (status != CL_SUCCESS) return -1;
+	boards[1] = clCreateBuffer(context, CL_MEM_READ_WRITE, wordsOfBoards*sizeof(cl_uint), NULL, &status);
+	if (status != CL_SUCCESS) return -1;
+	deviceRules = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+			sizeof(rules), rules, &status);
+	if (status != CL_SUCCESS) return -1;
+	std::vector<cl_uint> zeros(3*numberOfBoards, 0);
+	sums = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+			zeros.size()*sizeof(cl_uint), &zeros[0], &status);
+	if (status != CL_SUCCESS) return -1;
+	history = clCreateBuffer(context, CL_MEM_READ_WRITE,
+			(size_t)2*maxPeriod*numberOfBoards*sizeof(cl_uint), NULL, &status);
+	if (status != CL_SUCCESS) return -1;
+	states = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+			hostStates.size()*sizeof(cl_int), &hostStates[0], &status);
+	if (status != CL_SUCCESS) return -1;
+
+	/* Two kernel objects with fixed arguments, A->B and B->A */
+	for (int i = 0; i < 2; i++) {
+		kernel[i] = clCreateKernel(program, "nextGenerationSoups", &status);
+		if (status != CL_SUCCESS) return -1;
+		status |= clSetKernelArg(kernel[i], 0, sizeof(cl_mem), (void *)&boards[i]);
+		status |= clSetKernelArg(kernel[i], 1, sizeof(cl_mem), (void *)&boards[1-i]);
+		status |= clSetKernelArg(kernel[i], 2, sizeof(cl_mem), (void *)&deviceRules);
+		status |= clSetKernelArg(kernel[i], 3, sizeof(cl_int), (void *)&boardSize[0]);
+		status |= clSetKernelArg(kernel[i], 4, sizeof(cl_int), (void *)&boardSize[1]);
+		status |= clSetKernelArg(kernel[i], 5, sizeof(cl_int), (void *)&rowWords);
+		status |= clSetKernelArg(kernel[i], 6, sizeof(cl_int), (void *)&numberOfBoards);
+		status |= clSetKernelArg(kernel[i], 7, sizeof(cl_mem), (void *)&states);
+		status |= clSetKernelArg(kernel[i], 8, sizeof(cl_mem), (void *)&sums);
+		if (status != CL_SUCCESS) return -1;
+	}
+	checkKernel = clCreateKernel(program, "checkSoups", &status);
+	if (status != CL_SUCCESS) return -1;
+	status |= clSetKernelArg(checkKernel, 0, sizeof(cl_mem), (void *)&states);
+	status |= clSetKernelArg(checkKernel, 1, sizeof(cl_mem), (void *)&sums);
+	status |= clSetKernelArg(checkKernel, 2, sizeof(cl_mem), (void *)&history);
+	status |= clSetKernelArg(checkKernel, 3, sizeof(cl_int), (void *)&numberOfBoards);
+	status |= clSetKernelArg(checkKernel, 4, sizeof(cl_int), (void *)&maxPeriod);
+	status |= clSetKernelArg(checkKernel, 5, sizeof(cl_int), (void *)&maxGenerations);
+	if (status != CL_SUCCESS) return -1;
+
+	/* One work item per word of all boards and per board, local sizes from the runtime */
+	globalThreads[0] = wordsOfBoards;
+	globalThreads[1] = numberOfBoards;
+	return 0;
+}
+
+void SoupBatch::release() {
+	if (commandQueue != NULL) clFinish(commandQueue);
+	for (int i = 0; i < 2; i++) {
+		if (kernel[i] != NULL) clReleaseKernel(kernel[i]);
+		if (boards[i] != NULL) clReleaseMemObject(boards[i]);
+		kernel[i] = NULL;
+		boards[i] = NULL;
+	}
+	if (checkKernel != NULL) clReleaseKernel(checkKernel);
+	if (deviceRules != NULL) clReleaseMemObject(deviceRules);
+	if (sums != NULL) clReleaseMemObject(sums);
+	if (history != NULL) clReleaseMemObject(history);
+	if (states != NULL) clReleaseMemObject(states);
+	if (commandQueue != NULL) clReleaseCommandQueue(commandQueue);
+	checkKernel = NULL;
+	deviceRules = NULL;
+	sums = NULL;
+	history = NULL;
+	states = NULL;
+	commandQueue = NULL;
+	for (size_t i = 0; i < soups.size(); i++)
+		delete soups[i];
+	soups.clear();
+	numberOfBoards = 0;
+	runningSoups = 0;
+}
+
+int SoupBatch::step(std::vector<SoupResult> &results) {
+	if (numberOfBoards == 0) return -1;
+	return (commandQueue != NULL) ? stepDevice(results) : stepHost(results);
+}
+
+int SoupBatch::stepDevice(std::vector<SoupResult> &results) {
+	/* The generations of all boards are enqueued back to back, finished boards return at once */
+	cl_int status = CL_SUCCESS;
+	for (int g = 0; g < SOUP_GENERATIONS_PER_STEP; g++) {
+		status |= clEnqueueNDRangeKernel(commandQueue, kernel[g % 2], 1, NULL,
+				&globalThreads[0], NULL, 0, NULL, NULL);
+		status |= clEnqueueNDRangeKernel(commandQueue, checkKernel, 1, NULL,
+				&globalThreads[1], NULL, 0, NULL, NULL);
+	}
+	status |= clEnqueueReadBuffer(commandQueue, states, CL_TRUE, 0,
+			hostStates.size()*sizeof(cl_int), &hostStates[0], 0, NULL, NULL);
+	if (status != CL_SUCCESS) return -1;
+
+	/* Replace finished soups, the current generation of all boards is in boards[0] */
+	bool replaced = false;
+	for (int i = 0; i < numberOfBoards; i++) {
+		cl_int *state = &hostStates[4*i];
+		if (state[1] == 0 || state[1] == SOUP_IDLE) continue;
+		SoupResult result;
+		result.seed = seeds[i];
+		result.period = state[1];
+		result.generation = state[2];
+		result.population = state[3];
+		results.push_back(result);
+		runningSoups--;
+
+		state[0] = 0;
+		state[1] = SOUP_IDLE;
+		state[2] = 0;
+		state[3] = 0;
+		replaced = true;
+		if (nextSeed == endSeed) continue;
+		seeds[i] = nextSeed++;
+		state[1] = 0;
+		runningSoups++;
+		/* The staging words of a board are only reused after the next read */
+		spawnSoup(staging, seeds[i], density);
+		cl_uint *words = &stagingWords[(size_t)i*boardWords];
+		memcpy(words, staging.getWords(), staging.getSizeBytes());
+		status |= clEnqueueWriteBuffer(commandQueue, boards[0], CL_FALSE,
+				(size_t)i*boardWords*sizeof(cl_uint), boardWords*sizeof(cl_uint), words, 0, NULL, NULL);
+	}
+	if (replaced)
+		status |= clEnqueueWriteBuffer(commandQueue, states, CL_FALSE, 0,
+				hostStates.size()*sizeof(cl_int), &hostStates[0], 0, NULL, NULL);
+	clFlush(commandQueue);
+	return (status == CL_SUCCESS) ? 0 : -1;
+}
+
+int SoupBatch::stepHost(std::vector<SoupResult> &results) {
+	/* Each task calculates a few soups up to the end of the step */
+	pool.start(numberOfThreads);
+	const int tasks = std::min(numberOfBoards, (int)pool.getNumberOfThreads()*16);
+	pool.run(tasks, [&](int task) {
+		for (int i = (long)numberOfBoards*task/tasks; i < (long)numberOfBoards*(task+1)/tasks; i++) {
+			HostSoup &soup = *soups[i];
+			for (int g = 0; g < SOUP_GENERATIONS_PER_STEP && soup.status == 0; g++) {
+				PackedBoard &src = soup.board[soup.current];
+				PackedBoard &dst = soup.board[1-soup.current];
+				nextGenerationPacked(src, dst, rules, clamp, 0, boardSize[1]);
+				soup.current = 1-soup.current;
+				soup.generation++;
+				int period = soup.detector.add(dst.getHash(0, boardSize[1]), soup.generation);
+				if (period > 0) soup.status = period;
+				else if (soup.generation >= (unsigned long)maxGenerations) soup.status = SOUP_UNSTABLE;
+			}
+		}
+	});
+
+	/* Replace finished soups */
+	for (int i = 0; i < numberOfBoards; i++) {
+		HostSoup &soup = *soups[i];
+		if (soup.status == 0 || soup.status == SOUP_IDLE) continue;
+		SoupResult result;
+		result.seed = seeds[i];
+		result.period = soup.status;
+		result.generation = (soup.status > 0) ? soup.detector.getPeriodGeneration() : soup.generation;
+		result.population = (unsigned int)soup.board[soup.current].getPopulation();
+		results.push_back(result);
+		runningSoups--;
+
+		soup.status = SOUP_IDLE;
+		if (nextSeed == endSeed) continue;
+		seeds[i] = nextSeed++;
+		soup.current = 0;
+		soup.generation = 0;
+		soup.status = 0;
+		soup.detector.reset();
+		spawnSoup(soup.board[0], seeds[i], density);
+		runningSoups++;
+	}
+	return 0;
+}
@@ -0,0 +1,270 @@
+/**
+ * Name:        gol_soup
+ * Description: Soup search over many small random boards. Thousands of boards
+ *              are calculated together in one buffer until they become still
+ *              lifes or oscillators, then the census of the results is printed.
+ */
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>				/* for uint64_t */
+#include <unistd.h>				/* for command line parsing */
+#include <sys/time.h>			/* for gettimeofday() */
+#include <CL/cl.h>				/* OpenCL definitions */
+
+#include "../inc/SoupBatch.hpp"
+#include "../inc/KernelFile.hpp"
+
+using namespace std;
+
+/* Current time in seconds */
+static double getSeconds() {
+	timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + now.tv_usec * 1.0e-6;
+}
+
+/**
+* Parse a rule of the form SURVIVAL/BIRTH like GameOfLife::setRule.
+* @param rule list of Survival/Birth, e.g. 23/3
+* @param rules 18 rules for calculating next generation
+* @return 0 on success and -1 on failure
+*/
+static int parseRule(const char *rule, unsigned char *rules) {
+	const char *delimiter = strchr(rule, '/');
+	if (delimiter == NULL || strchr(delimiter+1, '/') != NULL) return -1;
+	memset(rules, 0, 18);
+	for (const char *c = rule; *c != '\0'; c++) {
+		if (c == delimiter) continue;
+		if (*c < '0' || *c > '9') return -1;
+		int number = *c - '0';
+		/* 9 is the same as 0 like in GameOfLife::setRule */
+		rules[(c < delimiter ? 9 : 0) + (number==9 ? 0 : number)] = 255;
+	}
+	return 0;
+}
+
+/* Print command line help */
+static void showHelp() {
+	printf( "\n" );
+	printf( "Usage: gol_soup [OPTIONS] WIDTH [HEIGHT]\n");
+	printf( "\n" );
+	printf( "---- Options ----\n" );
+	printf( " -h            Prints this help\n");
+	printf( " -r DENSITY    density of the random soups\n");
+	printf( "               default: 0.5\n");
+	printf( " -s SEED       seed of the first soup, soup n gets SEED+n\n");
+	printf( "               default: 1\n");
+	printf( " -l RULE       rule for next generations as a list of Survival/Birth\n");
+	printf( "               default: 23/3\n");
+	printf( " -n NUMBER     number of soups\n");
+	printf( "               default: 100000\n");
+	printf( " -g NUMBER     generations before a soup counts as unstable\n");
+	printf( "               default: 10000\n");
+	printf( " -p NUMBER     longest period detected\n");
+	printf( "               default: 16\n");
+	printf( " -b NUMBER     boards calculated together\n");
+	printf( "               default: 4096\n");
+	printf( " -e ENGINE     opencl or cpu\n");
+	printf( "               default: opencl\n");
+	printf( " -j NUMBER     threads of the cpu engine\n");
+	printf( "               default: all cores\n");
+	printf( " -c            Use clamp mode (dead cells outside a board)\n");
+	printf( "               default: wrap mode\n");
+	printf( " -v            Print every finished soup\n");
+	printf( "\n" );
+}
+
+/**
+* Create a GPU context and build kernels.cl with the rules baked in like GameOfLife::setupDevice.
+* @return 0 on success and -1 on failure
+*/
+static int setupOpenCL(const unsigned char *rules, bool clamp, cl_context &context,
+		cl_device_id &device, cl_program &program) {
+	cl_int status = CL_SUCCESS;
+	cl_uint numberOfPlatforms;
+	cl_platform_id platform = NULL;
+	if (clGetPlatformIDs(0, NULL, &numberOfPlatforms) != CL_SUCCESS || numberOfPlatforms == 0)
+		return -1;
+	vector<cl_platform_id> platforms(numberOfPlatforms);
+	clGetPlatformIDs(numberOfPlatforms, &platforms[0], NULL);
+	for (unsigned int i = 0; i < numberOfPlatforms; i++) {
+		char vendor[100];
+		clGetPlatformInfo(platforms[i], CL_PLATFORM_VENDOR, sizeof(vendor), vendor, NULL);
+		platform = platforms[i];
+		if (!strcmp(vendor, "Advanced Micro Devices, Inc.")
+			|| !strcmp(vendor, "NVIDIA Corporation")) {
+			break;
+		}
+	}
+	cl_context_properties cps[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
+	context = clCreateContextFromType(cps, CL_DEVICE_TYPE_GPU, NULL, NULL, &status);
+	if (status != CL_SUCCESS) return -1;
+	if (clGetContextInfo(context, CL_CONTEXT_DEVICES, sizeof(cl_device_id), &device, NULL) != CL_SUCCESS)
+		return -1;
+
+	KernelFile kernels;
+	if (!kernels.open("kernels.cl")) {
+		fprintf(stderr, "\nCannot open kernels.cl\n");
+		return -1;
+	}
+	const char *source = kernels.source().c_str();
+	size_t sourceSize[] = {strlen(source)};
+	program = clCreateProgramWithSource(context, 1, &source, sourceSize, &status);
+	if (status != CL_SUCCESS) return -1;
+
+	unsigned int birth, survival;
+	getRuleMasks(rules, birth, survival);
+	char options[96];
+	snprintf(options, sizeof(options), "-D RULE_BIRTH=0x%03X -D RULE_SURVIVAL=0x%03X%s",
+			birth, survival, clamp ? " -D CLAMP" : "");
+	status = clBuildProgram(program, 1, &device, options, NULL, NULL);
+	if (status != CL_SUCCESS) {
+		size_t logSize = 0;
+		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &logSize);
+		vector<char> log(logSize + 1, '\0');
+		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, logSize, &log[0], NULL);
+		fprintf(stderr, "\nBuild log:\n%s\n", &log[0]);
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	float density = 0.5f;
+	uint64_t seed = 1, numberOfSoups = 100000;
+	string rule("23/3"), engine("opencl");
+	int maxGenerations = 10000, maxPeriod = 16, numberOfBoards = 4096, threads = 0;
+	bool clamp = false, verbose = false;
+
+	int optionChar;
+	while ((optionChar = getopt(argc, argv, ":hr:s:l:n:g:p:b:e:j:cv")) != -1) {
+		bool error = false;
+		switch (optionChar) {
+		case 'r':
+			density = atof(optarg);
+			error = density < 0.0f || density > 1.0f;
+			break;
+		case 's': seed = strtoull(optarg, NULL, 10); break;
+		case 'l': rule = optarg; break;
+		case 'n':
+			error = atoll(optarg) <= 0;
+			numberOfSoups = strtoull(optarg, NULL, 10);
+			break;
+		case 'g':
+			error = atoi(optarg) <= 0;
+			maxGenerations = atoi(optarg);
+			break;
+		case 'p':
+			error = atoi(optarg) <= 0;
+			maxPeriod = atoi(optarg);
+			break;
+		case 'b':
+			error = atoi(optarg) <= 0;
+			numberOfBoards = atoi(optarg);
+			break;
+		case 'e':
+			engine = optarg;
+			error = engine != "opencl" && engine != "cpu";
+			break;
+		case 'j':
+			error = atoi(optarg) < 0;
+			threads = atoi(optarg);
+			break;
+		case 'c': clamp = true; break;
+		case 'v': verbose = true; break;
+		case 'h':
+			showHelp();
+			return 0;
+		case ':':
+			fprintf(stderr,"\nOption -%c requires an operand\n", optopt);
+			error = true;
+			break;
+		case '?':
+			fprintf(stderr,"\nUnrecognized option: -%c\n", optopt);
+			error = true;
+			break;
+		}
+		if (error) {
+			if (optionChar != ':' && optionChar != '?')
+				fprintf(stderr,"\nError in option -%c\n", optionChar);
+			showHelp();
+			return -1;
+		}
+	}
+
+	/* Board size from the remaining arguments */
+	if (optind >= argc || optind+2 < argc) {
+		showHelp();
+		return -1;
+	}
+	int width = atoi(argv[optind]);
+	int height = (optind+1 < argc) ? atoi(argv[optind+1]) : width;
+
+	unsigned char rules[18];
+	if (parseRule(rule.c_str(), rules) != 0) {
+		fprintf(stderr,"\nError in rule %s\n", rule.c_str());
+		return -1;
+	}
+
+	cl_context context = NULL;
+	cl_device_id device = NULL;
+	cl_program program = NULL;
+	if (engine == "opencl" && setupOpenCL(rules, clamp, context, device, program) != 0) {
+		fprintf(stderr, "\nCannot set up OpenCL, use -e cpu\n");
+		return -1;
+	}
+
+	SoupBatch batch;
+	batch.setSoups(seed, numberOfSoups, density);
+	batch.setLimits(maxGenerations, maxPeriod);
+	batch.setNumberOfThreads(threads);
+	if (batch.setup(width, height, numberOfBoards, rules, clamp, context, device, program) != 0) {
+		fprintf(stderr, "\nCannot set up %i boards of %ix%i cells\n", numberOfBoards, width, height);
+		return -1;
+	}
+	printf("boards: %i of %ix%i | soups: %llu | engine: %s", numberOfBoards, width, height,
+			(unsigned long long)numberOfSoups, engine.c_str());
+	if (context == NULL) printf(" | threads: %u", batch.getNumberOfThreads());
+	printf("\n");
+
+	/* Census: counts of extinct soups (0), periods and unstable soups (SOUP_UNSTABLE) */
+	map<int, unsigned long> census;
+	vector<SoupResult> results;
+	unsigned long long generations = 0;
+	double start = getSeconds();
+	while (!batch.isFinished()) {
+		results.clear();
+		if (batch.step(results) != 0) {
+			fprintf(stderr, "\nCalculating the soups failed\n");
+			return -1;
+		}
+		for (size_t i = 0; i < results.size(); i++) {
+			const SoupResult &result = results[i];
+			census[result.population == 0 ? 0 : result.period]++;
+			generations += result.generation;
+			if (verbose)
+				printf("seed: %llu | period: %i | generation: %lu | population: %u\n",
+						(unsigned long long)result.seed, result.period, result.generation, result.population);
+		}
+	}
+	double seconds = getSeconds() - start;
+
+	for (map<int, unsigned long>::iterator i = census.begin(); i != census.end(); i++) {
+		if (i->first == 0) printf("dead: %lu\n", i->second);
+		else if (i->first == 1) printf("still life: %lu\n", i->second);
+		else if (i->first == SOUP_UNSTABLE) printf("unstable: %lu\n", i->second);
+		else printf("p%i: %lu\n", i->first, i->second);
+	}
+	printf("seconds: %.3f | soups/sec: %.2f | generations/sec: %.4g\n",
+			seconds, numberOfSoups / seconds, generations / seconds);
+
+	batch.release();
+	if (program != NULL) clReleaseProgram(program);
+	if (context != NULL) clReleaseContext(context);
+	return 0;
+}
@@ -0,0 +1,70 @@
+#include "../inc/ThreadPool.hpp"
+
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wakeUp.notify_all();
+	for (unsigned int i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+void ThreadPool::start(unsigned int numberOfThreads) {
+	if (!workers.empty()) return;
+
+	if (numberOfThreads == 0)
+		numberOfThreads = std::thread::hardware_concurrency();
+	/* The calling thread is the first thread of the pool */
+	for (unsigned int i = 1; i < numberOfThreads; i++)
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+void ThreadPool::run(int _numberOfTasks, const std::function<void(int)> &_task) {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		/* Workers of the last batch must be idle before changing the task */
+		done.wait(lock, [this]{ return activeWorkers == 0; });
+		task = _task;
+		numberOfTasks = _numberOfTasks;
+		nextTask = 0;
+		finishedTasks = 0;
+		batch++;
+	}
+	wakeUp.notify_all();
+
+	work();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]{ return finishedTasks == numberOfTasks && activeWorkers == 0; });
+}
+
+void ThreadPool::work() {
+	for (;;) {
+		int i = nextTask.fetch_add(1);
+		if (i >= numberOfTasks) break;
+
+		task(i);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		if (++finishedTasks == numberOfTasks) done.notify_all();
+	}
+}
+
+void ThreadPool::workerLoop() {
+	unsigned long seenBatch = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeUp.wait(lock, [&]{ return stop || batch != seenBatch; });
+			if (stop) return;
+			seenBatch = batch;
+			activeWorkers++;
+		}
+
+		work();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		if (--activeWorkers == 0) done.notify_all();
+	}
+}
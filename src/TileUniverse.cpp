@@ -0,0 +1,237 @@
+#include "../inc/TileUniverse.hpp"
+#include "../inc/BitSliced.hpp"
+
+/*
+ * Neighbour directions of a tile in the order of UniverseTile::neighbours
+ */
+static const int directions[8][2] = {
+	{-1, -1}, {0, -1}, {1, -1},
+	{-1, 0},           {1, 0},
+	{-1, 1},  {0, 1},  {1, 1}
+};
+
+TileUniverse::~TileUniverse() {
+	clear();
+	for (size_t i = 0; i < freeTiles.size(); i++)
+		free(freeTiles[i]);
+}
+
+void TileUniverse::clear() {
+	for (std::unordered_map<uint64_t, UniverseTile *>::iterator it = tiles.begin(); it != tiles.end(); ++it)
+		freeTiles.push_back(it->second);
+	tiles.clear();
+	tileList.clear();
+}
+
+UniverseTile * TileUniverse::getTile(int64_t x, int64_t y) {
+	UniverseTile *&tile = tiles[key(x, y)];
+	if (tile != NULL) return tile;
+
+	if (freeTiles.empty()) {
+		tile = (UniverseTile *)malloc(sizeof(UniverseTile));
+		if (tile == NULL) abort();
+	} else {
+		tile = freeTiles.back();
+		freeTiles.pop_back();
+	}
+	memset(tile, 0, sizeof(UniverseTile));
+	tile->tile[0] = x;
+	tile->tile[1] = y;
+	return tile;
+}
+
+void TileUniverse::load(const unsigned char *image, int width, int height, int64_t x, int64_t y) {
+	clear();
+	for (int i = 0; i < height; i++) {
+		for (int k = 0; k < width; k++) {
+			if (image[4*k + 4*width*i] == 0) continue;
+			/* Arithmetic shifts round towards -infinity for negative coordinates */
+			int64_t cx = x + k, cy = y + i;
+			UniverseTile *tile = getTile(cx >> 6, cy >> 6);
+			tile->cells[current][cy & (UNIVERSE_TILE_SIZE-1)] |= (uint64_t)1 << (cx & (UNIVERSE_TILE_SIZE-1));
+		}
+	}
+}
+
+void TileUniverse::load(const PackedBoard &board, int64_t x, int64_t y) {
+	clear();
+	auto setBoardRun = [&](int cx, int cy, int length) { setRun(x + cx, y + cy, length); };
+	board.forEachRun(setBoardRun);
+}
+
+void TileUniverse::setRun(int64_t x, int64_t y, int length) {
+	/* The cells of the run in a tile at once */
+	const int64_t end = x + length;
+	while (x < end) {
+		const int bit = (int)(x & (UNIVERSE_TILE_SIZE-1));
+		const int bits = (end - x < UNIVERSE_TILE_SIZE - bit) ? (int)(end - x) : UNIVERSE_TILE_SIZE - bit;
+		const uint64_t mask = (bits == UNIVERSE_TILE_SIZE) ? ~(uint64_t)0 : (((uint64_t)1 << bits) - 1) << bit;
+		getTile(x >> 6, y >> 6)->cells[current][y & (UNIVERSE_TILE_SIZE-1)] |= mask;
+		x += bits;
+	}
+}
+
+template <class SetCell>
+void TileUniverse::forEachCell(int width, int height, SetCell &setCell) const {
+	for (int64_t ty = 0; ty*UNIVERSE_TILE_SIZE < height; ty++) {
+		for (int64_t tx = 0; tx*UNIVERSE_TILE_SIZE < width; tx++) {
+			const UniverseTile *tile = findTile(tx, ty);
+			if (tile == NULL) continue;
+
+			const uint64_t *rows = tile->cells[current];
+			for (int i = 0; i < UNIVERSE_TILE_SIZE; i++) {
+				const int y = ty*UNIVERSE_TILE_SIZE + i;
+				if (y >= height) break;
+				for (uint64_t bits = rows[i]; bits != 0; bits &= bits - 1) {
+					const int x = tx*UNIVERSE_TILE_SIZE + __builtin_ctzll(bits);
+					if (x < width) setCell(x, y);
+				}
+			}
+		}
+	}
+}
+
+void TileUniverse::rasterise(unsigned char *image, int width, int height) const {
+	for (int i = 0; i < width*height; i++) {
+		image[4*i] = 0;
+		image[4*i+1] = 0;
+		image[4*i+2] = 0;
+		image[4*i+3] = 1;
+	}
+
+	struct {
+		unsigned char *image;
+		int width;
+		void operator()(int x, int y) {
+			unsigned char *pixel = &image[4*x + 4*width*y];
+			pixel[0] = 255;
+			pixel[1] = 255;
+			pixel[2] = 255;
+		}
+	} setCell = { image, width };
+	forEachCell(width, height, setCell);
+}
+
+void TileUniverse::rasterise(PackedBoard &board) const {
+	board.clear();
+
+	struct {
+		PackedBoard *board;
+		void operator()(int x, int y) {
+			board->setCell(x, y, true);
+		}
+	} setCell = { &board };
+	forEachCell(board.getWidth(), board.getHeight(), setCell);
+}
+
+void TileUniverse::prepare() {
+	tileList.clear();
+	for (std::unordered_map<uint64_t, UniverseTile *>::iterator it = tiles.begin(); it != tiles.end(); ++it)
+		tileList.push_back(it->second);
+
+	/* Live cells at a border can give birth to cells in the neighbour tile */
+	const size_t numberOfTiles = tileList.size();
+	for (size_t i = 0; i < numberOfTiles; i++) {
+		const UniverseTile *tile = tileList[i];
+		const uint64_t *rows = tile->cells[current];
+		const uint64_t north = rows[0], south = rows[UNIVERSE_TILE_SIZE-1];
+		uint64_t columns = 0;
+		for (int k = 0; k < UNIVERSE_TILE_SIZE; k++)
+			columns |= rows[k];
+
+		const bool border[8] = {
+			(north & 1) != 0, north != 0, (north >> 63) != 0,
+			(columns & 1) != 0, (columns >> 63) != 0,
+			(south & 1) != 0, south != 0, (south >> 63) != 0
+		};
+		const int64_t x = tile->tile[0], y = tile->tile[1];
+		for (int d = 0; d < 8; d++) {
+			if (border[d] && findTile(x + directions[d][0], y + directions[d][1]) == NULL)
+				tileList.push_back(getTile(x + directions[d][0], y + directions[d][1]));
+		}
+	}
+
+	for (size_t i = 0; i < tileList.size(); i++) {
+		UniverseTile *tile = tileList[i];
+		for (int d = 0; d < 8; d++)
+			tile->neighbours[d] = findTile(tile->tile[0] + directions[d][0], tile->tile[1] + directions[d][1]);
+	}
+}
+
+void TileUniverse::nextGenerationTiles(const unsigned char *rules, size_t begin, size_t end) {
+	const RuleMasks<ScalarOps> ruleMasks(rules);
+	const int last = UNIVERSE_TILE_SIZE - 1;
+
+	for (size_t t = begin; t < end; t++) {
+		UniverseTile *tile = tileList[t];
+		const uint64_t *rows = tile->cells[current];
+		uint64_t *next = tile->cells[current^1];
+		UniverseTile * const *neighbours = tile->neighbours;
+
+		/* Rows of the tiles to the west and east, dead for empty space */
+		const uint64_t *westRows = neighbours[3] ? neighbours[3]->cells[current] : NULL;
+		const uint64_t *eastRows = neighbours[4] ? neighbours[4]->cells[current] : NULL;
+
+		/* Row y of the tile with its west and east neighbours, y from -1 to 64 */
+		auto shiftedRow = [&](int y, uint64_t &west, uint64_t &center, uint64_t &east) {
+			const uint64_t *centerRows = rows, *westSide = westRows, *eastSide = eastRows;
+			int r = y;
+			if (y < 0 || y > last) {
+				const int side = (y < 0) ? 0 : 5;
+				const UniverseTile *c = neighbours[side+1];
+				const UniverseTile *w = neighbours[side];
+				const UniverseTile *e = neighbours[side+2];
+				centerRows = c ? c->cells[current] : NULL;
+				westSide = w ? w->cells[current] : NULL;
+				eastSide = e ? e->cells[current] : NULL;
+				r = (y < 0) ? last : 0;
+			}
+			center = centerRows ? centerRows[r] : 0;
+			west = (center << 1) | (westSide ? westSide[r] >> 63 : 0);
+			east = (center >> 1) | (eastSide ? (eastSide[r] & 1) << 63 : 0);
+		};
+
+		uint64_t nw, n, ne, w, c, e, sw, s, se;
+		shiftedRow(-1, nw, n, ne);
+		shiftedRow(0, w, c, e);
+		uint64_t population = 0;
+		for (int y = 0; y <= last; y++) {
+			shiftedRow(y+1, sw, s, se);
+			next[y] = nextGenerationBitSliced<ScalarOps>(nw, n, ne, w, c, e, sw, s, se, ruleMasks);
+			population += __builtin_popcountll(next[y]);
+			nw = w; n = c; ne = e;
+			w = sw; c = s; e = se;
+		}
+		tile->population = population;
+	}
+}
+
+void TileUniverse::finish() {
+	current ^= 1;
+
+	/* Dead tiles are freed, they are allocated again when cells reach their border */
+	for (size_t i = 0; i < tileList.size(); i++) {
+		UniverseTile *tile = tileList[i];
+		if (tile->population != 0) continue;
+		tiles.erase(key(tile->tile[0], tile->tile[1]));
+		freeTiles.push_back(tile);
+	}
+	tileList.clear();
+
+	/* Keep a few tiles for reuse, return the rest of a collapsed population */
+	const size_t keep = tiles.size() / 4 + 64;
+	while (freeTiles.size() > keep) {
+		free(freeTiles.back());
+		freeTiles.pop_back();
+	}
+}
+
+uint64_t TileUniverse::getPopulation() const {
+	uint64_t population = 0;
+	for (std::unordered_map<uint64_t, UniverseTile *>::const_iterator it = tiles.begin(); it != tiles.end(); ++it) {
+		const uint64_t *rows = it->second->cells[current];
+		for (int i = 0; i < UNIVERSE_TILE_SIZE; i++)
+			population += __builtin_popcountll(rows[i]);
+	}
+	return population;
+}
@@ -14,6 +14,85 @@ sampler_t sampler = CLK_NORMALIZED_COORDS_TRUE |
 							CLK_ADDRESS_REPEAT | CLK_FILTER_NEAREST;
 #endif
 
+/*
+ * Rules baked in by the host: bit n of RULE_BIRTH and RULE_SURVIVAL is set
+ * if a dead cell is born or a live cell survives with n neighbours. The
+ * compiler folds the rules into the kernels, without them they are read
+ * from the rules buffer. RULE(i) is 255 or 0 like rules[i].
+ */
+#ifdef RULE_BIRTH
+#define RULE(i) (((i) < 9 ? (RULE_BIRTH >> (i)) & 1 : (RULE_SURVIVAL >> ((i) - 9)) & 1) * 255)
+#else
+#define RULE(i) rules[i]
+#endif
+
+/* Hash of a word of a packed board at its index like hashBoardWord on the host, 0 for dead words */
+inline ulong hashWord(
+				__private uint word,
+				__private uint index
+				) {
+	if (word == 0) return 0;
+	__private ulong z = ((ulong)index << 32) | word;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+	return z ^ (z >> 31);
+}
+
+#ifdef HASH_RING
+/*
+ * Period detection of packed boards: the hash of the board of generation g
+ * is accumulated in slot g % HASH_RING of the ring hashes, two uints per
+ * slot with the low half first. Each tile (work group) keeps the hash of
+ * its words in tileHashes and only adds the change of its hash to the slot,
+ * the first tile adds the hash of the generation before and clears the
+ * slot of the next generation. Stable tiles of sparse mode keep their hash.
+ * The hashes equal hashBoardWord and PackedBoard::getHash on the host.
+ */
+/* Start the board hash of a generation from the one before, called once per generation */
+inline void carryBoardHash(
+				__global uint *hashes,
+				__private int slot
+				) {
+	/* The slot before is complete, the slot after is not used by this generation */
+	__private int last = (slot + HASH_RING - 1) % HASH_RING;
+	__private int next = (slot + 1) % HASH_RING;
+	if (hashes[2*last] != 0) atomic_xor(&hashes[2*slot], hashes[2*last]);
+	if (hashes[2*last+1] != 0) atomic_xor(&hashes[2*slot+1], hashes[2*last+1]);
+	hashes[2*next] = 0;
+	hashes[2*next+1] = 0;
+}
+
+/* Combine the hashes of the work items to the tile hash and update the board hash */
+inline void updateBoardHash(
+				__local uint *tileHash,
+				__private ulong hash,
+				__global uint *tileHashes,
+				__global uint *hashes,
+				__private int slot
+				) {
+	__private int first = (get_local_id(0) == 0 && get_local_id(1) == 0);
+	if (first) {
+		tileHash[0] = 0;
+		tileHash[1] = 0;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if (hash != 0) {
+		atomic_xor(&tileHash[0], (uint)hash);
+		atomic_xor(&tileHash[1], (uint)(hash >> 32));
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if (!first) return;
+	
+	__private int tile = get_group_id(1)*get_num_groups(0) + get_group_id(0);
+	__private uint2 change = (uint2)(tileHash[0] ^ tileHashes[2*tile], tileHash[1] ^ tileHashes[2*tile+1]);
+	tileHashes[2*tile] = tileHash[0];
+	tileHashes[2*tile+1] = tileHash[1];
+	if (tile == 0) carryBoardHash(hashes, slot);
+	if (change.x != 0) atomic_xor(&hashes[2*slot], change.x);
+	if (change.y != 0) atomic_xor(&hashes[2*slot+1], change.y);
+}
+#endif
+
 inline uint4 getState(
 			#ifdef CLAMP
 				__private int2 coord,
@@ -104,6 +183,848 @@ __attribute__( (reqd_work_group_size(TPBX, TPBY, 1)) )
 #endif
 	/* Write state of cell in next generation to imageB according to rules */
 	__private uchar i = numberOfNeighbours + 9*(state.x >> 7);
-	setState(coord, (uint4)(rules[i],rules[i],rules[i],1), imageB);
+	setState(coord, (uint4)(RULE(i),RULE(i),RULE(i),1), imageB);
+	
+}
+
+
+/*
+ * Local memory kernel: each work group loads its tile plus a halo of one
+ * cell into local memory, neighbours are counted from local memory.
+ * Coordinates are wrapped as integers, no normalized coordinates needed.
+ */
+sampler_t localSampler = CLK_NORMALIZED_COORDS_FALSE |
+							CLK_ADDRESS_CLAMP | CLK_FILTER_NEAREST;
+
+__kernel
+__attribute__( (reqd_work_group_size(TPBX, TPBY, 1)) )
+	void nextGenerationLocal(
+		__read_only image2d_t imageA,
+		__write_only image2d_t imageB,
+		__constant uchar *rules
+		) {
+	
+	/* States (0 or 1) of the tile and its halo */
+	__local uchar tile[TPBY+2][TPBX+2];
+	
+	/* Get image dimensions */
+	__private int2 imageDim = get_image_dim(imageA);
+	/* Get coordinates of current cell and of the tile */
+	__private int2 coord = (int2)(get_global_id(0),get_global_id(1));
+	__private int2 localCoord = (int2)(get_local_id(0),get_local_id(1));
+	__private int2 tileOrigin = (int2)(get_group_id(0)*TPBX-1,get_group_id(1)*TPBY-1);
+	
+	/* Load tile and halo cooperatively, all work items take part */
+	for (int i = localCoord.y*TPBX + localCoord.x; i < (TPBX+2)*(TPBY+2); i += TPBX*TPBY) {
+		int2 loadCoord = tileOrigin + (int2)(i%(TPBX+2), i/(TPBX+2));
+	#ifndef CLAMP
+		/* Wrap around, clamp mode reads the dead border color instead */
+		loadCoord = (loadCoord + imageDim) % imageDim;
+	#endif
+		tile[i/(TPBX+2)][i%(TPBX+2)] = read_imageui(imageA, localSampler, loadCoord).x >> 7;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	/* Only valid coordinates calculate next generation */
+	if (!(coord.x<imageDim.x) || !(coord.y<imageDim.y)) return;
+	
+	/* Count neighbours in local memory */
+	__private int lx = localCoord.x;
+	__private int ly = localCoord.y;
+	__private uchar state = tile[ly+1][lx+1];
+	__private uchar numberOfNeighbours =
+				tile[ly][lx] + tile[ly][lx+1] + tile[ly][lx+2]
+			  + tile[ly+1][lx] + tile[ly+1][lx+2]
+			  + tile[ly+2][lx] + tile[ly+2][lx+1] + tile[ly+2][lx+2];
+	
+	/* Write state of cell in next generation to imageB according to rules */
+	__private uchar i = numberOfNeighbours + 9*state;
+	setState(coord, (uint4)(RULE(i),RULE(i),RULE(i),1), imageB);
+	
+}
+
+/*
+ * Temporal blocking kernel: each work group loads its tile plus a halo of
+ * GENS cells into local memory and calculates GENS generations there.
+ * The valid region shrinks by one cell per generation, after GENS
+ * generations only the tile itself is written back to global memory.
+ */
+#ifndef GENS
+#define GENS 1		// generations per kernel run
+#endif
+
+#define TEMPORAL_TILE_X (TPBX+2*GENS)
+#define TEMPORAL_TILE_Y (TPBY+2*GENS)
+
+__kernel
+__attribute__( (reqd_work_group_size(TPBX, TPBY, 1)) )
+	void nextGenerationTemporal(
+		__read_only image2d_t imageA,
+		__write_only image2d_t imageB,
+		__constant uchar *rules
+		) {
+	
+	/* States (0 or 1) of the tile and its halo, two buffers for ping-pong */
+	__local uchar tiles[2][TEMPORAL_TILE_Y][TEMPORAL_TILE_X];
 	
+	/* Get image dimensions */
+	__private int2 imageDim = get_image_dim(imageA);
+	/* Get coordinates of current cell and of the tile */
+	__private int2 coord = (int2)(get_global_id(0),get_global_id(1));
+	__private int2 localCoord = (int2)(get_local_id(0),get_local_id(1));
+	__private int2 tileOrigin = (int2)(get_group_id(0)*TPBX-GENS,get_group_id(1)*TPBY-GENS);
+	__private int first = localCoord.y*TPBX + localCoord.x;
+	
+	/* Load tile and halo cooperatively, all work items take part */
+	for (int i = first; i < TEMPORAL_TILE_X*TEMPORAL_TILE_Y; i += TPBX*TPBY) {
+		int2 loadCoord = tileOrigin + (int2)(i%TEMPORAL_TILE_X, i/TEMPORAL_TILE_X);
+	#ifndef CLAMP
+		/* Wrap around, the halo may be wider than the board */
+		loadCoord = (loadCoord % imageDim + imageDim) % imageDim;
+	#endif
+		tiles[0][i/TEMPORAL_TILE_X][i%TEMPORAL_TILE_X] =
+			read_imageui(imageA, localSampler, loadCoord).x >> 7;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	/* Calculate generations, generation g is valid g cells inside the halo */
+	for (int g = 1; g <= GENS; g++) {
+		int src = (g-1) & 1;
+		int dst = g & 1;
+		int regionX = TEMPORAL_TILE_X - 2*g;
+		int regionY = TEMPORAL_TILE_Y - 2*g;
+		for (int i = first; i < regionX*regionY; i += TPBX*TPBY) {
+			int x = g + i%regionX;
+			int y = g + i/regionX;
+			uchar state = tiles[src][y][x];
+			uchar numberOfNeighbours =
+					tiles[src][y-1][x-1] + tiles[src][y-1][x] + tiles[src][y-1][x+1]
+				  + tiles[src][y][x-1] + tiles[src][y][x+1]
+				  + tiles[src][y+1][x-1] + tiles[src][y+1][x] + tiles[src][y+1][x+1];
+			uchar next = RULE(numberOfNeighbours + 9*state) >> 7;
+		#ifdef CLAMP
+			/* Cells outside the board stay dead in every generation */
+			int2 cell = tileOrigin + (int2)(x, y);
+			if (cell.x < 0 || cell.y < 0 || cell.x >= imageDim.x || cell.y >= imageDim.y)
+				next = 0;
+		#endif
+			tiles[dst][y][x] = next;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	
+	/* Only valid coordinates write the last generation */
+	if (!(coord.x<imageDim.x) || !(coord.y<imageDim.y)) return;
+	
+	__private uchar state = tiles[GENS & 1][localCoord.y+GENS][localCoord.x+GENS] ? 255 : 0;
+	setState(coord, (uint4)(state,state,state,1), imageB);
+	
+}
+
+/*
+ * Bit-packed board: 1 bit per cell, 32 cells per uint, row-major
+ * with rowWords uints per row (cell x is bit x%32 of word x/32).
+ */
+
+/* Get a word of a row together with its west and east neighbours */
+inline uint4 getPackedRow(
+				__global const uint *row,
+				__private int w,
+				__private int words,
+				__private int lastBits
+				) {
+	uint center = row[w];
+	uint westCarry, eastCarry;
+#ifdef CLAMP
+	westCarry = (w > 0) ? (row[w-1] >> 31) : 0;
+	eastCarry = (w < words-1) ? (row[w+1] & 1) : 0;
+#else
+	westCarry = (w > 0) ? (row[w-1] >> 31) : ((row[words-1] >> (lastBits-1)) & 1);
+	eastCarry = (w < words-1) ? (row[w+1] & 1) : (row[0] & 1);
+#endif
+	/* The east carry belongs next to the last valid cell of the word */
+	return (uint4)((center << 1) | westCarry,
+				   center,
+				   (center >> 1) | (eastCarry << ((w < words-1) ? 31 : lastBits-1)),
+				   0);
+}
+
+/* Calculate the next generation of word w of a row from the row and its neighbours */
+inline uint getNextPackedWordFromRows(
+				__private uint4 north,
+				__private uint4 row,
+				__private uint4 south,
+				__constant uchar *rules,
+				__private int w,
+				__private int words,
+				__private int lastBits
+				) {
+	/* Full adders for the rows above and below, half adder for the own row */
+	__private uint northSum = north.x ^ north.y ^ north.z;
+	__private uint northCarry = (north.x & north.y) | (north.z & (north.x ^ north.y));
+	__private uint southSum = south.x ^ south.y ^ south.z;
+	__private uint southCarry = (south.x & south.y) | (south.z & (south.x ^ south.y));
+	__private uint rowSum = row.x ^ row.z;
+	__private uint rowCarry = row.x & row.z;
+	
+	/* Combine the partial sums to a 4 bit neighbour count */
+	__private uint b0 = northSum ^ rowSum ^ southSum;
+	__private uint onesCarry = (northSum & rowSum) | (southSum & (northSum ^ rowSum));
+	__private uint twos = northCarry ^ rowCarry ^ southCarry;
+	__private uint twosCarry = (northCarry & rowCarry) | (southCarry & (northCarry ^ rowCarry));
+	__private uint b1 = twos ^ onesCarry;
+	__private uint foursCarry = twos & onesCarry;
+	__private uint b2 = twosCarry ^ foursCarry;
+	__private uint b3 = twosCarry & foursCarry;
+	
+	/* Apply the rules to all 32 cells of the word at once */
+	__private uint alive = row.y;
+	__private uint next = 0;
+	for (int n=0; n<=8; n++) {
+		if (!RULE(n) && !RULE(9+n)) continue;
+		uint equal = ((n & 1) ? b0 : ~b0) & ((n & 2) ? b1 : ~b1)
+				   & ((n & 4) ? b2 : ~b2) & ((n & 8) ? b3 : ~b3);
+		next |= equal & ((RULE(n) ? ~alive : 0) | (RULE(9+n) ? alive : 0));
+	}
+	if (lastBits < 32 && w == words-1) next &= (1u << lastBits) - 1;
+	return next;
+}
+
+/* Calculate the next generation of word w of row y */
+inline uint getNextPackedWord(
+				__global const uint *boardA,
+				__constant uchar *rules,
+				__private int w,
+				__private int y,
+				__private int words,
+				__private int lastBits,
+				__private int height,
+				__private int rowWords
+				) {
+	/* Rows above and below, dead or wrapped around outside of the board */
+	__private uint4 row = getPackedRow(&boardA[y*rowWords], w, words, lastBits);
+	__private uint4 north, south;
+#ifdef CLAMP
+	north = (y > 0) ? getPackedRow(&boardA[(y-1)*rowWords], w, words, lastBits) : (uint4)(0);
+	south = (y < height-1) ? getPackedRow(&boardA[(y+1)*rowWords], w, words, lastBits) : (uint4)(0);
+#else
+	north = getPackedRow(&boardA[((y+height-1)%height)*rowWords], w, words, lastBits);
+	south = getPackedRow(&boardA[((y+1)%height)*rowWords], w, words, lastBits);
+#endif
+	return getNextPackedWordFromRows(north, row, south, rules, w, words, lastBits);
+}
+
+__kernel
+__attribute__( (reqd_work_group_size(TPBX, TPBY, 1)) )
+	void nextGenerationPacked(
+		__global const uint *boardA,
+		__global uint *boardB,
+		__constant uchar *rules,
+		const int width,
+		const int height,
+		const int rowWords
+	#ifdef HASH_RING
+		, __global uint *tileHashes,
+		__global uint *hashes,
+		const int slot
+	#endif
+		) {
+	
+	/* Get word and row of current work item */
+	__private int w = get_global_id(0);
+	__private int y = get_global_id(1);
+	
+	/* Only valid words calculate next generation, padding at the end of a row stays dead */
+	__private int words = (width + 31) / 32;
+	__private int lastBits = width - (words-1)*32;
+	__private uint next = 0;
+	if (w < rowWords && y < height) {
+		if (w < words) next = getNextPackedWord(boardA, rules, w, y, words, lastBits, height, rowWords);
+		boardB[y*rowWords + w] = next;
+	}
+	
+#ifdef HASH_RING
+	/* All work items of the tile take part in its hash, also those outside of the board */
+	__local uint tileHash[2];
+	updateBoardHash(tileHash, hashWord(next, y*rowWords + w), tileHashes, hashes, slot);
+#endif
+}
+
+#ifdef STATES
+/*
+ * Packed board with STATES states per cell (Generations rules): the state
+ * number is stored in PLANES bit planes, plane p of row y is the row
+ * y*PLANES+p. Only cells of state 1 are alive and counted, a live cell
+ * which does not survive counts up through the states 2..STATES-1 and dies.
+ */
+#define PLANES (STATES > 8 ? 4 : (STATES > 4 ? 3 : 2))
+
+/* Live cells (state 1) of word w of a row of planes */
+inline uint getAliveWord(
+				__global const uint *row,
+				__private int w,
+				__private int rowWords
+				) {
+	__private uint rest = 0;
+	for (int p=1; p<PLANES; p++) rest |= row[p*rowWords + w];
+	return row[w] & ~rest;
+}
+
+/* Get the live cells of a word of a row of planes together with its west and east neighbours */
+inline uint4 getAlivePackedRow(
+				__global const uint *row,
+				__private int w,
+				__private int words,
+				__private int lastBits,
+				__private int rowWords
+				) {
+	uint center = getAliveWord(row, w, rowWords);
+	uint westCarry, eastCarry;
+#ifdef CLAMP
+	westCarry = (w > 0) ? (getAliveWord(row, w-1, rowWords) >> 31) : 0;
+	eastCarry = (w < words-1) ? (getAliveWord(row, w+1, rowWords) & 1) : 0;
+#else
+	westCarry = (w > 0) ? (getAliveWord(row, w-1, rowWords) >> 31)
+						: ((getAliveWord(row, words-1, rowWords) >> (lastBits-1)) & 1);
+	eastCarry = (w < words-1) ? (getAliveWord(row, w+1, rowWords) & 1)
+							  : (getAliveWord(row, 0, rowWords) & 1);
+#endif
+	return (uint4)((center << 1) | westCarry,
+				   center,
+				   (center >> 1) | (eastCarry << ((w < words-1) ? 31 : lastBits-1)),
+				   0);
+}
+
+/* Calculate the next states of word w of row y, one word per plane */
+inline void nextPackedStates(
+				__global const uint *boardA,
+				__constant uchar *rules,
+				__private int w,
+				__private int y,
+				__private int words,
+				__private int lastBits,
+				__private int height,
+				__private int rowWords,
+				__private uint *state
+				) {
+	__private int planeRow = PLANES*rowWords;
+	
+	/* Live cells of the next generation from the live cells of the rows */
+	__global const uint *row = &boardA[y*planeRow];
+	__private uint4 center = getAlivePackedRow(row, w, words, lastBits, rowWords);
+	__private uint4 north, south;
+#ifdef CLAMP
+	north = (y > 0) ? getAlivePackedRow(&boardA[(y-1)*planeRow], w, words, lastBits, rowWords) : (uint4)(0);
+	south = (y < height-1) ? getAlivePackedRow(&boardA[(y+1)*planeRow], w, words, lastBits, rowWords) : (uint4)(0);
+#else
+	north = getAlivePackedRow(&boardA[((y+height-1)%height)*planeRow], w, words, lastBits, rowWords);
+	south = getAlivePackedRow(&boardA[((y+1)%height)*planeRow], w, words, lastBits, rowWords);
+#endif
+	__private uint next = getNextPackedWordFromRows(north, center, south, rules, w, words, lastBits);
+	
+	/* Births of dead cells, all other cells which are not dead and do not survive count up */
+	__private uint rest = 0;
+	for (int p=0; p<PLANES; p++) {
+		state[p] = row[p*rowWords + w];
+		if (p > 0) rest |= state[p];
+	}
+	__private uint any = state[0] | rest;
+	__private uint born = next & ~any;
+	__private uint count = any & ~(next & center.y);
+	
+	/* Ripple carry increment, the last state wraps around to dead */
+	__private uint carry = count, wrap = count;
+	for (int p=0; p<PLANES; p++) {
+		uint sum = state[p] ^ carry;
+		carry &= state[p];
+		state[p] = sum;
+		wrap &= ((STATES >> p) & 1) ? sum : ~sum;
+	}
+	for (int p=0; p<PLANES; p++)
+		state[p] = (state[p] & ~wrap) | (p == 0 ? born : 0);
+}
+
+__kernel
+__attribute__( (reqd_work_group_size(TPBX, TPBY, 1)) )
+	void nextGenerationPackedStates(
+		__global const uint *boardA,
+		__global uint *boardB,
+		__constant uchar *rules,
+		const int width,
+		const int height,
+		const int rowWords
+	#ifdef HASH_RING
+		, __global uint *tileHashes,
+		__global uint *hashes,
+		const int slot
+	#endif
+		) {
+	
+	/* Get word and row of current work item */
+	__private int w = get_global_id(0);
+	__private int y = get_global_id(1);
+	__private int words = (width + 31) / 32;
+	__private int lastBits = width - (words-1)*32;
+	__private int planeRow = PLANES*rowWords;
+	__private uint state[PLANES];
+	for (int p=0; p<PLANES; p++) state[p] = 0;
+	
+	/* Only valid words calculate next generation, padding at the end of a row stays dead */
+	if (w < words && y < height) nextPackedStates(boardA, rules, w, y, words, lastBits, height, rowWords, state);
+	if (w < rowWords && y < height)
+		for (int p=0; p<PLANES; p++) boardB[y*planeRow + p*rowWords + w] = state[p];
+	
+#ifdef HASH_RING
+	/* All work items of the tile take part in its hash, also those outside of the board */
+	__local uint tileHash[2];
+	__private ulong hash = 0;
+	for (int p=0; p<PLANES; p++) hash ^= hashWord(state[p], y*planeRow + p*rowWords + w);
+	updateBoardHash(tileHash, hash, tileHashes, hashes, slot);
+#endif
+}
+#endif
+
+/*
+ * Rows [0,rowEnd) of a packed board, the CPU calculates the other rows
+ * in co-execution mode. The rows next to the band are copied to boardA
+ * by the host before each generation.
+ */
+__kernel
+__attribute__( (reqd_work_group_size(TPBX, TPBY, 1)) )
+	void nextGenerationPackedRows(
+		__global const uint *boardA,
+		__global uint *boardB,
+		__constant uchar *rules,
+		const int width,
+		const int height,
+		const int rowWords,
+		const int rowEnd
+		) {
+	
+	/* Get word and row of current work item */
+	__private int w = get_global_id(0);
+	__private int y = get_global_id(1);
+	
+	/* Only valid words of the band calculate next generation */
+	if (!(w<rowWords) || !(y<rowEnd)) return;
+	
+	__private int words = (width + 31) / 32;
+	__private int lastBits = width - (words-1)*32;
+	if (!(w<words)) {
+		/* Padding at the end of a row stays dead */
+		boardB[y*rowWords + w] = 0;
+		return;
+	}
+	
+	/* Write 32 cells of the next generation to boardB */
+	boardB[y*rowWords + w] = getNextPackedWord(boardA, rules, w, y, words, lastBits, height, rowWords);
+}
+
+/*
+ * Strip of a packed board on one of several devices. Row 0 and row rows+1
+ * of the strip are halos holding the rows of the neighbour strips, or dead
+ * rows at the edges of a clamped board. Only the rows [rowBegin,rowEnd) are
+ * calculated, so the interior can run while the halos are exchanged.
+ */
+__kernel
+__attribute__( (reqd_work_group_size(TPBX, TPBY, 1)) )
+	void nextGenerationPackedStrip(
+		__global const uint *boardA,
+		__global uint *boardB,
+		__constant uchar *rules,
+		const int width,
+		const int rowWords,
+		const int rowBegin,
+		const int rowEnd
+		) {
+	
+	/* Get word and row of current work item */
+	__private int w = get_global_id(0);
+	__private int y = rowBegin + get_global_id(1);
+	
+	/* Only valid words calculate next generation */
+	if (!(w<rowWords) || !(y<rowEnd)) return;
+	
+	__private int words = (width + 31) / 32;
+	__private int lastBits = width - (words-1)*32;
+	if (!(w<words)) {
+		/* Padding at the end of a row stays dead */
+		boardB[y*rowWords + w] = 0;
+		return;
+	}
+	
+	/* The halos replace wrapping and clamping in y */
+	boardB[y*rowWords + w] = getNextPackedWordFromRows(
+		getPackedRow(&boardA[(y-1)*rowWords], w, words, lastBits),
+		getPackedRow(&boardA[y*rowWords], w, words, lastBits),
+		getPackedRow(&boardA[(y+1)*rowWords], w, words, lastBits),
+		rules, w, words, lastBits);
+}
+
+/*
+ * Sparse packed board: each work group is a tile of TPBX words x TPBY rows.
+ * A tile is only calculated if it or one of its 8 neighbours changed in the
+ * last generation (changedA), otherwise boardB already holds its cells from
+ * the generation before. Each tile records its own change in changedB.
+ */
+__kernel
+__attribute__( (reqd_work_group_size(TPBX, TPBY, 1)) )
+	void nextGenerationPackedSparse(
+		__global const uint *boardA,
+		__global uint *boardB,
+		__constant uchar *rules,
+		const int width,
+		const int height,
+		const int rowWords,
+		__global const uchar *changedA,
+		__global uchar *changedB
+	#ifdef HASH_RING
+		, __global uint *tileHashes,
+		__global uint *hashes,
+		const int slot
+	#endif
+		) {
+	
+	__local int active;
+	__local int changed;
+#ifdef HASH_RING
+	__local uint tileHash[2];
+#endif
+	
+	/* Get tile of the work group and word and row of current work item */
+	__private int2 tile = (int2)(get_group_id(0),get_group_id(1));
+	__private int2 tiles = (int2)(get_num_groups(0),get_num_groups(1));
+	__private int first = (get_local_id(0) == 0 && get_local_id(1) == 0);
+	__private int w = get_global_id(0);
+	__private int y = get_global_id(1);
+	
+	/* Check the tile and its neighbours for changes */
+	if (first) {
+		active = 0;
+		changed = 0;
+		for (int i=-1; i<=1; i++) {
+			for (int k=-1; k<=1; k++) {
+				int2 neighbour = tile + (int2)(k,i);
+			#ifdef CLAMP
+				if (neighbour.x < 0 || neighbour.y < 0
+					|| neighbour.x >= tiles.x || neighbour.y >= tiles.y) continue;
+			#else
+				neighbour = (neighbour + tiles) % tiles;
+			#endif
+				active |= changedA[neighbour.y*tiles.x + neighbour.x];
+			}
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	/* Stable tile: cells of boardB are still valid, so is the hash of the tile */
+	if (!active) {
+		if (first) {
+			changedB[tile.y*tiles.x + tile.x] = 0;
+		#ifdef HASH_RING
+			if (tile.x == 0 && tile.y == 0) carryBoardHash(hashes, slot);
+		#endif
+		}
+		return;
+	}
+	
+	__private int words = (width + 31) / 32;
+	__private int lastBits = width - (words-1)*32;
+	__private uint next = 0;
+	if (w < rowWords && y < height) {
+		/* Padding at the end of a row stays dead */
+		if (w < words) next = getNextPackedWord(boardA, rules, w, y, words, lastBits, height, rowWords);
+		if (next != boardA[y*rowWords + w]) atomic_or(&changed, 1);
+		boardB[y*rowWords + w] = next;
+	}
+#ifdef HASH_RING
+	updateBoardHash(tileHash, hashWord(next, y*rowWords + w), tileHashes, hashes, slot);
+#endif
+	barrier(CLK_LOCAL_MEM_FENCE);
+	
+	if (first) changedB[tile.y*tiles.x + tile.x] = (changed != 0);
+}
+
+/*
+ * Starting population regenerated on the device for resets: random cells
+ * from the same Philox-4x32-10 numbers as CPUEngine::spawnRandom (cell x
+ * of row y is number x%4 of counter (x/4, y)), patterns and checkpoints
+ * expanded from a packed copy which stays on the device.
+ */
+inline uint4 philox4x32(
+				__private uint4 counter,
+				__private ulong seed
+				) {
+	__private uint2 key = (uint2)((uint)seed, (uint)(seed >> 32));
+	for (int i=0; i<10; i++) {
+		__private uint high0 = mul_hi(0xD2511F53u, counter.x);
+		__private uint low0 = 0xD2511F53u * counter.x;
+		__private uint high1 = mul_hi(0xCD9E8D57u, counter.z);
+		__private uint low1 = 0xCD9E8D57u * counter.z;
+		counter = (uint4)(high1 ^ counter.y ^ key.x, low1, high0 ^ counter.w ^ key.y, low0);
+		key += (uint2)(0x9E3779B9u, 0xBB67AE85u);
+	}
+	return counter;
+}
+
+/* 4 random cells from counter (group, y), bit i for cell 4*group+i */
+inline uint getRandomCells(
+				__private ulong seed,
+				__private ulong threshold,
+				__private uint group,
+				__private uint y
+				) {
+	__private uint4 random = philox4x32((uint4)(group, y, 0, 0), seed);
+	return ((ulong)random.x < threshold) | (((ulong)random.y < threshold) << 1)
+		| (((ulong)random.z < threshold) << 2) | (((ulong)random.w < threshold) << 3);
+}
+
+__kernel void spawnRandomPacked(
+		__global uint *board,
+		const int width,
+		const int height,
+		const int rowWords,
+		const ulong seed,
+		const ulong threshold
+		) {
+	__private int w = get_global_id(0);
+	__private int y = get_global_id(1);
+	if (w >= rowWords || y >= height) return;
+	
+	/* Padding at the end of a row stays dead */
+	__private int words = (width + 31) / 32;
+	__private int lastBits = width - (words-1)*32;
+	__private uint word = 0;
+	if (w < words) {
+		for (int i=0; i<8; i++)
+			word |= getRandomCells(seed, threshold, 8*w + i, y) << 4*i;
+		if (lastBits < 32 && w == words-1) word &= (1u << lastBits) - 1;
+	}
+#ifdef STATES
+	/* Live cells are state 1 in the first plane */
+	board[y*PLANES*rowWords + w] = word;
+	for (int p=1; p<PLANES; p++)
+		board[(y*PLANES + p)*rowWords + w] = 0;
+#else
+	board[y*rowWords + w] = word;
+#endif
+}
+
+__kernel void spawnRandomImage(
+		__write_only image2d_t image,
+		const ulong seed,
+		const ulong threshold
+		) {
+	__private int2 coord = (int2)(get_global_id(0),get_global_id(1));
+	__private int2 imageDim = get_image_dim(image);
+	if (!(coord.x<imageDim.x) || !(coord.y<imageDim.y)) return;
+	__private uint state = ((getRandomCells(seed, threshold, coord.x/4, coord.y) >> (coord.x%4)) & 1) * 255;
+	write_imageui(image, coord, (uint4)(state,state,state,1));
+}
+
+__kernel void unpackImage(
+		__global const uint *board,
+		__write_only image2d_t image,
+		const int rowWords
+		) {
+	__private int2 coord = (int2)(get_global_id(0),get_global_id(1));
+	__private int2 imageDim = get_image_dim(image);
+	if (!(coord.x<imageDim.x) || !(coord.y<imageDim.y)) return;
+	__private uint state = ((board[coord.y*rowWords + coord.x/32] >> (coord.x%32)) & 1) * 255;
+	write_imageui(image, coord, (uint4)(state,state,state,1));
+}
+
+/*
+ * Batched soup search (see SoupBatch): many small packed boards one after
+ * another in one buffer, one work item per uint of all boards. Each board
+ * has 4 ints of state (generation, status, first generation of the period,
+ * population) and 3 uints of sums (hash and population of the generation).
+ * Only boards with status 0 are running.
+ */
+inline uint countBits(
+				__private uint word
+				) {
+	word = word - ((word >> 1) & 0x55555555u);
+	word = (word & 0x33333333u) + ((word >> 2) & 0x33333333u);
+	word = (word + (word >> 4)) & 0x0f0f0f0fu;
+	return (word * 0x01010101u) >> 24;
+}
+
+__kernel void nextGenerationSoups(
+		__global const uint *boardA,
+		__global uint *boardB,
+		__constant uchar *rules,
+		const int width,
+		const int height,
+		const int rowWords,
+		const int numberOfBoards,
+		__global const int *states,
+		__global uint *sums
+		) {
+	
+	/* Get board, row and word of current work item */
+	__private int boardWords = rowWords*height;
+	__private int i = get_global_id(0);
+	__private int board = i / boardWords;
+	if (board >= numberOfBoards || states[4*board+1] != 0) return;
+	__private int index = i - board*boardWords;
+	__private int y = index / rowWords;
+	__private int w = index - y*rowWords;
+	
+	__private int words = (width + 31) / 32;
+	__private int lastBits = width - (words-1)*32;
+	__private uint next = 0;
+	if (w < words) next = getNextPackedWord(&boardA[board*boardWords], rules, w, y, words, lastBits, height, rowWords);
+	boardB[i] = next;
+	if (next == 0) return;
+	
+	/* Hash and population of the board, the hashes equal PackedBoard::getHash */
+	__private ulong hash = hashWord(next, index);
+	atomic_xor(&sums[3*board], (uint)hash);
+	atomic_xor(&sums[3*board+1], (uint)(hash >> 32));
+	atomic_add(&sums[3*board+2], countBits(next));
+}
+
+/* Detect the period of a board after each generation like PeriodDetector, one work item per board */
+__kernel void checkSoups(
+		__global int *states,
+		__global uint *sums,
+		__global uint *history,
+		const int numberOfBoards,
+		const int maxPeriod,
+		const int maxGenerations
+		) {
+	__private int board = get_global_id(0);
+	if (board >= numberOfBoards || states[4*board+1] != 0) return;
+	__global int *state = &states[4*board];
+	__global uint *ring = &history[2*maxPeriod*board];
+	
+	/* Take the sums of the generation and clear them for the next one */
+	__private uint2 hash = (uint2)(sums[3*board], sums[3*board+1]);
+	__private uint population = sums[3*board+2];
+	sums[3*board] = 0;
+	sums[3*board+1] = 0;
+	sums[3*board+2] = 0;
+	__private int generation = state[0] + 1;
+	state[0] = generation;
+	
+	/* Search the last generations, the most recent first for the shortest period */
+	__private int count = min(generation-1, maxPeriod);
+	for (int p=1; p<=count; p++) {
+		__private int slot = (generation - p) % maxPeriod;
+		if (ring[2*slot] == hash.x && ring[2*slot+1] == hash.y) {
+			state[1] = p;
+			state[2] = generation - p;
+			state[3] = population;
+			return;
+		}
+	}
+	ring[2*(generation % maxPeriod)] = hash.x;
+	ring[2*(generation % maxPeriod)+1] = hash.y;
+	if (generation >= maxGenerations) {
+		state[1] = -1;		// SOUP_UNSTABLE
+		state[2] = generation;
+		state[3] = population;
+	}
+}
+
+/*
+ * Rendering to a GL texture shared with OpenCL (cl_khr_gl_sharing).
+ * The texture is a normalized RGBA8 image, the board never leaves the device.
+ */
+__kernel void renderImage(
+		__read_only image2d_t image,
+		__write_only image2d_t display
+		) {
+	__private int2 coord = (int2)(get_global_id(0),get_global_id(1));
+	__private float state = (float)read_imageui(image, localSampler, coord).x / 255.0f;
+	write_imagef(display, coord, (float4)(state,state,state,1.0f));
+}
+
+__kernel void renderPacked(
+		__global const uint *board,
+		__write_only image2d_t display,
+		__private int rowWords
+		) {
+	__private int2 coord = (int2)(get_global_id(0),get_global_id(1));
+#ifdef STATES
+	/* Dying cells fade from grey to black like PackedBoard::unpack */
+	__private int number = 0;
+	for (int p=0; p<PLANES; p++)
+		number |= ((board[(coord.y*PLANES + p)*rowWords + coord.x/32] >> (coord.x%32)) & 1) << p;
+	__private float state = (number == 1) ? 1.0f
+		: (number == 0) ? 0.0f : (float)(127 * (STATES - number) / (STATES - 1)) / 255.0f;
+#else
+	__private float state = (float)((board[coord.y*rowWords + coord.x/32] >> (coord.x%32)) & 1);
+#endif
+	write_imagef(display, coord, (float4)(state,state,state,1.0f));
+}
+
+/*
+ * Level of detail for zoomed out views: each work item is a pixel of the
+ * display and covers factor x factor cells from (originX, originY) of the
+ * board, it shows whether any of them is alive or their density. Cells
+ * outside the board do not count. Only the visible part of the board at
+ * about the resolution of the window is written, to the shared GL texture
+ * or to a small image read by the host.
+ */
+__kernel void downsampleImage(
+		__read_only image2d_t image,
+		__write_only image2d_t display,
+		__private int originX,
+		__private int originY,
+		__private int factor,
+		__private int density,
+		__private int width,
+		__private int height
+		) {
+	__private int2 coord = (int2)(get_global_id(0),get_global_id(1));
+	__private int x0 = originX + coord.x*factor, y0 = originY + coord.y*factor;
+	__private int x1 = min(x0 + factor, width), y1 = min(y0 + factor, height);
+	__private int alive = 0;
+	for (int y=y0; y<y1 && (density || alive == 0); y++) {
+		for (int x=x0; x<x1; x++)
+			alive += read_imageui(image, localSampler, (int2)(x,y)).x >> 7;
+	}
+	__private float state = density ? (float)alive / (float)max(1, (x1-x0)*(y1-y0))
+		: (float)(alive > 0);
+	write_imagef(display, coord, (float4)(state,state,state,1.0f));
+}
+
+__kernel void downsamplePacked(
+		__global const uint *board,
+		__write_only image2d_t display,
+		__private int originX,
+		__private int originY,
+		__private int factor,
+		__private int density,
+		__private int width,
+		__private int height,
+		__private int rowWords
+		) {
+	__private int2 coord = (int2)(get_global_id(0),get_global_id(1));
+	__private int x0 = originX + coord.x*factor, y0 = originY + coord.y*factor;
+	__private int x1 = min(x0 + factor, width), y1 = min(y0 + factor, height);
+	__private uint alive = 0;
+	for (int y=y0; y<y1 && (density || alive == 0); y++) {
+#ifdef STATES
+		__global const uint *row = &board[y*PLANES*rowWords];
+#else
+		__global const uint *row = &board[y*rowWords];
+#endif
+		/* Whole words of 32 cells, the first and last are masked to [x0,x1) */
+		for (int w=x0/32; w<=(x1-1)/32; w++) {
+#ifdef STATES
+			__private uint word = getAliveWord(row, w, rowWords);
+#else
+			__private uint word = row[w];
+#endif
+			if (w == x0/32) word &= 0xffffffffu << (x0%32);
+			if (w == (x1-1)/32 && x1%32 != 0) word &= 0xffffffffu >> (32 - x1%32);
+			alive += countBits(word);
+		}
+	}
+	__private float state = density ? (float)alive / (float)max(1, (x1-x0)*(y1-y0))
+		: (float)(alive > 0);
+	write_imagef(display, coord, (float4)(state,state,state,1.0f));
 }
@@ -20,8 +20,10 @@
 #include <iostream>
 #include <cstring>
 #include <unistd.h>				/* for command line parsing */
+#include <getopt.h>				/* for long command line options */
+#include <cfloat>				/* for FLT_MAX */
 #include <ctime>				/* for time() */
-#include <cstdlib>				/* for srand() and rand() */
+#include <cstdlib>				/* for atoi() and strtoull() */
 #ifdef WIN32				// Windows system specific
 	#include <windows.h>		/* for QueryPerformanceCounter */
 #else						// Unix based system specific
@@ -29,6 +31,7 @@
 #endif
 
 #include "../inc/GameOfLife.hpp"
+#include "../inc/ComputeThread.hpp"
 
 /**
 * Macro for OpenGL buffer offset
@@ -43,19 +46,30 @@ using namespace std;
 /* Create an instance of GameOfLife */
 GameOfLife GameOfLife;
 
+/* Engine calculating GameOfLife apart from the display, state of its last frame */
+ComputeThread computeThread;
+FrameInfo frameInfo;
+bool syncDisplay = false;
+EngineCommand viewCommand = {COMMAND_VIEW, {0, 0}, {0.0f, 0.0f, 0.0f}};
+
 /* Global variables for OpenGL */
 GLuint glPBO, glTex, glShader;
 int GLUTWindowHandle;
-char title[57*(int)sizeof(char)+(int)sizeof(float)+(int)sizeof(int)+(int)sizeof(long)];
+char title[192];
 bool mouseLeftDown, mouseRightDown;
 float mouseX, mouseY;
 float cameraDistance;
+int windowSize[2];
+DisplayRegion bufferRegion, textureRegion;	/* parts of the board in the PBO and the texture */
 float verticalMove, horizontalMove;
 float clampZoom = 1.0f;
 float clampMove = 0.0f;
 bool drawGrid = false;
 bool resetGame = false;
+bool uploadImage = true;
 float sleeperBarrier = 0.0f;
+bool headless = false;
+uint64_t headlessGenerations = 0;
 #ifdef WIN32
 	LARGE_INTEGER frequency;	/* ticks per second */
 	LARGE_INTEGER start;
@@ -77,17 +91,89 @@ void showHelp() {
 	printf( "\n" );
 	printf( "Usage: GameOfLife -f PATH [-l RULE] [ADV OPTIONS] WIDTH [HEIGHT]\n");
 	printf( "  or:  GameOfLife -r DENSITY [-l RULE] [ADV OPTIONS] WIDTH [HEIGHT]\n");
+	printf( "  or:  GameOfLife --headless -n NUMBER (-f PATH | -r DENSITY) [OPTIONS] WIDTH [HEIGHT]\n");
+	printf( "  or:  GameOfLife --restore FILE [OPTIONS] WIDTH [HEIGHT]\n");
 	printf( "\n" );
 	printf( "---- Options ----\n" );
-	printf( " -h            Prints this help\n");
+	printf( " -h, --help    Prints this help\n");
 	printf( " -f FILE       Path to RLE-file used for starting population\n");
 	printf( " -r DENSITY    Use random starting population with given density\n");
+	printf( " --seed NUMBER seed of the random starting population, the same seed\n");
+	printf( "               gives the same board with any engine and threads\n");
+	printf( "               default: time of the start\n");
 	printf( " -l RULE       rule for next generations as a list of Survival/Birth\n");
 	printf( "               default: 23/3\n");
+	printf( "               Survival/Birth/States for Generations rules with up to\n");
+	printf( "               16 states, e.g. /2/3 (Brian's Brain), uses -p\n");
 	printf( "               defintion is overwritten when there is a\n");
 	printf( "               rule specified in the file\n");
+	printf( " -p            Use bit-packed board (1 bit per cell)\n");
+	printf( "               default: RGBA board (4 bytes per cell)\n");
+	printf( " -s            Only calculate tiles near changed cells (uses -p)\n");
+	printf( "               default: calculate the whole board\n");
+	printf( " -i            Use an unbounded universe, the board shows a part of it\n");
+	printf( "               (CPU only, patterns may be bigger than the board)\n");
+	printf( "               default: board of fixed size\n");
+	printf( " -j NUMBER     threads for calculating generations in CPU mode\n");
+	printf( "               default: all cores\n");
+	printf( " -t NUMBER     HashLife step: 2^NUMBER generations per frame\n");
+	printf( "               default: 0\n");
+	printf( " -u NUMBER     memory cap for HashLife in MB\n");
+	printf( "               default: 1024\n");
+	printf( " --headless    Calculate without window as fast as possible (needs -n)\n");
+	printf( "               and print statistics, no X server required\n");
+	printf( " -n NUMBER     generations to calculate in headless mode\n");
+	printf( "               (up to generation NUMBER with --restore)\n");
+	printf( " --checkpoint FILE\n");
+	printf( "               Write bit-packed checkpoints of the board to FILE\n");
+	printf( "               in the background (not with -i or HashLife)\n");
+	printf( " --checkpoint-every NUMBER\n");
+	printf( "               generations between two checkpoints\n");
+	printf( "               default: only at the end of headless mode\n");
+	printf( " --restore FILE\n");
+	printf( "               Continue from a checkpoint instead of -f/-r, rule and\n");
+	printf( "               generation are restored, size and -c must match\n");
+	printf( " --export PATH Write frames to PATH<generation>.<format> in the background\n");
+	printf( " --export-format FORMAT\n");
+	printf( "               png (1 bit), rle (loadable with -f) or pbm (raw bitmap)\n");
+	printf( "               default: png\n");
+	printf( " --export-every NUMBER\n");
+	printf( "               generations between two frames, at most one per frame drawn\n");
+	printf( "               default: 1\n");
+	printf( " --detect-period NUMBER\n");
+	printf( "               Detect still lifes and oscillators up to period NUMBER by\n");
+	printf( "               hashing the boards (implies -p), ends headless mode early\n");
+	printf( "               default: off\n");
+	printf( " --metrics FILE\n");
+	printf( "               Write histograms of kernel, transfer, parse, setup and build\n");
+	printf( "               times and of the population to FILE at the end, Prometheus\n");
+	printf( "               text format for *.prom, else JSON\n");
+	printf( " --trace FILE  Write a timeline of the host and device work to FILE\n");
+	printf( "               (Chrome trace format, chrome://tracing or Perfetto)\n");
+	printf( " --sync-display\n");
+	printf( "               Calculate generations in the display callback, OpenCL\n");
+	printf( "               renders to the GL texture if possible\n");
+	printf( "               default: calculate on a compute thread\n");
 	printf( "\n" );
 	printf( "---- Advanced OpenCL Options ----\n" );
+	printf( " -m            Use local memory tiles for neighbour counting\n");
+	printf( "               default: read neighbours from image\n");
+	printf( " -g NUMBER     generations per kernel run (temporal blocking)\n");
+	printf( "               default: 1\n");
+	printf( " -a            Autotune work-items per work group, cached per device\n");
+	printf( "               in ~/.GameOfLife.autotune\n");
+	printf( "               default: 32x12 or -x/-y\n");
+	printf( " -d NUMBER     GPUs calculating horizontal strips of the board (implies -p),\n");
+	printf( "               0 for all GPUs of the platform\n");
+	printf( "               default: 1\n");
+	printf( " -e            Calculate a band of rows on the CPU while OpenCL calculates\n");
+	printf( "               the rest, split by measured times (implies -p)\n");
+	printf( "               default: OpenCL only\n");
+	printf( " --lod MODE    Boards with more cells than pixels in the window are\n");
+	printf( "               downsampled on the device to the visible part: any (a\n");
+	printf( "               pixel is alive if one of its cells is), density or full\n");
+	printf( "               (copy all cells)\n");
+	printf( "               default: any\n");
 	printf( " -c            Use clamp mode for images\n");
 	printf( "               default: wrap mode\n");
 	printf( " -x NUMBER     threads per block for x\n");
@@ -103,10 +189,33 @@ int readArguments(int argc, char **argv) {
 	int optionChar;
 	int fSet=0, rSet=0, lSet=0, cSet=0;
 	string x(""),y("");
+	const char *checkpointFile = NULL;
+	uint64_t checkpointInterval = 0;
+	const char *exportPrefix = NULL;
+	ExportFormat exportFormat = EXPORT_PNG;
+	uint64_t exportInterval = 1;
+	string metricsFile(""), traceFile("");
+	static const struct option longOptions[] = {
+		{ "headless",         no_argument,       NULL, 'H' },
+		{ "help",             no_argument,       NULL, 'h' },
+		{ "checkpoint",       required_argument, NULL, 'C' },
+		{ "checkpoint-every", required_argument, NULL, 'E' },
+		{ "restore",          required_argument, NULL, 'R' },
+		{ "export",           required_argument, NULL, 'X' },
+		{ "export-format",    required_argument, NULL, 'F' },
+		{ "export-every",     required_argument, NULL, 'N' },
+		{ "detect-period",    required_argument, NULL, 'P' },
+		{ "seed",             required_argument, NULL, 'S' },
+		{ "metrics",          required_argument, NULL, 'M' },
+		{ "trace",            required_argument, NULL, 'T' },
+		{ "lod",              required_argument, NULL, 'L' },
+		{ "sync-display",     no_argument,       NULL, 'D' },
+		{ NULL,               0,                 NULL, 0   }
+	};
 	extern char *optarg;
 	extern int optind, optopt;
 	
-	while ((optionChar = getopt(argc, argv, ":hf:l:r:cx:y:")) != -1) {
+	while ((optionChar = getopt_long(argc, argv, ":hf:l:r:psij:t:u:n:mg:acd:ex:y:", longOptions, NULL)) != -1) {
 		switch (optionChar) {
 		case 'f':			/* Set filename */
 			if (rSet) {
@@ -138,6 +247,126 @@ int readArguments(int argc, char **argv) {
 				lSet = 2;
 			}
 			break;
+		case 'p':			/* Set packed mode */
+			GameOfLife.setPackedMode(true);
+			break;
+		case 's':			/* Set sparse mode */
+			GameOfLife.setSparseMode(true);
+			break;
+		case 'i':			/* Set unbounded mode */
+			GameOfLife.setUnboundedMode(true);
+			break;
+		case 'j':			/* Set threads for CPU mode */
+			if (atoi(optarg) <= 0) {
+				fprintf(stderr,"\nError in number of threads\n");
+				return -1;
+			}
+			GameOfLife.setNumberOfThreads(atoi(optarg));
+			break;
+		case 't':			/* Set HashLife step */
+			if (atoi(optarg) < 0) {
+				fprintf(stderr,"\nError in HashLife step\n");
+				return -1;
+			}
+			GameOfLife.setHashLifeStep(atoi(optarg));
+			break;
+		case 'u':			/* Set HashLife memory cap */
+			if (atoi(optarg) <= 0) {
+				fprintf(stderr,"\nError in HashLife memory\n");
+				return -1;
+			}
+			GameOfLife.setHashLifeMemory(atoi(optarg));
+			break;
+		case 'H':			/* Set headless mode */
+			headless = true;
+			break;
+		case 'C':			/* Set checkpoint file */
+			checkpointFile = optarg;
+			break;
+		case 'E':			/* Set generations between checkpoints */
+			if (atoll(optarg) <= 0) {
+				fprintf(stderr,"\nError in checkpoint interval\n");
+				return -1;
+			}
+			checkpointInterval = strtoull(optarg, NULL, 10);
+			break;
+		case 'R':			/* Set checkpoint to restore */
+			GameOfLife.setRestoreFile(optarg);
+			break;
+		case 'X':			/* Set path of exported frames */
+			exportPrefix = optarg;
+			break;
+		case 'F':			/* Set file format of exported frames */
+			if (FrameExporter::getFormat(optarg, exportFormat) != 0) {
+				fprintf(stderr,"\nUnknown export format %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'N':			/* Set generations between exported frames */
+			if (atoll(optarg) <= 0) {
+				fprintf(stderr,"\nError in export interval\n");
+				return -1;
+			}
+			exportInterval = strtoull(optarg, NULL, 10);
+			break;
+		case 'P':			/* Set longest period to detect */
+			if (atoi(optarg) <= 0) {
+				fprintf(stderr,"\nError in period\n");
+				return -1;
+			}
+			GameOfLife.setPeriodDetection(atoi(optarg));
+			break;
+		case 'S':			/* Set seed for random mode */
+			GameOfLife.setSeed(strtoull(optarg, NULL, 10));
+			break;
+		case 'M':			/* Set file of the histograms */
+			metricsFile = optarg;
+			break;
+		case 'T':			/* Set file of the timeline */
+			traceFile = optarg;
+			break;
+		case 'L':			/* Set display of zoomed out views */
+			if (!strcmp(optarg, "full")) GameOfLife.setDisplayDetail(DISPLAY_FULL);
+			else if (!strcmp(optarg, "any")) GameOfLife.setDisplayDetail(DISPLAY_ANY_ALIVE);
+			else if (!strcmp(optarg, "density")) GameOfLife.setDisplayDetail(DISPLAY_DENSITY);
+			else {
+				fprintf(stderr,"\nError in level of detail %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'D':			/* Set calculation in the display callback */
+			syncDisplay = true;
+			break;
+		case 'n':			/* Set generations for headless mode */
+			if (atoll(optarg) <= 0) {
+				fprintf(stderr,"\nError in number of generations\n");
+				return -1;
+			}
+			headlessGenerations = strtoull(optarg, NULL, 10);
+			break;
+		case 'm':			/* Set local memory kernel */
+			GameOfLife.setLocalMemory(true);
+			break;
+		case 'g':			/* Set generations per kernel run */
+			if (atoi(optarg) <= 0) {
+				fprintf(stderr,"\nError in generations per kernel run\n");
+				return -1;
+			}
+			GameOfLife.setGenerationsPerLaunch(atoi(optarg));
+			break;
+		case 'a':			/* Set autotuning of work-items per work group */
+			GameOfLife.setAutotune(true);
+			break;
+		case 'd':			/* Set number of devices for strips */
+			if (atoi(optarg) < 0) {
+				fprintf(stderr,"\nError in number of devices\n");
+				return -1;
+			}
+			GameOfLife.setNumberOfDevices(atoi(optarg));
+			break;
+		case 'e':			/* Set co-execution of CPU and OpenCL */
+			GameOfLife.setCoExecution(true);
+			break;
 		case 'c':			/* Set clamp mode for images */
 			cSet++;
 			break;
@@ -153,12 +382,29 @@ int readArguments(int argc, char **argv) {
 			fprintf(stderr,"\nOption -%c requires an operand\n", optopt);
 			return -1;
 		case '?':
-			fprintf(stderr,"\nUnrecognized option: -%c\n", optopt);
+			fprintf(stderr,"\nUnrecognized option: %s\n", argv[optind-1]);
 			return -1;
 		}
 	}
 	
-	if (fSet == 0 && rSet == 0) {
+	if (headless != (headlessGenerations > 0)) {
+		fprintf(stderr,"\nHeadless mode requires --headless and -n\n");
+		return -1;
+	}
+	
+	if (checkpointInterval > 0 && checkpointFile == NULL) {
+		fprintf(stderr,"\n--checkpoint-every requires --checkpoint\n");
+		return -1;
+	}
+	if (checkpointFile != NULL)
+		GameOfLife.setCheckpoint(checkpointFile, checkpointInterval);
+	
+	if (exportPrefix != NULL)
+		GameOfLife.setExport(exportPrefix, exportFormat, exportInterval);
+	
+	GameOfLife.setMetricsFiles(metricsFile, traceFile);
+	
+	if (fSet == 0 && rSet == 0 && !GameOfLife.isRestoreMode()) {
 		fprintf(stderr,"\nNo spawn mode specified\n");
 		return -1;
 	}
@@ -184,8 +430,14 @@ int readArguments(int argc, char **argv) {
 	return 0;
 }
 
+/* Get the state shown by the display, the last frame of the compute thread */
+FrameInfo getFrameInfo() {
+	return computeThread.isRunning() ? frameInfo : ComputeThread::getInfo(GameOfLife);
+}
+
 /* Show keyboard controls for OpenGL window and Game of Life */
 void showControls() {
+	const FrameInfo info = getFrameInfo();
 	#ifdef WIN32
 		system("cls");
 	#else
@@ -201,8 +453,12 @@ void showControls() {
 			GameOfLife.getRule().c_str(),
 			GameOfLife.isFileMode() ? "file" : "random",
 			GameOfLife.getWidth(), GameOfLife.getHeight());
+	if (!GameOfLife.isFileMode())
+		printf("seed: %llu\n", (unsigned long long)GameOfLife.getSeed());
 	printf("Kernel info: \n");
 	printf("%s\n",GameOfLife.getKernelInfo().c_str());
+	printf("CPU info: \n");
+	printf("%s\n",info.cpuInfo.c_str());
 	printf("\n");
 	printf("Controls:\n");
 	printf(" key  | state | description\n");
@@ -210,22 +466,32 @@ void showControls() {
 	printf(" + -  |  %.1f  | wait time between calcuations in sec\n",
 					sleeperBarrier / 1000.0f);
 	printf("space | %s | start/stop calculation of next generation\n",
-					GameOfLife.isPaused() ? " stop" : "start");
+					info.paused ? " stop" : "start");
 	printf("  a   | %s | read image of next generation asynchronously \n",
-					GameOfLife.isReadSync() ? " sync" : "async");
+					info.readSync ? " sync" : "async");
 	printf("  c   | %s | calculate next generation with CPU/OpenCL \n",
-					GameOfLife.isCPUMode() ? " CPU " : " CL  ");
+					info.CPUMode ? " CPU " : " CL  ");
 	printf("  g   | %s | draw grid for board\n",
 					drawGrid ? " on  " : " off ");
+	printf("  h   | %s | calculate next generations with HashLife\n",
+					info.hashLifeMode ? " on  " : " off ");
+	printf(" [ ]  | 2^%-2i | generations per HashLife step\n",
+					info.hashLifeStep);
 	printf("  r   | %s | resets to starting population on the next stop \n",
 					resetGame ? " on  " : " off ");
 	printf("  s   | %s | stop after calculation of every generation\n",
-					GameOfLife.isSingleGeneration() ? " yes " : " no  ");
+					info.singleGeneration ? " yes " : " no  ");
 	printf("q/esc |       | quit\n\n");
 }
 
 /* Free host memory */
 void freeMem(void) {
+	/* The engine may still use the game */
+	computeThread.stop();
+	
+	/* There is no GL context in headless mode */
+	if (headless) return;
+	
 	if (glTex) {
 		glDeleteTextures(1, &glTex);
 		glTex = 0;
@@ -251,9 +517,9 @@ inline float getCurrentTime() {
 			 - startCount.QuadPart * (1000.0f / frequency.QuadPart)
 			);
 #else
-	gettimeofday(&end, NULL);
-	return ( (float)(end.tv_sec - start.tv_sec) * 1000.0f
-			 + (float)(end.tv_usec - start.tv_usec) / 1000.0f
+	gettimeofday(&::end, NULL);
+	return ( (float)(::end.tv_sec - start.tv_sec) * 1000.0f
+			 + (float)(::end.tv_usec - start.tv_usec) / 1000.0f
 			);
 #endif
 }
@@ -271,13 +537,77 @@ inline void resetTime() {
 /********************************************
 *         GLUT callback functions
 *********************************************/
+/* Send a command to the compute thread or apply it directly */
+void runCommand(EngineCommandType type, int argument = 0, float value = 0.0f) {
+	EngineCommand command = {type, {argument, 0}, {value, 0.0f, 0.0f}};
+	if (computeThread.isRunning()) computeThread.submit(command);
+	else ComputeThread::apply(GameOfLife, command);
+}
+
+/* Remember the view of the window, true if it changed since the last call */
+bool updateView() {
+	EngineCommand view = {COMMAND_VIEW, {windowSize[0], windowSize[1]},
+						  {cameraDistance, verticalMove, horizontalMove}};
+	if (view.arguments[0] == viewCommand.arguments[0] && view.arguments[1] == viewCommand.arguments[1]
+		&& view.values[0] == viewCommand.values[0] && view.values[1] == viewCommand.values[1]
+		&& view.values[2] == viewCommand.values[2])
+		return false;
+	viewCommand = view;
+	return true;
+}
+
+/* Upload the latest frame of the compute thread, it never waits for the engine */
+void displayFrame() {
+	if (computeThread.hasFailed()) exit(-1);
+	
+	/* Zoomed out views are downsampled by the engine to the next view */
+	if (updateView()) computeThread.submit(viewCommand);
+	
+	const EngineFrame *frame = computeThread.acquire();
+	if (frame == NULL) return;
+	
+	/* Copy the frame to the PBO, display() copies it to the texture */
+	if (frame->sizeBytes > 0) {
+		glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, frame->sizeBytes, frame->image, GL_STREAM_DRAW_ARB);
+		bufferRegion = frame->region;
+		uploadImage = true;
+	}
+	
+	/* The controls only change with a command */
+	const FrameInfo &info = frame->info;
+	bool changed = info.paused != frameInfo.paused || info.readSync != frameInfo.readSync
+		|| info.CPUMode != frameInfo.CPUMode || info.hashLifeMode != frameInfo.hashLifeMode
+		|| info.hashLifeStep != frameInfo.hashLifeStep
+		|| info.singleGeneration != frameInfo.singleGeneration
+		|| info.resetPending != resetGame;
+	frameInfo = info;
+	resetGame = info.resetPending;
+	if (changed) showControls();
+}
+
 /* functions which change the board before displaying it */
 void displayFunctions() {
+	if (computeThread.isRunning()) {
+		displayFrame();
+		return;
+	}
+	
+	bool viewChanged = updateView();
 	if(!GameOfLife.isPaused() && getCurrentTime() >= sleeperBarrier) {
 		resetTime();
 	/*
 	 * Calculate next generation if game is not paused
 	 */
+		if (GameOfLife.isGLSharing() && !GameOfLife.isCPUMode() && !GameOfLife.isHashLifeMode()) {
+			/* OpenCL renders to the shared texture, GL must be done with it */
+			glFinish();
+			uploadImage = false;
+			GameOfLife.setDisplayView(windowSize[0], windowSize[1], cameraDistance, verticalMove, horizontalMove);
+			if (GameOfLife.nextGeneration(NULL) != 0) exit(-1);
+			textureRegion = GameOfLife.getDisplayRegion();
+			return;
+		}
+		
 		/*
 		 * Map buffer to host memory space
 		 * and return address of buffer in host address space
@@ -289,9 +619,11 @@ void displayFunctions() {
          * If you do that, the previous data in PBO will be discarded and
          * glMapBufferARB() returns a new allocated pointer immediately
          * even if GPU is still working with the previous data.
+		 * Zoomed out views only get the visible part at the resolution of the window.
 		 */
+		GameOfLife.setDisplayView(windowSize[0], windowSize[1], cameraDistance, verticalMove, horizontalMove);
 		glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB,
-						4*GameOfLife.getWidth()*GameOfLife.getHeight(),
+						GameOfLife.getDisplaySizeBytes(),
 						0, GL_STREAM_DRAW_ARB);
 		GLubyte* bufferImage =
 			(GLubyte *)glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
@@ -299,6 +631,8 @@ void displayFunctions() {
 		if (bufferImage) {
 		  	/* Write image of next generation directly on the mapped buffer */
 			int state = GameOfLife.nextGeneration(bufferImage);
+			bufferRegion = GameOfLife.getDisplayRegion();
+			uploadImage = true;
 			
 			/* Release the mapped buffer */
 			glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
@@ -316,6 +650,8 @@ void displayFunctions() {
 		if (bufferImage) {
 		  	/* Write image of next generation directly on the mapped buffer */
 			int state = GameOfLife.resetGame(bufferImage);
+			bufferRegion = GameOfLife.getDisplayRegion();
+			uploadImage = true;
 			
 			/* Release the mapped buffer */
 			glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
@@ -326,6 +662,33 @@ void displayFunctions() {
 		
 		resetGame = false;
 		showControls();
+	} else if (viewChanged && GameOfLife.isDisplayRedrawable()) {
+	/*
+	 * Draw the current generation again for the new view, the image
+	 * of a zoomed out view only holds the old one
+	 */
+		GameOfLife.setDisplayView(windowSize[0], windowSize[1], cameraDistance, verticalMove, horizontalMove);
+		if (GameOfLife.isGLSharing()) {
+			glFinish();
+			if (GameOfLife.redrawDisplay(NULL) != 0) exit(-1);
+			textureRegion = GameOfLife.getDisplayRegion();
+			return;
+		}
+		glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB,
+						GameOfLife.getDisplaySizeBytes(),
+						0, GL_STREAM_DRAW_ARB);
+		GLubyte* bufferImage = (GLubyte *)glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+		
+		if (bufferImage) {
+			int state = GameOfLife.redrawDisplay(bufferImage);
+			bufferRegion = GameOfLife.getDisplayRegion();
+			uploadImage = true;
+			
+			/* Release the mapped buffer */
+			glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+			
+			if (state != 0) exit(-1);
+		}
 	}
 }
 
@@ -335,16 +698,28 @@ void display() {
 	glBindTexture(GL_TEXTURE_2D, glTex);
 	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, glPBO);
 	
-	/* Copy pixels from PBO to texture object */
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
-					GameOfLife.getWidth(), GameOfLife.getHeight(),
-					GL_RGBA, GL_UNSIGNED_BYTE, BUFFER_DATA(0));
+	/* Copy pixels from PBO to texture object, unless OpenCL rendered to the texture */
+	if (uploadImage) {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+						bufferRegion.width, bufferRegion.height,
+						GL_RGBA, GL_UNSIGNED_BYTE, BUFFER_DATA(0));
+		textureRegion = bufferRegion;
+	}
 	
 	/*
 	 * Execute functions which change the board
 	 */
 	displayFunctions();
 	
+	/* Frames of the compute thread are copied to the texture once */
+	if (computeThread.isRunning() && uploadImage) {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+						bufferRegion.width, bufferRegion.height,
+						GL_RGBA, GL_UNSIGNED_BYTE, BUFFER_DATA(0));
+		textureRegion = bufferRegion;
+		uploadImage = false;
+	}
+	
 	/*
 	 * Release PBOs with ID 0 after use
 	 * Once bound with 0, all pixel operations behave normal ways
@@ -366,13 +741,19 @@ void display() {
 	glTranslatef(verticalMove,horizontalMove,0.0f);	// move
 	
 	
-	/* Draw textured geometry */
+	/* Draw textured geometry, the top left of the texture holds the part of the board in textureRegion */
+	const float width = (float)GameOfLife.getWidth(), height = (float)GameOfLife.getHeight();
+	const float left = -1.0f + 2.0f*textureRegion.x/width;
+	const float right = -1.0f + 2.0f*(textureRegion.x + textureRegion.width*textureRegion.factor)/width;
+	const float top = 1.0f - 2.0f*textureRegion.y/height;
+	const float bottom = 1.0f - 2.0f*(textureRegion.y + textureRegion.height*textureRegion.factor)/height;
+	const float texRight = textureRegion.width/width, texBottom = textureRegion.height/height;
 	glColor3f(1.0f, 1.0f, 1.0f);
 	glBegin(GL_QUADS);
-		glTexCoord2f(0.0f, 0.0f); glVertex2f(-1.0f, 1.0f);
-		glTexCoord2f(1.0f, 0.0f); glVertex2f(1.0f, 1.0f);
-		glTexCoord2f(1.0f, 1.0f); glVertex2f(1.0f, -1.0f);
-		glTexCoord2f(0.0f, 1.0f); glVertex2f(-1.0f, -1.0f);
+		glTexCoord2f(0.0f, 0.0f); glVertex2f(left, top);
+		glTexCoord2f(texRight, 0.0f); glVertex2f(right, top);
+		glTexCoord2f(texRight, texBottom); glVertex2f(right, bottom);
+		glTexCoord2f(0.0f, texBottom); glVertex2f(left, bottom);
 	glEnd();
 	
 	/* Unbind texture */
@@ -406,13 +787,19 @@ void display() {
 	glutReportErrors();
 
 	/* Append execution information to window title */
-	snprintf(title, 57*sizeof(char)+sizeof(float)+sizeof(int)+sizeof(long),
-			 		"Game of Life @ %s @ %f ms/gen @ %i gens/copy @ generation %lu",
-					GameOfLife.isCPUMode() ? "CPU" : "OpenCL",
-					GameOfLife.getExecutionTime(),
-					GameOfLife.getGenerationsPerCopyEvent(),
-					GameOfLife.getGenerations()
+	const FrameInfo info = getFrameInfo();
+	snprintf(title, sizeof(title),
+			 		"Game of Life @ %s @ %f ms/gen @ %i gens/copy @ generation %llu",
+					info.hashLifeMode ? "HashLife" : info.CPUMode ? "CPU" : "OpenCL",
+					info.executionTime,
+					info.generationsPerCopyEvent,
+					(unsigned long long)info.generations
 					);
+	if (info.period > 0) {
+		size_t length = strlen(title);
+		snprintf(title + length, sizeof(title) - length, " @ period %i from generation %llu",
+				info.period, (unsigned long long)info.periodGeneration);
+	}
 	glutSetWindowTitle(title);
 }
 
@@ -423,24 +810,34 @@ void idle(void) { glutPostRedisplay(); }
 void keyboard(unsigned char key, int mouseX, int mouseY) {
 	switch(key) {
 		/* Pressing space starts/stops calculation of next generation */
-		case ' ': GameOfLife.switchPause(); break;
+		case ' ': runCommand(COMMAND_PAUSE); break;
 		/* Pressing a switches synchronous reading of images on/off */
-		case 'a': GameOfLife.switchreadSync(); break;
+		case 'a': runCommand(COMMAND_READ_SYNC); break;
 		/* Pressing c switches CPU mode on/off */
-		case 'c': GameOfLife.switchCPUMode(); break;
+		case 'c': runCommand(COMMAND_CPU_MODE); break;
 		/* Pressing g switches grid for Game of Life board on/off */
 		case 'g': drawGrid = !drawGrid; break;
+		/* Pressing h switches HashLife mode on/off */
+		case 'h': runCommand(COMMAND_HASHLIFE); break;
+		/* Pressing [ or ] halves or doubles the generations per HashLife step */
+		case '[': runCommand(COMMAND_HASHLIFE_STEP, -1); break;
+		case ']': runCommand(COMMAND_HASHLIFE_STEP, 1); break;
 		/* Pressing r resets the board to the starting population */
-		case 'r': resetGame = !resetGame; break;
+		case 'r':
+			resetGame = !resetGame;
+			runCommand(COMMAND_RESET);
+			break;
 		/* Pressing s switches single generation mode on/off */
-		case 's': GameOfLife.switchSingleGeneration(); break;
+		case 's': runCommand(COMMAND_SINGLE_GENERATION); break;
 		/* Pressing escape or q exits */
 		/* Pressing p switches waiting time between calculations on/off */
 		case '+':
 			sleeperBarrier += 100.0f;
+			runCommand(COMMAND_DELAY, 0, sleeperBarrier);
 			break;
 		case '-':
 			sleeperBarrier = max(0.0f, sleeperBarrier-100.0f);
+			runCommand(COMMAND_DELAY, 0, sleeperBarrier);
 			break;
 		case 27:
 		case 'q':
@@ -454,6 +851,8 @@ void keyboard(unsigned char key, int mouseX, int mouseY) {
 /* Reshape function */
 void reshape(int w, int h) {
 	glViewport(0, 0, w, h);
+	windowSize[0] = w;
+	windowSize[1] = h;
 	
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
@@ -581,6 +980,9 @@ void initOpenGLBuffers() {
 		glPBO = 0;
 	}
 
+	/* Packed boards are expanded once for both copies */
+	unsigned char *image = GameOfLife.getImage();
+	
     /* Create new texture */
 	glEnable(GL_TEXTURE_2D);
 	glGenTextures(1, &glTex);
@@ -590,7 +992,7 @@ void initOpenGLBuffers() {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, GameOfLife.getWidth(), GameOfLife.getHeight(),
-					0, GL_RGBA, GL_UNSIGNED_BYTE, GameOfLife.getImage());
+					0, GL_RGBA, GL_UNSIGNED_BYTE, image);
 	glBindTexture(GL_TEXTURE_2D, 0);
 	
 	/* Generate new pixel buffer object */
@@ -600,7 +1002,12 @@ void initOpenGLBuffers() {
 	/* Copy pixel data to the buffer object */
 	glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB,
 				 GameOfLife.getWidth() * GameOfLife.getHeight() * 4,
-				 GameOfLife.getImage(), GL_STREAM_DRAW_ARB);
+				 image, GL_STREAM_DRAW_ARB);
+	GameOfLife.releaseImage();
+	
+	/* Both hold the whole board */
+	bufferRegion = GameOfLife.getDisplayRegion();
+	textureRegion = bufferRegion;
 }
 
 /* Initalise display */
@@ -612,12 +1019,71 @@ void initDisplay(int argc, char *argv[]) {
 	
 	initGLUT(argc, argv);
 	initOpenGL();
-	initOpenGLBuffers();
 }
 
 /********************************************
 *             MAIN functions
 *********************************************/
+/* Calculate generations without OpenGL output and print statistics */
+int mainLoopHeadless(void) {
+	float minTime = FLT_MAX, maxTime = 0.0f, sumTime = 0.0f;
+	unsigned long calls = 0;
+	/* A restored checkpoint starts at its generation */
+	uint64_t firstGeneration = GameOfLife.getGenerations();
+	
+	resetTime();
+	/* Periodic boards end the run early */
+	while (GameOfLife.getGenerations() < headlessGenerations && GameOfLife.getPeriod() == 0) {
+		/* No frames are produced, the engine runs flat out */
+		if (GameOfLife.nextGeneration(NULL) != 0)
+			return -1;
+		/* Execution time of one generation, sampled once per call */
+		float time = GameOfLife.getExecutionTime();
+		minTime = min(minTime, time);
+		maxTime = max(maxTime, time);
+		sumTime += time;
+		calls++;
+	}
+	/* Generations may still be queued on the device */
+	if (GameOfLife.finishGenerations() != 0)
+		return -1;
+	float elapsed = getCurrentTime() / 1000.0f;
+	
+	/* Frames are still written in the background */
+	if (GameOfLife.finishExport() != 0) {
+		fprintf(stderr,"\nCannot write frames\n");
+		return -1;
+	}
+	
+	/* Last checkpoint of the run, wait until it is on disk */
+	if (GameOfLife.isCheckpointMode()
+		&& (GameOfLife.writeCheckpoint() != 0 || GameOfLife.finishCheckpoint() != 0)) {
+		fprintf(stderr,"\nCannot write checkpoint\n");
+		return -1;
+	}
+	
+	uint64_t generations = GameOfLife.getGenerations() - firstGeneration;
+	double cells = (double)GameOfLife.getWidth() * GameOfLife.getHeight();
+	printf("engine: %s | rule: %s | width: %i | height: %i\n",
+			GameOfLife.isHashLifeMode() ? "HashLife" : GameOfLife.isCPUMode() ? "CPU" : "OpenCL",
+			GameOfLife.getRule().c_str(), GameOfLife.getWidth(), GameOfLife.getHeight());
+	printf("%s\n", GameOfLife.isCPUMode() ? GameOfLife.getCPUInfo().c_str()
+										 : GameOfLife.getKernelInfo().c_str());
+	printf("generations: %llu in %.3f s\n", (unsigned long long)generations, elapsed);
+	printf("generations/sec: %.1f\n", generations / elapsed);
+	printf("cell updates/sec: %.3e\n", generations * cells / elapsed);
+	printf("ms/gen: min %f | avg %f | max %f (%lu samples)\n",
+			minTime, sumTime / calls, maxTime, calls);
+	if (GameOfLife.isExtinct())
+		printf("period: dead from generation %llu\n", (unsigned long long)GameOfLife.getPeriodGeneration());
+	else if (GameOfLife.getPeriod() == 1)
+		printf("period: still life from generation %llu\n", (unsigned long long)GameOfLife.getPeriodGeneration());
+	else if (GameOfLife.getPeriod() > 1)
+		printf("period: %i from generation %llu\n", GameOfLife.getPeriod(),
+				(unsigned long long)GameOfLife.getPeriodGeneration());
+	return 0;
+}
+
 /* OpenGL main loop */
 void mainLoopGL(void) {
 	/* last GLUT call (LOOP)
@@ -637,6 +1103,19 @@ int main(int argc, char **argv) {
 		return -1;
 	}
 	
+	/* Headless mode never creates a GL context, OpenCL runs without sharing */
+	if (headless) {
+		/* The run ends at generation -n, also with runs queued on the device */
+		GameOfLife.setMaxGenerations(headlessGenerations);
+		if (GameOfLife.setup() != 0) return -1;
+		return mainLoopHeadless();
+	}
+	
+#ifndef PROFILING
+	/* Setup OpenGL window first, OpenCL shares its context if possible */
+	initDisplay(argc, argv);
+#endif
+	
 	/* Setup host/device memory, starting population and OpenCL */
 	if(GameOfLife.setup()!=0) return -1;
 
@@ -651,12 +1130,20 @@ int main(int argc, char **argv) {
 	return 0;
 	*/
 #else
+	/* Setup OpenGL texture and PBO, render to the texture with OpenCL if possible */
+	initOpenGLBuffers();
+	if (syncDisplay) {
+		if (GameOfLife.shareGLTexture(glTex) != 0) return -1;
+	} else {
+		/* The engine owns the game from now on, the display only takes its frames */
+		uploadImage = false;
+		frameInfo = ComputeThread::getInfo(GameOfLife);
+		if (computeThread.start(GameOfLife) != 0) return -1;
+	}
+	
 	/* Show controls for Game of Life in console */
 	showControls();
 	
-	/* Setup OpenGL */
-	initDisplay(argc, argv);
-	
 	/* Start timer */
 	resetTime();
 	